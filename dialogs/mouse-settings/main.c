@@ -1593,10 +1593,12 @@ main (gint argc, gchar **argv)
     GObject           *object;
     XExtensionVersion *version = NULL;
 #ifdef DEVICE_PROPERTIES
-    gchar             *syndaemon;
     GObject           *synaptics_disable_while_type;
     GObject           *synaptics_disable_duration_table;
 #endif
+#ifdef TYPING_DETECTION
+    gint               xi2_major = 2, xi2_minor = 0;
+#endif
 
     /* setup translation domain */
     xfce_textdomain (GETTEXT_PACKAGE, LOCALEDIR, "UTF-8");
@@ -1718,9 +1720,14 @@ main (gint argc, gchar **argv)
 
 #ifdef DEVICE_PROPERTIES
             synaptics_disable_while_type = gtk_builder_get_object (builder, "synaptics-disable-while-type");
-            syndaemon = g_find_program_in_path ("syndaemon");
-            gtk_widget_set_sensitive (GTK_WIDGET (object), syndaemon != NULL);
-            g_free (syndaemon);
+#ifdef TYPING_DETECTION
+            /* the helper watches the keyboard with XI2 raw events */
+            if (XIQueryVersion (GDK_DISPLAY (), &xi2_major, &xi2_minor) != Success)
+                gtk_widget_set_sensitive (GTK_WIDGET (synaptics_disable_while_type), FALSE);
+#else
+            /* the helper cannot watch the keyboard */
+            gtk_widget_set_sensitive (GTK_WIDGET (synaptics_disable_while_type), FALSE);
+#endif
             xfconf_g_property_bind (pointers_channel, "/DisableTouchpadWhileTyping",
                                     G_TYPE_BOOLEAN, G_OBJECT (synaptics_disable_while_type), "active");
 
@@ -45,6 +45,9 @@
 
 #include "debug.h"
 #include "accessibility.h"
+#include "prefetch.h"
+#include "stats.h"
+#include "trace.h"
 
 
 
@@ -52,9 +55,18 @@
 #define UNSET_FLAG(mask,flag) G_STMT_START{ ((mask) &= ~(flag)); }G_STMT_END
 #define HAS_FLAG(mask,flag)   (((mask) & (flag)) != 0)
 
+/* interval in ms to collect channel changes before the controls
+ * are sent to the server */
+#define CONTROLS_FLUSH_INTERVAL (50)
+
 
 
 static void            xfce_accessibility_helper_finalize                       (GObject                      *object);
+static void            xfce_accessibility_helper_free_value                     (GValue                       *value);
+static void            xfce_accessibility_helper_store_setting                  (XfceAccessibilityHelper      *helper,
+                                                                                 const gchar                  *property_name,
+                                                                                 const GValue                 *value);
+static gboolean        xfce_accessibility_helper_flush_xkb                      (gpointer                      user_data);
 static void            xfce_accessibility_helper_set_xkb                        (XfceAccessibilityHelper      *helper,
                                                                                  gulong                        mask);
 static void            xfce_accessibility_helper_channel_property_changed       (XfconfChannel                *channel,
@@ -86,6 +98,16 @@ struct _XfceAccessibilityHelper
     /* xfconf channel */
     XfconfChannel      *channel;
 
+    /* copy of the channel, property name -> GValue */
+    GHashTable         *settings;
+
+    /* controls changed since the last XkbSetControls */
+    gulong              dirty_mask;
+    guint               n_dirty_changes;
+    guint               flush_timeout_id;
+
+    XfsdStats          *stats;
+
 #ifdef HAVE_LIBNOTIFY
     NotifyNotification *notification;
 #endif /* !HAVE_LIBNOTIFY */
@@ -111,18 +133,39 @@ xfce_accessibility_helper_class_init (XfceAccessibilityHelperClass *klass)
 static void
 xfce_accessibility_helper_init (XfceAccessibilityHelper *helper)
 {
-    gint dummy;
+    gint            dummy;
+    GHashTable     *props;
+    GHashTableIter  iter;
+    gpointer        property_name, value;
 
     helper->channel = NULL;
 #ifdef HAVE_LIBNOTIFY
     helper->notification = NULL;
 #endif /* !HAVE_LIBNOTIFY */
 
+    helper->stats = xfsettings_stats_get ("accessibility");
+
     if (XkbQueryExtension (GDK_DISPLAY (), &dummy, &dummy, &dummy, &dummy, &dummy))
     {
         /* open the channel */
         helper->channel = xfconf_channel_get ("accessibility");
 
+        /* fetch all the settings at once, instead of a round-trip
+         * to xfconfd for every control */
+        helper->settings = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+                                                  (GDestroyNotify) xfce_accessibility_helper_free_value);
+        props = xfsettings_prefetch_get_properties (helper->channel, NULL);
+        if (props != NULL)
+        {
+            g_hash_table_iter_init (&iter, props);
+            while (g_hash_table_iter_next (&iter, &property_name, &value))
+                xfce_accessibility_helper_store_setting (helper, property_name, value);
+            g_hash_table_destroy (props);
+        }
+
+        xfsettings_stats_watch_bytes (helper->stats, (XfsdStatsBytesFunc) xfsettings_stats_table_size,
+                                      helper->settings);
+
         /* monitor channel changes */
         g_signal_connect (G_OBJECT (helper->channel), "property-changed", G_CALLBACK (xfce_accessibility_helper_channel_property_changed), helper);
 
@@ -153,9 +196,21 @@ xfce_accessibility_helper_init (XfceAccessibilityHelper *helper)
 static void
 xfce_accessibility_helper_finalize (GObject *object)
 {
-#ifdef HAVE_LIBNOTIFY
     XfceAccessibilityHelper *helper = XFCE_ACCESSIBILITY_HELPER (object);
 
+    /* do not lose pending changes */
+    if (helper->flush_timeout_id != 0)
+    {
+        g_source_remove (helper->flush_timeout_id);
+        xfce_accessibility_helper_flush_xkb (helper);
+    }
+
+    xfsettings_stats_watch_bytes (helper->stats, NULL, NULL);
+
+    if (helper->settings != NULL)
+        g_hash_table_destroy (helper->settings);
+
+#ifdef HAVE_LIBNOTIFY
     /* close an opened notification */
     if (G_UNLIKELY (helper->notification))
         notify_notification_close (helper->notification, NULL);
@@ -166,6 +221,71 @@ xfce_accessibility_helper_finalize (GObject *object)
 
 
 
+static void
+xfce_accessibility_helper_free_value (GValue *value)
+{
+    if (G_IS_VALUE (value))
+        g_value_unset (value);
+    g_free (value);
+}
+
+
+
+static void
+xfce_accessibility_helper_store_setting (XfceAccessibilityHelper *helper,
+                                         const gchar             *property_name,
+                                         const GValue            *value)
+{
+    GValue *copy;
+
+    /* an unset value means the property was removed */
+    if (value == NULL || !G_IS_VALUE (value))
+    {
+        g_hash_table_remove (helper->settings, property_name);
+        return;
+    }
+
+    copy = g_new0 (GValue, 1);
+    g_value_init (copy, G_VALUE_TYPE (value));
+    g_value_copy (value, copy);
+
+    g_hash_table_replace (helper->settings, g_strdup (property_name), copy);
+}
+
+
+
+static gboolean
+xfce_accessibility_helper_get_bool (XfceAccessibilityHelper *helper,
+                                    const gchar             *property_name,
+                                    gboolean                 default_value)
+{
+    const GValue *value;
+
+    value = g_hash_table_lookup (helper->settings, property_name);
+    if (value != NULL && G_VALUE_HOLDS_BOOLEAN (value))
+        return g_value_get_boolean (value);
+
+    return default_value;
+}
+
+
+
+static gint
+xfce_accessibility_helper_get_int (XfceAccessibilityHelper *helper,
+                                   const gchar             *property_name,
+                                   gint                     default_value)
+{
+    const GValue *value;
+
+    value = g_hash_table_lookup (helper->settings, property_name);
+    if (value != NULL && G_VALUE_HOLDS_INT (value))
+        return g_value_get_int (value);
+
+    return default_value;
+}
+
+
+
 static void
 xfce_accessibility_helper_set_xkb (XfceAccessibilityHelper *helper,
                                    gulong                   mask)
@@ -202,7 +322,7 @@ xfce_accessibility_helper_set_xkb (XfceAccessibilityHelper *helper,
         /* AccessXKeys */
         if (HAS_FLAG (mask, XkbAccessXKeysMask))
         {
-            if (xfconf_channel_get_bool (helper->channel, "/AccessXKeys", FALSE))
+            if (xfce_accessibility_helper_get_bool (helper, "/AccessXKeys", FALSE))
             {
                 SET_FLAG (xkb->ctrls->enabled_ctrls, XkbAccessXKeysMask);
                 UNSET_FLAG (xkb->ctrls->axt_ctrls_mask, XkbAccessXKeysMask);
@@ -223,18 +343,18 @@ xfce_accessibility_helper_set_xkb (XfceAccessibilityHelper *helper,
         /* Sticky keys */
         if (HAS_FLAG (mask, XkbStickyKeysMask))
         {
-            if (xfconf_channel_get_bool (helper->channel, "/StickyKeys", FALSE))
+            if (xfce_accessibility_helper_get_bool (helper, "/StickyKeys", FALSE))
             {
                 SET_FLAG (xkb->ctrls->enabled_ctrls, XkbStickyKeysMask);
                 UNSET_FLAG (xkb->ctrls->axt_ctrls_mask, XkbStickyKeysMask);
                 UNSET_FLAG (xkb->ctrls->axt_ctrls_values, XkbStickyKeysMask);
 
-                if (xfconf_channel_get_bool (helper->channel, "/StickyKeys/LatchToLock", FALSE))
+                if (xfce_accessibility_helper_get_bool (helper, "/StickyKeys/LatchToLock", FALSE))
                     SET_FLAG (xkb->ctrls->ax_options, XkbAX_LatchToLockMask);
                 else
                     UNSET_FLAG (xkb->ctrls->ax_options, XkbAX_LatchToLockMask);
 
-                if (xfconf_channel_get_bool (helper->channel, "/StickyKeys/TwoKeysDisable", FALSE))
+                if (xfce_accessibility_helper_get_bool (helper, "/StickyKeys/TwoKeysDisable", FALSE))
                     SET_FLAG (xkb->ctrls->ax_options, XkbAX_TwoKeysMask);
                 else
                     UNSET_FLAG (xkb->ctrls->ax_options, XkbAX_TwoKeysMask);
@@ -255,13 +375,13 @@ xfce_accessibility_helper_set_xkb (XfceAccessibilityHelper *helper,
         /* Slow keys */
         if (HAS_FLAG (mask, XkbSlowKeysMask))
         {
-            if (xfconf_channel_get_bool (helper->channel, "/SlowKeys", FALSE))
+            if (xfce_accessibility_helper_get_bool (helper, "/SlowKeys", FALSE))
             {
                 SET_FLAG (xkb->ctrls->enabled_ctrls, XkbSlowKeysMask);
                 UNSET_FLAG (xkb->ctrls->axt_ctrls_mask, XkbSlowKeysMask);
                 UNSET_FLAG (xkb->ctrls->axt_ctrls_values, XkbSlowKeysMask);
 
-                delay = xfconf_channel_get_int (helper->channel, "/SlowKeys/Delay", 100);
+                delay = xfce_accessibility_helper_get_int (helper, "/SlowKeys/Delay", 100);
                 xkb->ctrls->slow_keys_delay = CLAMP (delay, 1, G_MAXUSHORT);
 
                 xfsettings_dbg (XFSD_DEBUG_ACCESSIBILITY, "slowkeys enabled (delay=%d)",
@@ -280,13 +400,13 @@ xfce_accessibility_helper_set_xkb (XfceAccessibilityHelper *helper,
         /* Bounce keys */
         if (HAS_FLAG (mask, XkbBounceKeysMask))
         {
-            if (xfconf_channel_get_bool (helper->channel, "/BounceKeys", FALSE))
+            if (xfce_accessibility_helper_get_bool (helper, "/BounceKeys", FALSE))
             {
                 SET_FLAG (xkb->ctrls->enabled_ctrls, XkbBounceKeysMask);
                 UNSET_FLAG (xkb->ctrls->axt_ctrls_mask, XkbBounceKeysMask);
                 UNSET_FLAG (xkb->ctrls->axt_ctrls_values, XkbBounceKeysMask);
 
-                delay = xfconf_channel_get_int (helper->channel, "/BounceKeys/Delay", 100);
+                delay = xfce_accessibility_helper_get_int (helper, "/BounceKeys/Delay", 100);
                 xkb->ctrls->debounce_delay = CLAMP (delay, 1, G_MAXUSHORT);
 
                 xfsettings_dbg (XFSD_DEBUG_ACCESSIBILITY, "bouncekeys enabled (delay=%d)",
@@ -305,18 +425,18 @@ xfce_accessibility_helper_set_xkb (XfceAccessibilityHelper *helper,
         /* Mouse keys */
         if (HAS_FLAG (mask, XkbMouseKeysMask))
         {
-            if (xfconf_channel_get_bool (helper->channel, "/MouseKeys", FALSE))
+            if (xfce_accessibility_helper_get_bool (helper, "/MouseKeys", FALSE))
             {
                 SET_FLAG (xkb->ctrls->enabled_ctrls, XkbMouseKeysMask);
                 UNSET_FLAG (xkb->ctrls->axt_ctrls_mask, XkbMouseKeysMask);
                 UNSET_FLAG (xkb->ctrls->axt_ctrls_values, XkbMouseKeysMask);
 
                 /* get values */
-                delay = xfconf_channel_get_int (helper->channel, "/MouseKeys/Delay", 160);
-                interval = xfconf_channel_get_int (helper->channel, "/MouseKeys/Interval", 20);
-                time_to_max = xfconf_channel_get_int (helper->channel, "/MouseKeys/TimeToMax", 3000);
-                max_speed = xfconf_channel_get_int (helper->channel, "/MouseKeys/MaxSpeed", 1000);
-                curve = xfconf_channel_get_int (helper->channel, "/MouseKeys/Curve", 0);
+                delay = xfce_accessibility_helper_get_int (helper, "/MouseKeys/Delay", 160);
+                interval = xfce_accessibility_helper_get_int (helper, "/MouseKeys/Interval", 20);
+                time_to_max = xfce_accessibility_helper_get_int (helper, "/MouseKeys/TimeToMax", 3000);
+                max_speed = xfce_accessibility_helper_get_int (helper, "/MouseKeys/MaxSpeed", 1000);
+                curve = xfce_accessibility_helper_get_int (helper, "/MouseKeys/Curve", 0);
 
                 /* calculate maximum speed and to to reach it */
                 interval = CLAMP (interval, 1, G_MAXUSHORT);
@@ -373,11 +493,19 @@ xfce_accessibility_helper_channel_property_changed (XfconfChannel           *cha
                                                     const GValue            *value,
                                                     XfceAccessibilityHelper *helper)
 {
-    gulong mask;
+    gulong        mask;
+    XfsdStatsMark mark;
 
     g_return_if_fail (helper->channel == channel);
 
-    if (strncmp (property_name, "/StickyKeys", 11) == 0)
+    xfsettings_stats_begin_xfconf (&mark, G_STRFUNC, property_name);
+
+    /* keep the copy of the channel up-to-date */
+    xfce_accessibility_helper_store_setting (helper, property_name, value);
+
+    if (strncmp (property_name, "/AccessXKeys", 12) == 0)
+        mask = XkbAccessXKeysMask;
+    else if (strncmp (property_name, "/StickyKeys", 11) == 0)
         mask = XkbStickyKeysMask;
     else if (strncmp (property_name, "/SlowKeys", 9) == 0)
         mask = XkbSlowKeysMask;
@@ -386,10 +514,49 @@ xfce_accessibility_helper_channel_property_changed (XfconfChannel           *cha
     else if (strncmp (property_name, "/MouseKeys", 10) == 0)
         mask = XkbMouseKeysMask;
     else
-        return;
+        mask = 0;
+
+    if (mask != 0)
+    {
+        /* update the xkb settings, together with the other changes
+         * of this batch */
+        SET_FLAG (helper->dirty_mask, mask);
+        helper->n_dirty_changes++;
 
-    /* update the xkb settings */
-    xfce_accessibility_helper_set_xkb (helper, mask);
+        if (helper->flush_timeout_id == 0)
+        {
+            helper->flush_timeout_id = g_timeout_add (CONTROLS_FLUSH_INTERVAL,
+                                                      xfce_accessibility_helper_flush_xkb,
+                                                      helper);
+        }
+    }
+
+    xfsettings_stats_end (helper->stats, XFSD_STATS_XFCONF, &mark);
+}
+
+
+
+static gboolean
+xfce_accessibility_helper_flush_xkb (gpointer user_data)
+{
+    XfceAccessibilityHelper *helper = XFCE_ACCESSIBILITY_HELPER (user_data);
+    XfsdStatsMark            mark;
+
+    xfsettings_stats_begin (&mark, G_STRFUNC);
+
+    helper->flush_timeout_id = 0;
+
+    xfsettings_trace (XFSD_TRACE_ACCESSIBILITY_FLUSH, helper->dirty_mask,
+                      helper->n_dirty_changes, 0, 0);
+
+    xfce_accessibility_helper_set_xkb (helper, helper->dirty_mask);
+
+    helper->dirty_mask = 0;
+    helper->n_dirty_changes = 0;
+
+    xfsettings_stats_end (helper->stats, XFSD_STATS_EVENT, &mark);
+
+    return FALSE;
 }
 
 
@@ -402,10 +569,13 @@ xfce_accessibility_helper_event_filter (GdkXEvent *xevent,
     XkbEvent                *event = xevent;
     XfceAccessibilityHelper *helper = XFCE_ACCESSIBILITY_HELPER (user_data);
     const gchar             *body;
+    XfsdStatsMark            mark;
 
     switch (event->any.xkb_type)
     {
         case XkbControlsNotify:
+            xfsettings_stats_begin_event (&mark, G_STRFUNC, event->type);
+
             if (HAS_FLAG (event->ctrls.enabled_ctrl_changes, XkbStickyKeysMask))
             {
                 if (HAS_FLAG (event->ctrls.enabled_ctrls, XkbStickyKeysMask))
@@ -434,6 +604,7 @@ xfce_accessibility_helper_event_filter (GdkXEvent *xevent,
                 xfce_accessibility_helper_notification_show (helper, _("Bounce keys"), body);
             }
 
+            xfsettings_stats_end (helper->stats, XFSD_STATS_EVENT, &mark);
             break;
 
         default:
@@ -38,6 +38,9 @@
 #include <gtk/gtk.h>
 
 #include "clipboard-manager.h"
+#include "helper-module.h"
+#include "stats.h"
+#include "trace.h"
 #include "xsettings.h"
 
 struct _GsdClipboardManagerPrivate
@@ -53,6 +56,8 @@ struct _GsdClipboardManagerPrivate
         Window   requestor;
         Atom     property;
         Time     time;
+
+        XfsdStats *stats;
 };
 
 typedef struct
@@ -99,7 +104,7 @@ static Atom XA_TIMESTAMP = None;
 
 
 
-G_DEFINE_TYPE (GsdClipboardManager, gsd_clipboard_manager, G_TYPE_OBJECT)
+G_DEFINE_DYNAMIC_TYPE (GsdClipboardManager, gsd_clipboard_manager, G_TYPE_OBJECT)
 
 
 
@@ -113,6 +118,11 @@ gsd_clipboard_manager_class_init (GsdClipboardManagerClass *klass)
         g_type_class_add_private (klass, sizeof (GsdClipboardManagerPrivate));
 }
 
+static void
+gsd_clipboard_manager_class_finalize (GsdClipboardManagerClass *klass)
+{
+}
+
 static void
 gsd_clipboard_manager_init (GsdClipboardManager *manager)
 {
@@ -121,7 +131,7 @@ gsd_clipboard_manager_init (GsdClipboardManager *manager)
                                                      GsdClipboardManagerPrivate);
 
         manager->priv->display = GDK_DISPLAY_XDISPLAY (gdk_display_get_default ());
-
+        manager->priv->stats = xfsettings_stats_get ("clipboard");
 }
 
 static void
@@ -132,6 +142,10 @@ gsd_clipboard_manager_finalize (GObject *object)
         if (clipboard_manager->priv->start_idle_id !=0)
                 g_source_remove (clipboard_manager->priv->start_idle_id);
 
+        /* release the selection before the module is unloaded */
+        gsd_clipboard_manager_stop (clipboard_manager);
+        xfsettings_stats_watch_bytes (clipboard_manager->priv->stats, NULL, NULL);
+
         G_OBJECT_CLASS (gsd_clipboard_manager_parent_class)->finalize (object);
 }
 
@@ -164,6 +178,23 @@ conversion_free (IncrConversion *rdata)
         g_slice_free (IncrConversion, rdata);
 }
 
+static gsize
+clipboard_manager_contents_size (gpointer user_data)
+{
+        GsdClipboardManager *manager = user_data;
+        GSList              *list;
+        TargetData          *tdata;
+        gsize                size = 0;
+
+        /* the saved clipboard targets, shared with running conversions */
+        for (list = manager->priv->contents; list != NULL; list = list->next) {
+                tdata = list->data;
+                size += sizeof (TargetData) + tdata->length;
+        }
+
+        return size;
+}
+
 static void
 send_selection_notify (GsdClipboardManager *manager,
                        Bool                 success)
@@ -831,12 +862,65 @@ clipboard_manager_process_event (GsdClipboardManager *manager,
         return False;
 }
 
+/* cheap version of the checks in clipboard_manager_process_event () */
+static gboolean
+clipboard_manager_may_handle_event (GsdClipboardManager *manager,
+                                    XEvent              *xev)
+{
+        switch (xev->xany.type) {
+        case PropertyNotify:
+                if (xev->xproperty.state == PropertyNewValue)
+                        return xev->xproperty.window == manager->priv->window;
+                return manager->priv->conversions != NULL;
+
+        case SelectionClear:
+        case SelectionNotify:
+        case SelectionRequest:
+                return xev->xany.window == manager->priv->window;
+
+        default:
+                return FALSE;
+        }
+}
+
 static GdkFilterReturn
 clipboard_manager_event_filter (GdkXEvent           *xevent,
                                 GdkEvent            *event,
                                 GsdClipboardManager *manager)
 {
-        if (clipboard_manager_process_event (manager, (XEvent *)xevent)) {
+        XEvent        *xev = xevent;
+        XfsdStatsMark  mark;
+        gboolean       measured;
+        Atom           atom;
+
+        /* the filter sees all events, only measure the ones for us */
+        measured = clipboard_manager_may_handle_event (manager, xev);
+        if (measured)
+                xfsettings_stats_begin_event (&mark, G_STRFUNC, xev->type);
+
+        if (clipboard_manager_process_event (manager, xev)) {
+                if (measured)
+                        xfsettings_stats_end (manager->priv->stats, XFSD_STATS_EVENT, &mark);
+
+                switch (xev->xany.type) {
+                case PropertyNotify:
+                        atom = xev->xproperty.atom;
+                        break;
+                case SelectionRequest:
+                        atom = xev->xselectionrequest.target;
+                        break;
+                case SelectionNotify:
+                        atom = xev->xselection.target;
+                        break;
+                case SelectionClear:
+                        atom = xev->xselectionclear.selection;
+                        break;
+                default:
+                        atom = None;
+                        break;
+                }
+                xfsettings_trace (XFSD_TRACE_CLIPBOARD_EVENT, xev->xany.type, atom, 0, 0);
+
                 return GDK_FILTER_REMOVE;
         } else {
                 return GDK_FILTER_CONTINUE;
@@ -985,6 +1069,8 @@ gsd_clipboard_manager_start (GsdClipboardManager *manager,
 
         manager->priv->start_idle_id = 0;
 
+        xfsettings_stats_watch_bytes (manager->priv->stats, clipboard_manager_contents_size, manager);
+
         return TRUE;
 }
 
@@ -1013,3 +1099,25 @@ gsd_clipboard_manager_stop (GsdClipboardManager *manager)
                 manager->priv->contents = NULL;
         }
 }
+
+G_MODULE_EXPORT void
+xfsettingsd_helper_register_types (GTypeModule *type_module)
+{
+        gsd_clipboard_manager_register_type (type_module);
+}
+
+G_MODULE_EXPORT GObject *
+xfsettingsd_helper_new (gboolean replace)
+{
+        GsdClipboardManager *manager;
+
+        manager = g_object_new (GSD_TYPE_CLIPBOARD_MANAGER, NULL);
+        if (!gsd_clipboard_manager_start (manager, replace)) {
+                g_object_unref (G_OBJECT (manager));
+                g_printerr (G_LOG_DOMAIN ": %s\n", "Another clipboard manager is already running.");
+
+                return NULL;
+        }
+
+        return G_OBJECT (manager);
+}
@@ -30,6 +30,7 @@
 
 
 
+/* in the order of the bits in XfsdDebugDomain */
 static const GDebugKey dbg_keys[] =
 {
     { "xsettings",  XFSD_DEBUG_XSETTINGS },
@@ -41,6 +42,11 @@ static const GDebugKey dbg_keys[] =
     { "accessibility", XFSD_DEBUG_ACCESSIBILITY },
     { "pointers", XFSD_DEBUG_POINTERS },
     { "displays", XFSD_DEBUG_DISPLAYS },
+    { "prefetch", XFSD_DEBUG_PREFETCH },
+    { "modules", XFSD_DEBUG_MODULES },
+    { "stalls", XFSD_DEBUG_STALLS },
+    { "clipboard", XFSD_DEBUG_CLIPBOARD },
+    { "handlers", XFSD_DEBUG_HANDLERS },
 };
 
 
@@ -75,24 +81,10 @@ xfsettings_dbg_print (XfsdDebugDomain  domain,
                       const gchar     *message,
                       va_list          args)
 {
-    const gchar *domain_name = NULL;
-    guint        i;
-    gchar       *string;
-
-    /* lookup domain name */
-    for (i = 0; i < G_N_ELEMENTS (dbg_keys); i++)
-    {
-        if (dbg_keys[i].value == domain)
-        {
-            domain_name = dbg_keys[i].key;
-            break;
-        }
-    }
-
-    g_assert (domain_name != NULL);
+    gchar *string;
 
     string = g_strdup_vprintf (message, args);
-    g_printerr (PACKAGE_NAME "(%s): %s\n", domain_name, string);
+    g_printerr (PACKAGE_NAME "(%s): %s\n", xfsettings_dbg_domain_name (domain), string);
     g_free (string);
 }
 
@@ -135,3 +127,28 @@ xfsettings_dbg_filtered (XfsdDebugDomain  domain,
     xfsettings_dbg_print (domain, message, args);
     va_end (args);
 }
+
+
+
+gboolean
+xfsettings_dbg_enabled (XfsdDebugDomain domain)
+{
+    /* whether xfsettings_dbg_filtered() would print for this domain */
+    return (xfsettings_dbg_init () & domain) != 0;
+}
+
+
+
+const gchar *
+xfsettings_dbg_domain_name (XfsdDebugDomain domain)
+{
+    gint bit;
+
+    /* the key of a domain is at the index of its bit, minus the
+     * XFSD_DEBUG_YES bit that has no key */
+    bit = g_bit_nth_lsf (domain, -1);
+    g_assert (bit >= 1 && (guint) bit <= G_N_ELEMENTS (dbg_keys));
+    g_assert (dbg_keys[bit - 1].value == (guint) domain);
+
+    return dbg_keys[bit - 1].key;
+}
@@ -33,6 +33,11 @@ typedef enum
    XFSD_DEBUG_ACCESSIBILITY      = 1 << 7,
    XFSD_DEBUG_POINTERS           = 1 << 8,
    XFSD_DEBUG_DISPLAYS           = 1 << 9,
+   XFSD_DEBUG_PREFETCH           = 1 << 10,
+   XFSD_DEBUG_MODULES            = 1 << 11,
+   XFSD_DEBUG_STALLS             = 1 << 12,
+   XFSD_DEBUG_CLIPBOARD          = 1 << 13,
+   XFSD_DEBUG_HANDLERS           = 1 << 14,
 }
 XfsdDebugDomain;
 
@@ -44,4 +49,8 @@ void xfsettings_dbg_filtered (XfsdDebugDomain  domain,
                               const gchar     *message,
                               ...) G_GNUC_PRINTF (2, 3);
 
+gboolean xfsettings_dbg_enabled (XfsdDebugDomain  domain);
+
+const gchar *xfsettings_dbg_domain_name (XfsdDebugDomain domain);
+
 #endif /* !__DEBUG_H__ */
@@ -0,0 +1,430 @@
+/*
+ *  Copyright (c) 2012 The Xfce Development Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <glib.h>
+#include <gdk/gdkx.h>
+#include <gtk/gtk.h>
+
+#include <X11/extensions/Xrandr.h>
+
+#include "debug.h"
+#include "displays-backend.h"
+
+
+
+typedef struct _XfceRRBackendX11 XfceRRBackendX11;
+
+
+
+static gboolean            xfce_rr_backend_x11_query_version         (XfceRRBackend       *backend,
+                                                                      gint                *major,
+                                                                      gint                *minor);
+static void                xfce_rr_backend_x11_watch                 (XfceRRBackend       *backend,
+                                                                      gboolean             enable);
+static GdkFilterReturn     xfce_rr_backend_x11_screen_on_event       (GdkXEvent           *xevent,
+                                                                      GdkEvent            *event,
+                                                                      gpointer             data);
+static XRRScreenResources *xfce_rr_backend_x11_get_resources         (XfceRRBackend       *backend,
+                                                                      gboolean             current);
+static void                xfce_rr_backend_x11_free_resources        (XfceRRBackend       *backend,
+                                                                      XRRScreenResources  *resources);
+static XRROutputInfo      *xfce_rr_backend_x11_get_output_info       (XfceRRBackend       *backend,
+                                                                      XRRScreenResources  *resources,
+                                                                      RROutput             output);
+static void                xfce_rr_backend_x11_free_output_info      (XfceRRBackend       *backend,
+                                                                      XRROutputInfo       *info);
+static XRRCrtcInfo        *xfce_rr_backend_x11_get_crtc_info         (XfceRRBackend       *backend,
+                                                                      XRRScreenResources  *resources,
+                                                                      RRCrtc               crtc);
+static void                xfce_rr_backend_x11_free_crtc_info        (XfceRRBackend       *backend,
+                                                                      XRRCrtcInfo         *info);
+static Status              xfce_rr_backend_x11_set_crtc_config       (XfceRRBackend       *backend,
+                                                                      XRRScreenResources  *resources,
+                                                                      RRCrtc               crtc,
+                                                                      gint                 x,
+                                                                      gint                 y,
+                                                                      RRMode               mode,
+                                                                      Rotation             rotation,
+                                                                      RROutput            *outputs,
+                                                                      gint                 noutputs);
+static gboolean            xfce_rr_backend_x11_get_screen_size_range (XfceRRBackend       *backend,
+                                                                      gint                *min_width,
+                                                                      gint                *min_height,
+                                                                      gint                *max_width,
+                                                                      gint                *max_height);
+static void                xfce_rr_backend_x11_get_screen_size       (XfceRRBackend       *backend,
+                                                                      gint                *width,
+                                                                      gint                *height,
+                                                                      gint                *mm_width,
+                                                                      gint                *mm_height);
+static void                xfce_rr_backend_x11_set_screen_size       (XfceRRBackend       *backend,
+                                                                      gint                 width,
+                                                                      gint                 height,
+                                                                      gint                 mm_width,
+                                                                      gint                 mm_height);
+static RROutput            xfce_rr_backend_x11_get_output_primary    (XfceRRBackend       *backend);
+static void                xfce_rr_backend_x11_set_output_primary    (XfceRRBackend       *backend,
+                                                                      RROutput             output);
+static void                xfce_rr_backend_x11_grab                  (XfceRRBackend       *backend);
+static void                xfce_rr_backend_x11_ungrab                (XfceRRBackend       *backend);
+static void                xfce_rr_backend_x11_free                  (XfceRRBackend       *backend);
+
+
+
+struct _XfceRRBackendX11
+{
+    XfceRRBackend  __parent__;
+
+    GdkDisplay    *display;
+    GdkWindow     *root_window;
+    Display       *xdisplay;
+    gint           event_base;
+    guint          watching : 1;
+};
+
+
+
+XfceRRBackend *
+xfce_rr_backend_x11_new (GdkDisplay *display)
+{
+    XfceRRBackendX11 *x11;
+    XfceRRBackend    *backend;
+
+    x11 = g_new0 (XfceRRBackendX11, 1);
+    x11->display = display;
+    x11->xdisplay = gdk_x11_display_get_xdisplay (display);
+    x11->root_window = gdk_get_default_root_window ();
+
+    backend = (XfceRRBackend *) x11;
+    backend->name = "x11";
+    backend->query_version = xfce_rr_backend_x11_query_version;
+    backend->watch = xfce_rr_backend_x11_watch;
+    backend->get_resources = xfce_rr_backend_x11_get_resources;
+    backend->free_resources = xfce_rr_backend_x11_free_resources;
+    backend->get_output_info = xfce_rr_backend_x11_get_output_info;
+    backend->free_output_info = xfce_rr_backend_x11_free_output_info;
+    backend->get_crtc_info = xfce_rr_backend_x11_get_crtc_info;
+    backend->free_crtc_info = xfce_rr_backend_x11_free_crtc_info;
+    backend->set_crtc_config = xfce_rr_backend_x11_set_crtc_config;
+    backend->get_screen_size_range = xfce_rr_backend_x11_get_screen_size_range;
+    backend->get_screen_size = xfce_rr_backend_x11_get_screen_size;
+    backend->set_screen_size = xfce_rr_backend_x11_set_screen_size;
+    backend->get_output_primary = xfce_rr_backend_x11_get_output_primary;
+    backend->set_output_primary = xfce_rr_backend_x11_set_output_primary;
+    backend->grab = xfce_rr_backend_x11_grab;
+    backend->ungrab = xfce_rr_backend_x11_ungrab;
+    backend->free = xfce_rr_backend_x11_free;
+
+    return backend;
+}
+
+
+
+static gboolean
+xfce_rr_backend_x11_query_version (XfceRRBackend *backend,
+                                   gint          *major,
+                                   gint          *minor)
+{
+    XfceRRBackendX11 *x11 = (XfceRRBackendX11 *) backend;
+    gint              error_base;
+
+    /* check if the randr extension is running */
+    if (!XRRQueryExtension (x11->xdisplay, &x11->event_base, &error_base))
+    {
+        g_critical ("No RANDR extension found in display %s. Display settings won't be applied.",
+                    gdk_display_get_name (x11->display));
+        return FALSE;
+    }
+
+    return XRRQueryVersion (x11->xdisplay, major, minor);
+}
+
+
+
+static void
+xfce_rr_backend_x11_watch (XfceRRBackend *backend,
+                           gboolean       enable)
+{
+    XfceRRBackendX11 *x11 = (XfceRRBackendX11 *) backend;
+
+    if (x11->watching == enable)
+        return;
+
+    if (enable)
+    {
+        /* Set up RandR notifications */
+        XRRSelectInput (x11->xdisplay,
+                        GDK_WINDOW_XID (x11->root_window),
+                        RRScreenChangeNotifyMask);
+        gdk_x11_register_standard_event_type (x11->display,
+                                              x11->event_base,
+                                              RRNotify + 1);
+        gdk_window_add_filter (x11->root_window,
+                               xfce_rr_backend_x11_screen_on_event,
+                               x11);
+    }
+    else
+    {
+        gdk_window_remove_filter (x11->root_window,
+                                  xfce_rr_backend_x11_screen_on_event,
+                                  x11);
+    }
+
+    x11->watching = enable;
+}
+
+
+
+static GdkFilterReturn
+xfce_rr_backend_x11_screen_on_event (GdkXEvent *xevent,
+                                     GdkEvent  *event,
+                                     gpointer   data)
+{
+    XfceRRBackendX11 *x11 = data;
+    XfceRRBackend    *backend = data;
+    XEvent           *e = xevent;
+
+    if (!e)
+        return GDK_FILTER_CONTINUE;
+
+    if (e->type - x11->event_base == RRScreenChangeNotify
+        && backend->changed_func != NULL)
+    {
+        xfsettings_dbg (XFSD_DEBUG_DISPLAYS, "RRScreenChangeNotify event received.");
+        backend->changed_func (backend, backend->changed_data);
+    }
+
+    /* Pass the event on to GTK+ */
+    return GDK_FILTER_CONTINUE;
+}
+
+
+
+static XRRScreenResources *
+xfce_rr_backend_x11_get_resources (XfceRRBackend *backend,
+                                   gboolean       current)
+{
+    XfceRRBackendX11 *x11 = (XfceRRBackendX11 *) backend;
+
+#if RANDR_MAJOR > 1 || (RANDR_MAJOR == 1 && RANDR_MINOR >= 3)
+    if (current)
+        return XRRGetScreenResourcesCurrent (x11->xdisplay,
+                                             GDK_WINDOW_XID (x11->root_window));
+#endif
+
+    return XRRGetScreenResources (x11->xdisplay,
+                                  GDK_WINDOW_XID (x11->root_window));
+}
+
+
+
+static void
+xfce_rr_backend_x11_free_resources (XfceRRBackend      *backend,
+                                    XRRScreenResources *resources)
+{
+    XRRFreeScreenResources (resources);
+}
+
+
+
+static XRROutputInfo *
+xfce_rr_backend_x11_get_output_info (XfceRRBackend      *backend,
+                                     XRRScreenResources *resources,
+                                     RROutput            output)
+{
+    XfceRRBackendX11 *x11 = (XfceRRBackendX11 *) backend;
+
+    return XRRGetOutputInfo (x11->xdisplay, resources, output);
+}
+
+
+
+static void
+xfce_rr_backend_x11_free_output_info (XfceRRBackend *backend,
+                                      XRROutputInfo *info)
+{
+    XRRFreeOutputInfo (info);
+}
+
+
+
+static XRRCrtcInfo *
+xfce_rr_backend_x11_get_crtc_info (XfceRRBackend      *backend,
+                                   XRRScreenResources *resources,
+                                   RRCrtc              crtc)
+{
+    XfceRRBackendX11 *x11 = (XfceRRBackendX11 *) backend;
+
+    return XRRGetCrtcInfo (x11->xdisplay, resources, crtc);
+}
+
+
+
+static void
+xfce_rr_backend_x11_free_crtc_info (XfceRRBackend *backend,
+                                    XRRCrtcInfo   *info)
+{
+    XRRFreeCrtcInfo (info);
+}
+
+
+
+static Status
+xfce_rr_backend_x11_set_crtc_config (XfceRRBackend      *backend,
+                                     XRRScreenResources *resources,
+                                     RRCrtc              crtc,
+                                     gint                x,
+                                     gint                y,
+                                     RRMode              mode,
+                                     Rotation            rotation,
+                                     RROutput           *outputs,
+                                     gint                noutputs)
+{
+    XfceRRBackendX11 *x11 = (XfceRRBackendX11 *) backend;
+
+    return XRRSetCrtcConfig (x11->xdisplay, resources, crtc, CurrentTime,
+                             x, y, mode, rotation, outputs, noutputs);
+}
+
+
+
+static gboolean
+xfce_rr_backend_x11_get_screen_size_range (XfceRRBackend *backend,
+                                           gint          *min_width,
+                                           gint          *min_height,
+                                           gint          *max_width,
+                                           gint          *max_height)
+{
+    XfceRRBackendX11 *x11 = (XfceRRBackendX11 *) backend;
+
+    return XRRGetScreenSizeRange (x11->xdisplay, GDK_WINDOW_XID (x11->root_window),
+                                  min_width, min_height, max_width, max_height);
+}
+
+
+
+static void
+xfce_rr_backend_x11_get_screen_size (XfceRRBackend *backend,
+                                     gint          *width,
+                                     gint          *height,
+                                     gint          *mm_width,
+                                     gint          *mm_height)
+{
+    *width = gdk_screen_width ();
+    *height = gdk_screen_height ();
+    *mm_width = gdk_screen_width_mm ();
+    *mm_height = gdk_screen_height_mm ();
+}
+
+
+
+static void
+xfce_rr_backend_x11_set_screen_size (XfceRRBackend *backend,
+                                     gint           width,
+                                     gint           height,
+                                     gint           mm_width,
+                                     gint           mm_height)
+{
+    XfceRRBackendX11 *x11 = (XfceRRBackendX11 *) backend;
+
+    XRRSetScreenSize (x11->xdisplay, GDK_WINDOW_XID (x11->root_window),
+                      width, height, mm_width, mm_height);
+}
+
+
+
+static RROutput
+xfce_rr_backend_x11_get_output_primary (XfceRRBackend *backend)
+{
+#if RANDR_MAJOR > 1 || (RANDR_MAJOR == 1 && RANDR_MINOR >= 3)
+    XfceRRBackendX11 *x11 = (XfceRRBackendX11 *) backend;
+
+    return XRRGetOutputPrimary (x11->xdisplay, GDK_WINDOW_XID (x11->root_window));
+#else
+    return None;
+#endif
+}
+
+
+
+static void
+xfce_rr_backend_x11_set_output_primary (XfceRRBackend *backend,
+                                        RROutput       output)
+{
+#if RANDR_MAJOR > 1 || (RANDR_MAJOR == 1 && RANDR_MINOR >= 3)
+    XfceRRBackendX11 *x11 = (XfceRRBackendX11 *) backend;
+
+    XRRSetOutputPrimary (x11->xdisplay, GDK_WINDOW_XID (x11->root_window), output);
+#endif
+}
+
+
+
+static void
+xfce_rr_backend_x11_grab (XfceRRBackend *backend)
+{
+    XfceRRBackendX11 *x11 = (XfceRRBackendX11 *) backend;
+
+    gdk_x11_display_grab (x11->display);
+}
+
+
+
+static void
+xfce_rr_backend_x11_ungrab (XfceRRBackend *backend)
+{
+    XfceRRBackendX11 *x11 = (XfceRRBackendX11 *) backend;
+
+    gdk_x11_display_ungrab (x11->display);
+}
+
+
+
+static void
+xfce_rr_backend_x11_free (XfceRRBackend *backend)
+{
+    xfce_rr_backend_x11_watch (backend, FALSE);
+    g_free (backend);
+}
+
+
+
+void
+xfce_rr_backend_free (XfceRRBackend *backend)
+{
+    if (backend != NULL)
+        backend->free (backend);
+}
+
+
+
+void
+xfce_rr_backend_watch (XfceRRBackend            *backend,
+                       XfceRRBackendChangedFunc  func,
+                       gpointer                  user_data)
+{
+    g_return_if_fail (backend != NULL);
+
+    backend->changed_func = func;
+    backend->changed_data = user_data;
+    backend->watch (backend, func != NULL);
+}
@@ -0,0 +1,104 @@
+/*
+ *  Copyright (c) 2012 The Xfce Development Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __DISPLAYS_BACKEND_H__
+#define __DISPLAYS_BACKEND_H__
+
+#include <gdk/gdk.h>
+#include <X11/extensions/Xrandr.h>
+
+typedef struct _XfceRRBackend XfceRRBackend;
+
+typedef void (*XfceRRBackendChangedFunc) (XfceRRBackend *backend,
+                                          gpointer       user_data);
+
+/* everything the displays helper asks from RandR, so the same logic
+ * can run against the X server or an in-memory simulation */
+struct _XfceRRBackend
+{
+    const gchar          *name;
+
+    gboolean            (*query_version)         (XfceRRBackend       *backend,
+                                                  gint                *major,
+                                                  gint                *minor);
+    void                (*watch)                 (XfceRRBackend       *backend,
+                                                  gboolean             enable);
+
+    XRRScreenResources *(*get_resources)         (XfceRRBackend       *backend,
+                                                  gboolean             current);
+    void                (*free_resources)        (XfceRRBackend       *backend,
+                                                  XRRScreenResources  *resources);
+    XRROutputInfo      *(*get_output_info)       (XfceRRBackend       *backend,
+                                                  XRRScreenResources  *resources,
+                                                  RROutput             output);
+    void                (*free_output_info)      (XfceRRBackend       *backend,
+                                                  XRROutputInfo       *info);
+    XRRCrtcInfo        *(*get_crtc_info)         (XfceRRBackend       *backend,
+                                                  XRRScreenResources  *resources,
+                                                  RRCrtc               crtc);
+    void                (*free_crtc_info)        (XfceRRBackend       *backend,
+                                                  XRRCrtcInfo         *info);
+    Status              (*set_crtc_config)       (XfceRRBackend       *backend,
+                                                  XRRScreenResources  *resources,
+                                                  RRCrtc               crtc,
+                                                  gint                 x,
+                                                  gint                 y,
+                                                  RRMode               mode,
+                                                  Rotation             rotation,
+                                                  RROutput            *outputs,
+                                                  gint                 noutputs);
+
+    gboolean            (*get_screen_size_range) (XfceRRBackend       *backend,
+                                                  gint                *min_width,
+                                                  gint                *min_height,
+                                                  gint                *max_width,
+                                                  gint                *max_height);
+    void                (*get_screen_size)       (XfceRRBackend       *backend,
+                                                  gint                *width,
+                                                  gint                *height,
+                                                  gint                *mm_width,
+                                                  gint                *mm_height);
+    void                (*set_screen_size)       (XfceRRBackend       *backend,
+                                                  gint                 width,
+                                                  gint                 height,
+                                                  gint                 mm_width,
+                                                  gint                 mm_height);
+
+    RROutput            (*get_output_primary)    (XfceRRBackend       *backend);
+    void                (*set_output_primary)    (XfceRRBackend       *backend,
+                                                  RROutput             output);
+
+    void                (*grab)                  (XfceRRBackend       *backend);
+    void                (*ungrab)                (XfceRRBackend       *backend);
+
+    void                (*free)                  (XfceRRBackend       *backend);
+
+    /* called when the outputs or their configuration changed */
+    XfceRRBackendChangedFunc changed_func;
+    gpointer                 changed_data;
+};
+
+XfceRRBackend *xfce_rr_backend_x11_new (GdkDisplay              *display);
+
+void           xfce_rr_backend_free    (XfceRRBackend           *backend);
+
+void           xfce_rr_backend_watch   (XfceRRBackend           *backend,
+                                        XfceRRBackendChangedFunc func,
+                                        gpointer                 user_data);
+
+#endif /* !__DISPLAYS_BACKEND_H__ */
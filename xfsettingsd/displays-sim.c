@@ -0,0 +1,1551 @@
+/*
+ *  Copyright (c) 2012 The Xfce Development Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * In-memory RandR backend for the test-displays check program. The
+ * fixture is either "heads:N" (1 to 16 generated heads with a dock/undock
+ * trace) or the path of a key file describing the hardware:
+ *
+ *   [Screen]         Width, Height, MinWidth, MinHeight, MaxWidth, MaxHeight
+ *   [Mode 1]         Name, Width, Height, Rate
+ *   [Output 10]      Name, Connected, Modes, Preferred, MmWidth, MmHeight
+ *   [Crtc 20]        Possible, Rotations, Mode, Rotation, X, Y, Outputs
+ *   [Scheme S/NAME]  Active, Primary, Rotation, Reflection, Resolution,
+ *                    RefreshRate, X, Y
+ *   [Trace]          Steps, Interval, Startup, Expect, Lit
+ *
+ * Schemes are stored in the channel given to xfce_rr_backend_sim_new()
+ * before the helper starts. Trace steps are "undock:10,11", "dock:10,11"
+ * or "apply:<scheme>" and are replayed once the helper watches for
+ * changes, like the X server every change is followed by a screen change
+ * notification.
+ *
+ * Every request the helper sends is recorded and counted, and a summary
+ * is printed per step. Startup and each entry of Expect list the counts
+ * the helper must reach, e.g. "SetCrtcConfig=2 GrabServer=1", and Lit
+ * the outputs that must be lit at the end. Rejected requests and missed
+ * expectations are failures, see xfce_rr_backend_sim_n_failures().
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+
+#include <glib.h>
+#include <xfconf/xfconf.h>
+
+#include <X11/extensions/Xrandr.h>
+
+#include "debug.h"
+#include "displays-backend.h"
+#include "displays-sim.h"
+
+
+
+#define SIM_MAX_HEADS 16
+#define SIM_INTERVAL  500
+
+
+
+typedef struct _XfceRRBackendSim XfceRRBackendSim;
+typedef struct _XfceRRSimCrtc    XfceRRSimCrtc;
+typedef struct _XfceRRSimOutput  XfceRRSimOutput;
+
+enum
+{
+    SIM_OP_GET_RESOURCES,
+    SIM_OP_GET_OUTPUT_INFO,
+    SIM_OP_GET_CRTC_INFO,
+    SIM_OP_SET_CRTC_CONFIG,
+    SIM_OP_GET_SCREEN_SIZE_RANGE,
+    SIM_OP_SET_SCREEN_SIZE,
+    SIM_OP_GET_PRIMARY,
+    SIM_OP_SET_PRIMARY,
+    SIM_OP_GRAB,
+    SIM_N_OPS
+};
+
+static const gchar *sim_op_names[SIM_N_OPS] =
+{
+    "GetScreenResources",
+    "GetOutputInfo",
+    "GetCrtcInfo",
+    "SetCrtcConfig",
+    "GetScreenSizeRange",
+    "SetScreenSize",
+    "GetOutputPrimary",
+    "SetOutputPrimary",
+    "GrabServer"
+};
+
+/* [Scheme] keys and the properties they are stored in */
+static const struct
+{
+    const gchar *key;
+    const gchar *property;
+    GType        type;
+}
+sim_scheme_keys[] =
+{
+    { "Active",      "Active",      G_TYPE_BOOLEAN },
+    { "Primary",     "Primary",     G_TYPE_BOOLEAN },
+    { "Rotation",    "Rotation",    G_TYPE_INT },
+    { "Reflection",  "Reflection",  G_TYPE_STRING },
+    { "Resolution",  "Resolution",  G_TYPE_STRING },
+    { "RefreshRate", "RefreshRate", G_TYPE_DOUBLE },
+    { "X",           "Position/X",  G_TYPE_INT },
+    { "Y",           "Position/Y",  G_TYPE_INT },
+};
+
+
+
+struct _XfceRRSimCrtc
+{
+    RRCrtc    id;
+    RRMode    mode;
+    Rotation  rotation;
+    Rotation  rotations;
+    gint      x;
+    gint      y;
+    GArray   *outputs;
+    GArray   *possible;
+};
+
+struct _XfceRRSimOutput
+{
+    RROutput  id;
+    gchar    *name;
+    gboolean  connected;
+    gulong    mm_width;
+    gulong    mm_height;
+    GArray   *modes;
+    gint      npreferred;
+    RRCrtc    crtc;
+};
+
+struct _XfceRRBackendSim
+{
+    XfceRRBackend  __parent__;
+
+    /* simulated hardware */
+    GArray        *modes;
+    GPtrArray     *crtcs;
+    GPtrArray     *outputs;
+    RROutput       primary;
+    gint           width;
+    gint           height;
+    gint           mm_width;
+    gint           mm_height;
+    gint           min_width;
+    gint           min_height;
+    gint           max_width;
+    gint           max_height;
+
+    /* trace replay */
+    XfconfChannel *channel;
+    gboolean       replayed;
+    gchar        **steps;
+    guint          step;
+    guint          interval;
+    guint          timeout_id;
+    guint          notify_id;
+
+    /* expectations */
+    gchar         *expect_startup;
+    gchar        **expect;
+    GArray        *lit;
+    guint          n_failures;
+
+    /* recorded requests */
+    GTimer        *timer;
+    guint          ops[SIM_N_OPS];
+    guint          total_ops[SIM_N_OPS];
+    guint          step_ops;
+    gdouble        first_op;
+    gdouble        last_op;
+    gdouble        busy;
+};
+
+
+
+static void
+xfce_rr_sim_record (XfceRRBackendSim *sim,
+                    guint             op,
+                    const gchar      *format,
+                    ...) G_GNUC_PRINTF (3, 4);
+static Status
+xfce_rr_sim_reject (XfceRRBackendSim *sim,
+                    const gchar      *format,
+                    ...) G_GNUC_PRINTF (2, 3);
+
+
+
+static void
+xfce_rr_sim_record (XfceRRBackendSim *sim,
+                    guint             op,
+                    const gchar      *format,
+                    ...)
+{
+    va_list  args;
+    gchar   *details;
+    gdouble  now;
+
+    now = g_timer_elapsed (sim->timer, NULL);
+    if (sim->step_ops++ == 0)
+        sim->first_op = now;
+    sim->last_op = now;
+
+    sim->ops[op]++;
+    sim->total_ops[op]++;
+
+    va_start (args, format);
+    details = g_strdup_vprintf (format, args);
+    va_end (args);
+
+    xfsettings_dbg (XFSD_DEBUG_DISPLAYS, "sim: %s %s", sim_op_names[op], details);
+    g_free (details);
+}
+
+
+
+static Status
+xfce_rr_sim_reject (XfceRRBackendSim *sim,
+                    const gchar      *format,
+                    ...)
+{
+    va_list  args;
+    gchar   *reason;
+
+    va_start (args, format);
+    reason = g_strdup_vprintf (format, args);
+    va_end (args);
+
+    /* the helper must never send a request the server refuses */
+    g_warning ("RandR simulation rejected a request: %s.", reason);
+    sim->n_failures++;
+    g_free (reason);
+
+    return RRSetConfigFailed;
+}
+
+
+
+static gboolean
+xfce_rr_sim_notify (gpointer data)
+{
+    XfceRRBackendSim *sim = data;
+    XfceRRBackend    *backend = data;
+
+    sim->notify_id = 0;
+
+    if (backend->changed_func != NULL)
+        backend->changed_func (backend, backend->changed_data);
+
+    return FALSE;
+}
+
+
+
+static void
+xfce_rr_sim_changed (XfceRRBackendSim *sim)
+{
+    /* like RRScreenChangeNotify, sent once after the pending requests */
+    if (sim->notify_id == 0)
+        sim->notify_id = g_idle_add (xfce_rr_sim_notify, sim);
+}
+
+
+
+static XfceRRSimCrtc *
+xfce_rr_sim_find_crtc (XfceRRBackendSim *sim,
+                       RRCrtc            id)
+{
+    XfceRRSimCrtc *crtc;
+    guint          n;
+
+    for (n = 0; n < sim->crtcs->len; ++n)
+    {
+        crtc = g_ptr_array_index (sim->crtcs, n);
+        if (crtc->id == id)
+            return crtc;
+    }
+
+    return NULL;
+}
+
+
+
+static XfceRRSimOutput *
+xfce_rr_sim_find_output (XfceRRBackendSim *sim,
+                         RROutput          id)
+{
+    XfceRRSimOutput *output;
+    guint            n;
+
+    for (n = 0; n < sim->outputs->len; ++n)
+    {
+        output = g_ptr_array_index (sim->outputs, n);
+        if (output->id == id)
+            return output;
+    }
+
+    return NULL;
+}
+
+
+
+static XRRModeInfo *
+xfce_rr_sim_find_mode (XfceRRBackendSim *sim,
+                       RRMode            id)
+{
+    guint n;
+
+    for (n = 0; n < sim->modes->len; ++n)
+    {
+        if (g_array_index (sim->modes, XRRModeInfo, n).id == id)
+            return &g_array_index (sim->modes, XRRModeInfo, n);
+    }
+
+    return NULL;
+}
+
+
+
+static gboolean
+xfce_rr_sim_has_id (GArray *array,
+                    XID     id)
+{
+    guint n;
+
+    for (n = 0; n < array->len; ++n)
+    {
+        if (g_array_index (array, XID, n) == id)
+            return TRUE;
+    }
+
+    return FALSE;
+}
+
+
+
+static void
+xfce_rr_sim_crtc_size (XfceRRBackendSim *sim,
+                       XfceRRSimCrtc    *crtc,
+                       guint            *width,
+                       guint            *height)
+{
+    XRRModeInfo *mode;
+
+    *width = *height = 0;
+
+    mode = xfce_rr_sim_find_mode (sim, crtc->mode);
+    if (mode == NULL)
+        return;
+
+    if ((crtc->rotation & (RR_Rotate_90|RR_Rotate_270)) != 0)
+    {
+        *width = mode->height;
+        *height = mode->width;
+    }
+    else
+    {
+        *width = mode->width;
+        *height = mode->height;
+    }
+}
+
+
+
+static void
+xfce_rr_sim_add_mode (XfceRRBackendSim *sim,
+                      RRMode            id,
+                      const gchar      *name,
+                      guint             width,
+                      guint             height,
+                      gdouble           rate)
+{
+    XRRModeInfo mode;
+
+    memset (&mode, 0, sizeof (mode));
+    mode.id = id;
+    mode.width = width;
+    mode.height = height;
+    mode.hTotal = width;
+    mode.vTotal = height;
+    mode.dotClock = (gulong) (rate * width * height + 0.5);
+    mode.name = name != NULL ? g_strdup (name) : g_strdup_printf ("%ux%u", width, height);
+    mode.nameLength = strlen (mode.name);
+
+    g_array_append_val (sim->modes, mode);
+}
+
+
+
+static XfceRRSimCrtc *
+xfce_rr_sim_add_crtc (XfceRRBackendSim *sim,
+                      RRCrtc            id)
+{
+    XfceRRSimCrtc *crtc;
+
+    crtc = g_new0 (XfceRRSimCrtc, 1);
+    crtc->id = id;
+    crtc->mode = None;
+    crtc->rotation = RR_Rotate_0;
+    crtc->rotations = RR_Rotate_0 | RR_Rotate_90 | RR_Rotate_180 | RR_Rotate_270
+                      | RR_Reflect_X | RR_Reflect_Y;
+    crtc->outputs = g_array_new (FALSE, FALSE, sizeof (RROutput));
+    crtc->possible = g_array_new (FALSE, FALSE, sizeof (RROutput));
+    g_ptr_array_add (sim->crtcs, crtc);
+
+    return crtc;
+}
+
+
+
+static XfceRRSimOutput *
+xfce_rr_sim_add_output (XfceRRBackendSim *sim,
+                        RROutput          id,
+                        const gchar      *name)
+{
+    XfceRRSimOutput *output;
+
+    output = g_new0 (XfceRRSimOutput, 1);
+    output->id = id;
+    output->name = g_strdup (name);
+    output->connected = TRUE;
+    output->modes = g_array_new (FALSE, FALSE, sizeof (RRMode));
+    output->crtc = None;
+    g_ptr_array_add (sim->outputs, output);
+
+    return output;
+}
+
+
+
+static void
+xfce_rr_sim_free_crtc (XfceRRSimCrtc *crtc)
+{
+    g_array_free (crtc->outputs, TRUE);
+    g_array_free (crtc->possible, TRUE);
+    g_free (crtc);
+}
+
+
+
+static void
+xfce_rr_sim_free_output (XfceRRSimOutput *output)
+{
+    g_array_free (output->modes, TRUE);
+    g_free (output->name);
+    g_free (output);
+}
+
+
+
+static void
+xfce_rr_sim_store_schemes (XfceRRBackendSim *sim,
+                           GKeyFile         *keyfile)
+{
+    gchar **groups, *prefix, *property, *value;
+    gsize   n;
+    guint   m;
+
+    groups = g_key_file_get_groups (keyfile, NULL);
+    for (n = 0; groups[n] != NULL; ++n)
+    {
+        if (!g_str_has_prefix (groups[n], "Scheme ") || strchr (groups[n], '/') == NULL)
+            continue;
+
+        /* like the dialog, the output holds its name and its settings below */
+        prefix = g_strdup_printf ("/%s", groups[n] + 7);
+        xfconf_channel_set_string (sim->channel, prefix, strrchr (prefix, '/') + 1);
+
+        for (m = 0; m < G_N_ELEMENTS (sim_scheme_keys); ++m)
+        {
+            if (!g_key_file_has_key (keyfile, groups[n], sim_scheme_keys[m].key, NULL))
+                continue;
+
+            property = g_strdup_printf ("%s/%s", prefix, sim_scheme_keys[m].property);
+            switch (sim_scheme_keys[m].type)
+            {
+                case G_TYPE_BOOLEAN:
+                    xfconf_channel_set_bool (sim->channel, property,
+                                             g_key_file_get_boolean (keyfile, groups[n],
+                                                                     sim_scheme_keys[m].key, NULL));
+                    break;
+
+                case G_TYPE_INT:
+                    xfconf_channel_set_int (sim->channel, property,
+                                            g_key_file_get_integer (keyfile, groups[n],
+                                                                    sim_scheme_keys[m].key, NULL));
+                    break;
+
+                case G_TYPE_DOUBLE:
+                    xfconf_channel_set_double (sim->channel, property,
+                                               g_key_file_get_double (keyfile, groups[n],
+                                                                      sim_scheme_keys[m].key, NULL));
+                    break;
+
+                default:
+                    value = g_key_file_get_string (keyfile, groups[n], sim_scheme_keys[m].key, NULL);
+                    xfconf_channel_set_string (sim->channel, property, value);
+                    g_free (value);
+                    break;
+            }
+            g_free (property);
+        }
+        g_free (prefix);
+    }
+    g_strfreev (groups);
+}
+
+
+
+static void
+xfce_rr_sim_generate_scheme (GKeyFile        *schemes,
+                             const gchar     *scheme,
+                             XfceRRSimOutput *output,
+                             const gchar     *resolution,
+                             gint             x)
+{
+    gchar *group;
+
+    group = g_strdup_printf ("Scheme %s/%s", scheme, output->name);
+    g_key_file_set_boolean (schemes, group, "Active", resolution != NULL);
+    if (resolution != NULL)
+    {
+        g_key_file_set_string (schemes, group, "Resolution", resolution);
+        g_key_file_set_double (schemes, group, "RefreshRate", 60.0);
+        g_key_file_set_integer (schemes, group, "X", x);
+        g_key_file_set_integer (schemes, group, "Y", 0);
+    }
+    g_free (group);
+}
+
+
+
+static void
+xfce_rr_sim_generate_step (GPtrArray *steps,
+                           GPtrArray *expect,
+                           gchar     *step,
+                           guint      n_crtcs)
+{
+    g_ptr_array_add (steps, step);
+
+    /* every step that changes something resizes the screen */
+    g_ptr_array_add (expect, g_strdup_printf ("SetCrtcConfig=%u SetScreenSize=%u GrabServer=%u",
+                                              n_crtcs, n_crtcs > 0 ? 1 : 0, n_crtcs > 0 ? 1 : 0));
+}
+
+
+
+static void
+xfce_rr_sim_generate (XfceRRBackendSim *sim,
+                      guint             heads)
+{
+    XfceRRSimOutput *output;
+    XfceRRSimCrtc   *crtc;
+    GKeyFile        *schemes;
+    GPtrArray       *steps, *expect;
+    GString         *external;
+    gchar           *name;
+    RRMode           mode;
+    guint            n;
+    gint             cycle;
+
+    xfce_rr_sim_add_mode (sim, 1, NULL, 1920, 1080, 60.0);
+    xfce_rr_sim_add_mode (sim, 2, NULL, 1280, 720, 60.0);
+    xfce_rr_sim_add_mode (sim, 3, NULL, 1366, 768, 60.0);
+
+    /* "Default" extends the panel with all external heads to the right,
+     * "Small" only keeps the panel with a mode that does not fit the
+     * current screen */
+    schemes = g_key_file_new ();
+    external = g_string_new (NULL);
+    sim->lit = g_array_new (FALSE, FALSE, sizeof (RROutput));
+
+    for (n = 0; n < heads; ++n)
+    {
+        if (n == 0)
+            name = g_strdup ("LVDS1");
+        else
+            name = g_strdup_printf ("DP-%u", n);
+
+        output = xfce_rr_sim_add_output (sim, 100 + n, name);
+        output->mm_width = n == 0 ? 310 : 530;
+        output->mm_height = n == 0 ? 174 : 300;
+        output->npreferred = 1;
+        mode = n == 0 ? 3 : 1;
+        g_array_append_val (output->modes, mode);
+        mode = 2;
+        g_array_append_val (output->modes, mode);
+        if (n > 0)
+        {
+            mode = 3;
+            g_array_append_val (output->modes, mode);
+            g_string_append_printf (external, "%s%lu", external->len > 0 ? "," : "", output->id);
+        }
+        g_free (name);
+
+        xfce_rr_sim_generate_scheme (schemes, "Default", output,
+                                     n == 0 ? "1366x768" : "1920x1080",
+                                     n == 0 ? 0 : 1366 + (n - 1) * 1920);
+        xfce_rr_sim_generate_scheme (schemes, "Small", output,
+                                     n == 0 ? "1280x720" : NULL, 0);
+
+        /* the trace ends on the default scheme */
+        g_array_append_val (sim->lit, output->id);
+
+        /* shared CRTCs like on MST hubs: each head can use its own CRTC
+         * or the next one */
+        crtc = xfce_rr_sim_add_crtc (sim, 200 + n);
+        g_array_append_val (crtc->possible, output->id);
+        if (n > 0)
+        {
+            output = g_ptr_array_index (sim->outputs, n - 1);
+            g_array_append_val (crtc->possible, output->id);
+        }
+    }
+
+    xfce_rr_sim_store_schemes (sim, schemes);
+    g_key_file_free (schemes);
+
+    /* only the internal panel is lit */
+    crtc = g_ptr_array_index (sim->crtcs, 0);
+    output = g_ptr_array_index (sim->outputs, 0);
+    crtc->mode = 3;
+    g_array_append_val (crtc->outputs, output->id);
+    output->crtc = crtc->id;
+    sim->width = 1366;
+    sim->height = 768;
+    sim->max_width = MAX (sim->max_width, 1366 + ((gint) heads - 1) * 1920);
+
+    /* the helper restores the default scheme when it starts, which
+     * lights all external heads */
+    sim->expect_startup = g_strdup_printf ("SetCrtcConfig=%u SetScreenSize=%u GrabServer=%u",
+                                           heads - 1, heads > 1 ? 1 : 0, heads > 1 ? 1 : 0);
+
+    steps = g_ptr_array_new ();
+    expect = g_ptr_array_new ();
+
+    /* undock and dock all external heads a few times, each undock
+     * disables their CRTCs and shrinks the screen, a dock only reloads */
+    for (cycle = 0; heads > 1 && cycle < 3; ++cycle)
+    {
+        xfce_rr_sim_generate_step (steps, expect, g_strdup_printf ("undock:%s", external->str),
+                                   heads - 1);
+        xfce_rr_sim_generate_step (steps, expect, g_strdup_printf ("dock:%s", external->str), 0);
+        xfce_rr_sim_generate_step (steps, expect, g_strdup ("apply:Default"), heads - 1);
+    }
+
+    /* all CRTCs are disabled for the smaller screen, then the panel gets
+     * its new mode; going back only enlarges the screen */
+    xfce_rr_sim_generate_step (steps, expect, g_strdup ("apply:Small"), heads + 1);
+    xfce_rr_sim_generate_step (steps, expect, g_strdup ("apply:Default"), heads);
+
+    g_ptr_array_add (steps, NULL);
+    sim->steps = (gchar **) g_ptr_array_free (steps, FALSE);
+    g_ptr_array_add (expect, NULL);
+    sim->expect = (gchar **) g_ptr_array_free (expect, FALSE);
+
+    g_string_free (external, TRUE);
+}
+
+
+
+static gboolean
+xfce_rr_sim_load (XfceRRBackendSim  *sim,
+                  const gchar       *fixture,
+                  GError           **error)
+{
+    GKeyFile        *keyfile;
+    XfceRRSimOutput *output;
+    XfceRRSimCrtc   *crtc;
+    gchar          **groups, *name;
+    gint            *list;
+    gsize            n_groups, length, n, m;
+    gulong           id;
+    RRMode           mode;
+    RROutput         oid;
+
+    keyfile = g_key_file_new ();
+    if (!g_key_file_load_from_file (keyfile, fixture, G_KEY_FILE_NONE, error))
+    {
+        g_key_file_free (keyfile);
+        return FALSE;
+    }
+
+    groups = g_key_file_get_groups (keyfile, &n_groups);
+    for (n = 0; n < n_groups; ++n)
+    {
+        if (g_str_has_prefix (groups[n], "Mode "))
+        {
+            id = strtoul (groups[n] + 5, NULL, 10);
+            name = g_key_file_get_string (keyfile, groups[n], "Name", NULL);
+            xfce_rr_sim_add_mode (sim, id, name,
+                                  g_key_file_get_integer (keyfile, groups[n], "Width", NULL),
+                                  g_key_file_get_integer (keyfile, groups[n], "Height", NULL),
+                                  g_key_file_get_double (keyfile, groups[n], "Rate", NULL));
+            g_free (name);
+        }
+        else if (g_str_has_prefix (groups[n], "Output "))
+        {
+            id = strtoul (groups[n] + 7, NULL, 10);
+            name = g_key_file_get_string (keyfile, groups[n], "Name", NULL);
+            if (name == NULL)
+                name = g_strdup_printf ("OUT-%lu", id);
+            output = xfce_rr_sim_add_output (sim, id, name);
+            g_free (name);
+
+            if (g_key_file_has_key (keyfile, groups[n], "Connected", NULL))
+                output->connected = g_key_file_get_boolean (keyfile, groups[n], "Connected", NULL);
+            output->mm_width = g_key_file_get_integer (keyfile, groups[n], "MmWidth", NULL);
+            output->mm_height = g_key_file_get_integer (keyfile, groups[n], "MmHeight", NULL);
+            output->npreferred = g_key_file_get_integer (keyfile, groups[n], "Preferred", NULL);
+
+            list = g_key_file_get_integer_list (keyfile, groups[n], "Modes", &length, NULL);
+            for (m = 0; m < length; ++m)
+            {
+                mode = list[m];
+                g_array_append_val (output->modes, mode);
+            }
+            g_free (list);
+        }
+        else if (g_str_has_prefix (groups[n], "Crtc "))
+        {
+            id = strtoul (groups[n] + 5, NULL, 10);
+            crtc = xfce_rr_sim_add_crtc (sim, id);
+
+            if (g_key_file_has_key (keyfile, groups[n], "Rotations", NULL))
+                crtc->rotations = g_key_file_get_integer (keyfile, groups[n], "Rotations", NULL);
+            crtc->mode = g_key_file_get_integer (keyfile, groups[n], "Mode", NULL);
+            crtc->x = g_key_file_get_integer (keyfile, groups[n], "X", NULL);
+            crtc->y = g_key_file_get_integer (keyfile, groups[n], "Y", NULL);
+            if (g_key_file_has_key (keyfile, groups[n], "Rotation", NULL))
+                crtc->rotation = g_key_file_get_integer (keyfile, groups[n], "Rotation", NULL);
+
+            list = g_key_file_get_integer_list (keyfile, groups[n], "Possible", &length, NULL);
+            for (m = 0; m < length; ++m)
+            {
+                oid = list[m];
+                g_array_append_val (crtc->possible, oid);
+            }
+            g_free (list);
+
+            list = g_key_file_get_integer_list (keyfile, groups[n], "Outputs", &length, NULL);
+            for (m = 0; m < length; ++m)
+            {
+                oid = list[m];
+                g_array_append_val (crtc->outputs, oid);
+            }
+            g_free (list);
+        }
+    }
+    g_strfreev (groups);
+
+    /* link outputs to the CRTCs driving them */
+    for (n = 0; n < sim->crtcs->len; ++n)
+    {
+        crtc = g_ptr_array_index (sim->crtcs, n);
+        for (m = 0; m < crtc->outputs->len; ++m)
+        {
+            output = xfce_rr_sim_find_output (sim, g_array_index (crtc->outputs, RROutput, m));
+            if (output != NULL)
+                output->crtc = crtc->id;
+        }
+    }
+
+    if (g_key_file_has_group (keyfile, "Screen"))
+    {
+        sim->width = g_key_file_get_integer (keyfile, "Screen", "Width", NULL);
+        sim->height = g_key_file_get_integer (keyfile, "Screen", "Height", NULL);
+        if (g_key_file_has_key (keyfile, "Screen", "MinWidth", NULL))
+            sim->min_width = g_key_file_get_integer (keyfile, "Screen", "MinWidth", NULL);
+        if (g_key_file_has_key (keyfile, "Screen", "MinHeight", NULL))
+            sim->min_height = g_key_file_get_integer (keyfile, "Screen", "MinHeight", NULL);
+        if (g_key_file_has_key (keyfile, "Screen", "MaxWidth", NULL))
+            sim->max_width = g_key_file_get_integer (keyfile, "Screen", "MaxWidth", NULL);
+        if (g_key_file_has_key (keyfile, "Screen", "MaxHeight", NULL))
+            sim->max_height = g_key_file_get_integer (keyfile, "Screen", "MaxHeight", NULL);
+    }
+
+    sim->steps = g_key_file_get_string_list (keyfile, "Trace", "Steps", NULL, NULL);
+    if (g_key_file_has_key (keyfile, "Trace", "Interval", NULL))
+        sim->interval = g_key_file_get_integer (keyfile, "Trace", "Interval", NULL);
+
+    sim->expect_startup = g_key_file_get_string (keyfile, "Trace", "Startup", NULL);
+    sim->expect = g_key_file_get_string_list (keyfile, "Trace", "Expect", NULL, NULL);
+    if (g_key_file_has_key (keyfile, "Trace", "Lit", NULL))
+    {
+        sim->lit = g_array_new (FALSE, FALSE, sizeof (RROutput));
+        list = g_key_file_get_integer_list (keyfile, "Trace", "Lit", &length, NULL);
+        for (m = 0; m < length; ++m)
+        {
+            oid = list[m];
+            g_array_append_val (sim->lit, oid);
+        }
+        g_free (list);
+    }
+
+    if (sim->outputs->len == 0 || sim->crtcs->len == 0 || sim->modes->len == 0)
+    {
+        g_set_error (error, G_KEY_FILE_ERROR, G_KEY_FILE_ERROR_GROUP_NOT_FOUND,
+                     "No modes, outputs or CRTCs defined");
+        g_key_file_free (keyfile);
+        return FALSE;
+    }
+
+    xfce_rr_sim_store_schemes (sim, keyfile);
+    g_key_file_free (keyfile);
+
+    return TRUE;
+}
+
+
+
+static void
+xfce_rr_sim_report (XfceRRBackendSim *sim,
+                    const gchar      *title,
+                    guint            *ops,
+                    gdouble           busy)
+{
+    GString *counts;
+    guint    n, total = 0;
+
+    counts = g_string_new (NULL);
+    for (n = 0; n < SIM_N_OPS; ++n)
+    {
+        total += ops[n];
+        if (ops[n] > 0)
+            g_string_append_printf (counts, ", %s: %u", sim_op_names[n], ops[n]);
+    }
+
+    g_message ("RandR simulation, %s: %u request(s) in %.2f ms%s.",
+               title, total, busy * 1000.0, counts->str);
+
+    g_string_free (counts, TRUE);
+}
+
+
+
+static void
+xfce_rr_sim_check_ops (XfceRRBackendSim *sim,
+                       const gchar      *title,
+                       const gchar      *expect)
+{
+    gchar **counts, *equal;
+    guint   n, op;
+
+    if (expect == NULL)
+        return;
+
+    /* "SetCrtcConfig=2 GrabServer=1", ops not listed are not checked */
+    counts = g_strsplit (expect, " ", -1);
+    for (n = 0; counts[n] != NULL; ++n)
+    {
+        if (*counts[n] == '\0')
+            continue;
+
+        equal = strchr (counts[n], '=');
+        for (op = 0; equal != NULL && op < SIM_N_OPS; ++op)
+        {
+            if (strncmp (counts[n], sim_op_names[op], equal - counts[n]) == 0
+                && sim_op_names[op][equal - counts[n]] == '\0')
+                break;
+        }
+
+        if (equal == NULL || op == SIM_N_OPS)
+        {
+            g_warning ("RandR simulation, %s: invalid expectation \"%s\".", title, counts[n]);
+            sim->n_failures++;
+        }
+        else if (sim->ops[op] != strtoul (equal + 1, NULL, 10))
+        {
+            g_warning ("RandR simulation, %s: expected %s, got %u.", title, counts[n], sim->ops[op]);
+            sim->n_failures++;
+        }
+    }
+    g_strfreev (counts);
+}
+
+
+
+static void
+xfce_rr_sim_check_lit (XfceRRBackendSim *sim)
+{
+    XfceRRSimOutput *output;
+    XfceRRSimCrtc   *crtc;
+    gboolean         lit;
+    guint            n;
+
+    if (sim->lit == NULL)
+        return;
+
+    for (n = 0; n < sim->outputs->len; ++n)
+    {
+        output = g_ptr_array_index (sim->outputs, n);
+        crtc = xfce_rr_sim_find_crtc (sim, output->crtc);
+        lit = crtc != NULL && crtc->mode != None;
+        if (lit != xfce_rr_sim_has_id (sim->lit, output->id))
+        {
+            g_warning ("RandR simulation: %s is %s at the end of the trace.",
+                       output->name, lit ? "lit" : "dark");
+            sim->n_failures++;
+        }
+    }
+}
+
+
+
+static void
+xfce_rr_sim_flush_step (XfceRRBackendSim *sim)
+{
+    const gchar *expect = NULL;
+    gchar       *title;
+
+    sim->busy += sim->last_op - sim->first_op;
+
+    /* the requests recorded since the previous step belong to it, the
+     * ones before the first step to the startup of the helper */
+    if (sim->step == 0)
+    {
+        title = g_strdup ("startup");
+        expect = sim->expect_startup;
+    }
+    else
+    {
+        title = g_strdup_printf ("step %u (%s)", sim->step, sim->steps[sim->step - 1]);
+        if (sim->expect != NULL && sim->step <= g_strv_length (sim->expect))
+            expect = sim->expect[sim->step - 1];
+    }
+
+    xfce_rr_sim_report (sim, title, sim->ops, sim->last_op - sim->first_op);
+    xfce_rr_sim_check_ops (sim, title, expect);
+    g_free (title);
+
+    memset (sim->ops, 0, sizeof (sim->ops));
+    sim->step_ops = 0;
+    sim->first_op = sim->last_op = 0.0;
+}
+
+
+
+static gboolean
+xfce_rr_sim_step (gpointer data)
+{
+    XfceRRBackendSim *sim = data;
+    XfceRRBackend    *backend = data;
+    XfceRRSimOutput  *output;
+    const gchar      *step;
+    gchar           **ids;
+    gboolean          connect;
+    guint             n;
+
+    xfce_rr_sim_flush_step (sim);
+
+    if (sim->steps == NULL || sim->steps[sim->step] == NULL)
+    {
+        xfce_rr_sim_check_lit (sim);
+        xfce_rr_sim_report (sim, "total", sim->total_ops, sim->busy);
+        sim->timeout_id = 0;
+        sim->replayed = TRUE;
+        return FALSE;
+    }
+
+    step = sim->steps[sim->step++];
+    xfsettings_dbg (XFSD_DEBUG_DISPLAYS, "sim: replaying step %u: %s.", sim->step, step);
+
+    if (g_str_has_prefix (step, "apply:"))
+    {
+        /* goes through the channel like the dialog does */
+        xfconf_channel_set_string (sim->channel, "/Schemes/Apply", step + 6);
+        return TRUE;
+    }
+
+    connect = g_str_has_prefix (step, "dock:");
+    if (!connect && !g_str_has_prefix (step, "undock:"))
+    {
+        g_warning ("Unknown RandR simulation step \"%s\".", step);
+        return TRUE;
+    }
+
+    ids = g_strsplit (strchr (step, ':') + 1, ",", -1);
+    for (n = 0; ids[n] != NULL; ++n)
+    {
+        output = xfce_rr_sim_find_output (sim, strtoul (ids[n], NULL, 10));
+        if (output == NULL)
+            continue;
+
+        /* like the X server, the CRTC keeps scanning out until the
+         * client disables it; only the primary output is reset */
+        output->connected = connect;
+        if (!connect && sim->primary == output->id)
+            sim->primary = None;
+    }
+    g_strfreev (ids);
+
+    if (backend->changed_func != NULL)
+        backend->changed_func (backend, backend->changed_data);
+
+    return TRUE;
+}
+
+
+
+static gboolean
+xfce_rr_backend_sim_query_version (XfceRRBackend *backend,
+                                   gint          *major,
+                                   gint          *minor)
+{
+    *major = 1;
+    *minor = 3;
+
+    return TRUE;
+}
+
+
+
+static void
+xfce_rr_backend_sim_watch (XfceRRBackend *backend,
+                           gboolean       enable)
+{
+    XfceRRBackendSim *sim = (XfceRRBackendSim *) backend;
+
+    if (enable && sim->timeout_id == 0 && sim->step == 0)
+    {
+        sim->timeout_id = g_timeout_add (sim->interval, xfce_rr_sim_step, sim);
+    }
+    else if (!enable)
+    {
+        if (sim->timeout_id != 0)
+        {
+            g_source_remove (sim->timeout_id);
+            sim->timeout_id = 0;
+        }
+        if (sim->notify_id != 0)
+        {
+            g_source_remove (sim->notify_id);
+            sim->notify_id = 0;
+        }
+    }
+}
+
+
+
+static XRRScreenResources *
+xfce_rr_backend_sim_get_resources (XfceRRBackend *backend,
+                                   gboolean       current)
+{
+    XfceRRBackendSim   *sim = (XfceRRBackendSim *) backend;
+    XRRScreenResources *resources;
+    guint               n;
+
+    xfce_rr_sim_record (sim, SIM_OP_GET_RESOURCES, "(current: %d)", current);
+
+    resources = g_new0 (XRRScreenResources, 1);
+
+    resources->ncrtc = sim->crtcs->len;
+    resources->crtcs = g_new0 (RRCrtc, sim->crtcs->len);
+    for (n = 0; n < sim->crtcs->len; ++n)
+        resources->crtcs[n] = ((XfceRRSimCrtc *) g_ptr_array_index (sim->crtcs, n))->id;
+
+    resources->noutput = sim->outputs->len;
+    resources->outputs = g_new0 (RROutput, sim->outputs->len);
+    for (n = 0; n < sim->outputs->len; ++n)
+        resources->outputs[n] = ((XfceRRSimOutput *) g_ptr_array_index (sim->outputs, n))->id;
+
+    /* mode names stay owned by the simulation */
+    resources->nmode = sim->modes->len;
+    resources->modes = g_memdup (sim->modes->data, sim->modes->len * sizeof (XRRModeInfo));
+
+    return resources;
+}
+
+
+
+static void
+xfce_rr_backend_sim_free_resources (XfceRRBackend      *backend,
+                                    XRRScreenResources *resources)
+{
+    if (resources == NULL)
+        return;
+
+    g_free (resources->crtcs);
+    g_free (resources->outputs);
+    g_free (resources->modes);
+    g_free (resources);
+}
+
+
+
+static XRROutputInfo *
+xfce_rr_backend_sim_get_output_info (XfceRRBackend      *backend,
+                                     XRRScreenResources *resources,
+                                     RROutput            id)
+{
+    XfceRRBackendSim *sim = (XfceRRBackendSim *) backend;
+    XfceRRSimOutput  *output;
+    XfceRRSimCrtc    *crtc;
+    XRROutputInfo    *info;
+    guint             n;
+
+    xfce_rr_sim_record (sim, SIM_OP_GET_OUTPUT_INFO, "%lu", id);
+
+    output = xfce_rr_sim_find_output (sim, id);
+    if (output == NULL)
+        return NULL;
+
+    info = g_new0 (XRROutputInfo, 1);
+    info->crtc = output->crtc;
+    info->name = g_strdup (output->name);
+    info->nameLen = strlen (output->name);
+    info->mm_width = output->mm_width;
+    info->mm_height = output->mm_height;
+    info->connection = output->connected ? RR_Connected : RR_Disconnected;
+
+    info->crtcs = g_new0 (RRCrtc, sim->crtcs->len);
+    for (n = 0; n < sim->crtcs->len; ++n)
+    {
+        crtc = g_ptr_array_index (sim->crtcs, n);
+        if (xfce_rr_sim_has_id (crtc->possible, id))
+            info->crtcs[info->ncrtc++] = crtc->id;
+    }
+
+    info->nmode = output->modes->len;
+    info->npreferred = output->npreferred;
+    info->modes = g_memdup (output->modes->data, output->modes->len * sizeof (RRMode));
+
+    return info;
+}
+
+
+
+static void
+xfce_rr_backend_sim_free_output_info (XfceRRBackend *backend,
+                                      XRROutputInfo *info)
+{
+    if (info == NULL)
+        return;
+
+    g_free (info->name);
+    g_free (info->crtcs);
+    g_free (info->modes);
+    g_free (info);
+}
+
+
+
+static XRRCrtcInfo *
+xfce_rr_backend_sim_get_crtc_info (XfceRRBackend      *backend,
+                                   XRRScreenResources *resources,
+                                   RRCrtc              id)
+{
+    XfceRRBackendSim *sim = (XfceRRBackendSim *) backend;
+    XfceRRSimCrtc    *crtc;
+    XRRCrtcInfo      *info;
+
+    xfce_rr_sim_record (sim, SIM_OP_GET_CRTC_INFO, "%lu", id);
+
+    crtc = xfce_rr_sim_find_crtc (sim, id);
+    if (crtc == NULL)
+        return NULL;
+
+    info = g_new0 (XRRCrtcInfo, 1);
+    info->x = crtc->x;
+    info->y = crtc->y;
+    xfce_rr_sim_crtc_size (sim, crtc, &info->width, &info->height);
+    info->mode = crtc->mode;
+    info->rotation = crtc->rotation;
+    info->rotations = crtc->rotations;
+    info->noutput = crtc->outputs->len;
+    info->outputs = g_memdup (crtc->outputs->data, crtc->outputs->len * sizeof (RROutput));
+    info->npossible = crtc->possible->len;
+    info->possible = g_memdup (crtc->possible->data, crtc->possible->len * sizeof (RROutput));
+
+    return info;
+}
+
+
+
+static void
+xfce_rr_backend_sim_free_crtc_info (XfceRRBackend *backend,
+                                    XRRCrtcInfo   *info)
+{
+    if (info == NULL)
+        return;
+
+    g_free (info->outputs);
+    g_free (info->possible);
+    g_free (info);
+}
+
+
+
+static Status
+xfce_rr_backend_sim_set_crtc_config (XfceRRBackend      *backend,
+                                     XRRScreenResources *resources,
+                                     RRCrtc              id,
+                                     gint                x,
+                                     gint                y,
+                                     RRMode              mode,
+                                     Rotation            rotation,
+                                     RROutput           *outputs,
+                                     gint                noutputs)
+{
+    XfceRRBackendSim *sim = (XfceRRBackendSim *) backend;
+    XfceRRSimOutput  *output;
+    XfceRRSimCrtc    *crtc, *other;
+    XRRModeInfo      *info;
+    guint             width, height, n;
+    gint              i;
+
+    xfce_rr_sim_record (sim, SIM_OP_SET_CRTC_CONFIG, "%lu: mode %lu at %dx%d, rotation %d, %d output(s)",
+                        id, mode, x, y, rotation, noutputs);
+
+    crtc = xfce_rr_sim_find_crtc (sim, id);
+    if (crtc == NULL)
+        return xfce_rr_sim_reject (sim, "CRTC %lu does not exist", id);
+
+    if (mode != None)
+    {
+        /* validate the request like the server would */
+        info = xfce_rr_sim_find_mode (sim, mode);
+        if (info == NULL || noutputs == 0 || (crtc->rotations & rotation) == 0)
+            return xfce_rr_sim_reject (sim, "invalid mode %lu, rotation %d or output list "
+                                       "for CRTC %lu", mode, rotation, id);
+
+        width = (rotation & (RR_Rotate_90|RR_Rotate_270)) != 0 ? info->height : info->width;
+        height = (rotation & (RR_Rotate_90|RR_Rotate_270)) != 0 ? info->width : info->height;
+        if (x < 0 || y < 0
+            || x + (gint) width > sim->width || y + (gint) height > sim->height)
+            return xfce_rr_sim_reject (sim, "CRTC %lu does not fit in %dx%d",
+                                       id, sim->width, sim->height);
+
+        for (i = 0; i < noutputs; ++i)
+        {
+            output = xfce_rr_sim_find_output (sim, outputs[i]);
+            if (output == NULL
+                || !xfce_rr_sim_has_id (crtc->possible, outputs[i])
+                || !xfce_rr_sim_has_id (output->modes, mode))
+                return xfce_rr_sim_reject (sim, "output %lu can not use CRTC %lu with mode %lu",
+                                           outputs[i], id, mode);
+        }
+    }
+
+    /* release the outputs of this CRTC */
+    for (n = 0; n < crtc->outputs->len; ++n)
+    {
+        output = xfce_rr_sim_find_output (sim, g_array_index (crtc->outputs, RROutput, n));
+        if (output != NULL && output->crtc == crtc->id)
+            output->crtc = None;
+    }
+    g_array_set_size (crtc->outputs, 0);
+
+    crtc->mode = mode;
+    crtc->rotation = mode != None ? rotation : RR_Rotate_0;
+    crtc->x = mode != None ? x : 0;
+    crtc->y = mode != None ? y : 0;
+
+    for (i = 0; mode != None && i < noutputs; ++i)
+    {
+        output = xfce_rr_sim_find_output (sim, outputs[i]);
+
+        /* an output can only be driven by one CRTC */
+        other = xfce_rr_sim_find_crtc (sim, output->crtc);
+        if (other != NULL && other != crtc)
+        {
+            for (n = 0; n < other->outputs->len; ++n)
+            {
+                if (g_array_index (other->outputs, RROutput, n) == output->id)
+                {
+                    g_array_remove_index (other->outputs, n);
+                    break;
+                }
+            }
+            if (other->outputs->len == 0)
+                other->mode = None;
+        }
+
+        output->crtc = crtc->id;
+        g_array_append_val (crtc->outputs, outputs[i]);
+    }
+
+    xfce_rr_sim_changed (sim);
+
+    return RRSetConfigSuccess;
+}
+
+
+
+static gboolean
+xfce_rr_backend_sim_get_screen_size_range (XfceRRBackend *backend,
+                                           gint          *min_width,
+                                           gint          *min_height,
+                                           gint          *max_width,
+                                           gint          *max_height)
+{
+    XfceRRBackendSim *sim = (XfceRRBackendSim *) backend;
+
+    xfce_rr_sim_record (sim, SIM_OP_GET_SCREEN_SIZE_RANGE, "");
+
+    *min_width = sim->min_width;
+    *min_height = sim->min_height;
+    *max_width = sim->max_width;
+    *max_height = sim->max_height;
+
+    return TRUE;
+}
+
+
+
+static void
+xfce_rr_backend_sim_get_screen_size (XfceRRBackend *backend,
+                                     gint          *width,
+                                     gint          *height,
+                                     gint          *mm_width,
+                                     gint          *mm_height)
+{
+    XfceRRBackendSim *sim = (XfceRRBackendSim *) backend;
+
+    *width = sim->width;
+    *height = sim->height;
+    *mm_width = sim->mm_width;
+    *mm_height = sim->mm_height;
+}
+
+
+
+static void
+xfce_rr_backend_sim_set_screen_size (XfceRRBackend *backend,
+                                     gint           width,
+                                     gint           height,
+                                     gint           mm_width,
+                                     gint           mm_height)
+{
+    XfceRRBackendSim *sim = (XfceRRBackendSim *) backend;
+    XfceRRSimCrtc    *crtc;
+    guint             crtc_width, crtc_height, n;
+
+    xfce_rr_sim_record (sim, SIM_OP_SET_SCREEN_SIZE, "%dx%d (%dx%d mm)",
+                        width, height, mm_width, mm_height);
+
+    /* enabled CRTCs must fit, otherwise the server refuses */
+    for (n = 0; n < sim->crtcs->len; ++n)
+    {
+        crtc = g_ptr_array_index (sim->crtcs, n);
+        if (crtc->mode == None)
+            continue;
+
+        xfce_rr_sim_crtc_size (sim, crtc, &crtc_width, &crtc_height);
+        if (crtc->x + (gint) crtc_width > width || crtc->y + (gint) crtc_height > height)
+        {
+            xfce_rr_sim_reject (sim, "BadMatch, CRTC %lu does not fit in %dx%d",
+                                crtc->id, width, height);
+            return;
+        }
+    }
+
+    sim->width = width;
+    sim->height = height;
+    sim->mm_width = mm_width;
+    sim->mm_height = mm_height;
+
+    xfce_rr_sim_changed (sim);
+}
+
+
+
+static RROutput
+xfce_rr_backend_sim_get_output_primary (XfceRRBackend *backend)
+{
+    XfceRRBackendSim *sim = (XfceRRBackendSim *) backend;
+
+    xfce_rr_sim_record (sim, SIM_OP_GET_PRIMARY, "");
+
+    return sim->primary;
+}
+
+
+
+static void
+xfce_rr_backend_sim_set_output_primary (XfceRRBackend *backend,
+                                        RROutput       output)
+{
+    XfceRRBackendSim *sim = (XfceRRBackendSim *) backend;
+
+    xfce_rr_sim_record (sim, SIM_OP_SET_PRIMARY, "%lu", output);
+
+    sim->primary = output;
+}
+
+
+
+static void
+xfce_rr_backend_sim_grab (XfceRRBackend *backend)
+{
+    xfce_rr_sim_record ((XfceRRBackendSim *) backend, SIM_OP_GRAB, "");
+}
+
+
+
+static void
+xfce_rr_backend_sim_ungrab (XfceRRBackend *backend)
+{
+    xfsettings_dbg (XFSD_DEBUG_DISPLAYS, "sim: UngrabServer");
+}
+
+
+
+static void
+xfce_rr_backend_sim_free (XfceRRBackend *backend)
+{
+    XfceRRBackendSim *sim = (XfceRRBackendSim *) backend;
+    guint             n;
+
+    xfce_rr_backend_sim_watch (backend, FALSE);
+
+    for (n = 0; n < sim->modes->len; ++n)
+        g_free (g_array_index (sim->modes, XRRModeInfo, n).name);
+    g_array_free (sim->modes, TRUE);
+    g_ptr_array_free (sim->crtcs, TRUE);
+    g_ptr_array_free (sim->outputs, TRUE);
+    g_strfreev (sim->steps);
+    g_strfreev (sim->expect);
+    g_free (sim->expect_startup);
+    if (sim->lit != NULL)
+        g_array_free (sim->lit, TRUE);
+    g_object_unref (G_OBJECT (sim->channel));
+    g_timer_destroy (sim->timer);
+    g_free (sim);
+}
+
+
+
+XfceRRBackend *
+xfce_rr_backend_sim_new (const gchar    *fixture,
+                         XfconfChannel  *channel,
+                         GError        **error)
+{
+    XfceRRBackendSim *sim;
+    XfceRRBackend    *backend;
+    XfceRRSimCrtc    *crtc;
+    guint             heads, width, height, n;
+
+    g_return_val_if_fail (fixture != NULL, NULL);
+    g_return_val_if_fail (XFCONF_IS_CHANNEL (channel), NULL);
+
+    sim = g_new0 (XfceRRBackendSim, 1);
+    sim->modes = g_array_new (FALSE, FALSE, sizeof (XRRModeInfo));
+    sim->crtcs = g_ptr_array_new_with_free_func ((GDestroyNotify) xfce_rr_sim_free_crtc);
+    sim->outputs = g_ptr_array_new_with_free_func ((GDestroyNotify) xfce_rr_sim_free_output);
+    sim->min_width = 320;
+    sim->min_height = 200;
+    sim->max_width = sim->max_height = 8192 * 2;
+    sim->interval = SIM_INTERVAL;
+    sim->channel = g_object_ref (G_OBJECT (channel));
+    sim->timer = g_timer_new ();
+
+    backend = (XfceRRBackend *) sim;
+    backend->name = "simulation";
+    backend->query_version = xfce_rr_backend_sim_query_version;
+    backend->watch = xfce_rr_backend_sim_watch;
+    backend->get_resources = xfce_rr_backend_sim_get_resources;
+    backend->free_resources = xfce_rr_backend_sim_free_resources;
+    backend->get_output_info = xfce_rr_backend_sim_get_output_info;
+    backend->free_output_info = xfce_rr_backend_sim_free_output_info;
+    backend->get_crtc_info = xfce_rr_backend_sim_get_crtc_info;
+    backend->free_crtc_info = xfce_rr_backend_sim_free_crtc_info;
+    backend->set_crtc_config = xfce_rr_backend_sim_set_crtc_config;
+    backend->get_screen_size_range = xfce_rr_backend_sim_get_screen_size_range;
+    backend->get_screen_size = xfce_rr_backend_sim_get_screen_size;
+    backend->set_screen_size = xfce_rr_backend_sim_set_screen_size;
+    backend->get_output_primary = xfce_rr_backend_sim_get_output_primary;
+    backend->set_output_primary = xfce_rr_backend_sim_set_output_primary;
+    backend->grab = xfce_rr_backend_sim_grab;
+    backend->ungrab = xfce_rr_backend_sim_ungrab;
+    backend->free = xfce_rr_backend_sim_free;
+
+    if (g_str_has_prefix (fixture, "heads:"))
+    {
+        heads = strtoul (fixture + 6, NULL, 10);
+        if (heads < 1 || heads > SIM_MAX_HEADS)
+        {
+            g_set_error (error, G_KEY_FILE_ERROR, G_KEY_FILE_ERROR_INVALID_VALUE,
+                         "The number of heads must be between 1 and %d", SIM_MAX_HEADS);
+            xfce_rr_backend_sim_free (backend);
+            return NULL;
+        }
+
+        xfce_rr_sim_generate (sim, heads);
+    }
+    else if (!xfce_rr_sim_load (sim, fixture, error))
+    {
+        xfce_rr_backend_sim_free (backend);
+        return NULL;
+    }
+
+    /* derive the screen size from the lit CRTCs if not given */
+    if (sim->width == 0 || sim->height == 0)
+    {
+        for (n = 0; n < sim->crtcs->len; ++n)
+        {
+            crtc = g_ptr_array_index (sim->crtcs, n);
+            xfce_rr_sim_crtc_size (sim, crtc, &width, &height);
+            sim->width = MAX (sim->width, crtc->x + (gint) width);
+            sim->height = MAX (sim->height, crtc->y + (gint) height);
+        }
+    }
+    sim->mm_width = (sim->width / 96.0) * 25.4 + 0.5;
+    sim->mm_height = (sim->height / 96.0) * 25.4 + 0.5;
+
+    g_message ("Using the RandR simulation \"%s\": %d output(s), %d CRTC(s), %d mode(s).",
+               fixture, sim->outputs->len, sim->crtcs->len, sim->modes->len);
+
+    return backend;
+}
+
+
+
+gboolean
+xfce_rr_backend_sim_replayed (XfceRRBackend *backend)
+{
+    XfceRRBackendSim *sim = (XfceRRBackendSim *) backend;
+
+    g_return_val_if_fail (backend != NULL, FALSE);
+
+    return sim->replayed;
+}
+
+
+
+guint
+xfce_rr_backend_sim_n_failures (XfceRRBackend *backend)
+{
+    XfceRRBackendSim *sim = (XfceRRBackendSim *) backend;
+
+    g_return_val_if_fail (backend != NULL, 0);
+
+    return sim->n_failures;
+}
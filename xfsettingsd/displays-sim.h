@@ -0,0 +1,37 @@
+/*
+ *  Copyright (c) 2012 The Xfce Development Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __DISPLAYS_SIM_H__
+#define __DISPLAYS_SIM_H__
+
+#include <glib.h>
+#include <xfconf/xfconf.h>
+
+#include "displays-backend.h"
+
+XfceRRBackend *xfce_rr_backend_sim_new        (const gchar    *fixture,
+                                               XfconfChannel  *channel,
+                                               GError        **error);
+
+/* whether all steps of the trace were replayed */
+gboolean       xfce_rr_backend_sim_replayed   (XfceRRBackend  *backend);
+
+/* rejected requests and missed expectations so far */
+guint          xfce_rr_backend_sim_n_failures (XfceRRBackend  *backend);
+
+#endif /* !__DISPLAYS_SIM_H__ */
@@ -0,0 +1,295 @@
+/*
+ *  Copyright (c) 2012 The Xfce Development Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#include <stdio.h>
+
+#include <glib.h>
+
+#include "debug.h"
+#include "displays-timeline.h"
+
+/* Chrome trace-event output, see chrome://tracing */
+#define TRACE_FILE_ENV "XFSETTINGSD_DISPLAYS_TRACE"
+
+
+
+typedef struct _XfceRRSpan XfceRRSpan;
+typedef struct _XfceRRSpanSum XfceRRSpanSum;
+
+struct _XfceRRTimeline
+{
+    GTimer *timer;
+
+    /* current session, only the outermost begin/finish pair counts */
+    gchar  *what;
+    gdouble start;
+    guint   depth;
+    GArray *spans;
+
+    /* trace-event file, if requested */
+    FILE   *trace;
+    guint   n_events;
+};
+
+struct _XfceRRSpan
+{
+    const gchar *name;
+    gulong       id;
+    gdouble      start;
+    gdouble      duration;
+};
+
+struct _XfceRRSpanSum
+{
+    const gchar *name;
+    guint        count;
+    gdouble      total;
+    gdouble      max;
+};
+
+
+
+XfceRRTimeline *
+xfce_rr_timeline_new (void)
+{
+    XfceRRTimeline *timeline;
+    const gchar    *path;
+    FILE           *trace = NULL;
+
+    path = g_getenv (TRACE_FILE_ENV);
+    if (path != NULL && *path != '\0')
+    {
+        trace = fopen (path, "w");
+        if (trace == NULL)
+            g_warning ("Failed to open the display trace file %s.", path);
+    }
+
+    /* only pay for the timing when somebody looks at it */
+    if (trace == NULL && !xfsettings_dbg_enabled (XFSD_DEBUG_DISPLAYS))
+        return NULL;
+
+    timeline = g_new0 (XfceRRTimeline, 1);
+    timeline->timer = g_timer_new ();
+    timeline->spans = g_array_new (FALSE, FALSE, sizeof (XfceRRSpan));
+    timeline->trace = trace;
+
+    /* the closing bracket is optional in the JSON array format, so the
+     * file stays valid if the daemon is killed */
+    if (trace != NULL)
+    {
+        fputs ("[\n", trace);
+        fflush (trace);
+    }
+
+    return timeline;
+}
+
+
+
+void
+xfce_rr_timeline_free (XfceRRTimeline *timeline)
+{
+    if (timeline == NULL)
+        return;
+
+    if (timeline->trace != NULL)
+    {
+        fputs ("\n]\n", timeline->trace);
+        fclose (timeline->trace);
+    }
+
+    g_array_free (timeline->spans, TRUE);
+    g_timer_destroy (timeline->timer);
+    g_free (timeline->what);
+    g_free (timeline);
+}
+
+
+
+void
+xfce_rr_timeline_begin (XfceRRTimeline *timeline,
+                        const gchar    *what)
+{
+    if (timeline == NULL)
+        return;
+
+    if (timeline->depth++ > 0)
+        return;
+
+    g_free (timeline->what);
+    timeline->what = g_strdup (what);
+    timeline->start = g_timer_elapsed (timeline->timer, NULL);
+    g_array_set_size (timeline->spans, 0);
+}
+
+
+
+static void
+xfce_rr_timeline_write_event (XfceRRTimeline *timeline,
+                              const gchar    *name,
+                              gulong          id,
+                              gdouble         start,
+                              gdouble         duration)
+{
+    GString     *escaped;
+    const gchar *p;
+
+    /* scheme names are user input, keep the JSON valid */
+    escaped = g_string_sized_new (32);
+    for (p = name; *p != '\0'; ++p)
+    {
+        if (*p == '"' || *p == '\\')
+            g_string_append_printf (escaped, "\\%c", *p);
+        else if ((guchar) *p < 0x20)
+            g_string_append_printf (escaped, "\\u%04x", (guint) *p);
+        else
+            g_string_append_c (escaped, *p);
+    }
+
+    fprintf (timeline->trace,
+             "%s{\"name\":\"%s\",\"cat\":\"displays\",\"ph\":\"X\","
+             "\"ts\":%.0f,\"dur\":%.0f,\"pid\":%d,\"tid\":1,"
+             "\"args\":{\"id\":%lu}}",
+             timeline->n_events++ > 0 ? ",\n" : "", escaped->str,
+             start * G_USEC_PER_SEC, duration * G_USEC_PER_SEC,
+             (gint) getpid (), id);
+    g_string_free (escaped, TRUE);
+}
+
+
+
+void
+xfce_rr_timeline_finish (XfceRRTimeline *timeline)
+{
+    XfceRRSpan    *span;
+    XfceRRSpanSum *sum;
+    GArray        *sums;
+    GString       *summary;
+    gdouble        total;
+    guint          n, m;
+
+    if (timeline == NULL || timeline->depth == 0)
+        return;
+
+    if (--timeline->depth > 0)
+        return;
+
+    total = g_timer_elapsed (timeline->timer, NULL) - timeline->start;
+
+    /* nothing happened, nothing to report */
+    if (timeline->spans->len == 0)
+        return;
+
+    /* group the spans by name, in order of first appearance */
+    sums = g_array_new (FALSE, TRUE, sizeof (XfceRRSpanSum));
+    for (n = 0; n < timeline->spans->len; ++n)
+    {
+        span = &g_array_index (timeline->spans, XfceRRSpan, n);
+
+        sum = NULL;
+        for (m = 0; m < sums->len && sum == NULL; ++m)
+        {
+            if (strcmp (g_array_index (sums, XfceRRSpanSum, m).name, span->name) == 0)
+                sum = &g_array_index (sums, XfceRRSpanSum, m);
+        }
+        if (sum == NULL)
+        {
+            g_array_set_size (sums, sums->len + 1);
+            sum = &g_array_index (sums, XfceRRSpanSum, sums->len - 1);
+            sum->name = span->name;
+        }
+
+        sum->count++;
+        sum->total += span->duration;
+        sum->max = MAX (sum->max, span->duration);
+    }
+
+    summary = g_string_new (NULL);
+    for (n = 0; n < sums->len; ++n)
+    {
+        sum = &g_array_index (sums, XfceRRSpanSum, n);
+        g_string_append_printf (summary, "%s%s %.1f ms", n > 0 ? ", " : "",
+                                sum->name, sum->total * 1000.0);
+        if (sum->count > 1)
+            g_string_append_printf (summary, " (%u, max %.1f ms)",
+                                    sum->count, sum->max * 1000.0);
+    }
+
+    xfsettings_dbg (XFSD_DEBUG_DISPLAYS, "Timeline of %s: %.1f ms total; %s.",
+                    timeline->what, total * 1000.0, summary->str);
+
+    g_string_free (summary, TRUE);
+    g_array_free (sums, TRUE);
+
+    if (timeline->trace != NULL)
+    {
+        /* the session itself, then its spans */
+        xfce_rr_timeline_write_event (timeline, timeline->what, 0,
+                                      timeline->start, total);
+        for (n = 0; n < timeline->spans->len; ++n)
+        {
+            span = &g_array_index (timeline->spans, XfceRRSpan, n);
+            xfce_rr_timeline_write_event (timeline, span->name, span->id,
+                                          span->start, span->duration);
+        }
+        fflush (timeline->trace);
+    }
+}
+
+
+
+gdouble
+xfce_rr_timeline_now (XfceRRTimeline *timeline)
+{
+    if (timeline == NULL)
+        return 0.0;
+
+    return g_timer_elapsed (timeline->timer, NULL);
+}
+
+
+
+void
+xfce_rr_timeline_span (XfceRRTimeline *timeline,
+                       const gchar    *name,
+                       gulong          id,
+                       gdouble         start)
+{
+    XfceRRSpan span;
+
+    /* spans outside of a session are not reported */
+    if (timeline == NULL || timeline->depth == 0)
+        return;
+
+    span.name = name;
+    span.id = id;
+    span.start = start;
+    span.duration = g_timer_elapsed (timeline->timer, NULL) - start;
+
+    g_array_append_val (timeline->spans, span);
+}
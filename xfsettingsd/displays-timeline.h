@@ -0,0 +1,44 @@
+/*
+ *  Copyright (c) 2012 The Xfce Development Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __DISPLAYS_TIMELINE_H__
+#define __DISPLAYS_TIMELINE_H__
+
+#include <glib.h>
+
+typedef struct _XfceRRTimeline XfceRRTimeline;
+
+/* all functions accept a NULL timeline and do nothing then, so callers
+ * do not have to care whether timing is enabled */
+XfceRRTimeline *xfce_rr_timeline_new    (void);
+
+void            xfce_rr_timeline_free   (XfceRRTimeline *timeline);
+
+void            xfce_rr_timeline_begin  (XfceRRTimeline *timeline,
+                                         const gchar    *what);
+
+void            xfce_rr_timeline_finish (XfceRRTimeline *timeline);
+
+gdouble         xfce_rr_timeline_now    (XfceRRTimeline *timeline);
+
+void            xfce_rr_timeline_span   (XfceRRTimeline *timeline,
+                                         const gchar    *name,
+                                         gulong          id,
+                                         gdouble         start);
+
+#endif /* !__DISPLAYS_TIMELINE_H__ */
@@ -37,7 +37,13 @@
 #include <X11/extensions/Xrandr.h>
 
 #include "debug.h"
+#include "helper-module.h"
 #include "displays.h"
+#include "displays-backend.h"
+#include "displays-timeline.h"
+#include "prefetch.h"
+#include "stats.h"
+#include "trace.h"
 #ifdef HAVE_UPOWERGLIB
 #include "displays-upower.h"
 #endif
@@ -52,35 +58,36 @@
 /* Xfconf properties */
 #define APPLY_SCHEME_PROP   "/Schemes/Apply"
 #define DEFAULT_SCHEME_NAME "Default"
-#define OUTPUT_FMT          "/%s/%s"
-#define PRIMARY_PROP        OUTPUT_FMT "/Primary"
-#define ACTIVE_PROP         OUTPUT_FMT "/Active"
-#define ROTATION_PROP       OUTPUT_FMT "/Rotation"
-#define REFLECTION_PROP     OUTPUT_FMT "/Reflection"
-#define RESOLUTION_PROP     OUTPUT_FMT "/Resolution"
-#define RRATE_PROP          OUTPUT_FMT "/RefreshRate"
-#define POSX_PROP           OUTPUT_FMT "/Position/X"
-#define POSY_PROP           OUTPUT_FMT "/Position/Y"
 #define NOTIFY_PROP         "/Notify"
 
 
 
 /* wrappers to avoid querying too often */
-typedef struct _XfceRRCrtc   XfceRRCrtc;
-typedef struct _XfceRROutput XfceRROutput;
+typedef struct _XfceRRCrtc         XfceRRCrtc;
+typedef struct _XfceRRCrtcState    XfceRRCrtcState;
+typedef struct _XfceRROutput       XfceRROutput;
+typedef struct _XfceRRPlan         XfceRRPlan;
+typedef struct _XfceRRLidPlan      XfceRRLidPlan;
+typedef struct _XfceDisplayProfile XfceDisplayProfile;
 
 
 
 static void             xfce_displays_helper_dispose                        (GObject                 *object);
 static void             xfce_displays_helper_finalize                       (GObject                 *object);
+static void             xfce_displays_helper_setup                          (XfceDisplaysHelper      *helper);
 static void             xfce_displays_helper_reload                         (XfceDisplaysHelper      *helper);
-static GdkFilterReturn  xfce_displays_helper_screen_on_event                (GdkXEvent               *xevent,
-                                                                             GdkEvent                *event,
+static void             xfce_displays_helper_screen_changed                 (XfceRRBackend           *backend,
                                                                              gpointer                 data);
 static void             xfce_displays_helper_set_screen_size                (XfceDisplaysHelper      *helper);
+static GArray          *xfce_displays_helper_parse_profiles                 (XfceDisplaysHelper      *helper,
+                                                                             const gchar             *scheme);
+static void             xfce_displays_helper_free_profiles                  (GArray                  *profiles);
+static GArray          *xfce_displays_helper_get_profiles                   (XfceDisplaysHelper      *helper,
+                                                                             const gchar             *scheme);
+static const XfceDisplayProfile *xfce_displays_helper_find_profile          (GArray                  *profiles,
+                                                                             const gchar             *name);
 static gboolean         xfce_displays_helper_load_from_xfconf               (XfceDisplaysHelper      *helper,
-                                                                             const gchar             *scheme,
-                                                                             GHashTable              *saved_outputs,
+                                                                             GArray                  *profiles,
                                                                              XfceRROutput            *output);
 static GPtrArray       *xfce_displays_helper_list_outputs                   (XfceDisplaysHelper      *helper);
 static void             xfce_displays_helper_free_output                    (XfceRROutput            *output);
@@ -88,8 +95,18 @@ static GPtrArray       *xfce_displays_helper_list_crtcs                     (Xfc
 static XfceRRCrtc      *xfce_displays_helper_find_crtc_by_id                (XfceDisplaysHelper      *helper,
                                                                              RRCrtc                   id);
 static void             xfce_displays_helper_free_crtc                      (XfceRRCrtc              *crtc);
+static void             xfce_displays_helper_want_crtcs                     (XfceDisplaysHelper      *helper,
+                                                                             GArray                  *profiles);
+static gint             xfce_displays_helper_assignment_cost                (XfceRROutput            *output,
+                                                                             XfceRRCrtc              *crtc);
+static void             xfce_displays_helper_assign_crtcs                   (XfceDisplaysHelper      *helper);
 static XfceRRCrtc      *xfce_displays_helper_find_usable_crtc               (XfceDisplaysHelper      *helper,
                                                                              XfceRROutput            *output);
+static gboolean         xfce_displays_helper_crtc_differs                   (XfceRRCrtc              *crtc);
+static gboolean         xfce_displays_helper_crtc_fits                      (XfceRRCrtc              *crtc,
+                                                                             XfceDisplaysHelper      *helper);
+static void             xfce_displays_helper_plan                           (XfceDisplaysHelper      *helper,
+                                                                             XfceRRPlan              *plan);
 static void             xfce_displays_helper_get_topleftmost_pos            (XfceRRCrtc              *crtc,
                                                                              XfceDisplaysHelper      *helper);
 static void             xfce_displays_helper_normalize_crtc                 (XfceRRCrtc              *crtc,
@@ -109,9 +126,29 @@ static void             xfce_displays_helper_channel_property_changed       (Xfc
                                                                              const gchar             *property_name,
                                                                              const GValue            *value,
                                                                              XfceDisplaysHelper      *helper);
+static XfceRROutput    *xfce_displays_helper_find_internal                  (XfceDisplaysHelper      *helper);
+static void             xfce_displays_helper_save_crtc                      (XfceRRCrtc              *crtc,
+                                                                             XfceRRCrtcState         *state);
+static void             xfce_displays_helper_restore_crtc                   (XfceRRCrtc              *crtc,
+                                                                             const XfceRRCrtcState   *state);
+static void             xfce_displays_helper_reset_crtcs                    (XfceDisplaysHelper      *helper);
+static gboolean         xfce_displays_helper_prepare_lid_closed             (XfceDisplaysHelper      *helper);
+static gboolean         xfce_displays_helper_prepare_lid_open               (XfceDisplaysHelper      *helper);
+static void             xfce_displays_helper_save_lid_plan                  (XfceDisplaysHelper      *helper,
+                                                                             XfceRRLidPlan           *plan,
+                                                                             gboolean                 apply);
+static void             xfce_displays_helper_clear_lid_plan                 (XfceRRLidPlan           *plan);
+static void             xfce_displays_helper_compute_lid_plans              (XfceDisplaysHelper      *helper);
+static gboolean         xfce_displays_helper_compute_lid_plans_idle         (gpointer                 data);
+static void             xfce_displays_helper_invalidate_lid_plans           (XfceDisplaysHelper      *helper);
 static void             xfce_displays_helper_toggle_internal                (gpointer                *power,
                                                                              gboolean                 lid_is_closed,
                                                                              XfceDisplaysHelper      *helper);
+#ifdef HAVE_UPOWERGLIB
+static void             xfce_displays_helper_lid_changed                    (gpointer                *power,
+                                                                             gboolean                 lid_is_closed,
+                                                                             XfceDisplaysHelper      *helper);
+#endif
 
 
 
@@ -131,6 +168,7 @@ struct _XfceDisplaysHelper
 #ifdef HAS_RANDR_ONE_POINT_THREE
     gint                has_1_3;
     gint                primary;
+    RROutput            cur_primary;
 #endif
 
 #ifdef HAVE_UPOWERGLIB
@@ -138,16 +176,27 @@ struct _XfceDisplaysHelper
     gint                phandler;
 #endif
 
-    GdkDisplay         *display;
-    GdkWindow          *root_window;
-    Display            *xdisplay;
-    gint                event_base;
+    XfceRRBackend      *backend;
+
+    /* timing of the RandR requests, NULL unless debugging */
+    XfceRRTimeline     *timeline;
+
+    XfsdStats          *stats;
 
     /* RandR cache */
     XRRScreenResources *resources;
     GPtrArray          *crtcs;
     GPtrArray          *outputs;
 
+    /* parsed schemes, scheme name -> array of XfceDisplayProfile */
+    GHashTable         *profiles;
+
+    /* internal panel and the configurations to apply on lid events */
+    XfceRROutput       *lvds;
+    XfceRRLidPlan      *lid_open;
+    XfceRRLidPlan      *lid_closed;
+    guint               lid_plans_idle;
+
     /* screen size */
     gint                width;
     gint                height;
@@ -159,6 +208,19 @@ struct _XfceDisplaysHelper
     gint                min_y;
 };
 
+/* configuration of a CRTC as known by the X server */
+struct _XfceRRCrtcState
+{
+    RRMode    mode;
+    Rotation  rotation;
+    gint      width;
+    gint      height;
+    gint      x;
+    gint      y;
+    gint      noutput;
+    RROutput *outputs;
+};
+
 struct _XfceRRCrtc
 {
     RRCrtc    id;
@@ -174,18 +236,84 @@ struct _XfceRRCrtc
     gint      npossible;
     RROutput *possible;
     gint      changed;
+
+    /* what is currently applied, to only send what differs */
+    XfceRRCrtcState current;
 };
 
 struct _XfceRROutput
 {
     RROutput       id;
     XRROutputInfo *info;
+    XfceRRBackend *backend;
     RRMode         preferred_mode;
     guint          active : 1;
+
+    /* input and result of the CRTC assignment */
+    guint          wanted : 1;
+    guint          pinned : 1;
+    RRCrtc         assigned;
+};
+
+/* minimal sequence of operations to reach the target configuration */
+struct _XfceRRPlan
+{
+    guint    n_disable;   /* CRTCs that must be disabled before resizing */
+    guint    n_crtcs;     /* CRTCs to configure */
+    gboolean resize;      /* whether the screen size differs */
+    gboolean primary;     /* whether the primary output differs */
+    gboolean grab;        /* whether clients may see an intermediate state */
+};
+
+/* target configuration of all CRTCs for one lid state */
+struct _XfceRRLidPlan
+{
+    gboolean  valid;      /* FALSE until computed for the current outputs and scheme */
+    gboolean  apply;      /* FALSE if the lid event must be ignored */
+    GArray   *crtcs;      /* XfceRRCrtcState, in the order of helper->crtcs */
+#ifdef HAS_RANDR_ONE_POINT_THREE
+    RROutput  primary;
+#endif
 };
 
+/* settings of one output in a scheme, as saved in xfconf */
+struct _XfceDisplayProfile
+{
+    gchar    *name;
+    gboolean  has_active;
+    gboolean  active;
+    gboolean  primary;
+    gint      rotation;
+    gchar    *reflection;
+    gchar    *resolution;
+    gdouble   refresh_rate;
+    gint      x;
+    gint      y;
+};
+
+/* properties below /<scheme>/<output> and where they end up in the profile */
+typedef struct
+{
+    const gchar *property;
+    GType        type;
+    gsize        offset;
+}
+XfceDisplayProfileKey;
+
+static const XfceDisplayProfileKey profile_keys[] =
+{
+    { "/Active",      G_TYPE_BOOLEAN, G_STRUCT_OFFSET (XfceDisplayProfile, active) },
+    { "/Primary",     G_TYPE_BOOLEAN, G_STRUCT_OFFSET (XfceDisplayProfile, primary) },
+    { "/Rotation",    G_TYPE_INT,     G_STRUCT_OFFSET (XfceDisplayProfile, rotation) },
+    { "/Reflection",  G_TYPE_STRING,  G_STRUCT_OFFSET (XfceDisplayProfile, reflection) },
+    { "/Resolution",  G_TYPE_STRING,  G_STRUCT_OFFSET (XfceDisplayProfile, resolution) },
+    { "/RefreshRate", G_TYPE_DOUBLE,  G_STRUCT_OFFSET (XfceDisplayProfile, refresh_rate) },
+    { "/Position/X",  G_TYPE_INT,     G_STRUCT_OFFSET (XfceDisplayProfile, x) },
+    { "/Position/Y",  G_TYPE_INT,     G_STRUCT_OFFSET (XfceDisplayProfile, y) },
+};
 
-G_DEFINE_TYPE (XfceDisplaysHelper, xfce_displays_helper, G_TYPE_OBJECT);
+
+G_DEFINE_DYNAMIC_TYPE (XfceDisplaysHelper, xfce_displays_helper, G_TYPE_OBJECT);
 
 
 
@@ -201,11 +329,15 @@ xfce_displays_helper_class_init (XfceDisplaysHelperClass *klass)
 
 
 static void
-xfce_displays_helper_init (XfceDisplaysHelper *helper)
+xfce_displays_helper_class_finalize (XfceDisplaysHelperClass *klass)
 {
-    gint major = 0, minor = 0;
-    gint error_base, err;
+}
+
+
 
+static void
+xfce_displays_helper_init (XfceDisplaysHelper *helper)
+{
 #ifdef HAVE_UPOWERGLIB
     helper->power = NULL;
     helper->phandler = 0;
@@ -214,23 +346,32 @@ xfce_displays_helper_init (XfceDisplaysHelper *helper)
     helper->outputs = NULL;
     helper->crtcs = NULL;
     helper->handler = 0;
+    helper->profiles = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+                                              (GDestroyNotify) xfce_displays_helper_free_profiles);
+    helper->lvds = NULL;
+    helper->lid_open = g_new0 (XfceRRLidPlan, 1);
+    helper->lid_closed = g_new0 (XfceRRLidPlan, 1);
+    helper->lid_plans_idle = 0;
+    helper->timeline = xfce_rr_timeline_new ();
+    helper->stats = xfsettings_stats_get ("displays");
+}
 
-    /* get the default display */
-    helper->display = gdk_display_get_default ();
-    helper->xdisplay = gdk_x11_display_get_xdisplay (helper->display);
-    helper->root_window = gdk_get_default_root_window ();
 
-    /* check if the randr extension is running */
-    if (XRRQueryExtension (helper->xdisplay, &helper->event_base, &error_base))
+
+static void
+xfce_displays_helper_setup (XfceDisplaysHelper *helper)
+{
+    gint major = 0, minor = 0;
+    gint err;
+
+    /* check if the randr extension is running and query the version */
+    if (helper->backend->query_version (helper->backend, &major, &minor))
     {
-        /* query the version */
-        if (XRRQueryVersion (helper->xdisplay, &major, &minor)
-            && (major > 1 || (major == 1 && minor >= 2)))
+        if (major > 1 || (major == 1 && minor >= 2))
         {
             gdk_error_trap_push ();
             /* get the screen resource */
-            helper->resources = XRRGetScreenResources (helper->xdisplay,
-                                                       GDK_WINDOW_XID (helper->root_window));
+            helper->resources = helper->backend->get_resources (helper->backend, FALSE);
             gdk_flush ();
             err = gdk_error_trap_pop ();
             if (err)
@@ -243,29 +384,21 @@ xfce_displays_helper_init (XfceDisplaysHelper *helper)
             /* get all existing CRTCs and connected outputs */
             helper->crtcs = xfce_displays_helper_list_crtcs (helper);
             helper->outputs = xfce_displays_helper_list_outputs (helper);
+            helper->lvds = xfce_displays_helper_find_internal (helper);
 
             /* Set up RandR notifications */
-            XRRSelectInput (helper->xdisplay,
-                            GDK_WINDOW_XID (helper->root_window),
-                            RRScreenChangeNotifyMask);
-            gdk_x11_register_standard_event_type (helper->display,
-                                                  helper->event_base,
-                                                  RRNotify + 1);
-            gdk_window_add_filter (helper->root_window,
-                                   xfce_displays_helper_screen_on_event,
+            xfce_rr_backend_watch (helper->backend,
+                                   xfce_displays_helper_screen_changed,
                                    helper);
 
 #ifdef HAVE_UPOWERGLIB
             helper->power = g_object_new (XFCE_TYPE_DISPLAYS_UPOWER, NULL);
             helper->phandler = g_signal_connect (G_OBJECT (helper->power),
                                                  "lid-changed",
-                                                 G_CALLBACK (xfce_displays_helper_toggle_internal),
+                                                 G_CALLBACK (xfce_displays_helper_lid_changed),
                                                  helper);
 #endif
 
-            /* open the channel */
-            helper->channel = xfconf_channel_get ("displays");
-
             /* remove any leftover apply property before setting the monitor */
             xfconf_channel_reset_property (helper->channel, APPLY_SCHEME_PROP, FALSE);
 
@@ -277,9 +410,16 @@ xfce_displays_helper_init (XfceDisplaysHelper *helper)
 
 #ifdef HAS_RANDR_ONE_POINT_THREE
             helper->has_1_3 = (major > 1 || (major == 1 && minor >= 3));
+            if (helper->has_1_3)
+                helper->cur_primary = helper->backend->get_output_primary (helper->backend);
 #endif
             /* restore the default scheme */
+            xfce_rr_timeline_begin (helper->timeline, "apply " DEFAULT_SCHEME_NAME);
             xfce_displays_helper_channel_apply (helper, DEFAULT_SCHEME_NAME);
+            xfce_rr_timeline_finish (helper->timeline);
+
+            /* be ready for the first lid event */
+            xfce_displays_helper_invalidate_lid_plans (helper);
         }
         else
         {
@@ -288,11 +428,6 @@ xfce_displays_helper_init (XfceDisplaysHelper *helper)
                          major, minor);
         }
     }
-    else
-    {
-        g_critical ("No RANDR extension found in display %s. Display settings won't be applied.",
-                    gdk_display_get_name (helper->display));
-    }
 }
 
 
@@ -319,14 +454,20 @@ xfce_displays_helper_dispose (GObject *object)
     }
 #endif
 
-    gdk_window_remove_filter (helper->root_window,
-                              xfce_displays_helper_screen_on_event,
-                              helper);
+    if (helper->backend)
+        xfce_rr_backend_watch (helper->backend, NULL, NULL);
+
+    if (helper->lid_plans_idle != 0)
+    {
+        g_source_remove (helper->lid_plans_idle);
+        helper->lid_plans_idle = 0;
+    }
 
     if (helper->outputs)
     {
         g_ptr_array_unref (helper->outputs);
         helper->outputs = NULL;
+        helper->lvds = NULL;
     }
 
     if (helper->crtcs)
@@ -335,6 +476,12 @@ xfce_displays_helper_dispose (GObject *object)
         helper->crtcs = NULL;
     }
 
+    if (helper->profiles)
+    {
+        g_hash_table_destroy (helper->profiles);
+        helper->profiles = NULL;
+    }
+
     (*G_OBJECT_CLASS (xfce_displays_helper_parent_class)->dispose) (object);
 }
 
@@ -349,12 +496,20 @@ xfce_displays_helper_finalize (GObject *object)
     if (helper->resources)
     {
         gdk_error_trap_push ();
-        XRRFreeScreenResources (helper->resources);
+        helper->backend->free_resources (helper->backend, helper->resources);
         gdk_flush ();
         gdk_error_trap_pop ();
         helper->resources = NULL;
     }
 
+    xfce_rr_backend_free (helper->backend);
+    xfce_rr_timeline_free (helper->timeline);
+
+    xfce_displays_helper_clear_lid_plan (helper->lid_open);
+    xfce_displays_helper_clear_lid_plan (helper->lid_closed);
+    g_free (helper->lid_open);
+    g_free (helper->lid_closed);
+
     (*G_OBJECT_CLASS (xfce_displays_helper_parent_class)->finalize) (object);
 }
 
@@ -363,9 +518,11 @@ xfce_displays_helper_finalize (GObject *object)
 static void
 xfce_displays_helper_reload (XfceDisplaysHelper *helper)
 {
-    gint err;
+    gdouble start;
+    gint    err;
 
     xfsettings_dbg (XFSD_DEBUG_DISPLAYS, "Refreshing RandR cache.");
+    start = xfce_rr_timeline_now (helper->timeline);
 
     /* Free the caches */
     g_ptr_array_unref (helper->outputs);
@@ -374,20 +531,20 @@ xfce_displays_helper_reload (XfceDisplaysHelper *helper)
     gdk_error_trap_push ();
 
     /* Free the screen resources */
-    XRRFreeScreenResources (helper->resources);
+    helper->backend->free_resources (helper->backend, helper->resources);
 
     /* get the screen resource */
 #ifdef HAS_RANDR_ONE_POINT_THREE
     /* xfce_displays_helper_reload () is usually called after a xrandr notification,
        which means that X is aware of the new hardware already. So, if possible,
        do not reprobe the hardware again. */
+    helper->resources = helper->backend->get_resources (helper->backend, helper->has_1_3);
+
     if (helper->has_1_3)
-        helper->resources = XRRGetScreenResourcesCurrent (helper->xdisplay,
-                                                          GDK_WINDOW_XID (helper->root_window));
-    else
+        helper->cur_primary = helper->backend->get_output_primary (helper->backend);
+#else
+    helper->resources = helper->backend->get_resources (helper->backend, FALSE);
 #endif
-    helper->resources = XRRGetScreenResources (helper->xdisplay,
-                                               GDK_WINDOW_XID (helper->root_window));
 
     gdk_flush ();
     err = gdk_error_trap_pop ();
@@ -397,115 +554,114 @@ xfce_displays_helper_reload (XfceDisplaysHelper *helper)
     /* recreate the caches */
     helper->crtcs = xfce_displays_helper_list_crtcs (helper);
     helper->outputs = xfce_displays_helper_list_outputs (helper);
+    helper->lvds = xfce_displays_helper_find_internal (helper);
+
+    xfce_rr_timeline_span (helper->timeline, "reload", 0, start);
+
+    /* the lid plans refer to the old CRTCs and outputs */
+    xfce_displays_helper_invalidate_lid_plans (helper);
 }
 
 
 
-static GdkFilterReturn
-xfce_displays_helper_screen_on_event (GdkXEvent *xevent,
-                                      GdkEvent  *event,
-                                      gpointer   data)
+static void
+xfce_displays_helper_screen_changed (XfceRRBackend *backend,
+                                     gpointer       data)
 {
     XfceDisplaysHelper *helper = XFCE_DISPLAYS_HELPER (data);
     GPtrArray          *old_outputs;
-    XfceRRCrtc         *crtc;
+    XfceRRCrtc         *crtc = NULL;
     XfceRROutput       *output, *o;
-    XEvent             *e = xevent;
-    gint                event_num;
     guint               n, m, nactive = 0;
     gboolean            found = FALSE, changed = FALSE;
+    XfsdStatsMark       mark;
 
-    if (!e)
-        return GDK_FILTER_CONTINUE;
-
-    event_num = e->type - helper->event_base;
-
-    if (event_num == RRScreenChangeNotify)
-    {
-        xfsettings_dbg (XFSD_DEBUG_DISPLAYS, "RRScreenChangeNotify event received.");
+    xfsettings_stats_begin (&mark, G_STRFUNC);
+    xfce_rr_timeline_begin (helper->timeline, "screen change");
 
-        old_outputs = g_ptr_array_ref (helper->outputs);
-        xfce_displays_helper_reload (helper);
+    old_outputs = g_ptr_array_ref (helper->outputs);
+    xfce_displays_helper_reload (helper);
 
-        xfsettings_dbg (XFSD_DEBUG_DISPLAYS, "Noutput: before = %d, after = %d.",
-                        old_outputs->len, helper->outputs->len);
+    xfsettings_trace (XFSD_TRACE_DISPLAYS_SCREEN_CHANGED, old_outputs->len,
+                      helper->outputs->len, 0, 0);
 
-        if (old_outputs->len > helper->outputs->len)
+    if (old_outputs->len > helper->outputs->len)
+    {
+        /* Diff the new and old output list to find removed outputs */
+        for (n = 0; n < old_outputs->len; ++n)
         {
-            /* Diff the new and old output list to find removed outputs */
-            for (n = 0; n < old_outputs->len; ++n)
+            found = FALSE;
+            crtc = NULL;
+            output = g_ptr_array_index (old_outputs, n);
+            for (m = 0; m < helper->outputs->len && !found; ++m)
             {
-                found = FALSE;
-                output = g_ptr_array_index (old_outputs, n);
-                for (m = 0; m < helper->outputs->len && !found; ++m)
-                {
-                    o = g_ptr_array_index (helper->outputs, m);
-                    found = o->id == output->id;
-                }
-                if (!found)
+                o = g_ptr_array_index (helper->outputs, m);
+                found = o->id == output->id;
+            }
+            if (!found)
+            {
+                xfsettings_dbg (XFSD_DEBUG_DISPLAYS, "Output disconnected: %s",
+                                output->info->name);
+                /* force deconfiguring the crtc for the removed output */
+                if (output->info->crtc != None)
+                    crtc = xfce_displays_helper_find_crtc_by_id (helper,
+                                                                 output->info->crtc);
+                if (crtc)
                 {
-                    xfsettings_dbg (XFSD_DEBUG_DISPLAYS, "Output disconnected: %s",
-                                    output->info->name);
-                    /* force deconfiguring the crtc for the removed output */
-                    if (output->info->crtc != None)
-                        crtc = xfce_displays_helper_find_crtc_by_id (helper,
-                                                                     output->info->crtc);
-                    if (crtc)
-                    {
-                        crtc->mode = None;
-                        xfce_displays_helper_disable_crtc (helper, crtc->id);
-                    }
-                    /* if the output was active, we must recalculate the screen size */
-                    changed |= output->active;
+                    crtc->mode = None;
+                    if (xfce_displays_helper_disable_crtc (helper, crtc->id) == RRSetConfigSuccess)
+                        crtc->current.mode = None;
                 }
+                /* if the output was active, we must recalculate the screen size */
+                changed |= output->active;
             }
+        }
 
-            /* Basically, this means the external output was disconnected,
-               so reenable the internal one if needed. */
-            for (n = 0; n < helper->outputs->len; ++n)
-            {
-                output = g_ptr_array_index (helper->outputs, n);
-                if (output->active)
-                    ++nactive;
-            }
-            if (nactive == 0)
-            {
-                xfsettings_dbg (XFSD_DEBUG_DISPLAYS, "No active output anymore! "
-                                "Attempting to re-enable the internal output.");
-                xfce_displays_helper_toggle_internal (NULL, FALSE, helper);
-            }
-            else if (changed)
-                xfce_displays_helper_apply_all (helper);
+        /* Basically, this means the external output was disconnected,
+           so reenable the internal one if needed. */
+        for (n = 0; n < helper->outputs->len; ++n)
+        {
+            output = g_ptr_array_index (helper->outputs, n);
+            if (output->active)
+                ++nactive;
         }
-        else
+        if (nactive == 0)
+        {
+            xfsettings_dbg (XFSD_DEBUG_DISPLAYS, "No active output anymore! "
+                            "Attempting to re-enable the internal output.");
+            xfce_displays_helper_toggle_internal (NULL, FALSE, helper);
+        }
+        else if (changed)
+            xfce_displays_helper_apply_all (helper);
+    }
+    else
+    {
+        /* Diff the new and old output list to find new outputs */
+        for (n = 0; n < helper->outputs->len; ++n)
         {
-            /* Diff the new and old output list to find new outputs */
-            for (n = 0; n < helper->outputs->len; ++n)
+            found = FALSE;
+            output = g_ptr_array_index (helper->outputs, n);
+            for (m = 0; m < old_outputs->len && !found; ++m)
             {
-                found = FALSE;
-                output = g_ptr_array_index (helper->outputs, n);
-                for (m = 0; m < old_outputs->len && !found; ++m)
-                {
-                    o = g_ptr_array_index (old_outputs, m);
-                    found = o->id == output->id;
-                }
-                if (!found)
-                {
-                    xfsettings_dbg (XFSD_DEBUG_DISPLAYS, "New output connected: %s",
-                                    output->info->name);
-                    changed = TRUE;
-                }
+                o = g_ptr_array_index (old_outputs, m);
+                found = o->id == output->id;
+            }
+            if (!found)
+            {
+                xfsettings_dbg (XFSD_DEBUG_DISPLAYS, "New output connected: %s",
+                                output->info->name);
+                changed = TRUE;
             }
-            /* Start the minimal dialog according to the user preferences */
-            if (changed && xfconf_channel_get_bool (helper->channel, NOTIFY_PROP, FALSE))
-                xfce_spawn_command_line_on_screen (NULL, "xfce4-display-settings -m", FALSE,
-                                                   FALSE, NULL);
         }
-        g_ptr_array_unref (old_outputs);
+        /* Start the minimal dialog according to the user preferences */
+        if (changed && xfsettings_prefetch_get_bool (helper->channel, NOTIFY_PROP, FALSE))
+            xfce_spawn_command_line_on_screen (NULL, "xfce4-display-settings -m", FALSE,
+                                               FALSE, NULL);
     }
+    g_ptr_array_unref (old_outputs);
 
-    /* Pass the event on to GTK+ */
-    return GDK_FILTER_CONTINUE;
+    xfce_rr_timeline_finish (helper->timeline);
+    xfsettings_stats_end (helper->stats, XFSD_STATS_EVENT, &mark);
 }
 
 
@@ -513,87 +669,254 @@ xfce_displays_helper_screen_on_event (GdkXEvent *xevent,
 static void
 xfce_displays_helper_set_screen_size (XfceDisplaysHelper *helper)
 {
-    gint min_width, min_height, max_width, max_height;
+    gint    min_width, min_height, max_width, max_height;
+    gint    width, height, mm_width, mm_height;
+    gdouble start;
 
-    g_assert (XFCE_IS_DISPLAYS_HELPER (helper) && helper->xdisplay && helper->resources);
+    g_assert (XFCE_IS_DISPLAYS_HELPER (helper) && helper->backend && helper->resources);
 
     /* get the screen size extremums */
-    if (!XRRGetScreenSizeRange (helper->xdisplay, GDK_WINDOW_XID (helper->root_window),
-                                &min_width, &min_height, &max_width, &max_height))
+    if (!helper->backend->get_screen_size_range (helper->backend, &min_width, &min_height,
+                                                 &max_width, &max_height))
     {
         g_warning ("Unable to get the range of screen sizes. "
                    "Display settings may fail to apply.");
         return;
     }
 
+    helper->backend->get_screen_size (helper->backend, &width, &height, &mm_width, &mm_height);
+
     xfsettings_dbg (XFSD_DEBUG_DISPLAYS, "min_h = %d, min_w = %d, max_h = %d, max_w = %d, "
                     "prev_h = %d, prev_w = %d, prev_hmm = %d, prev_wmm = %d, h = %d, w = %d, "
                     "hmm = %d, wmm = %d.", min_height, min_width, max_height, max_width,
-                    gdk_screen_height (), gdk_screen_width (), gdk_screen_height_mm (),
-                    gdk_screen_width_mm (), helper->height, helper->width, helper->mm_height,
-                    helper->mm_width);
+                    height, width, mm_height, mm_width, helper->height, helper->width,
+                    helper->mm_height, helper->mm_width);
 
     /* set the screen size only if it's really needed and valid */
     if (helper->width >= min_width && helper->width <= max_width
         && helper->height >= min_height && helper->height <= max_height
-        && (helper->width != gdk_screen_width ()
-            || helper->height != gdk_screen_height ()
-            || helper->mm_width != gdk_screen_width_mm ()
-            || helper->mm_height != gdk_screen_height_mm ()))
+        && (helper->width != width
+            || helper->height != height
+            || helper->mm_width != mm_width
+            || helper->mm_height != mm_height))
     {
         xfsettings_dbg (XFSD_DEBUG_DISPLAYS, "Applying desktop dimensions: %dx%d (px), %dx%d (mm).",
                         helper->width, helper->height, helper->mm_width, helper->mm_height);
-        XRRSetScreenSize (helper->xdisplay, GDK_WINDOW_XID (helper->root_window),
-                          helper->width, helper->height, helper->mm_width, helper->mm_height);
+        start = xfce_rr_timeline_now (helper->timeline);
+        helper->backend->set_screen_size (helper->backend, helper->width, helper->height,
+                                          helper->mm_width, helper->mm_height);
+        xfce_rr_timeline_span (helper->timeline, "XRRSetScreenSize", 0, start);
+    }
+}
+
+
+
+static GArray *
+xfce_displays_helper_parse_profiles (XfceDisplaysHelper *helper,
+                                     const gchar        *scheme)
+{
+    GArray             *profiles;
+    GHashTable         *saved_outputs;
+    GHashTable         *indices;
+    GHashTableIter      iter;
+    XfceDisplayProfile *profile;
+    XfceDisplayProfile  empty = { NULL, };
+    gpointer            key, value, idx;
+    const gchar        *path, *slash;
+    gchar              *prefix, *name;
+    gsize               prefix_len;
+    guint               n;
+
+    profiles = g_array_new (FALSE, FALSE, sizeof (XfceDisplayProfile));
+
+    /* the only D-Bus call, everything below works on the returned table */
+    prefix = g_strdup_printf ("/%s", scheme);
+    saved_outputs = xfsettings_prefetch_get_properties (helper->channel, prefix);
+    if (saved_outputs == NULL)
+    {
+        g_free (prefix);
+        return profiles;
+    }
+
+    /* properties look like /<scheme>/<output>[/<key>] */
+    prefix_len = strlen (prefix) + 1;
+    indices = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+    g_hash_table_iter_init (&iter, saved_outputs);
+    while (g_hash_table_iter_next (&iter, &key, &value))
+    {
+        path = key;
+        if (strncmp (path, prefix, prefix_len - 1) != 0 || path[prefix_len - 1] != '/')
+            continue;
+        path += prefix_len;
+
+        slash = strchr (path, '/');
+        name = slash != NULL ? g_strndup (path, slash - path) : g_strdup (path);
+
+        /* find or create the profile of this output */
+        if (g_hash_table_lookup_extended (indices, name, NULL, &idx))
+        {
+            profile = &g_array_index (profiles, XfceDisplayProfile, GPOINTER_TO_UINT (idx));
+            g_free (name);
+        }
+        else
+        {
+            g_hash_table_insert (indices, name, GUINT_TO_POINTER (profiles->len));
+            g_array_append_val (profiles, empty);
+            profile = &g_array_index (profiles, XfceDisplayProfile, profiles->len - 1);
+        }
+
+        if (slash == NULL)
+        {
+            /* the output itself only exists if it holds a string */
+            if (G_VALUE_HOLDS_STRING (value))
+                profile->name = g_strdup (path);
+            continue;
+        }
+
+        for (n = 0; n < G_N_ELEMENTS (profile_keys); n++)
+        {
+            if (strcmp (slash, profile_keys[n].property) != 0)
+                continue;
+
+            if (!G_VALUE_HOLDS (value, profile_keys[n].type))
+                break;
+
+            switch (profile_keys[n].type)
+            {
+                case G_TYPE_BOOLEAN:
+                    G_STRUCT_MEMBER (gboolean, profile, profile_keys[n].offset) = g_value_get_boolean (value);
+                    if (profile_keys[n].offset == G_STRUCT_OFFSET (XfceDisplayProfile, active))
+                        profile->has_active = TRUE;
+                    break;
+
+                case G_TYPE_INT:
+                    G_STRUCT_MEMBER (gint, profile, profile_keys[n].offset) = g_value_get_int (value);
+                    break;
+
+                case G_TYPE_DOUBLE:
+                    G_STRUCT_MEMBER (gdouble, profile, profile_keys[n].offset) = g_value_get_double (value);
+                    break;
+
+                case G_TYPE_STRING:
+                    G_STRUCT_MEMBER (gchar *, profile, profile_keys[n].offset) = g_value_dup_string (value);
+                    break;
+
+                default:
+                    g_assert_not_reached ();
+            }
+            break;
+        }
+    }
+
+    xfsettings_dbg (XFSD_DEBUG_DISPLAYS, "Parsed %d properties of scheme %s into %d profile(s).",
+                    g_hash_table_size (saved_outputs), scheme, profiles->len);
+
+    g_hash_table_destroy (indices);
+    g_hash_table_destroy (saved_outputs);
+    g_free (prefix);
+
+    return profiles;
+}
+
+
+
+static void
+xfce_displays_helper_free_profiles (GArray *profiles)
+{
+    XfceDisplayProfile *profile;
+    guint               n;
+
+    if (profiles == NULL)
+        return;
+
+    for (n = 0; n < profiles->len; ++n)
+    {
+        profile = &g_array_index (profiles, XfceDisplayProfile, n);
+        g_free (profile->name);
+        g_free (profile->reflection);
+        g_free (profile->resolution);
+    }
+
+    g_array_free (profiles, TRUE);
+}
+
+
+
+static GArray *
+xfce_displays_helper_get_profiles (XfceDisplaysHelper *helper,
+                                   const gchar        *scheme)
+{
+    GArray *profiles;
+
+    g_return_val_if_fail (scheme != NULL, NULL);
+
+    profiles = g_hash_table_lookup (helper->profiles, scheme);
+    if (profiles == NULL)
+    {
+        profiles = xfce_displays_helper_parse_profiles (helper, scheme);
+        g_hash_table_insert (helper->profiles, g_strdup (scheme), profiles);
+    }
+    else
+    {
+        xfsettings_dbg (XFSD_DEBUG_DISPLAYS, "Using cached profiles of scheme %s.", scheme);
+    }
+
+    return profiles;
+}
+
+
+
+static const XfceDisplayProfile *
+xfce_displays_helper_find_profile (GArray      *profiles,
+                                   const gchar *name)
+{
+    XfceDisplayProfile *profile;
+    guint               n;
+
+    for (n = 0; n < profiles->len; ++n)
+    {
+        profile = &g_array_index (profiles, XfceDisplayProfile, n);
+        if (g_strcmp0 (profile->name, name) == 0)
+            return profile;
     }
+
+    return NULL;
 }
 
 
 
 static gboolean
 xfce_displays_helper_load_from_xfconf (XfceDisplaysHelper *helper,
-                                       const gchar        *scheme,
-                                       GHashTable         *saved_outputs,
+                                       GArray             *profiles,
                                        XfceRROutput       *output)
 {
-    XfceRRCrtc  *crtc = NULL;
-    GValue      *value;
-    const gchar *str_value;
-    gchar        property[512];
-    gdouble      output_rate, rate;
-    RRMode       valid_mode;
-    Rotation     rot;
-    gint         x, y, n, m, int_value;
-    gboolean     active;
+    const XfceDisplayProfile *profile;
+    XfceRRCrtc               *crtc = NULL;
+    const gchar              *str_value;
+    gdouble                   rate;
+    RRMode                    valid_mode;
+    Rotation                  rot;
+    gint                      n, m;
+    gboolean                  active;
 
     g_assert (XFCE_IS_DISPLAYS_HELPER (helper) && helper->resources && output);
 
     active = output->active;
 
     /* does this output exist in xfconf? */
-    g_snprintf (property, sizeof (property), OUTPUT_FMT, scheme, output->info->name);
-    value = g_hash_table_lookup (saved_outputs, property);
-
-    if (value == NULL || !G_VALUE_HOLDS_STRING (value))
+    profile = xfce_displays_helper_find_profile (profiles, output->info->name);
+    if (profile == NULL)
         return active;
 
 #ifdef HAS_RANDR_ONE_POINT_THREE
-    if (helper->has_1_3)
-    {
-        /* is it the primary output? */
-        g_snprintf (property, sizeof (property), PRIMARY_PROP, scheme,
-                    output->info->name);
-        value = g_hash_table_lookup (saved_outputs, property);
-        if (G_VALUE_HOLDS_BOOLEAN (value) && g_value_get_boolean (value))
-            helper->primary = output->id;
-    }
+    /* is it the primary output? */
+    if (helper->has_1_3 && profile->primary)
+        helper->primary = output->id;
 #endif
 
     /* status */
-    g_snprintf (property, sizeof (property), ACTIVE_PROP, scheme, output->info->name);
-    value = g_hash_table_lookup (saved_outputs, property);
-
-    if (value == NULL || !G_VALUE_HOLDS_BOOLEAN (value))
+    if (!profile->has_active)
         return active;
 
     /* Get the associated CRTC */
@@ -602,7 +925,7 @@ xfce_displays_helper_load_from_xfconf (XfceDisplaysHelper *helper,
         return active;
 
     /* disable inactive outputs */
-    if (!g_value_get_boolean (value))
+    if (!profile->active)
     {
         if (crtc->mode != None)
         {
@@ -617,16 +940,8 @@ xfce_displays_helper_load_from_xfconf (XfceDisplaysHelper *helper,
         return active;
     }
 
-    /* rotation */
-    g_snprintf (property, sizeof (property), ROTATION_PROP, scheme, output->info->name);
-    value = g_hash_table_lookup (saved_outputs, property);
-    if (G_VALUE_HOLDS_INT (value))
-        int_value = g_value_get_int (value);
-    else
-        int_value = 0;
-
     /* convert to a Rotation */
-    switch (int_value)
+    switch (profile->rotation)
     {
         case 90:  rot = RR_Rotate_90;  break;
         case 180: rot = RR_Rotate_180; break;
@@ -634,20 +949,12 @@ xfce_displays_helper_load_from_xfconf (XfceDisplaysHelper *helper,
         default:  rot = RR_Rotate_0;   break;
     }
 
-    /* reflection */
-    g_snprintf (property, sizeof (property), REFLECTION_PROP, scheme, output->info->name);
-    value = g_hash_table_lookup (saved_outputs, property);
-    if (G_VALUE_HOLDS_STRING (value))
-        str_value = g_value_get_string (value);
-    else
-        str_value = "0";
-
-    /* convert to a Rotation */
-    if (g_strcmp0 (str_value, "X") == 0)
+    /* convert the reflection to a Rotation */
+    if (g_strcmp0 (profile->reflection, "X") == 0)
         rot |= RR_Reflect_X;
-    else if (g_strcmp0 (str_value, "Y") == 0)
+    else if (g_strcmp0 (profile->reflection, "Y") == 0)
         rot |= RR_Reflect_Y;
-    else if (g_strcmp0 (str_value, "XY") == 0)
+    else if (g_strcmp0 (profile->reflection, "XY") == 0)
         rot |= (RR_Reflect_X|RR_Reflect_Y);
 
     /* check rotation support */
@@ -665,20 +972,7 @@ xfce_displays_helper_load_from_xfconf (XfceDisplaysHelper *helper,
     }
 
     /* resolution */
-    g_snprintf (property, sizeof (property), RESOLUTION_PROP, scheme, output->info->name);
-    value = g_hash_table_lookup (saved_outputs, property);
-    if (value == NULL || !G_VALUE_HOLDS_STRING (value))
-        str_value = "";
-    else
-        str_value = g_value_get_string (value);
-
-    /* refresh rate */
-    g_snprintf (property, sizeof (property), RRATE_PROP, scheme, output->info->name);
-    value = g_hash_table_lookup (saved_outputs, property);
-    if (G_VALUE_HOLDS_DOUBLE (value))
-        output_rate = g_value_get_double (value);
-    else
-        output_rate = 0.0;
+    str_value = profile->resolution != NULL ? profile->resolution : "";
 
     /* check mode validity */
     valid_mode = None;
@@ -696,7 +990,7 @@ xfce_displays_helper_load_from_xfconf (XfceDisplaysHelper *helper,
                     ((gdouble) helper->resources->modes[m].hTotal * (gdouble) helper->resources->modes[m].vTotal);
 
             /* find the mode corresponding to the saved values */
-            if (rint (rate) == rint (output_rate)
+            if (rint (rate) == rint (profile->refresh_rate)
                 && (g_strcmp0 (helper->resources->modes[m].name, str_value) == 0))
             {
                 valid_mode = helper->resources->modes[m].id;
@@ -712,7 +1006,7 @@ xfce_displays_helper_load_from_xfconf (XfceDisplaysHelper *helper,
     {
         /* unsupported mode, abort for this output */
         g_warning ("Unknown mode '%s @ %.1f' for output %s, aborting.",
-                   str_value, output_rate, output->info->name);
+                   str_value, profile->refresh_rate, output->info->name);
         return active;
     }
     else if (crtc->mode != valid_mode)
@@ -737,29 +1031,11 @@ xfce_displays_helper_load_from_xfconf (XfceDisplaysHelper *helper,
         crtc->height = helper->resources->modes[m].height;
     }
 
-    /* position, x */
-    g_snprintf (property, sizeof (property), POSX_PROP, scheme,
-                output->info->name);
-    value = g_hash_table_lookup (saved_outputs, property);
-    if (G_VALUE_HOLDS_INT (value))
-        x = g_value_get_int (value);
-    else
-        x = 0;
-
-    /* position, y */
-    g_snprintf (property, sizeof (property), POSY_PROP, scheme,
-                output->info->name);
-    value = g_hash_table_lookup (saved_outputs, property);
-    if (G_VALUE_HOLDS_INT (value))
-        y = g_value_get_int (value);
-    else
-        y = 0;
-
     /* update CRTC position */
-    if (crtc->x != x || crtc->y != y)
+    if (crtc->x != profile->x || crtc->y != profile->y)
     {
-        crtc->x = x;
-        crtc->y = y;
+        crtc->x = profile->x;
+        crtc->y = profile->y;
         crtc->changed = TRUE;
     }
 
@@ -778,8 +1054,12 @@ xfce_displays_helper_list_outputs (XfceDisplaysHelper *helper)
     XfceRROutput  *output;
     XfceRRCrtc    *crtc;
     gint           best_dist, dist, n, m, l, err;
+    gint           width, height, mm_width, mm_height;
+    gdouble        start;
+
+    g_assert (XFCE_IS_DISPLAYS_HELPER (helper) && helper->backend && helper->resources);
 
-    g_assert (XFCE_IS_DISPLAYS_HELPER (helper) && helper->xdisplay && helper->resources);
+    helper->backend->get_screen_size (helper->backend, &width, &height, &mm_width, &mm_height);
 
     outputs = g_ptr_array_new ();
 
@@ -787,10 +1067,14 @@ xfce_displays_helper_list_outputs (XfceDisplaysHelper *helper)
     outputs = g_ptr_array_new_with_free_func ((GDestroyNotify) xfce_displays_helper_free_output);
     for (n = 0; n < helper->resources->noutput; ++n)
     {
+        start = xfce_rr_timeline_now (helper->timeline);
         gdk_error_trap_push ();
-        output_info = XRRGetOutputInfo (helper->xdisplay, helper->resources, helper->resources->outputs[n]);
+        output_info = helper->backend->get_output_info (helper->backend, helper->resources,
+                                                        helper->resources->outputs[n]);
         gdk_flush ();
         err = gdk_error_trap_pop ();
+        xfce_rr_timeline_span (helper->timeline, "XRRGetOutputInfo",
+                               helper->resources->outputs[n], start);
         if (err || !output_info)
         {
             g_warning ("Failed to load info for output %lu (err: %d). Skipping.",
@@ -800,13 +1084,14 @@ xfce_displays_helper_list_outputs (XfceDisplaysHelper *helper)
 
         if (output_info->connection != RR_Connected)
         {
-            XRRFreeOutputInfo (output_info);
+            helper->backend->free_output_info (helper->backend, output_info);
             continue;
         }
 
         output = g_new0 (XfceRROutput, 1);
         output->id = helper->resources->outputs[n];
         output->info = output_info;
+        output->backend = helper->backend;
 
         /* find the preferred mode */
         output->preferred_mode = None;
@@ -823,10 +1108,10 @@ xfce_displays_helper_list_outputs (XfceDisplaysHelper *helper)
                 if (l < output->info->npreferred)
                     dist = 0;
                 else if (output->info->mm_height != 0)
-                    dist = (1000 * gdk_screen_height () / gdk_screen_height_mm () -
+                    dist = (1000 * height / mm_height -
                             1000 * helper->resources->modes[m].height / output->info->mm_height);
                 else
-                    dist = gdk_screen_height () - helper->resources->modes[m].height;
+                    dist = height - helper->resources->modes[m].height;
 
                 dist = ABS (dist);
 
@@ -861,7 +1146,7 @@ xfce_displays_helper_free_output (XfceRROutput *output)
         return;
 
     gdk_error_trap_push ();
-    XRRFreeOutputInfo (output->info);
+    output->backend->free_output_info (output->backend, output->info);
     gdk_flush ();
     gdk_error_trap_pop ();
 
@@ -878,7 +1163,7 @@ xfce_displays_helper_list_crtcs (XfceDisplaysHelper *helper)
     XfceRRCrtc  *crtc;
     gint         n, err;
 
-    g_assert (XFCE_IS_DISPLAYS_HELPER (helper) && helper->xdisplay && helper->resources);
+    g_assert (XFCE_IS_DISPLAYS_HELPER (helper) && helper->backend && helper->resources);
 
     /* get all existing CRTCs */
     crtcs = g_ptr_array_new_with_free_func ((GDestroyNotify) xfce_displays_helper_free_crtc);
@@ -887,7 +1172,8 @@ xfce_displays_helper_list_crtcs (XfceDisplaysHelper *helper)
         xfsettings_dbg (XFSD_DEBUG_DISPLAYS, "Detected CRTC %lu.", helper->resources->crtcs[n]);
 
         gdk_error_trap_push ();
-        crtc_info = XRRGetCrtcInfo (helper->xdisplay, helper->resources, helper->resources->crtcs[n]);
+        crtc_info = helper->backend->get_crtc_info (helper->backend, helper->resources,
+                                                    helper->resources->crtcs[n]);
         gdk_flush ();
         err = gdk_error_trap_pop ();
         if (err || !crtc_info)
@@ -920,7 +1206,20 @@ xfce_displays_helper_list_crtcs (XfceDisplaysHelper *helper)
                                        crtc_info->npossible * sizeof (RROutput));
 
         crtc->changed = FALSE;
-        XRRFreeCrtcInfo (crtc_info);
+        helper->backend->free_crtc_info (helper->backend, crtc_info);
+
+        /* remember what the server has */
+        crtc->current.mode = crtc->mode;
+        crtc->current.rotation = crtc->rotation;
+        crtc->current.width = crtc->width;
+        crtc->current.height = crtc->height;
+        crtc->current.x = crtc->x;
+        crtc->current.y = crtc->y;
+        crtc->current.noutput = crtc->noutput;
+        crtc->current.outputs = NULL;
+        if (crtc->noutput > 0)
+            crtc->current.outputs = g_memdup (crtc->outputs,
+                                              crtc->noutput * sizeof (RROutput));
 
         /* cache it */
         g_ptr_array_add (crtcs, crtc);
@@ -962,87 +1261,407 @@ xfce_displays_helper_free_crtc (XfceRRCrtc *crtc)
         g_free (crtc->outputs);
     if (crtc->possible != NULL)
         g_free (crtc->possible);
+    if (crtc->current.outputs != NULL)
+        g_free (crtc->current.outputs);
     g_free (crtc);
 }
 
 
 
-static XfceRRCrtc *
-xfce_displays_helper_find_usable_crtc (XfceDisplaysHelper *helper,
-                                       XfceRROutput       *output)
+static void
+xfce_displays_helper_want_crtcs (XfceDisplaysHelper *helper,
+                                 GArray             *profiles)
 {
-    XfceRRCrtc *crtc = NULL;
-    guint       n;
-    gint        m;
-    gboolean    found = FALSE;
+    const XfceDisplayProfile *profile;
+    XfceRROutput             *output;
+    guint                     n;
 
-    g_assert (XFCE_IS_DISPLAYS_HELPER (helper) && helper->crtcs && output);
+    g_assert (XFCE_IS_DISPLAYS_HELPER (helper) && helper->outputs);
 
-    if (output->info->crtc != None)
+    /* an output needs a CRTC if it will be active after applying */
+    for (n = 0; n < helper->outputs->len; ++n)
     {
-        crtc = xfce_displays_helper_find_crtc_by_id (helper, output->info->crtc);
-        found = crtc != NULL;
-    }
+        output = g_ptr_array_index (helper->outputs, n);
 
-    /* try to find one that is not already used by another output */
-    for (n = 0; n < helper->crtcs->len && !found; ++n)
-    {
-        crtc = g_ptr_array_index (helper->crtcs, n);
-        if (crtc->noutput > 0 || crtc->changed)
-            continue;
+        profile = NULL;
+        if (profiles != NULL)
+            profile = xfce_displays_helper_find_profile (profiles, output->info->name);
 
-        for (m = 0; m < crtc->npossible; ++m)
+        if (profile != NULL && profile->has_active)
         {
-            if (crtc->possible[m] == output->id)
-            {
-                found = TRUE;
-                break;
-            }
+            output->wanted = profile->active;
+            output->pinned = FALSE;
+        }
+        else
+        {
+            /* nothing will reconfigure it, so it cannot move */
+            output->wanted = output->active;
+            output->pinned = TRUE;
         }
     }
-
-    if (found)
-        xfsettings_dbg (XFSD_DEBUG_DISPLAYS, "CRTC %lu assigned to %s.", crtc->id,
-                        output->info->name);
-    else
-        g_warning ("No available CRTC for %s.", output->info->name);
-
-    return crtc;
 }
 
 
 
-static void
-xfce_displays_helper_get_topleftmost_pos (XfceRRCrtc         *crtc,
-                                          XfceDisplaysHelper *helper)
+#define COST_IMPOSSIBLE 1000
+
+static gint
+xfce_displays_helper_assignment_cost (XfceRROutput *output,
+                                      XfceRRCrtc   *crtc)
 {
-    g_assert (XFCE_IS_DISPLAYS_HELPER (helper) && crtc);
+    gint m;
 
-    if (crtc->mode == None)
-        return;
+    for (m = 0; m < crtc->npossible; ++m)
+    {
+        if (crtc->possible[m] != output->id)
+            continue;
 
-    /* used to normalize positions later */
-    helper->min_x = MIN (helper->min_x, crtc->x);
-    helper->min_y = MIN (helper->min_y, crtc->y);
+        /* keeping the current CRTC avoids a mode set */
+        if (output->info->crtc == crtc->id)
+            return 0;
+
+        if (output->pinned && output->info->crtc != None)
+            break;
+
+        /* prefer idle CRTCs over the ones of outputs being disabled */
+        return crtc->noutput == 0 ? 1 : 2;
+    }
+
+    return COST_IMPOSSIBLE;
 }
 
 
 
 static void
-xfce_displays_helper_normalize_crtc (XfceRRCrtc         *crtc,
-                                     XfceDisplaysHelper *helper)
+xfce_displays_helper_assign_crtcs (XfceDisplaysHelper *helper)
 {
-    g_assert (XFCE_IS_DISPLAYS_HELPER (helper) && crtc);
+    XfceRROutput  *output;
+    XfceRRCrtc    *crtc;
+    XfceRROutput **rows;
+    gint          *cost, *u, *v, *p, *way, *minv;
+    gboolean      *used, keep;
+    guint          n_rows, n_cols, size, i, j, i0, j0, j1, n;
+    gint           cur, delta, m;
 
-    /* ignore disabled outputs for size computations */
-    if (crtc->mode == None)
-        return;
+    g_assert (XFCE_IS_DISPLAYS_HELPER (helper) && helper->outputs && helper->crtcs);
 
-    /* normalize positions to ensure the upper left corner is at (0,0) */
-    if (helper->min_x || helper->min_y)
+    /* the outputs that need a CRTC are the rows, the CRTCs the columns */
+    rows = g_new0 (XfceRROutput *, helper->outputs->len + 1);
+    n_rows = 0;
+    for (n = 0; n < helper->outputs->len; ++n)
     {
-        crtc->x -= helper->min_x;
-        crtc->y -= helper->min_y;
+        output = g_ptr_array_index (helper->outputs, n);
+        output->assigned = None;
+        if (output->wanted)
+            rows[n_rows++] = output;
+    }
+
+    n_cols = helper->crtcs->len;
+    size = MAX (n_rows, n_cols);
+    if (n_rows == 0 || n_cols == 0)
+    {
+        g_free (rows);
+        return;
+    }
+
+    /* square cost matrix, 1-based, padded with impossible pairs so the
+     * number of real assignments is maximized before their total cost */
+    cost = g_new0 (gint, (size + 1) * (size + 1));
+    for (i = 1; i <= size; ++i)
+    {
+        for (j = 1; j <= size; ++j)
+        {
+            if (i <= n_rows && j <= n_cols)
+                cost[i * (size + 1) + j] =
+                    xfce_displays_helper_assignment_cost (rows[i - 1],
+                                                          g_ptr_array_index (helper->crtcs, j - 1));
+            else
+                cost[i * (size + 1) + j] = COST_IMPOSSIBLE;
+        }
+    }
+
+    /* Hungarian method with potentials, p[j] is the row matched to column j */
+    u = g_new0 (gint, size + 1);
+    v = g_new0 (gint, size + 1);
+    p = g_new0 (gint, size + 1);
+    way = g_new0 (gint, size + 1);
+    minv = g_new0 (gint, size + 1);
+    used = g_new0 (gboolean, size + 1);
+
+    for (i = 1; i <= size; ++i)
+    {
+        p[0] = i;
+        j0 = 0;
+        for (j = 0; j <= size; ++j)
+        {
+            minv[j] = G_MAXINT;
+            used[j] = FALSE;
+        }
+
+        do
+        {
+            used[j0] = TRUE;
+            i0 = p[j0];
+            delta = G_MAXINT;
+            j1 = 0;
+
+            for (j = 1; j <= size; ++j)
+            {
+                if (used[j])
+                    continue;
+
+                cur = cost[i0 * (size + 1) + j] - u[i0] - v[j];
+                if (cur < minv[j])
+                {
+                    minv[j] = cur;
+                    way[j] = j0;
+                }
+                if (minv[j] < delta)
+                {
+                    delta = minv[j];
+                    j1 = j;
+                }
+            }
+
+            for (j = 0; j <= size; ++j)
+            {
+                if (used[j])
+                {
+                    u[p[j]] += delta;
+                    v[j] -= delta;
+                }
+                else
+                {
+                    minv[j] -= delta;
+                }
+            }
+
+            j0 = j1;
+        }
+        while (p[j0] != 0);
+
+        do
+        {
+            j1 = way[j0];
+            p[j0] = p[j1];
+            j0 = j1;
+        }
+        while (j0 != 0);
+    }
+
+    for (j = 1; j <= n_cols; ++j)
+    {
+        i = p[j];
+        if (i == 0 || i > n_rows || cost[i * (size + 1) + j] == COST_IMPOSSIBLE)
+            continue;
+
+        output = rows[i - 1];
+        crtc = g_ptr_array_index (helper->crtcs, j - 1);
+        output->assigned = crtc->id;
+
+        xfsettings_dbg (XFSD_DEBUG_DISPLAYS, "CRTC %lu assigned to %s%s.", crtc->id,
+                        output->info->name, output->info->crtc == crtc->id ? " (kept)" : "");
+
+        /* the CRTC changes hands, start from a disabled CRTC so nothing
+         * of the previous output is sent if its new output fails to load */
+        keep = FALSE;
+        for (m = 0; m < crtc->noutput; ++m)
+            keep |= crtc->outputs[m] == output->id;
+        if (!keep && crtc->noutput > 0)
+        {
+            crtc->mode = None;
+            crtc->noutput = 0;
+            crtc->changed = TRUE;
+        }
+    }
+
+    /* CRTCs whose output moved somewhere else are not used anymore */
+    for (n = 0; n < helper->outputs->len; ++n)
+    {
+        output = g_ptr_array_index (helper->outputs, n);
+        if (!output->wanted)
+            continue;
+
+        if (output->assigned == None)
+            g_warning ("No available CRTC for %s.", output->info->name);
+
+        if (output->info->crtc == None || output->info->crtc == output->assigned)
+            continue;
+
+        crtc = xfce_displays_helper_find_crtc_by_id (helper, output->info->crtc);
+        keep = FALSE;
+        for (i = 0; crtc != NULL && i < n_rows && !keep; ++i)
+            keep = rows[i]->assigned == crtc->id;
+        if (crtc != NULL && !keep)
+        {
+            crtc->mode = None;
+            crtc->noutput = 0;
+            crtc->changed = TRUE;
+        }
+    }
+
+    g_free (rows);
+    g_free (cost);
+    g_free (u);
+    g_free (v);
+    g_free (p);
+    g_free (way);
+    g_free (minv);
+    g_free (used);
+}
+
+
+
+static XfceRRCrtc *
+xfce_displays_helper_find_usable_crtc (XfceDisplaysHelper *helper,
+                                       XfceRROutput       *output)
+{
+    XfceRROutput *o;
+    XfceRRCrtc   *crtc = NULL;
+    guint         n;
+
+    g_assert (XFCE_IS_DISPLAYS_HELPER (helper) && helper->crtcs && output);
+
+    /* outputs that will be active got their CRTC from the solver */
+    if (output->assigned != None)
+        return xfce_displays_helper_find_crtc_by_id (helper, output->assigned);
+
+    /* the others only need their current CRTC, to disable it, as long
+     * as it was not handed to another output */
+    if (!output->wanted && output->info->crtc != None)
+    {
+        crtc = xfce_displays_helper_find_crtc_by_id (helper, output->info->crtc);
+        for (n = 0; crtc != NULL && n < helper->outputs->len; ++n)
+        {
+            o = g_ptr_array_index (helper->outputs, n);
+            if (o != output && o->assigned == crtc->id)
+                crtc = NULL;
+        }
+    }
+
+    if (crtc == NULL)
+        xfsettings_dbg (XFSD_DEBUG_DISPLAYS, "No usable CRTC for %s.", output->info->name);
+
+    return crtc;
+}
+
+
+
+static gboolean
+xfce_displays_helper_crtc_differs (XfceRRCrtc *crtc)
+{
+    g_assert (crtc);
+
+    /* disabled on both sides, whatever the rest says */
+    if (crtc->mode == None && crtc->current.mode == None)
+        return FALSE;
+
+    if (crtc->mode != crtc->current.mode
+        || crtc->rotation != crtc->current.rotation
+        || crtc->x != crtc->current.x
+        || crtc->y != crtc->current.y
+        || crtc->noutput != crtc->current.noutput)
+        return TRUE;
+
+    return crtc->noutput > 0
+           && memcmp (crtc->outputs, crtc->current.outputs,
+                      crtc->noutput * sizeof (RROutput)) != 0;
+}
+
+
+
+static gboolean
+xfce_displays_helper_crtc_fits (XfceRRCrtc         *crtc,
+                                XfceDisplaysHelper *helper)
+{
+    g_assert (XFCE_IS_DISPLAYS_HELPER (helper) && crtc);
+
+    /* does the current configuration fit in the new screen? */
+    return crtc->current.mode == None
+           || (crtc->current.x + crtc->current.width <= helper->width
+               && crtc->current.y + crtc->current.height <= helper->height);
+}
+
+
+
+static void
+xfce_displays_helper_plan (XfceDisplaysHelper *helper,
+                           XfceRRPlan         *plan)
+{
+    XfceRRCrtc *crtc;
+    guint       n;
+    gint        width, height, mm_width, mm_height;
+
+    g_assert (XFCE_IS_DISPLAYS_HELPER (helper) && helper->crtcs && plan);
+
+    memset (plan, 0, sizeof (*plan));
+
+    helper->backend->get_screen_size (helper->backend, &width, &height, &mm_width, &mm_height);
+    plan->resize = (helper->width != width
+                    || helper->height != height
+                    || helper->mm_width != mm_width
+                    || helper->mm_height != mm_height);
+
+    for (n = 0; n < helper->crtcs->len; ++n)
+    {
+        crtc = g_ptr_array_index (helper->crtcs, n);
+
+        /* only keep the changed flag where the server really differs */
+        crtc->changed = xfce_displays_helper_crtc_differs (crtc);
+        if (crtc->changed)
+            plan->n_crtcs++;
+
+        if (plan->resize && !xfce_displays_helper_crtc_fits (crtc, helper))
+            plan->n_disable++;
+    }
+
+#ifdef HAS_RANDR_ONE_POINT_THREE
+    plan->primary = helper->has_1_3 && (RROutput) helper->primary != helper->cur_primary;
+#endif
+
+    /* a single request is atomic, no need to freeze the other clients */
+    plan->grab = plan->n_disable > 0 || plan->resize
+                 || plan->n_crtcs + (plan->primary ? 1 : 0) > 1;
+
+    xfsettings_dbg (XFSD_DEBUG_DISPLAYS, "Apply plan: %d CRTC(s) to configure, %d to disable first, "
+                    "resize = %s, primary = %s, grab = %s.", plan->n_crtcs, plan->n_disable,
+                    plan->resize ? "yes" : "no", plan->primary ? "yes" : "no",
+                    plan->grab ? "yes" : "no");
+}
+
+
+
+static void
+xfce_displays_helper_get_topleftmost_pos (XfceRRCrtc         *crtc,
+                                          XfceDisplaysHelper *helper)
+{
+    g_assert (XFCE_IS_DISPLAYS_HELPER (helper) && crtc);
+
+    if (crtc->mode == None)
+        return;
+
+    /* used to normalize positions later */
+    helper->min_x = MIN (helper->min_x, crtc->x);
+    helper->min_y = MIN (helper->min_y, crtc->y);
+}
+
+
+
+static void
+xfce_displays_helper_normalize_crtc (XfceRRCrtc         *crtc,
+                                     XfceDisplaysHelper *helper)
+{
+    g_assert (XFCE_IS_DISPLAYS_HELPER (helper) && crtc);
+
+    /* ignore disabled outputs for size computations */
+    if (crtc->mode == None)
+        return;
+
+    /* normalize positions to ensure the upper left corner is at (0,0) */
+    if (helper->min_x || helper->min_y)
+    {
+        crtc->x -= helper->min_x;
+        crtc->y -= helper->min_y;
         crtc->changed = TRUE;
     }
 
@@ -1069,12 +1688,19 @@ static Status
 xfce_displays_helper_disable_crtc (XfceDisplaysHelper *helper,
                                    RRCrtc              crtc)
 {
-    g_assert (XFCE_IS_DISPLAYS_HELPER (helper) && helper->xdisplay && helper->resources);
+    Status  ret;
+    gdouble start;
+
+    g_assert (XFCE_IS_DISPLAYS_HELPER (helper) && helper->backend && helper->resources);
 
     xfsettings_dbg (XFSD_DEBUG_DISPLAYS, "Disabling CRTC %lu.", crtc);
 
-    return XRRSetCrtcConfig (helper->xdisplay, helper->resources, crtc,
-                             CurrentTime, 0, 0, None, RR_Rotate_0, NULL, 0);
+    start = xfce_rr_timeline_now (helper->timeline);
+    ret = helper->backend->set_crtc_config (helper->backend, helper->resources, crtc,
+                                            0, 0, None, RR_Rotate_0, NULL, 0);
+    xfce_rr_timeline_span (helper->timeline, "XRRSetCrtcConfig", crtc, start);
+
+    return ret;
 }
 
 
@@ -1083,24 +1709,22 @@ static void
 xfce_displays_helper_workaround_crtc_size (XfceRRCrtc         *crtc,
                                            XfceDisplaysHelper *helper)
 {
-    XRRCrtcInfo *crtc_info;
-
-    g_assert (XFCE_IS_DISPLAYS_HELPER (helper) && helper->xdisplay && helper->resources && crtc);
+    g_assert (XFCE_IS_DISPLAYS_HELPER (helper) && helper->backend && helper->resources && crtc);
 
     /* The CRTC needs to be disabled if its previous mode won't fit in the new screen.
        It will be reenabled with its new mode (known to fit) after the screen size is
        changed, unless the user disabled it (no need to reenable it then). */
-    crtc_info = XRRGetCrtcInfo (helper->xdisplay, helper->resources, crtc->id);
-    if ((crtc_info->x + crtc_info->width > (guint) helper->width) ||
-        (crtc_info->y + crtc_info->height > (guint) helper->height))
+    if (!xfce_displays_helper_crtc_fits (crtc, helper))
     {
         xfsettings_dbg (XFSD_DEBUG_DISPLAYS, "CRTC %lu must be temporarily disabled.", crtc->id);
         if (xfce_displays_helper_disable_crtc (helper, crtc->id) == RRSetConfigSuccess)
+        {
+            crtc->current.mode = None;
             crtc->changed = (crtc->mode != None);
+        }
         else
             g_warning ("Failed to temporarily disable CRTC %lu.", crtc->id);
     }
-    XRRFreeCrtcInfo (crtc_info);
 }
 
 
@@ -1109,9 +1733,10 @@ static void
 xfce_displays_helper_apply_crtc (XfceRRCrtc         *crtc,
                                  XfceDisplaysHelper *helper)
 {
-    Status ret;
+    Status  ret;
+    gdouble start;
 
-    g_assert (XFCE_IS_DISPLAYS_HELPER (helper) && helper->xdisplay && helper->resources && crtc);
+    g_assert (XFCE_IS_DISPLAYS_HELPER (helper) && helper->backend && helper->resources && crtc);
 
     xfsettings_dbg (XFSD_DEBUG_DISPLAYS, "Configuring CRTC %lu.", crtc->id);
 
@@ -1123,12 +1748,32 @@ xfce_displays_helper_apply_crtc (XfceRRCrtc         *crtc,
         if (crtc->mode == None)
             ret = xfce_displays_helper_disable_crtc (helper, crtc->id);
         else
-            ret = XRRSetCrtcConfig (helper->xdisplay, helper->resources, crtc->id,
-                                    CurrentTime, crtc->x, crtc->y, crtc->mode,
-                                    crtc->rotation, crtc->outputs, crtc->noutput);
+        {
+            start = xfce_rr_timeline_now (helper->timeline);
+            ret = helper->backend->set_crtc_config (helper->backend, helper->resources, crtc->id,
+                                                    crtc->x, crtc->y, crtc->mode,
+                                                    crtc->rotation, crtc->outputs, crtc->noutput);
+            xfce_rr_timeline_span (helper->timeline, "XRRSetCrtcConfig", crtc->id, start);
+        }
 
         if (ret == RRSetConfigSuccess)
+        {
             crtc->changed = FALSE;
+
+            /* the server now has the new configuration */
+            crtc->current.mode = crtc->mode;
+            crtc->current.rotation = crtc->rotation;
+            crtc->current.width = crtc->width;
+            crtc->current.height = crtc->height;
+            crtc->current.x = crtc->x;
+            crtc->current.y = crtc->y;
+            crtc->current.noutput = crtc->mode != None ? crtc->noutput : 0;
+            g_free (crtc->current.outputs);
+            crtc->current.outputs = NULL;
+            if (crtc->current.noutput > 0)
+                crtc->current.outputs = g_memdup (crtc->outputs,
+                                                  crtc->noutput * sizeof (RROutput));
+        }
         else
             g_warning ("Failed to configure CRTC %lu.", crtc->id);
     }
@@ -1175,39 +1820,82 @@ xfce_displays_helper_set_outputs (XfceRRCrtc   *crtc,
 static void
 xfce_displays_helper_apply_all (XfceDisplaysHelper *helper)
 {
+    XfceRRPlan  plan;
+    GTimer     *blanked = NULL;
+    gdouble     start, grabbed = 0.0;
+
     g_assert (XFCE_IS_DISPLAYS_HELPER (helper) && helper->crtcs);
 
     helper->mm_width = helper->mm_height = helper->width = helper->height = 0;
     helper->min_x = helper->min_y = 32768;
 
     /* normalization and screen size calculation */
+    start = xfce_rr_timeline_now (helper->timeline);
     g_ptr_array_foreach (helper->crtcs, (GFunc) xfce_displays_helper_get_topleftmost_pos, helper);
     g_ptr_array_foreach (helper->crtcs, (GFunc) xfce_displays_helper_normalize_crtc, helper);
+    xfce_rr_timeline_span (helper->timeline, "normalize", 0, start);
+
+    /* compare with what the server has */
+    xfce_displays_helper_plan (helper, &plan);
+    if (plan.n_crtcs == 0 && !plan.resize && !plan.primary)
+    {
+        xfsettings_dbg (XFSD_DEBUG_DISPLAYS, "Configuration unchanged, nothing to apply.");
+        return;
+    }
 
     gdk_error_trap_push ();
 
     /* grab server to prevent clients from thinking no output is enabled */
-    gdk_x11_display_grab (helper->display);
+    if (plan.grab)
+    {
+        grabbed = xfce_rr_timeline_now (helper->timeline);
+        helper->backend->grab (helper->backend);
+    }
 
-    /* disable CRTCs that won't fit in the new screen */
-    g_ptr_array_foreach (helper->crtcs, (GFunc) xfce_displays_helper_workaround_crtc_size, helper);
+    if (plan.resize)
+    {
+        /* disable CRTCs that won't fit in the new screen */
+        if (plan.n_disable > 0)
+        {
+            blanked = g_timer_new ();
+            start = xfce_rr_timeline_now (helper->timeline);
+            g_ptr_array_foreach (helper->crtcs, (GFunc) xfce_displays_helper_workaround_crtc_size, helper);
+            xfce_rr_timeline_span (helper->timeline, "workaround", 0, start);
+        }
 
-    /* set the screen size only if it's really needed and valid */
-    xfce_displays_helper_set_screen_size (helper);
+        /* set the screen size only if it's really needed and valid */
+        xfce_displays_helper_set_screen_size (helper);
+    }
 
     /* final loop, apply crtc changes */
     g_ptr_array_foreach (helper->crtcs, (GFunc) xfce_displays_helper_apply_crtc, helper);
 
 #ifdef HAS_RANDR_ONE_POINT_THREE
-        if (helper->has_1_3)
-            XRRSetOutputPrimary (helper->xdisplay, GDK_WINDOW_XID (helper->root_window),
-                                 helper->primary);
+    if (plan.primary)
+    {
+        helper->backend->set_output_primary (helper->backend, helper->primary);
+        helper->cur_primary = helper->primary;
+    }
 #endif
 
     /* release the grab, changes are done */
-    gdk_x11_display_ungrab (helper->display);
+    if (plan.grab)
+    {
+        helper->backend->ungrab (helper->backend);
+        xfce_rr_timeline_span (helper->timeline, "grab", 0, grabbed);
+    }
     gdk_flush ();
     gdk_error_trap_pop ();
+
+    if (blanked != NULL)
+    {
+        xfsettings_dbg (XFSD_DEBUG_DISPLAYS, "%d CRTC(s) were blanked for %.1f ms.",
+                        plan.n_disable, g_timer_elapsed (blanked, NULL) * 1000.0);
+        g_timer_destroy (blanked);
+    }
+
+    /* the lid plans were computed from the previous configuration */
+    xfce_displays_helper_invalidate_lid_plans (helper);
 }
 
 
@@ -1216,31 +1904,35 @@ static void
 xfce_displays_helper_channel_apply (XfceDisplaysHelper *helper,
                                     const gchar        *scheme)
 {
-    gchar       property[512];
-    guint       n, nactive;
-    GHashTable *saved_outputs;
+    guint         n, nactive;
+    GArray       *profiles;
+    XfceRROutput *output;
+    gdouble       start;
 
-    saved_outputs = NULL;
 #ifdef HAS_RANDR_ONE_POINT_THREE
     helper->primary = None;
 #endif
 
-    /* finally the list of saved outputs from xfconf */
-    g_snprintf (property, sizeof (property), "/%s", scheme);
-    saved_outputs = xfconf_channel_get_properties (helper->channel, property);
+    /* finally the list of saved outputs, parsed once per scheme */
+    profiles = xfce_displays_helper_get_profiles (helper, scheme);
 
     /* nothing saved, nothing to do */
-    if (saved_outputs == NULL)
-        goto err_cleanup;
+    if (profiles->len == 0)
+        return;
+
+    /* assign CRTCs to all outputs at once */
+    xfce_displays_helper_want_crtcs (helper, profiles);
+    xfce_displays_helper_assign_crtcs (helper);
 
     /* first loop, loads all the outputs, and gets the number of active ones */
     nactive = 0;
     for (n = 0; n < helper->outputs->len; ++n)
     {
-        if (xfce_displays_helper_load_from_xfconf (helper, scheme, saved_outputs,
-                                                   g_ptr_array_index (helper->outputs,
-                                                                      n)))
+        output = g_ptr_array_index (helper->outputs, n);
+        start = xfce_rr_timeline_now (helper->timeline);
+        if (xfce_displays_helper_load_from_xfconf (helper, profiles, output))
             ++nactive;
+        xfce_rr_timeline_span (helper->timeline, "load_from_xfconf", output->id, start);
     }
 
     xfsettings_dbg (XFSD_DEBUG_DISPLAYS, "Total %d active output(s).", nactive);
@@ -1249,16 +1941,11 @@ xfce_displays_helper_channel_apply (XfceDisplaysHelper *helper,
     if (nactive == 0)
     {
         g_critical ("Stored Xfconf properties disable all outputs, aborting.");
-        goto err_cleanup;
+        return;
     }
 
     /* apply settings */
     xfce_displays_helper_apply_all (helper);
-
-err_cleanup:
-    /* Free the xfconf properties */
-    if (saved_outputs)
-        g_hash_table_destroy (saved_outputs);
 }
 
 
@@ -1269,29 +1956,51 @@ xfce_displays_helper_channel_property_changed (XfconfChannel      *channel,
                                                const GValue       *value,
                                                XfceDisplaysHelper *helper)
 {
+    const gchar   *slash;
+    gchar         *scheme;
+    XfsdStatsMark  mark;
+
+    xfsettings_stats_begin_xfconf (&mark, G_STRFUNC, property_name);
+
+    /* drop the parsed profiles of the scheme this property belongs to */
+    if (property_name[0] == '/' && g_hash_table_size (helper->profiles) > 0)
+    {
+        slash = strchr (property_name + 1, '/');
+        if (slash != NULL)
+        {
+            scheme = g_strndup (property_name + 1, slash - property_name - 1);
+            if (g_hash_table_remove (helper->profiles, scheme))
+                xfsettings_dbg (XFSD_DEBUG_DISPLAYS, "Invalidated cached profiles of scheme %s.", scheme);
+            /* the lid-open plan restores the default scheme */
+            if (strcmp (scheme, DEFAULT_SCHEME_NAME) == 0)
+                xfce_displays_helper_invalidate_lid_plans (helper);
+            g_free (scheme);
+        }
+    }
+
     if (G_UNLIKELY (G_VALUE_HOLDS_STRING (value) &&
         g_strcmp0 (property_name, APPLY_SCHEME_PROP) == 0))
     {
         /* apply */
+        xfce_rr_timeline_begin (helper->timeline, g_value_get_string (value));
         xfce_displays_helper_channel_apply (helper, g_value_get_string (value));
+        xfce_rr_timeline_finish (helper->timeline);
         /* remove the apply property */
         xfconf_channel_reset_property (channel, APPLY_SCHEME_PROP, FALSE);
     }
+
+    xfsettings_stats_end (helper->stats, XFSD_STATS_XFCONF, &mark);
 }
 
 
 
-static void
-xfce_displays_helper_toggle_internal (gpointer           *power,
-                                      gboolean            lid_is_closed,
-                                      XfceDisplaysHelper *helper)
+static XfceRROutput *
+xfce_displays_helper_find_internal (XfceDisplaysHelper *helper)
 {
-    GHashTable    *saved_outputs;
-    XfceRRCrtc    *crtc = NULL;
-    XfceRROutput  *output, *lvds = NULL;
-    gboolean       active = FALSE;
-    guint          n;
-    gint           m;
+    XfceRROutput *output;
+    guint         n;
+
+    g_assert (XFCE_IS_DISPLAYS_HELPER (helper) && helper->outputs);
 
     for (n = 0; n < helper->outputs->len; ++n)
     {
@@ -1301,81 +2010,410 @@ xfce_displays_helper_toggle_internal (gpointer           *power,
         /* Try to find the internal display */
         if (g_str_has_prefix (output->info->name, "LVDS")
             || strcmp (output->info->name, "PANEL") == 0)
-        {
-            lvds = output;
-            break;
-        }
+            return output;
     }
 
-    if (!lvds)
-        return;
+    return NULL;
+}
+
+
+
+static void
+xfce_displays_helper_save_crtc (XfceRRCrtc      *crtc,
+                                XfceRRCrtcState *state)
+{
+    g_assert (crtc && state);
+
+    state->mode = crtc->mode;
+    state->rotation = crtc->rotation;
+    state->width = crtc->width;
+    state->height = crtc->height;
+    state->x = crtc->x;
+    state->y = crtc->y;
+    state->noutput = crtc->mode != None ? crtc->noutput : 0;
+    state->outputs = NULL;
+    if (state->noutput > 0)
+        state->outputs = g_memdup (crtc->outputs, state->noutput * sizeof (RROutput));
+}
+
+
+
+static void
+xfce_displays_helper_restore_crtc (XfceRRCrtc            *crtc,
+                                   const XfceRRCrtcState *state)
+{
+    g_assert (crtc && state);
+
+    crtc->mode = state->mode;
+    crtc->rotation = state->rotation;
+    crtc->width = state->width;
+    crtc->height = state->height;
+    crtc->x = state->x;
+    crtc->y = state->y;
+    crtc->noutput = state->noutput;
+    g_free (crtc->outputs);
+    crtc->outputs = NULL;
+    if (state->noutput > 0)
+        crtc->outputs = g_memdup (state->outputs, state->noutput * sizeof (RROutput));
+    crtc->changed = xfce_displays_helper_crtc_differs (crtc);
+}
 
-    xfsettings_dbg (XFSD_DEBUG_DISPLAYS, "Toggling internal output %s.",
-                    lvds->info->name);
 
-    if (lvds->active && lid_is_closed)
+
+static void
+xfce_displays_helper_reset_crtcs (XfceDisplaysHelper *helper)
+{
+    XfceRRCrtc *crtc;
+    guint       n;
+
+    g_assert (XFCE_IS_DISPLAYS_HELPER (helper) && helper->crtcs);
+
+    /* start from what the server has */
+    for (n = 0; n < helper->crtcs->len; ++n)
     {
-        /* if active and the lid is closed, deactivate it */
-        crtc = xfce_displays_helper_find_usable_crtc (helper, lvds);
-        if (!crtc)
-            return;
-        crtc->mode = None;
-        crtc->noutput = 0;
-        crtc->changed = TRUE;
-        xfsettings_dbg (XFSD_DEBUG_DISPLAYS, "%s will be disabled.", lvds->info->name);
+        crtc = g_ptr_array_index (helper->crtcs, n);
+        xfce_displays_helper_restore_crtc (crtc, &crtc->current);
     }
-    else if (!lvds->active && !lid_is_closed)
+}
+
+
+
+static gboolean
+xfce_displays_helper_prepare_lid_closed (XfceDisplaysHelper *helper)
+{
+    XfceRRCrtc *crtc;
+
+    g_assert (XFCE_IS_DISPLAYS_HELPER (helper) && helper->lvds);
+
+    xfce_displays_helper_want_crtcs (helper, NULL);
+    helper->lvds->wanted = FALSE;
+    xfce_displays_helper_assign_crtcs (helper);
+
+    /* deactivate the internal output */
+    crtc = xfce_displays_helper_find_usable_crtc (helper, helper->lvds);
+    if (!crtc)
+        return FALSE;
+    crtc->mode = None;
+    crtc->noutput = 0;
+    crtc->changed = TRUE;
+
+    return TRUE;
+}
+
+
+
+static gboolean
+xfce_displays_helper_prepare_lid_open (XfceDisplaysHelper *helper)
+{
+    GArray       *profiles;
+    XfceRRCrtc   *crtc;
+    XfceRROutput *output, *lvds = helper->lvds;
+    gboolean      active = FALSE;
+    gdouble       start;
+    guint         n;
+    gint          m;
+
+    g_assert (XFCE_IS_DISPLAYS_HELPER (helper) && lvds);
+
+    /* re-activate it according to the default scheme */
+    profiles = xfce_displays_helper_get_profiles (helper, DEFAULT_SCHEME_NAME);
+    xfce_displays_helper_want_crtcs (helper, profiles);
+    lvds->wanted = TRUE;
+    lvds->pinned = FALSE;
+    xfce_displays_helper_assign_crtcs (helper);
+
+    if (profiles->len > 0)
     {
-        /* re-activate it because the user opened the lid */
-        saved_outputs = xfconf_channel_get_properties (helper->channel, "/" DEFAULT_SCHEME_NAME);
-        if (saved_outputs)
+        /* first, ensure the position of the other outputs is correct */
+        for (n = 0; n < helper->outputs->len; ++n)
         {
-            /* first, ensure the position of the other outputs is correct */
-            for (n = 0; n < helper->outputs->len; ++n)
-            {
-                output = g_ptr_array_index (helper->outputs, n);
-                g_assert (output);
-
-                if (output->id == lvds->id)
-                    continue;
+            output = g_ptr_array_index (helper->outputs, n);
+            g_assert (output);
 
-                xfce_displays_helper_load_from_xfconf (helper, DEFAULT_SCHEME_NAME,
-                                                       saved_outputs, output);
-            }
+            if (output->id == lvds->id)
+                continue;
 
-            /* try to load user saved settings for lvds */
-            active = xfce_displays_helper_load_from_xfconf (helper, DEFAULT_SCHEME_NAME,
-                                                            saved_outputs, lvds);
-            g_hash_table_destroy (saved_outputs);
+            start = xfce_rr_timeline_now (helper->timeline);
+            xfce_displays_helper_load_from_xfconf (helper, profiles, output);
+            xfce_rr_timeline_span (helper->timeline, "load_from_xfconf", output->id, start);
         }
-        if (!active)
+
+        /* try to load user saved settings for lvds */
+        start = xfce_rr_timeline_now (helper->timeline);
+        active = xfce_displays_helper_load_from_xfconf (helper, profiles, lvds);
+        xfce_rr_timeline_span (helper->timeline, "load_from_xfconf", lvds->id, start);
+    }
+    if (!active)
+    {
+        /* autoset the preferred mode */
+        crtc = xfce_displays_helper_find_usable_crtc (helper, lvds);
+        if (!crtc)
+            return FALSE;
+        crtc->mode = lvds->preferred_mode;
+        crtc->rotation = RR_Rotate_0;
+        crtc->x = crtc->y = 0;
+        /* set width and height */
+        for (m = 0; m < helper->resources->nmode; ++m)
         {
-            /* autoset the preferred mode */
-            crtc = xfce_displays_helper_find_usable_crtc (helper, lvds);
-            if (!crtc)
-                return;
-            crtc->mode = lvds->preferred_mode;
-            crtc->rotation = RR_Rotate_0;
-            crtc->x = crtc->y = 0;
-            /* set width and height */
-            for (m = 0; m < helper->resources->nmode; ++m)
+            if (helper->resources->modes[m].id == lvds->preferred_mode)
             {
-                if (helper->resources->modes[m].id == lvds->preferred_mode)
-                {
-                    crtc->width = helper->resources->modes[m].width;
-                    crtc->height = helper->resources->modes[m].height;
-                    break;
-                }
+                crtc->width = helper->resources->modes[m].width;
+                crtc->height = helper->resources->modes[m].height;
+                break;
             }
-            xfce_displays_helper_set_outputs (crtc, lvds);
-            crtc->changed = TRUE;
         }
-        xfsettings_dbg (XFSD_DEBUG_DISPLAYS, "%s will be re-enabled.",
-                        lvds->info->name);
+        xfce_displays_helper_set_outputs (crtc, lvds);
+        crtc->changed = TRUE;
     }
+
+    return TRUE;
+}
+
+
+
+static void
+xfce_displays_helper_save_lid_plan (XfceDisplaysHelper *helper,
+                                    XfceRRLidPlan      *plan,
+                                    gboolean            apply)
+{
+    XfceRRCrtcState state;
+    guint           n;
+
+    g_assert (XFCE_IS_DISPLAYS_HELPER (helper) && helper->crtcs && plan);
+
+    xfce_displays_helper_clear_lid_plan (plan);
+
+    plan->valid = TRUE;
+    plan->apply = apply;
+    if (!apply)
+        return;
+
+    plan->crtcs = g_array_sized_new (FALSE, FALSE, sizeof (XfceRRCrtcState),
+                                     helper->crtcs->len);
+    for (n = 0; n < helper->crtcs->len; ++n)
+    {
+        xfce_displays_helper_save_crtc (g_ptr_array_index (helper->crtcs, n), &state);
+        g_array_append_val (plan->crtcs, state);
+    }
+
+#ifdef HAS_RANDR_ONE_POINT_THREE
+    plan->primary = helper->primary;
+#endif
+}
+
+
+
+static void
+xfce_displays_helper_clear_lid_plan (XfceRRLidPlan *plan)
+{
+    guint n;
+
+    if (plan->crtcs != NULL)
+    {
+        for (n = 0; n < plan->crtcs->len; ++n)
+            g_free (g_array_index (plan->crtcs, XfceRRCrtcState, n).outputs);
+        g_array_free (plan->crtcs, TRUE);
+        plan->crtcs = NULL;
+    }
+
+    plan->valid = FALSE;
+    plan->apply = FALSE;
+}
+
+
+
+static void
+xfce_displays_helper_compute_lid_plans (XfceDisplaysHelper *helper)
+{
+    GTimer  *timer;
+#ifdef HAS_RANDR_ONE_POINT_THREE
+    RROutput primary = helper->primary;
+#endif
+
+    g_assert (XFCE_IS_DISPLAYS_HELPER (helper) && helper->crtcs && helper->outputs);
+
+    if (helper->lvds == NULL)
+    {
+        /* nothing to toggle */
+        xfce_displays_helper_save_lid_plan (helper, helper->lid_closed, FALSE);
+        xfce_displays_helper_save_lid_plan (helper, helper->lid_open, FALSE);
+        return;
+    }
+
+    timer = g_timer_new ();
+    xfce_rr_timeline_begin (helper->timeline, "lid plans");
+
+    /* both plans start from the current configuration, which is
+     * restored afterwards so nothing leaks into the next operation */
+    xfce_displays_helper_reset_crtcs (helper);
+    xfce_displays_helper_save_lid_plan (helper, helper->lid_closed,
+                                        xfce_displays_helper_prepare_lid_closed (helper));
+
+    xfce_displays_helper_reset_crtcs (helper);
+    xfce_displays_helper_save_lid_plan (helper, helper->lid_open,
+                                        xfce_displays_helper_prepare_lid_open (helper));
+
+    xfce_displays_helper_reset_crtcs (helper);
+#ifdef HAS_RANDR_ONE_POINT_THREE
+    helper->primary = primary;
+#endif
+
+    xfce_rr_timeline_finish (helper->timeline);
+    xfsettings_dbg (XFSD_DEBUG_DISPLAYS, "Computed lid plans for %s in %.1f ms.",
+                    helper->lvds->info->name, g_timer_elapsed (timer, NULL) * 1000.0);
+    g_timer_destroy (timer);
+}
+
+
+
+static gboolean
+xfce_displays_helper_compute_lid_plans_idle (gpointer data)
+{
+    XfceDisplaysHelper *helper = XFCE_DISPLAYS_HELPER (data);
+
+    helper->lid_plans_idle = 0;
+
+    if (!helper->lid_open->valid || !helper->lid_closed->valid)
+        xfce_displays_helper_compute_lid_plans (helper);
+
+    return FALSE;
+}
+
+
+
+static void
+xfce_displays_helper_invalidate_lid_plans (XfceDisplaysHelper *helper)
+{
+    xfce_displays_helper_clear_lid_plan (helper->lid_open);
+    xfce_displays_helper_clear_lid_plan (helper->lid_closed);
+
+    /* recompute them once the current batch of changes is over */
+    if (helper->lid_plans_idle == 0)
+        helper->lid_plans_idle = g_idle_add_full (G_PRIORITY_LOW,
+                                                  xfce_displays_helper_compute_lid_plans_idle,
+                                                  helper, NULL);
+}
+
+
+
+static void
+xfce_displays_helper_toggle_internal (gpointer           *power,
+                                      gboolean            lid_is_closed,
+                                      XfceDisplaysHelper *helper)
+{
+    XfceRRLidPlan *plan;
+    guint          n;
+
+    if (!helper->lvds)
+        return;
+
+    xfsettings_dbg (XFSD_DEBUG_DISPLAYS, "Toggling internal output %s.",
+                    helper->lvds->info->name);
+
+    if (helper->lvds->active && lid_is_closed)
+        plan = helper->lid_closed;
+    else if (!helper->lvds->active && !lid_is_closed)
+        plan = helper->lid_open;
     else
         return;
 
+    /* the event came before the idle computation */
+    if (!plan->valid)
+    {
+        if (helper->lid_plans_idle != 0)
+        {
+            g_source_remove (helper->lid_plans_idle);
+            helper->lid_plans_idle = 0;
+        }
+        xfce_displays_helper_compute_lid_plans (helper);
+    }
+
+    if (!plan->apply)
+        return;
+
+    g_assert (plan->crtcs->len == helper->crtcs->len);
+
+    xfce_rr_timeline_begin (helper->timeline, lid_is_closed ? "lid closed" : "lid opened");
+
+    /* load the ready-made configuration */
+    for (n = 0; n < helper->crtcs->len; ++n)
+        xfce_displays_helper_restore_crtc (g_ptr_array_index (helper->crtcs, n),
+                                           &g_array_index (plan->crtcs, XfceRRCrtcState, n));
+#ifdef HAS_RANDR_ONE_POINT_THREE
+    helper->primary = plan->primary;
+#endif
+
+    xfsettings_dbg (XFSD_DEBUG_DISPLAYS, "%s will be %s.", helper->lvds->info->name,
+                    lid_is_closed ? "disabled" : "re-enabled");
+
     /* apply settings */
     xfce_displays_helper_apply_all (helper);
+
+    xfce_rr_timeline_finish (helper->timeline);
+}
+
+
+
+#ifdef HAVE_UPOWERGLIB
+static void
+xfce_displays_helper_lid_changed (gpointer           *power,
+                                  gboolean            lid_is_closed,
+                                  XfceDisplaysHelper *helper)
+{
+    XfsdStatsMark mark;
+
+    /* toggle_internal is also used by the screen change handler */
+    xfsettings_stats_begin (&mark, G_STRFUNC);
+    xfce_displays_helper_toggle_internal (power, lid_is_closed, helper);
+    xfsettings_stats_end (helper->stats, XFSD_STATS_EVENT, &mark);
+}
+
+
+
+G_MODULE_EXPORT const gchar *
+g_module_check_init (GModule *module)
+{
+    /* upower-glib and XfceDisplaysUPower are static types, the
+     * module can not be unloaded */
+    g_module_make_resident (module);
+
+    return NULL;
+}
+#endif
+
+
+
+G_MODULE_EXPORT void
+xfsettingsd_helper_register_types (GTypeModule *type_module)
+{
+    xfce_displays_helper_register_type (type_module);
+}
+
+
+
+GObject *
+xfce_displays_helper_new_for_backend (XfceRRBackend *backend,
+                                      XfconfChannel *channel)
+{
+    XfceDisplaysHelper *helper;
+
+    g_return_val_if_fail (backend != NULL, NULL);
+    g_return_val_if_fail (XFCONF_IS_CHANNEL (channel), NULL);
+
+    helper = g_object_new (XFCE_TYPE_DISPLAYS_HELPER, NULL);
+    helper->backend = backend;
+    helper->channel = channel;
+
+    xfce_displays_helper_setup (helper);
+
+    return G_OBJECT (helper);
+}
+
+
+
+G_MODULE_EXPORT GObject *
+xfsettingsd_helper_new (gboolean replace)
+{
+    return xfce_displays_helper_new_for_backend (xfce_rr_backend_x11_new (gdk_display_get_default ()),
+                                                 xfconf_channel_get ("displays"));
 }
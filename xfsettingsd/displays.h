@@ -19,6 +19,10 @@
 #ifndef __DISPLAYS_H__
 #define __DISPLAYS_H__
 
+#include <xfconf/xfconf.h>
+
+#include "displays-backend.h"
+
 typedef struct _XfceDisplaysHelperClass XfceDisplaysHelperClass;
 typedef struct _XfceDisplaysHelper      XfceDisplaysHelper;
 
@@ -29,6 +33,11 @@ typedef struct _XfceDisplaysHelper      XfceDisplaysHelper;
 #define XFCE_IS_DISPLAYS_HELPER_CLASS(klass) (G_TYPE_CHECK_CLASS_TYPE ((klass), XFCE_TYPE_DISPLAYS_HELPER))
 #define XFCE_DISPLAYS_HELPER_GET_CLASS(obj)  (G_TYPE_INSTANCE_GET_CLASS ((obj), XFCE_TYPE_DISPLAYS_HELPER, XfceDisplaysHelperClass))
 
-GType xfce_displays_helper_get_type (void) G_GNUC_CONST;
+GType    xfce_displays_helper_get_type        (void) G_GNUC_CONST;
+
+/* takes ownership of the backend, the check programs use this to run
+ * the helper on a simulation and a private channel */
+GObject *xfce_displays_helper_new_for_backend (XfceRRBackend *backend,
+                                               XfconfChannel *channel);
 
 #endif /* !__DISPLAYS_H__ */
@@ -0,0 +1,205 @@
+/*
+ *  Copyright (c) 2012 The Xfce Development Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <glib.h>
+#include <glib-object.h>
+#include <gmodule.h>
+
+#include "debug.h"
+#include "helper-module.h"
+
+
+
+typedef void      (*XfceHelperRegisterFunc) (GTypeModule *type_module);
+typedef GObject * (*XfceHelperNewFunc)      (gboolean     replace);
+
+
+
+static void     xfce_helper_module_finalize (GObject     *object);
+static gboolean xfce_helper_module_load     (GTypeModule *type_module);
+static void     xfce_helper_module_unload   (GTypeModule *type_module);
+
+
+
+struct _XfceHelperModuleClass
+{
+    GTypeModuleClass __parent__;
+};
+
+struct _XfceHelperModule
+{
+    GTypeModule        __parent__;
+
+    gchar             *filename;
+
+    /* only set while the module is loaded */
+    GModule           *library;
+    XfceHelperNewFunc  new_func;
+};
+
+
+
+G_DEFINE_TYPE (XfceHelperModule, xfce_helper_module, G_TYPE_TYPE_MODULE)
+
+
+
+/* modules by name, type modules are never destroyed */
+static GHashTable *helper_modules = NULL;
+
+
+
+static void
+xfce_helper_module_class_init (XfceHelperModuleClass *klass)
+{
+    GObjectClass     *gobject_class;
+    GTypeModuleClass *type_module_class;
+
+    gobject_class = G_OBJECT_CLASS (klass);
+    gobject_class->finalize = xfce_helper_module_finalize;
+
+    type_module_class = G_TYPE_MODULE_CLASS (klass);
+    type_module_class->load = xfce_helper_module_load;
+    type_module_class->unload = xfce_helper_module_unload;
+}
+
+
+
+static void
+xfce_helper_module_init (XfceHelperModule *module)
+{
+}
+
+
+
+static void
+xfce_helper_module_finalize (GObject *object)
+{
+    XfceHelperModule *module = XFCE_HELPER_MODULE (object);
+
+    g_free (module->filename);
+
+    (*G_OBJECT_CLASS (xfce_helper_module_parent_class)->finalize) (object);
+}
+
+
+
+static gboolean
+xfce_helper_module_load (GTypeModule *type_module)
+{
+    XfceHelperModule       *module = XFCE_HELPER_MODULE (type_module);
+    XfceHelperRegisterFunc  register_func;
+    GTimer                 *timer;
+
+    timer = g_timer_new ();
+
+    module->library = g_module_open (module->filename, G_MODULE_BIND_LOCAL);
+    if (G_UNLIKELY (module->library == NULL))
+    {
+        g_critical ("Failed to load helper module \"%s\": %s",
+                    module->filename, g_module_error ());
+        g_timer_destroy (timer);
+
+        return FALSE;
+    }
+
+    if (!g_module_symbol (module->library, "xfsettingsd_helper_register_types", (gpointer) &register_func)
+        || !g_module_symbol (module->library, "xfsettingsd_helper_new", (gpointer) &module->new_func))
+    {
+        g_critical ("Helper module \"%s\" lacks required symbols: %s",
+                    module->filename, g_module_error ());
+        g_module_close (module->library);
+        module->library = NULL;
+        g_timer_destroy (timer);
+
+        return FALSE;
+    }
+
+    /* (re)register the types of the module */
+    register_func (type_module);
+
+    xfsettings_dbg (XFSD_DEBUG_MODULES, "loaded %s in %.1f ms",
+                    module->filename, g_timer_elapsed (timer, NULL) * 1000.0);
+
+    g_timer_destroy (timer);
+
+    return TRUE;
+}
+
+
+
+static void
+xfce_helper_module_unload (GTypeModule *type_module)
+{
+    XfceHelperModule *module = XFCE_HELPER_MODULE (type_module);
+
+    g_module_close (module->library);
+    module->library = NULL;
+    module->new_func = NULL;
+
+    xfsettings_dbg (XFSD_DEBUG_MODULES, "unloaded %s", module->filename);
+}
+
+
+
+XfceHelperModule *
+xfce_helper_module_get (const gchar *name)
+{
+    XfceHelperModule *module;
+
+    g_return_val_if_fail (name != NULL, NULL);
+
+    if (helper_modules == NULL)
+        helper_modules = g_hash_table_new (g_str_hash, g_str_equal);
+
+    module = g_hash_table_lookup (helper_modules, name);
+    if (module == NULL)
+    {
+        module = g_object_new (XFCE_TYPE_HELPER_MODULE, NULL);
+        module->filename = g_module_build_path (HELPERDIR, name);
+        g_type_module_set_name (G_TYPE_MODULE (module), name);
+
+        g_hash_table_insert (helper_modules, (gpointer) g_type_module_get_name (G_TYPE_MODULE (module)), module);
+    }
+
+    return module;
+}
+
+
+
+GObject *
+xfce_helper_module_create (XfceHelperModule *module,
+                           gboolean          replace)
+{
+    GObject *helper;
+
+    g_return_val_if_fail (XFCE_IS_HELPER_MODULE (module), NULL);
+
+    if (!g_type_module_use (G_TYPE_MODULE (module)))
+        return NULL;
+
+    /* the instance keeps the module loaded until it is finalized */
+    helper = module->new_func (replace);
+
+    g_type_module_unuse (G_TYPE_MODULE (module));
+
+    return helper;
+}
@@ -0,0 +1,48 @@
+/*
+ *  Copyright (c) 2012 The Xfce Development Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __HELPER_MODULE_H__
+#define __HELPER_MODULE_H__
+
+#include <glib-object.h>
+#include <gmodule.h>
+
+typedef struct _XfceHelperModuleClass XfceHelperModuleClass;
+typedef struct _XfceHelperModule      XfceHelperModule;
+
+#define XFCE_TYPE_HELPER_MODULE            (xfce_helper_module_get_type ())
+#define XFCE_HELPER_MODULE(obj)            (G_TYPE_CHECK_INSTANCE_CAST ((obj), XFCE_TYPE_HELPER_MODULE, XfceHelperModule))
+#define XFCE_HELPER_MODULE_CLASS(klass)    (G_TYPE_CHECK_CLASS_CAST ((klass), XFCE_TYPE_HELPER_MODULE, XfceHelperModuleClass))
+#define XFCE_IS_HELPER_MODULE(obj)         (G_TYPE_CHECK_INSTANCE_TYPE ((obj), XFCE_TYPE_HELPER_MODULE))
+#define XFCE_IS_HELPER_MODULE_CLASS(klass) (G_TYPE_CHECK_CLASS_TYPE ((klass), XFCE_TYPE_HELPER_MODULE))
+#define XFCE_HELPER_MODULE_GET_CLASS(obj)  (G_TYPE_INSTANCE_GET_CLASS ((obj), XFCE_TYPE_HELPER_MODULE, XfceHelperModuleClass))
+
+GType             xfce_helper_module_get_type (void) G_GNUC_CONST;
+
+XfceHelperModule *xfce_helper_module_get      (const gchar      *name);
+
+GObject          *xfce_helper_module_create   (XfceHelperModule *module,
+                                               gboolean          replace);
+
+/* implemented by each module, the types must be registered with
+ * G_DEFINE_DYNAMIC_TYPE so the module can be unloaded again */
+G_MODULE_EXPORT void     xfsettingsd_helper_register_types (GTypeModule *type_module);
+
+G_MODULE_EXPORT GObject *xfsettingsd_helper_new            (gboolean     replace);
+
+#endif /* !__HELPER_MODULE_H__ */
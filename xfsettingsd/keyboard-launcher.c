@@ -0,0 +1,495 @@
+/*
+ *  Copyright (c) 2012 The Xfce Development Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#ifdef HAVE_ERRNO_H
+#include <errno.h>
+#endif
+#ifdef HAVE_SIGNAL_H
+#include <signal.h>
+#endif
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>
+#endif
+#ifdef HAVE_SYS_TYPES_H
+#include <sys/types.h>
+#endif
+#ifdef HAVE_SYS_WAIT_H
+#include <sys/wait.h>
+#endif
+#ifdef HAVE_SYS_SOCKET_H
+#include <sys/socket.h>
+#endif
+#ifdef HAVE_SPAWN_H
+#include <spawn.h>
+#endif
+#include <stdio.h>
+
+#include <glib.h>
+#include <gtk/gtk.h>
+#include <libxfce4util/libxfce4util.h>
+#include <libxfce4ui/libxfce4ui.h>
+
+#include "debug.h"
+#include "keyboard-launcher.h"
+
+#if defined (HAVE_SPAWN_H) && defined (HAVE_SYS_SOCKET_H) && defined (HAVE_SYS_WAIT_H)
+#define HAVE_LAUNCHER 1
+#endif
+
+#ifdef HAVE_LAUNCHER
+
+/* limits of a single request to the launcher */
+#define LAUNCHER_MAX_REQUEST (64 * 1024)
+#define LAUNCHER_MAX_ARGS    (1024)
+
+/* highest descriptor closed in the launcher */
+#define LAUNCHER_MAX_FD      (65536)
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+extern gchar **environ;
+
+
+
+typedef struct _XfceLauncher XfceLauncher;
+typedef struct _XfceLaunch   XfceLaunch;
+
+typedef struct
+{
+    /* bytes of the display name and arguments that follow */
+    guint32 size;
+    guint32 argc;
+}
+XfceLauncherRequest;
+
+typedef struct
+{
+    gint32  pid;
+
+    /* errno of posix_spawn, 0 on success */
+    gint32  error_code;
+
+    /* when posix_spawn returned, so the program was executed */
+    glong   exec_sec;
+    glong   exec_usec;
+}
+XfceLauncherReply;
+
+struct _XfceLauncher
+{
+    /* our end of the socket and the launcher process */
+    gint    fd;
+    pid_t   pid;
+    guint   watch_id;
+
+    /* launches waiting for a reply, in order */
+    GQueue *launches;
+};
+
+struct _XfceLaunch
+{
+    gchar    *name;
+    GTimeVal  key_time;
+};
+
+
+
+static XfceLauncher *launcher = NULL;
+
+
+
+static gboolean
+xfce_launcher_read_all (gint     fd,
+                        gpointer data,
+                        gsize    size)
+{
+    gchar  *p = data;
+    gssize  n;
+
+    while (size > 0)
+    {
+        n = read (fd, p, size);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return FALSE;
+
+        p += n;
+        size -= n;
+    }
+
+    return TRUE;
+}
+
+
+
+static gboolean
+xfce_launcher_write_all (gint          fd,
+                         gconstpointer data,
+                         gsize         size)
+{
+    const gchar *p = data;
+    gssize       n;
+
+    while (size > 0)
+    {
+        /* do not die if the other side went away */
+        n = send (fd, p, size, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return FALSE;
+
+        p += n;
+        size -= n;
+    }
+
+    return TRUE;
+}
+
+
+
+static void G_GNUC_NORETURN
+xfce_launcher_main (gint fd)
+{
+    static gchar         buffer[LAUNCHER_MAX_REQUEST + 1];
+    static gchar        *argv[LAUNCHER_MAX_ARGS + 1];
+    static gchar         display_env[256];
+    XfceLauncherRequest  request;
+    XfceLauncherReply    reply;
+    posix_spawnattr_t    attr;
+    sigset_t             signals;
+    gchar              **envp;
+    gchar               *p, *end;
+    guint                n, n_env, display_slot;
+    pid_t                pid;
+    GTimeVal             now;
+
+    /* the system reaps the launched processes */
+    signal (SIGCHLD, SIG_IGN);
+    signal (SIGPIPE, SIG_IGN);
+
+    /* launched processes start with default signal handling
+     * in a process group of their own */
+    posix_spawnattr_init (&attr);
+    sigfillset (&signals);
+    posix_spawnattr_setsigdefault (&attr, &signals);
+    sigemptyset (&signals);
+    posix_spawnattr_setsigmask (&attr, &signals);
+    posix_spawnattr_setpgroup (&attr, 0);
+    posix_spawnattr_setflags (&attr, POSIX_SPAWN_SETSIGDEF
+                                     | POSIX_SPAWN_SETSIGMASK
+                                     | POSIX_SPAWN_SETPGROUP);
+
+    /* environment of the daemon, DISPLAY is set per request */
+    for (n_env = 0; environ[n_env] != NULL; n_env++);
+    envp = malloc ((n_env + 2) * sizeof (gchar *));
+    if (envp == NULL)
+        _exit (EXIT_FAILURE);
+
+    for (n = 0, display_slot = 0; n < n_env; n++)
+    {
+        if (strncmp (environ[n], "DISPLAY=", 8) != 0
+            && strncmp (environ[n], "DESKTOP_STARTUP_ID=", 19) != 0)
+            envp[display_slot++] = environ[n];
+    }
+    envp[display_slot] = NULL;
+    envp[display_slot + 1] = NULL;
+
+    for (;;)
+    {
+        /* the daemon closed the socket */
+        if (!xfce_launcher_read_all (fd, &request, sizeof (request)))
+            _exit (EXIT_SUCCESS);
+
+        if (request.size > LAUNCHER_MAX_REQUEST
+            || request.argc == 0
+            || request.argc > LAUNCHER_MAX_ARGS
+            || !xfce_launcher_read_all (fd, buffer, request.size))
+            _exit (EXIT_FAILURE);
+
+        buffer[request.size] = '\0';
+
+        /* the display name, then the arguments, all nul-terminated */
+        p = buffer;
+        end = buffer + request.size;
+
+        if (*p != '\0')
+        {
+            snprintf (display_env, sizeof (display_env), "DISPLAY=%s", p);
+            envp[display_slot] = display_env;
+        }
+        else
+        {
+            envp[display_slot] = NULL;
+        }
+        p += strlen (p) + 1;
+
+        for (n = 0; n < request.argc && p < end; n++)
+        {
+            argv[n] = p;
+            p += strlen (p) + 1;
+        }
+        argv[n] = NULL;
+
+        memset (&reply, 0, sizeof (reply));
+        if (n == request.argc)
+        {
+            reply.error_code = posix_spawnp (&pid, argv[0], NULL, &attr, argv, envp);
+            if (reply.error_code == 0)
+                reply.pid = pid;
+        }
+        else
+        {
+            reply.error_code = EINVAL;
+        }
+
+        g_get_current_time (&now);
+        reply.exec_sec = now.tv_sec;
+        reply.exec_usec = now.tv_usec;
+
+        if (!xfce_launcher_write_all (fd, &reply, sizeof (reply)))
+            _exit (EXIT_SUCCESS);
+    }
+}
+
+
+
+static void
+xfce_launcher_launch_free (XfceLaunch *launch)
+{
+    g_free (launch->name);
+    g_free (launch);
+}
+
+
+
+static gboolean
+xfce_launcher_reply (GIOChannel   *source,
+                     GIOCondition  condition,
+                     gpointer      user_data)
+{
+    XfceLauncherReply  reply;
+    XfceLaunch        *launch;
+    GError            *error = NULL;
+    gdouble            latency;
+
+    if (!xfce_launcher_read_all (launcher->fd, &reply, sizeof (reply)))
+    {
+        g_warning ("The launcher process exited, commands are "
+                   "launched by the daemon from now on");
+
+        /* the source is removed when we return */
+        launcher->watch_id = 0;
+        xfce_launcher_stop ();
+
+        return FALSE;
+    }
+
+    launch = g_queue_pop_head (launcher->launches);
+    if (G_UNLIKELY (launch == NULL))
+        return TRUE;
+
+    if (reply.error_code == 0)
+    {
+        latency = (reply.exec_sec - launch->key_time.tv_sec) * 1000.0
+                  + (reply.exec_usec - launch->key_time.tv_usec) / 1000.0;
+
+        xfsettings_dbg (XFSD_DEBUG_KEYBOARD_SHORTCUTS,
+                        "launched \"%s\" (pid=%d) %.2f ms after the key press",
+                        launch->name, reply.pid, latency);
+    }
+    else
+    {
+        g_set_error_literal (&error, G_SPAWN_ERROR, G_SPAWN_ERROR_FAILED,
+                             g_strerror (reply.error_code));
+        xfce_dialog_show_error (NULL, error, _("Failed to launch shortcut \"%s\""),
+                                launch->name);
+        g_error_free (error);
+    }
+
+    xfce_launcher_launch_free (launch);
+
+    return TRUE;
+}
+#endif /* HAVE_LAUNCHER */
+
+
+
+void
+xfce_launcher_start (void)
+{
+#ifdef HAVE_LAUNCHER
+    GIOChannel *channel;
+    gint        fds[2];
+    pid_t       pid;
+    glong       fd, max_fd;
+
+    if (launcher != NULL || g_getenv ("XFSETTINGSD_NO_LAUNCHER") != NULL)
+        return;
+
+    if (socketpair (AF_UNIX, SOCK_STREAM, 0, fds) != 0)
+    {
+        g_warning ("Failed to create the launcher socket: %s", g_strerror (errno));
+        return;
+    }
+
+    pid = fork ();
+    if (pid < 0)
+    {
+        g_warning ("Failed to fork the launcher: %s", g_strerror (errno));
+        close (fds[0]);
+        close (fds[1]);
+        return;
+    }
+
+    if (pid == 0)
+    {
+        /* do not leak the connections of the daemon into
+         * the launched processes */
+        max_fd = sysconf (_SC_OPEN_MAX);
+        if (max_fd < 0 || max_fd > LAUNCHER_MAX_FD)
+            max_fd = LAUNCHER_MAX_FD;
+        for (fd = 3; fd < max_fd; fd++)
+            if (fd != fds[1])
+                close (fd);
+
+        xfce_launcher_main (fds[1]);
+    }
+
+    close (fds[1]);
+    fcntl (fds[0], F_SETFD, FD_CLOEXEC);
+
+    launcher = g_new0 (XfceLauncher, 1);
+    launcher->fd = fds[0];
+    launcher->pid = pid;
+    launcher->launches = g_queue_new ();
+
+    channel = g_io_channel_unix_new (launcher->fd);
+    launcher->watch_id = g_io_add_watch (channel, G_IO_IN | G_IO_HUP | G_IO_ERR,
+                                         xfce_launcher_reply, NULL);
+    g_io_channel_unref (channel);
+
+    xfsettings_dbg (XFSD_DEBUG_KEYBOARD_SHORTCUTS, "started launcher (pid=%d)", (gint) pid);
+#endif
+}
+
+
+
+void
+xfce_launcher_stop (void)
+{
+#ifdef HAVE_LAUNCHER
+    if (launcher == NULL)
+        return;
+
+    if (launcher->watch_id != 0)
+        g_source_remove (launcher->watch_id);
+
+    /* the launcher exits when the socket is closed */
+    close (launcher->fd);
+    waitpid (launcher->pid, NULL, 0);
+
+    g_queue_foreach (launcher->launches, (GFunc) xfce_launcher_launch_free, NULL);
+    g_queue_free (launcher->launches);
+
+    g_free (launcher);
+    launcher = NULL;
+#endif
+}
+
+
+
+gboolean
+xfce_launcher_spawn (GdkScreen       *screen,
+                     gchar          **argv,
+                     const gchar     *name,
+                     const GTimeVal  *key_time)
+{
+#ifdef HAVE_LAUNCHER
+    XfceLauncherRequest  request;
+    XfceLaunch          *launch;
+    GString             *payload;
+    gchar               *display;
+    guint                n;
+
+    g_return_val_if_fail (GDK_IS_SCREEN (screen), FALSE);
+    g_return_val_if_fail (argv != NULL, FALSE);
+
+    if (launcher == NULL)
+        return FALSE;
+
+    display = gdk_screen_make_display_name (screen);
+    payload = g_string_new (NULL);
+    g_string_append_len (payload, display, strlen (display) + 1);
+    g_free (display);
+
+    for (n = 0; argv[n] != NULL; n++)
+        g_string_append_len (payload, argv[n], strlen (argv[n]) + 1);
+
+    if (n == 0
+        || n > LAUNCHER_MAX_ARGS
+        || payload->len > LAUNCHER_MAX_REQUEST)
+    {
+        g_string_free (payload, TRUE);
+        return FALSE;
+    }
+
+    request.size = payload->len;
+    request.argc = n;
+
+    if (!xfce_launcher_write_all (launcher->fd, &request, sizeof (request))
+        || !xfce_launcher_write_all (launcher->fd, payload->str, payload->len))
+    {
+        g_warning ("Failed to send the command to the launcher process, "
+                   "commands are launched by the daemon from now on");
+
+        g_string_free (payload, TRUE);
+        xfce_launcher_stop ();
+
+        return FALSE;
+    }
+
+    g_string_free (payload, TRUE);
+
+    /* the reply tells how long this took */
+    launch = g_new0 (XfceLaunch, 1);
+    launch->name = g_strdup (name);
+    launch->key_time = *key_time;
+    g_queue_push_tail (launcher->launches, launch);
+
+    return TRUE;
+#else
+    return FALSE;
+#endif
+}
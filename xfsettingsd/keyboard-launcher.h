@@ -0,0 +1,39 @@
+/*
+ *  Copyright (c) 2012 The Xfce Development Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __KEYBOARD_LAUNCHER_H__
+#define __KEYBOARD_LAUNCHER_H__
+
+#include <glib.h>
+#include <gdk/gdk.h>
+
+/* forks the launcher process, call this early while the daemon
+ * is still small and has no other threads */
+void     xfce_launcher_start (void);
+
+void     xfce_launcher_stop  (void);
+
+/* returns FALSE if the launcher is not running, the caller has to
+ * spawn the command itself then. failures to execute the command are
+ * reported asynchronously with an error dialog */
+gboolean xfce_launcher_spawn (GdkScreen       *screen,
+                              gchar          **argv,
+                              const gchar     *name,
+                              const GTimeVal  *key_time);
+
+#endif /* !__KEYBOARD_LAUNCHER_H__ */
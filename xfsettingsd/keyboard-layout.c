@@ -42,12 +42,25 @@
 #endif /* HAVE_LIBXKLAVIER */
 
 #include "debug.h"
+#include "helper-module.h"
 #include "keyboard-layout.h"
+#include "keyboard-xmodmap.h"
+#include "prefetch.h"
+#include "stats.h"
+#include "trace.h"
+
+#ifdef HAVE_LIBXKLAVIER
+/* interval in ms to collect changes before the keymap is compiled
+ * and uploaded, the dialog often changes several settings at once */
+#define ACTIVATE_SETTLE_INTERVAL (100)
+#endif
 
 static void xfce_keyboard_layout_helper_finalize                  (GObject                       *object);
-static void xfce_keyboard_layout_helper_process_xmodmap           (void);
+static void xfce_keyboard_layout_helper_process_xmodmap           (XfceKeyboardLayoutHelper      *helper);
 
 #ifdef HAVE_LIBXKLAVIER
+static void xfce_keyboard_layout_helper_activate_later            (XfceKeyboardLayoutHelper      *helper);
+static gboolean xfce_keyboard_layout_helper_activate              (gpointer                       user_data);
 static void xfce_keyboard_layout_helper_set_model                 (XfceKeyboardLayoutHelper      *helper);
 static void xfce_keyboard_layout_helper_set_layout                (XfceKeyboardLayoutHelper      *helper);
 static void xfce_keyboard_layout_helper_set_variant               (XfceKeyboardLayoutHelper      *helper);
@@ -81,16 +94,27 @@ struct _XfceKeyboardLayoutHelper
 
     gboolean           xkb_disable_settings;
 
+    XfsdStats         *stats;
+
+    /* parsed ~/.Xmodmap */
+    XfceXmodmap       *xmodmap;
+
 #ifdef HAVE_LIBXKLAVIER
     /* libxklavier */
     XklEngine         *engine;
     XklConfigRegistry *registry;
     XklConfigRec      *config;
     gchar             *system_keyboard_model;
+
+    /* changes of the config waiting for activation */
+    guint              activate_timeout_id;
+    guint              n_changes;
+    guint              n_activations;
+    guint              n_saved_activations;
 #endif /* HAVE_LIBXKLAVIER */
 };
 
-G_DEFINE_TYPE (XfceKeyboardLayoutHelper, xfce_keyboard_layout_helper, G_TYPE_OBJECT);
+G_DEFINE_DYNAMIC_TYPE (XfceKeyboardLayoutHelper, xfce_keyboard_layout_helper, G_TYPE_OBJECT);
 
 static void
 xfce_keyboard_layout_helper_class_init (XfceKeyboardLayoutHelperClass *klass)
@@ -101,16 +125,28 @@ xfce_keyboard_layout_helper_class_init (XfceKeyboardLayoutHelperClass *klass)
     gobject_class->finalize = xfce_keyboard_layout_helper_finalize;
 }
 
+static void
+xfce_keyboard_layout_helper_class_finalize (XfceKeyboardLayoutHelperClass *klass)
+{
+}
+
 static void
 xfce_keyboard_layout_helper_init (XfceKeyboardLayoutHelper *helper)
 {
+    gchar *xmodmap_path;
+
     /* init */
     helper->channel = NULL;
+    helper->stats = xfsettings_stats_get ("keyboard-layout");
 
     /* open the channel */
     helper->channel = xfconf_channel_get ("keyboard-layout");
 
-    helper->xkb_disable_settings = xfconf_channel_get_bool (helper->channel, "/Default/XkbDisable", TRUE);
+    helper->xkb_disable_settings = xfsettings_prefetch_get_bool (helper->channel, "/Default/XkbDisable", TRUE);
+
+    xmodmap_path = g_build_filename (xfce_get_homedir (), ".Xmodmap", NULL);
+    helper->xmodmap = xfce_xmodmap_new (xmodmap_path);
+    g_free (xmodmap_path);
 
 #ifdef HAVE_LIBXKLAVIER
     /* monitor channel changes */
@@ -132,17 +168,39 @@ xfce_keyboard_layout_helper_init (XfceKeyboardLayoutHelper *helper)
     xfce_keyboard_layout_helper_set_variant (helper);
     xfce_keyboard_layout_helper_set_grpkey (helper);
     xfce_keyboard_layout_helper_set_composekey (helper);
+
+    /* do not wait for the settle interval on startup */
+    if (helper->activate_timeout_id != 0)
+    {
+        g_source_remove (helper->activate_timeout_id);
+        xfce_keyboard_layout_helper_activate (helper);
+        return;
+    }
 #endif /* HAVE_LIBXKLAVIER */
 
-    xfce_keyboard_layout_helper_process_xmodmap ();
+    xfce_keyboard_layout_helper_process_xmodmap (helper);
 }
 
 static void
 xfce_keyboard_layout_helper_finalize (GObject *object)
 {
-#ifdef HAVE_LIBXKLAVIER
     XfceKeyboardLayoutHelper *helper = XFCE_KEYBOARD_LAYOUT_HELPER (object);
 
+#ifdef HAVE_LIBXKLAVIER
+
+    /* do not lose pending changes */
+    if (helper->activate_timeout_id != 0)
+    {
+        g_source_remove (helper->activate_timeout_id);
+        xfce_keyboard_layout_helper_activate (helper);
+    }
+
+    /* the module can be unloaded after this */
+    g_signal_handlers_disconnect_by_func (G_OBJECT (helper->channel),
+        xfce_keyboard_layout_helper_channel_property_changed, helper);
+    g_signal_handlers_disconnect_by_func (G_OBJECT (helper->engine),
+        xfce_keyboard_layout_reset_xkl_config, helper);
+
     xkl_engine_stop_listen (helper->engine, XKLL_TRACK_KEYBOARD_STATE);
     gdk_window_remove_filter (NULL, (GdkFilterFunc) handle_xevent, helper);
     g_object_unref (helper->config);
@@ -150,39 +208,67 @@ xfce_keyboard_layout_helper_finalize (GObject *object)
     g_free (helper->system_keyboard_model);
 #endif /* HAVE_LIBXKLAVIER */
 
+    xfce_xmodmap_free (helper->xmodmap);
+
     G_OBJECT_CLASS (xfce_keyboard_layout_helper_parent_class)->finalize (object);
 }
 
 
 static void
-xfce_keyboard_layout_helper_process_xmodmap (void)
+xfce_keyboard_layout_helper_process_xmodmap (XfceKeyboardLayoutHelper *helper)
 {
-    const gchar *xmodmap_path;
+    /* applied in-process if we understand all of it, the file is
+     * only read again when it changed */
+    xfce_xmodmap_apply (helper->xmodmap, GDK_DISPLAY ());
+}
 
-    xmodmap_path = g_build_filename (xfce_get_homedir (), ".Xmodmap", NULL);
+#ifdef HAVE_LIBXKLAVIER
+
+static void
+xfce_keyboard_layout_helper_activate_later (XfceKeyboardLayoutHelper *helper)
+{
+    /* every activation compiles the keymap and sends it to the server,
+     * which notifies all clients, so changes are activated together */
+    helper->n_changes++;
 
-    if (g_file_test (xmodmap_path, G_FILE_TEST_EXISTS))
+    if (helper->activate_timeout_id == 0)
     {
-        /* There is a .Xmodmap file, try to use it */
-        const gchar *xmodmap_command;
-        GError      *error = NULL;
+        helper->activate_timeout_id = g_timeout_add (ACTIVATE_SETTLE_INTERVAL,
+                                                     xfce_keyboard_layout_helper_activate,
+                                                     helper);
+    }
+}
 
-        xmodmap_command = g_strconcat ("xmodmap ", xmodmap_path, NULL);
+static gboolean
+xfce_keyboard_layout_helper_activate (gpointer user_data)
+{
+    XfceKeyboardLayoutHelper *helper = XFCE_KEYBOARD_LAYOUT_HELPER (user_data);
+    XfsdStatsMark             mark;
 
-        xfsettings_dbg (XFSD_DEBUG_KEYBOARD_LAYOUT, "spawning \"%s\"", xmodmap_command);
+    helper->activate_timeout_id = 0;
 
-        /* Launch the xmodmap command and only print errors when in debugging mode */
-        if (!g_spawn_command_line_async (xmodmap_command, &error))
-        {
-            DBG ("Xmodmap call failed: %s", error->message);
-            g_error_free (error);
-        }
-    }
+    if (helper->n_changes == 0)
+        return FALSE;
 
-    g_free ((gchar*) xmodmap_path);
-}
+    xfsettings_stats_begin (&mark, G_STRFUNC);
 
-#ifdef HAVE_LIBXKLAVIER
+    xkl_config_rec_activate (helper->config, helper->engine);
+
+    helper->n_activations++;
+    helper->n_saved_activations += helper->n_changes - 1;
+
+    xfsettings_trace (XFSD_TRACE_KEYBOARD_LAYOUT_ACTIVATE, helper->n_changes,
+                      helper->n_activations, helper->n_saved_activations, 0);
+
+    helper->n_changes = 0;
+
+    /* the new keymap replaced the modifier mapping */
+    xfce_keyboard_layout_helper_process_xmodmap (helper);
+
+    xfsettings_stats_end (helper->stats, XFSD_STATS_EVENT, &mark);
+
+    return FALSE;
+}
 
 static void
 xfce_keyboard_layout_helper_set_model (XfceKeyboardLayoutHelper *helper)
@@ -191,7 +277,7 @@ xfce_keyboard_layout_helper_set_model (XfceKeyboardLayoutHelper *helper)
 
     if (!helper->xkb_disable_settings)
     {
-        xkbmodel = xfconf_channel_get_string (helper->channel, "/Default/XkbModel", NULL);
+        xkbmodel = xfsettings_prefetch_get_string (helper->channel, "/Default/XkbModel", NULL);
         if (!xkbmodel || !*xkbmodel)
         {
             /* If xkb model is not set by user, we want to try to use the system default */
@@ -203,7 +289,7 @@ xfce_keyboard_layout_helper_set_model (XfceKeyboardLayoutHelper *helper)
         {
             g_free (helper->config->model);
             helper->config->model = xkbmodel;
-            xkl_config_rec_activate (helper->config, helper->engine);
+            xfce_keyboard_layout_helper_activate_later (helper);
 
             xfsettings_dbg (XFSD_DEBUG_KEYBOARD_LAYOUT, "set model to \"%s\"", xkbmodel);
         }
@@ -226,15 +312,15 @@ xfce_keyboard_layout_helper_set (XfceKeyboardLayoutHelper *helper,
     if (!helper->xkb_disable_settings)
     {
         xfconf_values  = g_strjoinv (",", *xkl_config_option);
-        xkl_values  = xfconf_channel_get_string (helper->channel,
-                                                 xfconf_option_name, xfconf_values);
+        xkl_values  = xfsettings_prefetch_get_string (helper->channel,
+                                                      xfconf_option_name, xfconf_values);
 
         if (g_strcmp0 (xfconf_values, xkl_values) != 0)
         {
             values = g_strsplit_set (xkl_values, ",", 0);
             g_strfreev (*xkl_config_option);
             *xkl_config_option = values;
-            xkl_config_rec_activate (helper->config, helper->engine);
+            xfce_keyboard_layout_helper_activate_later (helper);
 
             xfsettings_dbg (XFSD_DEBUG_KEYBOARD_LAYOUT, "set %s to \"%s\"", debug_name, xkl_values);
         }
@@ -316,8 +402,8 @@ xfce_keyboard_layout_helper_set_option (XfceKeyboardLayoutHelper *helper,
         xkl_option_value = xfce_keyboard_layout_get_option (helper->config->options,
                                                             xkb_option_name, &other_options);
 
-        option_value = xfconf_channel_get_string (helper->channel, xfconf_option_name,
-                                                  xkl_option_value);
+        option_value = xfsettings_prefetch_get_string (helper->channel, xfconf_option_name,
+                                                       xkl_option_value);
         if (g_strcmp0 (option_value, xkl_option_value) != 0)
         {
             gchar *options_string;
@@ -339,7 +425,7 @@ xfce_keyboard_layout_helper_set_option (XfceKeyboardLayoutHelper *helper,
 
             g_strfreev (helper->config->options);
             helper->config->options = g_strsplit (options_string, ",", 0);
-            xkl_config_rec_activate (helper->config, helper->engine);
+            xfce_keyboard_layout_helper_activate_later (helper);
 
             xfsettings_dbg (XFSD_DEBUG_KEYBOARD_LAYOUT, "set %s to \"%s\"",
                             xkb_option_name, option_value);
@@ -369,8 +455,12 @@ xfce_keyboard_layout_helper_channel_property_changed (XfconfChannel      *channe
                                                const GValue              *value,
                                                XfceKeyboardLayoutHelper  *helper)
 {
+    XfsdStatsMark mark;
+
     g_return_if_fail (helper->channel == channel);
 
+    xfsettings_stats_begin_xfconf (&mark, G_STRFUNC, property_name);
+
     if (strcmp (property_name, "/Default/XkbDisable") == 0)
     {
         helper->xkb_disable_settings = g_value_get_boolean (value);
@@ -401,7 +491,7 @@ xfce_keyboard_layout_helper_channel_property_changed (XfconfChannel      *channe
         xfce_keyboard_layout_helper_set_composekey (helper);
     }
 
-    xfce_keyboard_layout_helper_process_xmodmap ();
+    xfsettings_stats_end (helper->stats, XFSD_STATS_XFCONF, &mark);
 }
 
 static GdkFilterReturn
@@ -417,17 +507,21 @@ static void
 xfce_keyboard_layout_reset_xkl_config (XklEngine *xklengine,
                                        XfceKeyboardLayoutHelper *helper)
 {
+    XfsdStatsMark mark;
+
     if (!helper->xkb_disable_settings)
     {
         gchar *xfconf_model;
 
+        xfsettings_stats_begin (&mark, G_STRFUNC);
+
         xfsettings_dbg (XFSD_DEBUG_KEYBOARD_LAYOUT,
                         "New keyboard detected; restoring XKB settings.");
 
         xkl_config_rec_reset (helper->config);
         xkl_config_rec_get_from_server (helper->config, helper->engine);
 
-        xfconf_model = xfconf_channel_get_string (helper->channel, "/Default/XkbModel", NULL);
+        xfconf_model = xfsettings_prefetch_get_string (helper->channel, "/Default/XkbModel", NULL);
         if (xfconf_model && *xfconf_model &&
             g_strcmp0 (xfconf_model, helper->config->model) != 0 &&
             g_strcmp0 (helper->system_keyboard_model, helper->config->model) != 0)
@@ -456,7 +550,40 @@ xfce_keyboard_layout_reset_xkl_config (XklEngine *xklengine,
         xfce_keyboard_layout_helper_set_grpkey (helper);
         xfce_keyboard_layout_helper_set_composekey (helper);
 
-        xfce_keyboard_layout_helper_process_xmodmap ();
+        /* otherwise this happens after the activation */
+        if (helper->activate_timeout_id == 0)
+            xfce_keyboard_layout_helper_process_xmodmap (helper);
+
+        xfsettings_stats_end (helper->stats, XFSD_STATS_EVENT, &mark);
     }
 }
 #endif /* HAVE_LIBXKLAVIER */
+
+
+
+#ifdef HAVE_LIBXKLAVIER
+G_MODULE_EXPORT const gchar *
+g_module_check_init (GModule *module)
+{
+    /* libxklavier registers static types, it can not be unloaded */
+    g_module_make_resident (module);
+
+    return NULL;
+}
+#endif /* HAVE_LIBXKLAVIER */
+
+
+
+G_MODULE_EXPORT void
+xfsettingsd_helper_register_types (GTypeModule *type_module)
+{
+    xfce_keyboard_layout_helper_register_type (type_module);
+}
+
+
+
+G_MODULE_EXPORT GObject *
+xfsettingsd_helper_new (gboolean replace)
+{
+    return g_object_new (XFCE_TYPE_KEYBOARD_LAYOUT_HELPER, NULL);
+}
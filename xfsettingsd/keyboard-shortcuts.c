@@ -43,6 +43,9 @@
 
 #include "debug.h"
 #include "keyboard-shortcuts.h"
+#include "keyboard-launcher.h"
+#include "stats.h"
+#include "trace.h"
 
 
 
@@ -54,6 +57,10 @@ enum
 
 
 
+typedef struct _XfceShortcutEntry XfceShortcutEntry;
+
+
+
 static void            xfce_keyboard_shortcuts_helper_finalize           (GObject                          *object);
 static void            xfce_keyboard_shortcuts_helper_shortcut_added     (XfceShortcutsProvider            *provider,
                                                                           const gchar                      *shortcut,
@@ -66,6 +73,8 @@ static void            xfce_keyboard_shortcuts_helper_shortcut_activated (XfceSh
                                                                           gint                              timestamp,
                                                                           XfceKeyboardShortcutsHelper      *helper);
 static void            xfce_keyboard_shortcuts_helper_load_shortcuts     (XfceKeyboardShortcutsHelper      *helper);
+static void            xfce_keyboard_shortcuts_helper_entry_free         (XfceShortcutEntry                *entry);
+static gsize           xfce_keyboard_shortcuts_helper_entries_size       (gpointer                          user_data);
 
 
 
@@ -83,6 +92,22 @@ struct _XfceKeyboardShortcutsHelper
 
   XfceShortcutsGrabber  *grabber;
   XfceShortcutsProvider *provider;
+
+  /* Accelerator -> XfceShortcutEntry, so activating a shortcut does
+   * not need a round-trip to xfconfd */
+  GHashTable            *entries;
+
+  XfsdStats             *stats;
+};
+
+struct _XfceShortcutEntry
+{
+  gchar     *command;
+
+  /* Parsed command, NULL if the command can not be parsed */
+  gchar    **argv;
+
+  gboolean   snotify;
 };
 
 
@@ -105,6 +130,8 @@ xfce_keyboard_shortcuts_helper_class_init (XfceKeyboardShortcutsHelperClass *kla
 static void
 xfce_keyboard_shortcuts_helper_init (XfceKeyboardShortcutsHelper *helper)
 {
+  helper->stats = xfsettings_stats_get ("keyboard-shortcuts");
+
   /* Create shortcuts grabber */
   helper->grabber = xfce_shortcuts_grabber_new ();
 
@@ -114,6 +141,10 @@ xfce_keyboard_shortcuts_helper_init (XfceKeyboardShortcutsHelper *helper)
   /* Create shortcuts provider */
   helper->provider = xfce_shortcuts_provider_new ("commands");
 
+  helper->entries = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+                                           (GDestroyNotify) xfce_keyboard_shortcuts_helper_entry_free);
+  xfsettings_stats_watch_bytes (helper->stats, xfce_keyboard_shortcuts_helper_entries_size, helper);
+
   /* Be notified of property changes */
   g_signal_connect (helper->provider, "shortcut-added", G_CALLBACK (xfce_keyboard_shortcuts_helper_shortcut_added), helper);
   g_signal_connect (helper->provider, "shortcut-removed", G_CALLBACK (xfce_keyboard_shortcuts_helper_shortcut_removed), helper);
@@ -134,20 +165,99 @@ xfce_keyboard_shortcuts_helper_finalize (GObject *object)
   /* Free shortcuts grabber */
   g_object_unref (helper->grabber);
 
+  xfsettings_stats_watch_bytes (helper->stats, NULL, NULL);
+  g_hash_table_destroy (helper->entries);
+
   (*G_OBJECT_CLASS (xfce_keyboard_shortcuts_helper_parent_class)->finalize) (object);
 }
 
 
 
+static void
+xfce_keyboard_shortcuts_helper_entry_free (XfceShortcutEntry *entry)
+{
+  g_free (entry->command);
+  g_strfreev (entry->argv);
+  g_free (entry);
+}
+
+
+
+static gsize
+xfce_keyboard_shortcuts_helper_entries_size (gpointer user_data)
+{
+  XfceKeyboardShortcutsHelper *helper = XFCE_KEYBOARD_SHORTCUTS_HELPER (user_data);
+  GHashTableIter               iter;
+  gpointer                     key, value;
+  XfceShortcutEntry           *entry;
+  gsize                        size = 0;
+  guint                        n;
+
+  g_hash_table_iter_init (&iter, helper->entries);
+  while (g_hash_table_iter_next (&iter, &key, &value))
+    {
+      entry = value;
+      size += strlen (key) + 1 + sizeof (XfceShortcutEntry);
+
+      if (entry->command != NULL)
+        size += strlen (entry->command) + 1;
+
+      for (n = 0; entry->argv != NULL && entry->argv[n] != NULL; n++)
+        size += strlen (entry->argv[n]) + 1 + sizeof (gchar *);
+    }
+
+  return size;
+}
+
+
+
+static void
+xfce_keyboard_shortcuts_helper_entry_add (XfceKeyboardShortcutsHelper *helper,
+                                          XfceShortcut                *shortcut)
+{
+  XfceShortcutEntry *entry;
+
+  entry = g_new0 (XfceShortcutEntry, 1);
+  entry->command = g_strdup (shortcut->command);
+  entry->snotify = shortcut->snotify;
+
+  /* Parse the command once, the error is reported on activation */
+  if (entry->command != NULL)
+    g_shell_parse_argv (entry->command, NULL, &entry->argv, NULL);
+
+  g_hash_table_replace (helper->entries, g_strdup (shortcut->shortcut), entry);
+}
+
+
+
 static void
 xfce_keyboard_shortcuts_helper_shortcut_added (XfceShortcutsProvider       *provider,
                                                const gchar                 *shortcut,
                                                XfceKeyboardShortcutsHelper *helper)
 {
+  XfceShortcut  *sc;
+  XfsdStatsMark  mark;
+
   g_return_if_fail (XFCE_IS_KEYBOARD_SHORTCUTS_HELPER (helper));
+
+  xfsettings_stats_begin (&mark, G_STRFUNC);
   xfce_shortcuts_grabber_add (helper->grabber, shortcut);
 
+  /* Remember the command of the new shortcut */
+  sc = xfce_shortcuts_provider_get_shortcut (provider, shortcut);
+  if (G_LIKELY (sc != NULL))
+    {
+      xfce_keyboard_shortcuts_helper_entry_add (helper, sc);
+      xfce_shortcut_free (sc);
+    }
+  else
+    {
+      g_hash_table_remove (helper->entries, shortcut);
+    }
+
   xfsettings_dbg (XFSD_DEBUG_KEYBOARD_SHORTCUTS, "add \"%s\"", shortcut);
+
+  xfsettings_stats_end (helper->stats, XFSD_STATS_XFCONF, &mark);
 }
 
 
@@ -157,25 +267,18 @@ xfce_keyboard_shortcuts_helper_shortcut_removed (XfceShortcutsProvider       *pr
                                                  const gchar                 *shortcut,
                                                  XfceKeyboardShortcutsHelper *helper)
 {
-  g_return_if_fail (XFCE_IS_KEYBOARD_SHORTCUTS_HELPER (helper));
-  xfce_shortcuts_grabber_remove (helper->grabber, shortcut);
-
-  xfsettings_dbg (XFSD_DEBUG_KEYBOARD_SHORTCUTS, "remove \"%s\"", shortcut);
-}
+  XfsdStatsMark mark;
 
+  g_return_if_fail (XFCE_IS_KEYBOARD_SHORTCUTS_HELPER (helper));
 
+  xfsettings_stats_begin (&mark, G_STRFUNC);
+  xfce_shortcuts_grabber_remove (helper->grabber, shortcut);
 
-static void
-_xfce_keyboard_shortcuts_helper_load_shortcut (XfceShortcut                *shortcut,
-                                               XfceKeyboardShortcutsHelper *helper)
-{
-  g_return_if_fail (shortcut != NULL);
-  g_return_if_fail (XFCE_IS_KEYBOARD_SHORTCUTS_HELPER (helper));
+  g_hash_table_remove (helper->entries, shortcut);
 
-  xfce_shortcuts_grabber_add (helper->grabber, shortcut->shortcut);
+  xfsettings_dbg (XFSD_DEBUG_KEYBOARD_SHORTCUTS, "remove \"%s\"", shortcut);
 
-  xfsettings_dbg_filtered (XFSD_DEBUG_KEYBOARD_SHORTCUTS, "loaded \"%s\" => \"%s\"",
-                           shortcut->shortcut, shortcut->command);
+  xfsettings_stats_end (helper->stats, XFSD_STATS_XFCONF, &mark);
 }
 
 
@@ -183,15 +286,33 @@ _xfce_keyboard_shortcuts_helper_load_shortcut (XfceShortcut                *shor
 static void
 xfce_keyboard_shortcuts_helper_load_shortcuts (XfceKeyboardShortcutsHelper *helper)
 {
-  GList *shortcuts;
+  GList        *shortcuts, *li;
+  XfceShortcut *shortcut;
+  guint         n_shortcuts = 0;
+  GTimer       *timer;
 
   g_return_if_fail (XFCE_IS_KEYBOARD_SHORTCUTS_HELPER (helper));
 
+  timer = g_timer_new ();
+
   /* Load shortcuts one by one */
   shortcuts = xfce_shortcuts_provider_get_shortcuts (helper->provider);
-  g_list_foreach (shortcuts, (GFunc) _xfce_keyboard_shortcuts_helper_load_shortcut, helper);
-  xfsettings_dbg (XFSD_DEBUG_KEYBOARD_SHORTCUTS, "%d shortcuts loaded", g_list_length (shortcuts));
+  for (li = shortcuts; li != NULL; li = li->next)
+    {
+      shortcut = li->data;
+      xfce_shortcuts_grabber_add (helper->grabber, shortcut->shortcut);
+      xfce_keyboard_shortcuts_helper_entry_add (helper, shortcut);
+      n_shortcuts++;
+
+      xfsettings_dbg_filtered (XFSD_DEBUG_KEYBOARD_SHORTCUTS, "loaded \"%s\" => \"%s\"",
+                               shortcut->shortcut, shortcut->command);
+    }
   xfce_shortcuts_free (shortcuts);
+
+  xfsettings_dbg (XFSD_DEBUG_KEYBOARD_SHORTCUTS, "%u shortcuts loaded in %.1f ms",
+                  n_shortcuts, g_timer_elapsed (timer, NULL) * 1000.0);
+
+  g_timer_destroy (timer);
 }
 
 
@@ -202,48 +323,76 @@ xfce_keyboard_shortcuts_helper_shortcut_activated (XfceShortcutsGrabber        *
                                                    gint                         timestamp,
                                                    XfceKeyboardShortcutsHelper *helper)
 {
-  XfceShortcut  *sc;
-  GError        *error = NULL;
-  gchar        **argv;
-  gboolean       succeed;
+  XfceShortcutEntry  *entry;
+  GError             *error = NULL;
+  gboolean            succeed;
+  GdkScreen          *screen;
+  GTimeVal            key_time, now;
+  XfsdStatsMark       mark;
 
   g_return_if_fail (XFCE_IS_KEYBOARD_SHORTCUTS_HELPER (helper));
-  g_return_if_fail (XFCE_IS_SHORTCUTS_PROVIDER (helper->provider));
+
+  /* Start of the launch latency */
+  g_get_current_time (&key_time);
 
   /* Ignore empty shortcuts */
-  if (shortcut == NULL || g_utf8_strlen (shortcut, -1) == 0)
+  if (shortcut == NULL || *shortcut == '\0')
     return;
 
-  /* Get shortcut from the provider */
-  sc = xfce_shortcuts_provider_get_shortcut (helper->provider, shortcut);
+  xfsettings_stats_begin (&mark, G_STRFUNC);
 
-  if (G_UNLIKELY (sc == NULL))
+  /* Get the shortcut from the table */
+  entry = g_hash_table_lookup (helper->entries, shortcut);
+
+  if (G_UNLIKELY (entry == NULL))
    {
       xfsettings_dbg (XFSD_DEBUG_KEYBOARD_SHORTCUTS, "\"%s\" not found", shortcut);
+      xfsettings_stats_end (helper->stats, XFSD_STATS_EVENT, &mark);
       return;
    }
 
-  xfsettings_dbg (XFSD_DEBUG_KEYBOARD_SHORTCUTS,
-                  "activated \"%s\" (command=\"%s\", snotify=%d, stamp=%d)",
-                  shortcut, sc->command, sc->snotify, timestamp);
+  xfsettings_trace (XFSD_TRACE_SHORTCUT_ACTIVATED, g_quark_from_string (shortcut),
+                    timestamp, 0, 0);
 
   /* Handle the argv ourselfs, because xfce_spawn_command_line_on_screen() does
    * not accept a custom timestamp for startup notification */
-  succeed = g_shell_parse_argv (sc->command, NULL, &argv, &error);
-  if (G_LIKELY (succeed))
+  if (G_LIKELY (entry->argv != NULL))
     {
-      succeed = xfce_spawn_on_screen (xfce_gdk_screen_get_active (NULL),
-                                      NULL, argv, NULL, G_SPAWN_SEARCH_PATH,
-                                      sc->snotify, timestamp, NULL, &error);
-
-      g_strfreev (argv);
+      screen = xfce_gdk_screen_get_active (NULL);
+
+      /* Startup notification needs the X connection, so only commands
+       * without it are sent to the launcher process */
+      if (!entry->snotify
+          && xfce_launcher_spawn (screen, entry->argv, shortcut, &key_time))
+        {
+          xfsettings_stats_end (helper->stats, XFSD_STATS_EVENT, &mark);
+          return;
+        }
+
+      succeed = xfce_spawn_on_screen (screen, NULL, entry->argv, NULL, G_SPAWN_SEARCH_PATH,
+                                      entry->snotify, timestamp, NULL, &error);
+
+      if (succeed)
+        {
+          g_get_current_time (&now);
+          xfsettings_dbg (XFSD_DEBUG_KEYBOARD_SHORTCUTS,
+                          "launched \"%s\" %.2f ms after the key press (without launcher)",
+                          shortcut, (now.tv_sec - key_time.tv_sec) * 1000.0
+                                    + (now.tv_usec - key_time.tv_usec) / 1000.0);
+        }
+    }
+  else
+    {
+      /* Parse again for the error message */
+      succeed = g_shell_parse_argv (entry->command != NULL ? entry->command : "",
+                                    NULL, NULL, &error);
     }
 
+  xfsettings_stats_end (helper->stats, XFSD_STATS_EVENT, &mark);
+
   if (!succeed)
     {
       xfce_dialog_show_error (NULL, error, _("Failed to launch shortcut \"%s\""), shortcut);
       g_error_free (error);
     }
-
-  xfce_shortcut_free (sc);
 }
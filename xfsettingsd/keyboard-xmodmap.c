@@ -0,0 +1,685 @@
+/*
+ *  Copyright (c) 2012 The Xfce Development Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+#ifdef HAVE_SYS_TYPES_H
+#include <sys/types.h>
+#endif
+#ifdef HAVE_SYS_STAT_H
+#include <sys/stat.h>
+#endif
+
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <gdk/gdk.h>
+#include <libxfce4util/libxfce4util.h>
+
+#include "debug.h"
+#include "keyboard-xmodmap.h"
+
+
+
+/* the server refuses a new modifier mapping while one of the
+ * modifiers is pressed, retry a few times without blocking */
+#define MODMAP_BUSY_INTERVAL (100)
+#define MODMAP_BUSY_ATTEMPTS (10)
+
+
+typedef struct _XfceXmodmapCommand XfceXmodmapCommand;
+
+typedef enum
+{
+    XMODMAP_KEYCODE,
+    XMODMAP_KEYSYM,
+    XMODMAP_ADD,
+    XMODMAP_REMOVE,
+    XMODMAP_CLEAR
+}
+XfceXmodmapCommandType;
+
+struct _XfceXmodmapCommand
+{
+    XfceXmodmapCommandType  type;
+
+    /* left-hand side, depending on the type */
+    gint                    keycode;
+    KeySym                  keysym;
+    gint                    modifier;
+
+    /* right-hand side */
+    KeySym                 *keysyms;
+    gint                    n_keysyms;
+};
+
+struct _XfceXmodmap
+{
+    gchar           *filename;
+
+    /* what the parsed commands belong to */
+    time_t           mtime;
+    off_t            size;
+    gchar           *checksum;
+
+    /* NULL if the file needs the real xmodmap */
+    GPtrArray       *commands;
+
+    /* keymap of the server before applying, or after the keymap
+     * changes while evaluating the add expressions */
+    KeySym          *keymap;
+    gint             min_keycode;
+    gint             max_keycode;
+    gint             keysyms_per_keycode;
+
+    /* modifier mapping waiting for the modifiers to be released */
+    XModifierKeymap *busy_modmap;
+    Display         *busy_display;
+    guint            busy_timeout_id;
+    guint            busy_attempts;
+};
+
+
+
+static const gchar *modifier_names[] =
+{
+    "shift", "lock", "control", "mod1", "mod2", "mod3", "mod4", "mod5"
+};
+
+
+
+static void
+xfce_xmodmap_command_free (XfceXmodmapCommand *command)
+{
+    g_free (command->keysyms);
+    g_free (command);
+}
+
+
+
+static gboolean
+xfce_xmodmap_parse_keysym (const gchar *name,
+                           KeySym      *keysym)
+{
+    gchar *end;
+
+    if (strcmp (name, "NoSymbol") == 0)
+    {
+        *keysym = NoSymbol;
+        return TRUE;
+    }
+
+    *keysym = XStringToKeysym (name);
+    if (*keysym != NoSymbol)
+        return TRUE;
+
+    /* numeric keysyms, like xmodmap accepts them */
+    if (g_ascii_isdigit (*name))
+    {
+        *keysym = strtoul (name, &end, 0);
+        return *end == '\0';
+    }
+
+    return FALSE;
+}
+
+
+
+static gint
+xfce_xmodmap_parse_modifier (const gchar *name)
+{
+    guint n;
+
+    for (n = 0; n < G_N_ELEMENTS (modifier_names); n++)
+        if (g_ascii_strcasecmp (name, modifier_names[n]) == 0)
+            return n;
+
+    return -1;
+}
+
+
+
+static XfceXmodmapCommand *
+xfce_xmodmap_parse_line (const gchar *line)
+{
+    XfceXmodmapCommand  *command;
+    gchar              **tokens, **p;
+    GString             *spaced;
+    gchar               *end;
+    gint                 n_tokens, n;
+
+    /* make sure the equal sign is a token of its own */
+    spaced = g_string_sized_new (strlen (line) + 2);
+    for (; *line != '\0'; line++)
+    {
+        if (*line == '=')
+            g_string_append (spaced, " = ");
+        else
+            g_string_append_c (spaced, *line);
+    }
+
+    tokens = g_strsplit_set (spaced->str, " \t", -1);
+    g_string_free (spaced, TRUE);
+
+    /* drop the empty tokens */
+    for (p = tokens, n_tokens = 0; *p != NULL; p++)
+    {
+        if (**p != '\0')
+            tokens[n_tokens++] = *p;
+        else
+            g_free (*p);
+    }
+    tokens[n_tokens] = NULL;
+
+    command = g_new0 (XfceXmodmapCommand, 1);
+
+    if (n_tokens == 2 && strcmp (tokens[0], "clear") == 0)
+    {
+        command->type = XMODMAP_CLEAR;
+        command->modifier = xfce_xmodmap_parse_modifier (tokens[1]);
+        if (command->modifier == -1)
+            goto unsupported;
+
+        g_strfreev (tokens);
+        return command;
+    }
+
+    if (n_tokens < 3 || strcmp (tokens[2], "=") != 0)
+        goto unsupported;
+
+    if (strcmp (tokens[0], "keycode") == 0)
+    {
+        /* "keycode any" is not supported */
+        command->type = XMODMAP_KEYCODE;
+        command->keycode = strtol (tokens[1], &end, 0);
+        if (*end != '\0' || command->keycode <= 0 || command->keycode > 255)
+            goto unsupported;
+    }
+    else if (strcmp (tokens[0], "keysym") == 0)
+    {
+        command->type = XMODMAP_KEYSYM;
+        if (!xfce_xmodmap_parse_keysym (tokens[1], &command->keysym)
+            || command->keysym == NoSymbol)
+            goto unsupported;
+    }
+    else if (strcmp (tokens[0], "add") == 0
+             || strcmp (tokens[0], "remove") == 0)
+    {
+        command->type = tokens[0][0] == 'a' ? XMODMAP_ADD : XMODMAP_REMOVE;
+        command->modifier = xfce_xmodmap_parse_modifier (tokens[1]);
+        if (command->modifier == -1)
+            goto unsupported;
+    }
+    else
+    {
+        goto unsupported;
+    }
+
+    command->n_keysyms = n_tokens - 3;
+    command->keysyms = g_new0 (KeySym, MAX (command->n_keysyms, 1));
+    for (n = 0; n < command->n_keysyms; n++)
+        if (!xfce_xmodmap_parse_keysym (tokens[n + 3], &command->keysyms[n]))
+            goto unsupported;
+
+    g_strfreev (tokens);
+
+    return command;
+
+    unsupported:
+
+    xfce_xmodmap_command_free (command);
+    g_strfreev (tokens);
+
+    return NULL;
+}
+
+
+
+static GPtrArray *
+xfce_xmodmap_parse (const gchar *contents)
+{
+    GPtrArray           *commands;
+    XfceXmodmapCommand  *command;
+    gchar              **lines;
+    gchar               *line;
+    guint                n;
+
+    commands = g_ptr_array_new_with_free_func ((GDestroyNotify) xfce_xmodmap_command_free);
+
+    lines = g_strsplit (contents, "\n", -1);
+    for (n = 0; lines[n] != NULL; n++)
+    {
+        /* skip empty lines and comments */
+        line = g_strstrip (lines[n]);
+        if (*line == '\0' || *line == '!')
+            continue;
+
+        command = xfce_xmodmap_parse_line (line);
+        if (command == NULL)
+        {
+            xfsettings_dbg (XFSD_DEBUG_KEYBOARD_LAYOUT,
+                            "xmodmap expression \"%s\" is not supported", line);
+
+            g_ptr_array_unref (commands);
+            commands = NULL;
+            break;
+        }
+
+        g_ptr_array_add (commands, command);
+    }
+    g_strfreev (lines);
+
+    return commands;
+}
+
+
+
+static void
+xfce_xmodmap_drop_modifiers (XfceXmodmap *xmodmap)
+{
+    if (xmodmap->busy_timeout_id != 0)
+    {
+        g_source_remove (xmodmap->busy_timeout_id);
+        xmodmap->busy_timeout_id = 0;
+    }
+
+    if (xmodmap->busy_modmap != NULL)
+    {
+        XFreeModifiermap (xmodmap->busy_modmap);
+        xmodmap->busy_modmap = NULL;
+    }
+}
+
+
+
+static gboolean
+xfce_xmodmap_set_modifiers (gpointer data)
+{
+    XfceXmodmap *xmodmap = data;
+    gint         status;
+
+    gdk_error_trap_push ();
+    status = XSetModifierMapping (xmodmap->busy_display, xmodmap->busy_modmap);
+    if (gdk_error_trap_pop () != 0)
+        status = MappingFailed;
+
+    if (status == MappingBusy && ++xmodmap->busy_attempts < MODMAP_BUSY_ATTEMPTS)
+    {
+        if (xmodmap->busy_timeout_id == 0)
+            xmodmap->busy_timeout_id = g_timeout_add (MODMAP_BUSY_INTERVAL,
+                                                      xfce_xmodmap_set_modifiers,
+                                                      xmodmap);
+        return TRUE;
+    }
+
+    if (status != MappingSuccess)
+        g_warning ("Failed to set the modifier mapping from %s", xmodmap->filename);
+
+    /* the source is removed by returning FALSE */
+    xmodmap->busy_timeout_id = 0;
+    xfce_xmodmap_drop_modifiers (xmodmap);
+
+    return FALSE;
+}
+
+
+
+XfceXmodmap *
+xfce_xmodmap_new (const gchar *filename)
+{
+    XfceXmodmap *xmodmap;
+
+    xmodmap = g_new0 (XfceXmodmap, 1);
+    xmodmap->filename = g_strdup (filename);
+
+    return xmodmap;
+}
+
+
+
+void
+xfce_xmodmap_free (XfceXmodmap *xmodmap)
+{
+    if (xmodmap == NULL)
+        return;
+
+    xfce_xmodmap_drop_modifiers (xmodmap);
+
+    if (xmodmap->commands != NULL)
+        g_ptr_array_unref (xmodmap->commands);
+
+    g_free (xmodmap->checksum);
+    g_free (xmodmap->filename);
+    g_free (xmodmap);
+}
+
+
+
+static gboolean
+xfce_xmodmap_load (XfceXmodmap *xmodmap)
+{
+    struct stat  st;
+    gchar       *contents;
+    gsize        length;
+    gchar       *checksum;
+    GError      *error = NULL;
+
+    if (g_stat (xmodmap->filename, &st) != 0)
+        return FALSE;
+
+    /* nothing changed since the last time */
+    if (xmodmap->checksum != NULL
+        && st.st_mtime == xmodmap->mtime
+        && st.st_size == xmodmap->size)
+        return TRUE;
+
+    if (!g_file_get_contents (xmodmap->filename, &contents, &length, &error))
+    {
+        g_warning ("Failed to read %s: %s", xmodmap->filename, error->message);
+        g_error_free (error);
+        return FALSE;
+    }
+
+    xmodmap->mtime = st.st_mtime;
+    xmodmap->size = st.st_size;
+
+    /* the file was touched, but the contents are the same */
+    checksum = g_compute_checksum_for_string (G_CHECKSUM_MD5, contents, length);
+    if (g_strcmp0 (checksum, xmodmap->checksum) != 0)
+    {
+        g_free (xmodmap->checksum);
+        xmodmap->checksum = checksum;
+
+        if (xmodmap->commands != NULL)
+            g_ptr_array_unref (xmodmap->commands);
+        xmodmap->commands = xfce_xmodmap_parse (contents);
+
+        xfsettings_dbg (XFSD_DEBUG_KEYBOARD_LAYOUT, "parsed %s: %s",
+                        xmodmap->filename,
+                        xmodmap->commands != NULL ? "applied in-process" : "using xmodmap");
+    }
+    else
+    {
+        g_free (checksum);
+    }
+
+    g_free (contents);
+
+    return TRUE;
+}
+
+
+
+static void
+xfce_xmodmap_spawn (XfceXmodmap *xmodmap)
+{
+    gchar  *command;
+    GError *error = NULL;
+
+    command = g_strconcat ("xmodmap ", xmodmap->filename, NULL);
+
+    xfsettings_dbg (XFSD_DEBUG_KEYBOARD_LAYOUT, "spawning \"%s\"", command);
+
+    /* Launch the xmodmap command and only print errors when in debugging mode */
+    if (!g_spawn_command_line_async (command, &error))
+    {
+        DBG ("Xmodmap call failed: %s", error->message);
+        g_error_free (error);
+    }
+
+    g_free (command);
+}
+
+
+
+static KeySym *
+xfce_xmodmap_get_keymap (XfceXmodmap *xmodmap,
+                         Display     *xdisplay)
+{
+    if (xmodmap->keymap == NULL)
+    {
+        xmodmap->keymap = XGetKeyboardMapping (xdisplay, xmodmap->min_keycode,
+                                               xmodmap->max_keycode - xmodmap->min_keycode + 1,
+                                               &xmodmap->keysyms_per_keycode);
+    }
+
+    return xmodmap->keymap;
+}
+
+
+
+static void
+xfce_xmodmap_drop_keymap (XfceXmodmap *xmodmap)
+{
+    if (xmodmap->keymap != NULL)
+    {
+        XFree (xmodmap->keymap);
+        xmodmap->keymap = NULL;
+    }
+}
+
+
+
+static GArray *
+xfce_xmodmap_find_keycodes (XfceXmodmap *xmodmap,
+                            Display     *xdisplay,
+                            KeySym       keysym)
+{
+    GArray  *keycodes;
+    KeySym  *keymap;
+    KeyCode  keycode;
+    gint     n, col;
+
+    keycodes = g_array_new (FALSE, FALSE, sizeof (KeyCode));
+
+    keymap = xfce_xmodmap_get_keymap (xmodmap, xdisplay);
+    if (keymap == NULL)
+        return keycodes;
+
+    /* all the keys that have the keysym, like xmodmap */
+    for (n = xmodmap->min_keycode; n <= xmodmap->max_keycode; n++)
+    {
+        for (col = 0; col < xmodmap->keysyms_per_keycode; col++)
+        {
+            if (keymap[(n - xmodmap->min_keycode) * xmodmap->keysyms_per_keycode + col] == keysym)
+            {
+                keycode = n;
+                g_array_append_val (keycodes, keycode);
+                break;
+            }
+        }
+    }
+
+    return keycodes;
+}
+
+
+
+static void
+xfce_xmodmap_change_key (XfceXmodmap        *xmodmap,
+                         Display            *xdisplay,
+                         gint                keycode,
+                         XfceXmodmapCommand *command)
+{
+    KeySym no_symbol = NoSymbol;
+
+    if (keycode < xmodmap->min_keycode || keycode > xmodmap->max_keycode)
+        return;
+
+    if (command->n_keysyms > 0)
+        XChangeKeyboardMapping (xdisplay, keycode, command->n_keysyms, command->keysyms, 1);
+    else
+        XChangeKeyboardMapping (xdisplay, keycode, 1, &no_symbol, 1);
+}
+
+
+
+static void
+xfce_xmodmap_change_modifier (XfceXmodmap         *xmodmap,
+                              Display             *xdisplay,
+                              XModifierKeymap    **modmap,
+                              XfceXmodmapCommand  *command)
+{
+    GArray *keycodes;
+    gint    k;
+    guint   i;
+
+    for (k = 0; k < command->n_keysyms; k++)
+    {
+        keycodes = xfce_xmodmap_find_keycodes (xmodmap, xdisplay, command->keysyms[k]);
+        for (i = 0; i < keycodes->len; i++)
+        {
+            if (command->type == XMODMAP_ADD)
+                *modmap = XInsertModifiermapEntry (*modmap, g_array_index (keycodes, KeyCode, i),
+                                                   command->modifier);
+            else
+                *modmap = XDeleteModifiermapEntry (*modmap, g_array_index (keycodes, KeyCode, i),
+                                                   command->modifier);
+        }
+        g_array_free (keycodes, TRUE);
+    }
+}
+
+
+
+void
+xfce_xmodmap_apply (XfceXmodmap *xmodmap,
+                    Display     *xdisplay)
+{
+    XfceXmodmapCommand *command;
+    XModifierKeymap    *modmap = NULL;
+    GArray             *keycodes;
+    GPtrArray          *adds;
+    guint               n, i;
+    GTimer             *timer;
+
+    if (xmodmap == NULL || !xfce_xmodmap_load (xmodmap))
+        return;
+
+    if (xmodmap->commands == NULL)
+    {
+        xfce_xmodmap_spawn (xmodmap);
+        return;
+    }
+
+    timer = g_timer_new ();
+
+    XDisplayKeycodes (xdisplay, &xmodmap->min_keycode, &xmodmap->max_keycode);
+
+    gdk_error_trap_push ();
+
+    /* like xmodmap, the keysyms of keysym and remove expressions are
+     * looked up in the keymap from before any change, so swapping two
+     * keys works */
+    xfce_xmodmap_drop_keymap (xmodmap);
+    xfce_xmodmap_get_keymap (xmodmap, xdisplay);
+
+    /* add expressions are evaluated after all the keymap changes */
+    adds = g_ptr_array_new ();
+
+    for (n = 0; n < xmodmap->commands->len; n++)
+    {
+        command = g_ptr_array_index (xmodmap->commands, n);
+
+        switch (command->type)
+        {
+            case XMODMAP_KEYCODE:
+                xfce_xmodmap_change_key (xmodmap, xdisplay, command->keycode, command);
+                break;
+
+            case XMODMAP_KEYSYM:
+                keycodes = xfce_xmodmap_find_keycodes (xmodmap, xdisplay, command->keysym);
+                for (i = 0; i < keycodes->len; i++)
+                    xfce_xmodmap_change_key (xmodmap, xdisplay,
+                                             g_array_index (keycodes, KeyCode, i), command);
+                g_array_free (keycodes, TRUE);
+                break;
+
+            case XMODMAP_ADD:
+                g_ptr_array_add (adds, command);
+                break;
+
+            case XMODMAP_REMOVE:
+                /* the modifier mapping is sent once at the end, like xmodmap */
+                if (modmap == NULL)
+                    modmap = XGetModifierMapping (xdisplay);
+                if (modmap == NULL)
+                    break;
+
+                xfce_xmodmap_change_modifier (xmodmap, xdisplay, &modmap, command);
+                break;
+
+            case XMODMAP_CLEAR:
+                if (modmap == NULL)
+                    modmap = XGetModifierMapping (xdisplay);
+                if (modmap == NULL)
+                    break;
+
+                memset (modmap->modifiermap + command->modifier * modmap->max_keypermod,
+                        0, modmap->max_keypermod);
+                break;
+        }
+    }
+
+    if (adds->len > 0)
+    {
+        /* the keysyms of the add expressions are looked up in the
+         * changed keymap */
+        xfce_xmodmap_drop_keymap (xmodmap);
+
+        if (modmap == NULL)
+            modmap = XGetModifierMapping (xdisplay);
+
+        for (n = 0; modmap != NULL && n < adds->len; n++)
+            xfce_xmodmap_change_modifier (xmodmap, xdisplay, &modmap,
+                                          g_ptr_array_index (adds, n));
+    }
+
+    g_ptr_array_free (adds, TRUE);
+
+    if (modmap != NULL)
+    {
+        /* replaces a mapping still waiting for the modifiers */
+        xfce_xmodmap_drop_modifiers (xmodmap);
+        xmodmap->busy_modmap = modmap;
+        xmodmap->busy_display = xdisplay;
+        xmodmap->busy_attempts = 0;
+        xfce_xmodmap_set_modifiers (xmodmap);
+    }
+
+    xfce_xmodmap_drop_keymap (xmodmap);
+
+    if (gdk_error_trap_pop () != 0)
+        g_warning ("Failed to apply %s", xmodmap->filename);
+
+    xfsettings_dbg (XFSD_DEBUG_KEYBOARD_LAYOUT, "applied %u expressions of %s in %.1f ms",
+                    xmodmap->commands->len, xmodmap->filename,
+                    g_timer_elapsed (timer, NULL) * 1000.0);
+
+    g_timer_destroy (timer);
+}
@@ -0,0 +1,36 @@
+/*
+ *  Copyright (c) 2012 The Xfce Development Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __KEYBOARD_XMODMAP_H__
+#define __KEYBOARD_XMODMAP_H__
+
+#include <glib.h>
+#include <X11/Xlib.h>
+
+typedef struct _XfceXmodmap XfceXmodmap;
+
+/* the file is only parsed again when its contents changed, files
+ * with expressions we do not support are passed to xmodmap */
+XfceXmodmap *xfce_xmodmap_new   (const gchar *filename);
+
+void         xfce_xmodmap_free  (XfceXmodmap *xmodmap);
+
+void         xfce_xmodmap_apply (XfceXmodmap *xmodmap,
+                                 Display     *xdisplay);
+
+#endif /* !__KEYBOARD_XMODMAP_H__ */
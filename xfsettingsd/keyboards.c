@@ -42,6 +42,9 @@
 
 #include "debug.h"
 #include "keyboards.h"
+#include "prefetch.h"
+#include "stats.h"
+#include "trace.h"
 
 
 
@@ -77,6 +80,8 @@ struct _XfceKeyboardsHelper
     /* xfconf channel */
     XfconfChannel *channel;
 
+    XfsdStats     *stats;
+
 #ifdef DEVICE_HOTPLUGGING
     /* device presence event type */
     gint device_presence_event_type;
@@ -113,6 +118,7 @@ xfce_keyboards_helper_init (XfceKeyboardsHelper *helper)
 
     /* init */
     helper->channel = NULL;
+    helper->stats = xfsettings_stats_get ("keyboards");
 
     /* get the default display */
     xdisplay = gdk_x11_display_get_xdisplay (gdk_display_get_default ());
@@ -176,7 +182,7 @@ xfce_keyboards_helper_set_auto_repeat_mode (XfceKeyboardsHelper *helper)
     gboolean         repeat;
 
     /* load setting */
-    repeat = xfconf_channel_get_bool (helper->channel, "/Default/KeyRepeat", TRUE);
+    repeat = xfsettings_prefetch_get_bool (helper->channel, "/Default/KeyRepeat", TRUE);
 
     /* set key repeat */
     values.auto_repeat_mode = repeat ? 1 : 0;
@@ -198,8 +204,8 @@ xfce_keyboards_helper_set_repeat_rate (XfceKeyboardsHelper *helper)
     gint       delay, rate;
 
     /* load settings */
-    delay = xfconf_channel_get_int (helper->channel, "/Default/KeyRepeat/Delay", 500);
-    rate = xfconf_channel_get_int (helper->channel, "/Default/KeyRepeat/Rate", 20);
+    delay = xfsettings_prefetch_get_int (helper->channel, "/Default/KeyRepeat/Delay", 500);
+    rate = xfsettings_prefetch_get_int (helper->channel, "/Default/KeyRepeat/Rate", 20);
 
     gdk_error_trap_push ();
 
@@ -237,8 +243,12 @@ xfce_keyboards_helper_channel_property_changed (XfconfChannel      *channel,
                                                const GValue        *value,
                                                XfceKeyboardsHelper *helper)
 {
+    XfsdStatsMark mark;
+
     g_return_if_fail (helper->channel == channel);
 
+    xfsettings_stats_begin_xfconf (&mark, G_STRFUNC, property_name);
+
     if (strcmp (property_name, "/Default/KeyRepeat") == 0)
     {
         /* update auto repeat mode */
@@ -250,6 +260,8 @@ xfce_keyboards_helper_channel_property_changed (XfconfChannel      *channel,
         /* update repeat rate */
         xfce_keyboards_helper_set_repeat_rate (helper);
     }
+
+    xfsettings_stats_end (helper->stats, XFSD_STATS_XFCONF, &mark);
 }
 
 
@@ -261,10 +273,10 @@ xfce_keyboards_helper_restore_numlock_state (XfconfChannel *channel)
     Display      *dpy;
     gboolean      state;
 
-    if (xfconf_channel_has_property (channel, "/Default/Numlock")
-        && xfconf_channel_get_bool (channel, "/Default/RestoreNumlock", TRUE))
+    if (xfsettings_prefetch_has_property (channel, "/Default/Numlock")
+        && xfsettings_prefetch_get_bool (channel, "/Default/RestoreNumlock", TRUE))
     {
-        state = xfconf_channel_get_bool (channel, "/Default/Numlock", FALSE);
+        state = xfsettings_prefetch_get_bool (channel, "/Default/Numlock", FALSE);
 
         gdk_error_trap_push ();
 
@@ -360,6 +372,7 @@ xfce_keyboards_helper_event_filter (GdkXEvent *xevent,
     XEvent                     *event = xevent;
     XDevicePresenceNotifyEvent *dpn_event = xevent;
     XfceKeyboardsHelper        *helper = XFCE_KEYBOARDS_HELPER (user_data);
+    XfsdStatsMark               mark;
 
     if (G_UNLIKELY (event->type != helper->device_presence_event_type))
         return GDK_FILTER_CONTINUE;
@@ -367,11 +380,16 @@ xfce_keyboards_helper_event_filter (GdkXEvent *xevent,
     if (G_LIKELY (dpn_event->devchange != DeviceAdded))
         return GDK_FILTER_CONTINUE;
 
-    if (!xfce_keyboards_helper_device_is_keyboard(dpn_event->deviceid))
-        return GDK_FILTER_CONTINUE;
+    xfsettings_stats_begin_event (&mark, G_STRFUNC, event->type);
 
     /* New keyboard added. Need to reapply settings. */
-    xfce_keyboards_helper_set_all_settings (helper);
+    if (xfce_keyboards_helper_device_is_keyboard (dpn_event->deviceid))
+    {
+        xfsettings_trace (XFSD_TRACE_KEYBOARDS_DEVICE, dpn_event->deviceid, 0, 0, 0);
+        xfce_keyboards_helper_set_all_settings (helper);
+    }
+
+    xfsettings_stats_end (helper->stats, XFSD_STATS_EVENT, &mark);
 
     return GDK_FILTER_CONTINUE;
 }
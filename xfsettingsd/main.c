@@ -51,35 +51,96 @@
 
 #include "debug.h"
 #include "accessibility.h"
+#include "helper-module.h"
 #include "pointers.h"
 #include "keyboards.h"
-#include "keyboard-layout.h"
 #include "keyboard-shortcuts.h"
+#include "keyboard-launcher.h"
+#include "prefetch.h"
+#include "stats.h"
+#include "trace.h"
 #include "workspaces.h"
-#include "clipboard-manager.h"
 #include "xsettings.h"
 
-#ifdef HAVE_XRANDR
-#include "displays.h"
-#endif
-
 #define XFSETTINGS_DBUS_NAME    "org.xfce.SettingsDaemon"
 #define XFSETTINGS_DESKTOP_FILE (SYSCONFIGDIR "/xdg/autostart/xfsettingsd.desktop")
 
+/* created before the main loop runs, clients block on them */
+#define STARTUP_PRIORITY_NOW    (G_PRIORITY_HIGH)
+
+
+
+typedef struct _XfsdStartupStep XfsdStartupStep;
+struct _XfsdStartupStep
+{
+    const gchar *name;
+    gint         priority;
+
+    /* the type of the helper, a function creating it or the
+     * name of the module it is loaded from */
+    GType      (*get_type) (void);
+    GObject   *(*start)    (void);
+    const gchar *module;
+
+    /* for modules: the channel with the settings that enable the
+     * helper and a check on them, besides /Helpers/<name> */
+    const gchar *channel;
+    gboolean   (*enabled)  (void);
+
+    GObject     *helper;
+    gboolean     is_enabled;
+    gdouble      start_ms;
+    gdouble      duration_ms;
+};
+
+
+
+static GObject *startup_xsettings_start         (void);
+static gboolean startup_keyboard_layout_enabled (void);
+static gboolean startup_clipboard_enabled       (void);
+
 
 static XfceSMClient *sm_client = NULL;
 
 static gboolean opt_version = FALSE;
 static gboolean opt_no_daemon = FALSE;
 static gboolean opt_replace = FALSE;
+static gboolean opt_startup_timeline = FALSE;
+static gboolean opt_stats = FALSE;
+static gboolean opt_trace = FALSE;
 static GOptionEntry option_entries[] =
 {
     { "version", 'V', 0, G_OPTION_ARG_NONE, &opt_version, N_("Version information"), NULL },
     { "no-daemon", 0, 0, G_OPTION_ARG_NONE, &opt_no_daemon, N_("Do not fork to the background"), NULL },
     { "replace", 0, 0, G_OPTION_ARG_NONE, &opt_replace, N_("Replace running xsettings daemon (if any)"), NULL },
+    { "startup-timeline", 0, 0, G_OPTION_ARG_NONE, &opt_startup_timeline, N_("Print how long the initialization of each helper took"), NULL },
+    { "stats", 0, 0, G_OPTION_ARG_NONE, &opt_stats, N_("Print the statistics of the running daemon"), NULL },
+    { "trace", 0, 0, G_OPTION_ARG_NONE, &opt_trace, N_("Print the recent trace records of the running daemon"), NULL },
     { NULL }
 };
 
+/* in order of priority */
+static XfsdStartupStep startup_steps[] =
+{
+    { "xsettings", STARTUP_PRIORITY_NOW, NULL, startup_xsettings_start, NULL, NULL, NULL },
+#ifdef HAVE_XRANDR
+    { "displays", STARTUP_PRIORITY_NOW, NULL, NULL, "displays", NULL, NULL },
+#endif
+    { "pointers", G_PRIORITY_HIGH_IDLE, xfce_pointers_helper_get_type, NULL, NULL, NULL, NULL },
+    { "keyboards", G_PRIORITY_HIGH_IDLE, xfce_keyboards_helper_get_type, NULL, NULL, NULL, NULL },
+    { "accessibility", G_PRIORITY_HIGH_IDLE, xfce_accessibility_helper_get_type, NULL, NULL, NULL, NULL },
+    { "keyboard-shortcuts", G_PRIORITY_HIGH_IDLE, xfce_keyboard_shortcuts_helper_get_type, NULL, NULL, NULL, NULL },
+    { "keyboard-layout", G_PRIORITY_HIGH_IDLE, NULL, NULL, "keyboard-layout", "keyboard-layout", startup_keyboard_layout_enabled },
+    { "workspaces", G_PRIORITY_DEFAULT_IDLE, xfce_workspaces_helper_get_type, NULL, NULL, NULL, NULL },
+    { "clipboard", G_PRIORITY_DEFAULT_IDLE, NULL, NULL, "clipboard", NULL, startup_clipboard_enabled }
+};
+
+static guint          startup_next = 0;
+static guint          startup_idle_id = 0;
+static guint          startup_update_id = 0;
+static GTimer        *startup_timer = NULL;
+static XfconfChannel *startup_channel = NULL;
+
 
 
 static void
@@ -92,6 +153,16 @@ signal_handler (gint signum,
 
 
 
+static void
+signal_trace_handler (gint     signum,
+                      gpointer user_data)
+{
+    /* leave the trace records in the cache directory */
+    xfsettings_trace_write ();
+}
+
+
+
 static DBusHandlerResult
 dbus_connection_filter_func (DBusConnection *connection,
                              DBusMessage    *message,
@@ -123,6 +194,236 @@ dbus_connection_filter_func (DBusConnection *connection,
 
 
 
+static GObject *
+startup_xsettings_start (void)
+{
+    GObject *helper;
+
+    helper = g_object_new (XFCE_TYPE_XSETTINGS_HELPER, NULL);
+    xfce_xsettings_helper_register (XFCE_XSETTINGS_HELPER (helper),
+                                    gdk_display_get_default (), opt_replace);
+
+    return helper;
+}
+
+
+
+static gboolean
+startup_keyboard_layout_enabled (void)
+{
+    XfconfChannel *channel;
+    gchar         *xmodmap_path;
+    gboolean       enabled;
+
+    /* the helper is also needed to apply ~/.Xmodmap */
+    channel = xfconf_channel_get ("keyboard-layout");
+    enabled = !xfsettings_prefetch_get_bool (channel, "/Default/XkbDisable", TRUE);
+    if (!enabled)
+    {
+        xmodmap_path = g_build_filename (xfce_get_homedir (), ".Xmodmap", NULL);
+        enabled = g_file_test (xmodmap_path, G_FILE_TEST_EXISTS);
+        g_free (xmodmap_path);
+    }
+
+    return enabled;
+}
+
+
+
+static gboolean
+startup_clipboard_enabled (void)
+{
+    return g_getenv ("XFSETTINGSD_NO_CLIPBOARD") == NULL;
+}
+
+
+
+static gboolean
+startup_step_enabled (XfsdStartupStep *step)
+{
+    gchar    *property;
+    gboolean  enabled;
+
+    /* built-in helpers always run */
+    if (step->module == NULL)
+        return TRUE;
+
+    /* allow turning helpers off, e.g. the displays helper on single-head
+     * machines, or sessions where another clipboard manager runs */
+    property = g_strdup_printf ("/Helpers/%s", step->name);
+    enabled = xfsettings_prefetch_get_bool (startup_channel, property, TRUE);
+    g_free (property);
+
+    if (enabled && step->enabled != NULL)
+        enabled = step->enabled ();
+
+    return enabled;
+}
+
+
+
+static GObject *
+startup_step_create (XfsdStartupStep *step)
+{
+    if (step->module != NULL)
+        return xfce_helper_module_create (xfce_helper_module_get (step->module), opt_replace);
+    else if (step->start != NULL)
+        return step->start ();
+    else
+        return g_object_new (step->get_type (), NULL);
+}
+
+
+
+static gboolean
+startup_update (gpointer data)
+{
+    XfsdStartupStep *step;
+    guint            i;
+    gboolean         enabled;
+
+    startup_update_id = 0;
+
+    /* load or unload the helpers started so far */
+    for (i = 0; i < startup_next; i++)
+    {
+        step = &startup_steps[i];
+        if (step->module == NULL)
+            continue;
+
+        enabled = startup_step_enabled (step);
+        if (enabled == step->is_enabled)
+            continue;
+
+        step->is_enabled = enabled;
+
+        if (enabled && step->helper == NULL)
+        {
+            step->helper = startup_step_create (step);
+            xfsettings_dbg (XFSD_DEBUG_MODULES, "%s helper enabled", step->name);
+        }
+        else if (!enabled && step->helper != NULL)
+        {
+            /* this unloads the module if possible */
+            g_object_unref (G_OBJECT (step->helper));
+            step->helper = NULL;
+            xfsettings_dbg (XFSD_DEBUG_MODULES, "%s helper disabled", step->name);
+        }
+    }
+
+    return FALSE;
+}
+
+
+
+static void
+startup_channel_property_changed (XfconfChannel *channel,
+                                  const gchar   *property,
+                                  const GValue  *value,
+                                  gpointer       user_data)
+{
+    /* check all helpers once the changes are in */
+    if (startup_update_id == 0)
+        startup_update_id = g_idle_add (startup_update, NULL);
+}
+
+
+
+static void
+startup_run_step (XfsdStartupStep *step)
+{
+    step->start_ms = g_timer_elapsed (startup_timer, NULL) * 1000.0;
+
+    step->is_enabled = startup_step_enabled (step);
+    if (step->is_enabled)
+        step->helper = startup_step_create (step);
+    else
+        xfsettings_dbg (XFSD_DEBUG_MODULES, "%s helper is not loaded", step->name);
+
+    step->duration_ms = g_timer_elapsed (startup_timer, NULL) * 1000.0 - step->start_ms;
+
+    /* load or unload the helper when its settings change */
+    if (step->channel != NULL)
+    {
+        g_signal_connect (G_OBJECT (xfconf_channel_get (step->channel)), "property-changed",
+                          G_CALLBACK (startup_channel_property_changed), NULL);
+    }
+}
+
+
+
+static void
+startup_finished (void)
+{
+    XfsdStartupStep *step;
+    guint            i;
+    gdouble          total_ms;
+
+    total_ms = g_timer_elapsed (startup_timer, NULL) * 1000.0;
+
+    if (opt_startup_timeline)
+    {
+        g_print ("%-20s %10s %10s %10s\n", "helper", "priority", "start", "duration");
+        for (i = 0; i < G_N_ELEMENTS (startup_steps); i++)
+        {
+            step = &startup_steps[i];
+            g_print ("%-20s %10d %7.1f ms %7.1f ms\n", step->name, step->priority,
+                     step->start_ms, step->duration_ms);
+        }
+        g_print ("%-20s %10s %10s %7.1f ms\n", "total", "", "", total_ms);
+    }
+
+    /* drop the snapshots, the helpers keep their own state */
+    xfsettings_prefetch_finish (total_ms);
+
+    g_timer_destroy (startup_timer);
+    startup_timer = NULL;
+}
+
+
+
+static gboolean startup_idle (gpointer data);
+
+
+
+static void
+startup_schedule (void)
+{
+    if (startup_next < G_N_ELEMENTS (startup_steps))
+    {
+        /* run the next helper when nothing more important is pending */
+        startup_idle_id = g_idle_add_full (startup_steps[startup_next].priority,
+                                           startup_idle, NULL, NULL);
+    }
+    else
+    {
+        startup_idle_id = 0;
+        startup_finished ();
+    }
+}
+
+
+
+static gboolean
+startup_idle (gpointer data)
+{
+    gint priority;
+
+    /* one helper per iteration, so events can be handled in between */
+    priority = startup_steps[startup_next].priority;
+    startup_run_step (&startup_steps[startup_next++]);
+
+    if (startup_next < G_N_ELEMENTS (startup_steps)
+        && startup_steps[startup_next].priority == priority)
+        return TRUE;
+
+    startup_schedule ();
+
+    return FALSE;
+}
+
+
+
 static gint
 daemonize (void)
 {
@@ -154,17 +455,7 @@ main (gint argc, gchar **argv)
 {
     GError               *error = NULL;
     GOptionContext       *context;
-    GObject              *pointer_helper;
-    GObject              *keyboards_helper;
-    GObject              *accessibility_helper;
-    GObject              *shortcuts_helper;
-    GObject              *keyboard_layout_helper;
-    GObject              *xsettings_helper;
-    GObject              *clipboard_daemon = NULL;
-#ifdef HAVE_XRANDR
-    GObject              *displays_helper;
-#endif
-    GObject              *workspaces_helper;
+    XfsdStartupStep      *step;
     guint                 i;
     const gint            signums[] = { SIGQUIT, SIGTERM };
     DBusConnection       *dbus_connection;
@@ -207,6 +498,12 @@ main (gint argc, gchar **argv)
         return EXIT_SUCCESS;
     }
 
+    /* ask the running instance */
+    if (opt_stats)
+        return xfsettings_stats_print (XFSETTINGS_DBUS_NAME);
+    if (opt_trace)
+        return xfsettings_trace_print (XFSETTINGS_DBUS_NAME);
+
     dbus_connection = dbus_bus_get (DBUS_BUS_SESSION, NULL);
     if (G_LIKELY (dbus_connection != NULL))
     {
@@ -226,6 +523,10 @@ main (gint argc, gchar **argv)
 
         dbus_bus_add_match (dbus_connection, "type='signal',member='NameOwnerChanged',arg0='"XFSETTINGS_DBUS_NAME"'", NULL);
         dbus_connection_add_filter (dbus_connection, dbus_connection_filter_func, NULL, NULL);
+
+        /* read-only statistics and trace of the helpers */
+        xfsettings_stats_register (dbus_connection);
+        xfsettings_trace_register (dbus_connection);
     }
     else
     {
@@ -264,69 +565,70 @@ main (gint argc, gchar **argv)
         }
     }
 
-    /* launch settings manager */
-    xsettings_helper = g_object_new (XFCE_TYPE_XSETTINGS_HELPER, NULL);
-    xfce_xsettings_helper_register (XFCE_XSETTINGS_HELPER (xsettings_helper),
-                                    gdk_display_get_default (), opt_replace);
+    /* fork the process that launches shortcut commands, while we are small */
+    xfce_launcher_start ();
 
-    /* create the sub daemons */
-#ifdef HAVE_XRANDR
-    displays_helper = g_object_new (XFCE_TYPE_DISPLAYS_HELPER, NULL);
-#endif
-    pointer_helper = g_object_new (XFCE_TYPE_POINTERS_HELPER, NULL);
-    keyboards_helper = g_object_new (XFCE_TYPE_KEYBOARDS_HELPER, NULL);
-    accessibility_helper = g_object_new (XFCE_TYPE_ACCESSIBILITY_HELPER, NULL);
-    shortcuts_helper = g_object_new (XFCE_TYPE_KEYBOARD_SHORTCUTS_HELPER, NULL);
-    keyboard_layout_helper = g_object_new (XFCE_TYPE_KEYBOARD_LAYOUT_HELPER, NULL);
-    workspaces_helper = g_object_new (XFCE_TYPE_WORKSPACES_HELPER, NULL);
-
-    if (g_getenv ("XFSETTINGSD_NO_CLIPBOARD") == NULL)
-    {
-        clipboard_daemon = g_object_new (GSD_TYPE_CLIPBOARD_MANAGER, NULL);
-        if (!gsd_clipboard_manager_start (GSD_CLIPBOARD_MANAGER (clipboard_daemon), opt_replace))
-        {
-            g_object_unref (G_OBJECT (clipboard_daemon));
-            clipboard_daemon = NULL;
+    /* fetch the channels of the helpers in one go */
+    startup_timer = g_timer_new ();
+    xfsettings_prefetch_init ();
 
-            g_printerr (G_LOG_DOMAIN ": %s\n", "Another clipboard manager is already running.");
-        }
-    }
+    /* switches for the helpers loaded from modules */
+    startup_channel = xfconf_channel_get ("xfsettingsd");
+    g_signal_connect (G_OBJECT (startup_channel), "property-changed",
+                      G_CALLBACK (startup_channel_property_changed), NULL);
+
+    /* the helpers clients wait for, xsettings first */
+    while (startup_next < G_N_ELEMENTS (startup_steps)
+           && startup_steps[startup_next].priority == STARTUP_PRIORITY_NOW)
+        startup_run_step (&startup_steps[startup_next++]);
+
+    /* the others are created from the main loop */
+    startup_schedule ();
 
     /* setup signal handlers to properly quit the main loop */
     if (xfce_posix_signal_handler_init (NULL))
     {
         for (i = 0; i < G_N_ELEMENTS (signums); i++)
             xfce_posix_signal_handler_set_handler (signums[i], signal_handler, NULL, NULL);
+        xfce_posix_signal_handler_set_handler (SIGUSR1, signal_trace_handler, NULL, NULL);
     }
 
     gtk_main();
 
+    /* handler times per helper, with XFSETTINGSD_DEBUG=stalls */
+    xfsettings_stats_histograms ();
+
     /* release the dbus name */
     if (dbus_connection != NULL)
     {
+        xfsettings_stats_unregister (dbus_connection);
+        xfsettings_trace_unregister (dbus_connection);
         dbus_connection_remove_filter (dbus_connection, dbus_connection_filter_func, NULL);
         dbus_bus_release_name (dbus_connection, XFSETTINGS_DBUS_NAME, NULL);
         dbus_connection_unref (dbus_connection);
     }
 
+    if (startup_idle_id != 0)
+    {
+        /* quit before all helpers were started */
+        g_source_remove (startup_idle_id);
+        g_timer_destroy (startup_timer);
+        xfsettings_prefetch_finish (0.0);
+    }
+
+    if (startup_update_id != 0)
+        g_source_remove (startup_update_id);
+
     /* release the sub daemons */
-    g_object_unref (G_OBJECT (xsettings_helper));
-#ifdef HAVE_XRANDR
-    g_object_unref (G_OBJECT (displays_helper));
-#endif
-    g_object_unref (G_OBJECT (pointer_helper));
-    g_object_unref (G_OBJECT (keyboards_helper));
-    g_object_unref (G_OBJECT (accessibility_helper));
-    g_object_unref (G_OBJECT (shortcuts_helper));
-    g_object_unref (G_OBJECT (keyboard_layout_helper));
-    g_object_unref (G_OBJECT (workspaces_helper));
-
-    if (G_LIKELY (clipboard_daemon != NULL))
+    for (i = 0; i < G_N_ELEMENTS (startup_steps); i++)
     {
-        gsd_clipboard_manager_stop (GSD_CLIPBOARD_MANAGER (clipboard_daemon));
-        g_object_unref (G_OBJECT (clipboard_daemon));
+        step = &startup_steps[i];
+        if (step->helper != NULL)
+            g_object_unref (G_OBJECT (step->helper));
     }
 
+    xfce_launcher_stop ();
+
     xfconf_shutdown ();
 
     g_object_unref (G_OBJECT (sm_client));
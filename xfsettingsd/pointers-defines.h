@@ -45,6 +45,14 @@
 #  define DEVICE_PROPERTIES
 #endif
 
+/* test if raw key events are available for the typing detector */
+#undef TYPING_DETECTION
+#if defined (DEVICE_HOTPLUGGING) && defined (DEVICE_PROPERTIES) \
+    && defined (HAVE_X11_EXTENSIONS_XINPUT2_H)
+#  include <X11/extensions/XInput2.h>
+#  define TYPING_DETECTION
+#endif
+
 #ifndef IsXExtensionPointer
 #define IsXExtensionPointer 4
 #endif
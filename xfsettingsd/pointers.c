@@ -20,12 +20,6 @@
 #include <config.h>
 #endif
 
-#ifdef HAVE_SYS_TYPES_H
-#include <sys/types.h>
-#endif
-#ifdef HAVE_SIGNAL_H
-#include <signal.h>
-#endif
 #ifdef HAVE_STRING_H
 #include <string.h>
 #endif
@@ -41,24 +35,70 @@
 #include "debug.h"
 #include "pointers.h"
 #include "pointers-defines.h"
+#include "prefetch.h"
+#include "stats.h"
+#include "trace.h"
 
 
 #define MAX_DENOMINATOR (100.00)
 
+/* interval in ms at which queued device writes are flushed, so a
+ * slider drag in the dialog does not turn into hundreds of requests */
+#define WRITE_FLUSH_INTERVAL (50)
+
+/* interval in ms to collect device presence events, a docking station
+ * adds or removes a bunch of devices at once */
+#define HOTPLUG_BATCH_INTERVAL (100)
+
 #define XFCONF_TYPE_G_VALUE_ARRAY (dbus_g_type_get_collection ("GPtrArray", G_TYPE_VALUE))
 
 
 
+typedef struct _XfcePointerDevice   XfcePointerDevice;
+typedef struct _XfcePointerProperty XfcePointerProperty;
+
+
+
 static void             xfce_pointers_helper_finalize                 (GObject            *object);
-static void             xfce_pointers_helper_syndaemon_stop           (XfcePointersHelper *helper);
-static void             xfce_pointers_helper_syndaemon_check          (XfcePointersHelper *helper);
-static void             xfce_pointers_helper_restore_devices          (XfcePointersHelper *helper,
-                                                                       XID                *xid);
+static void             xfce_pointers_helper_free_value               (GValue             *value);
+static void             xfce_pointers_helper_store_setting            (XfcePointersHelper *helper,
+                                                                       const gchar        *property_name,
+                                                                       const GValue       *value);
+static void             xfce_pointers_helper_device_free              (XfcePointerDevice  *pdev);
+static void             xfce_pointers_helper_devices_update           (XfcePointersHelper *helper,
+                                                                       GArray             *fresh_ids,
+                                                                       GPtrArray          *added);
+#ifdef DEVICE_PROPERTIES
+static void             xfce_pointers_helper_device_flush_properties  (XfcePointerDevice  *pdev);
+#endif
+#ifdef TYPING_DETECTION
+static const gchar     *xfce_pointers_helper_typing_property          (XfcePointersHelper *helper,
+                                                                       XfcePointerDevice  *pdev);
+static void             xfce_pointers_helper_typing_set_touchpads     (XfcePointersHelper *helper,
+                                                                       gboolean            enabled);
+static gboolean         xfce_pointers_helper_typing_timeout           (gpointer            user_data);
+static void             xfce_pointers_helper_typing_key               (XfcePointersHelper *helper,
+                                                                       gint                keycode,
+                                                                       gboolean            pressed);
+#endif
+static void             xfce_pointers_helper_typing_check             (XfcePointersHelper *helper);
+static void             xfce_pointers_helper_restore_device           (XfcePointersHelper *helper,
+                                                                       XfcePointerDevice  *pdev);
+static void             xfce_pointers_helper_restore_devices          (XfcePointersHelper *helper);
+static void             xfce_pointers_helper_apply_device_property    (XfcePointersHelper *helper,
+                                                                       const gchar        *property_name,
+                                                                       const GValue       *value);
+static void             xfce_pointers_helper_queue_write              (XfcePointersHelper *helper,
+                                                                       const gchar        *property_name,
+                                                                       const GValue       *value);
+static gboolean         xfce_pointers_helper_flush_writes             (gpointer            user_data);
 static void             xfce_pointers_helper_channel_property_changed (XfconfChannel      *channel,
                                                                        const gchar        *property_name,
                                                                        const GValue       *value,
                                                                        XfcePointersHelper *helper);
 #ifdef DEVICE_HOTPLUGGING
+static gboolean         xfce_pointers_helper_select_events            (XfcePointersHelper *helper);
+static gboolean         xfce_pointers_helper_hotplug_flush            (gpointer            user_data);
 static GdkFilterReturn  xfce_pointers_helper_event_filter             (GdkXEvent          *xevent,
                                                                        GdkEvent           *gdk_event,
                                                                        gpointer            user_data);
@@ -78,24 +118,97 @@ struct _XfcePointersHelper
     /* xfconf channel */
     XfconfChannel *channel;
 
+    /* copy of the channel, property name -> GValue, so restoring
+     * a device does not cost a round-trip to xfconfd */
+    GHashTable    *settings;
+
+    /* registry of the pointer devices, kept up-to-date on hotplug */
+    XDeviceInfo   *device_list;
+    gint           ndevices;
+    GPtrArray     *devices;
+    GHashTable    *device_names;
+
+    /* channel changes waiting to be written, property name -> GValue */
+    GHashTable    *pending_writes;
+    guint          flush_timeout_id;
+    guint          n_writes;
+    guint          n_dropped_writes;
+
+    XfsdStats     *stats;
+
+#ifdef TYPING_DETECTION
+    /* typing detector, disables the touchpads while the keyboard is used */
+    gint           xi_opcode;
+    Atom           touchpad_type;
+    gboolean       typing_watch;
+    gboolean       touchpads_off;
+    gdouble        typing_duration;
+    GTimer        *typing_timer;
+    guint          typing_timeout_id;
+    guchar         modifier_keys[32];
+    guchar         modifiers_down[32];
+#endif
+
 #ifdef DEVICE_PROPERTIES
-    GPid           syndaemon_pid;
+    /* property name -> atom, None if the atom does not exist */
+    GHashTable    *atoms;
+    Atom           float_atom;
 #endif
 
 #ifdef DEVICE_HOTPLUGGING
     /* device presence event type */
     gint           device_presence_event_type;
+
+    /* presence events collected for the next registry update */
+    guint          hotplug_timeout_id;
+    GArray        *hotplug_added;
+    guint          n_hotplug_events;
+#ifdef DEVICE_PROPERTIES
+    gint           device_property_event_type;
+#endif
 #endif
 };
 
-typedef struct
+struct _XfcePointerDevice
 {
-    Display     *xdisplay;
+    /* points into the device list of the helper */
+    XDeviceInfo *info;
+
+    /* open handle, closed when the device goes away */
     XDevice     *device;
-    XDeviceInfo *device_info;
-    gsize        prop_name_len;
-}
-XfcePointerData;
+
+    /* name of the device in the pointers channel */
+    gchar       *xfconf_name;
+
+#ifdef DEVICE_PROPERTIES
+    /* properties of the device, fetched on first use */
+    Atom        *atoms;
+    gint         n_atoms;
+
+    /* xfconf property name -> XfcePointerProperty */
+    GHashTable  *properties;
+#endif
+
+#ifdef TYPING_DETECTION
+    /* property to disable the device while typing, NULL if
+     * this is not a touchpad */
+    const gchar *typing_prop;
+#endif
+};
+
+#ifdef DEVICE_PROPERTIES
+/* what XChangeDeviceProperty needs to know about a property */
+struct _XfcePointerProperty
+{
+    Atom   atom;      /* None if the device does not have it */
+    Atom   type;
+    gint   format;
+    gulong n_items;
+
+    /* our own writes, so their notify does not flush the cache */
+    guint  pending;
+};
+#endif
 
 
 
@@ -118,8 +231,12 @@ xfce_pointers_helper_init (XfcePointersHelper *helper)
 {
     XExtensionVersion *version = NULL;
     Display           *xdisplay;
-#ifdef DEVICE_HOTPLUGGING
-    XEventClass        event_class;
+    GHashTable        *props;
+    GHashTableIter     iter;
+    gpointer           property_name, value;
+#ifdef TYPING_DETECTION
+    gint               event_base, error_base;
+    gint               major = 2, minor = 0;
 #endif
 
     /* get the default display */
@@ -149,27 +266,65 @@ xfce_pointers_helper_init (XfcePointersHelper *helper)
 
         /* open the channel */
         helper->channel = xfconf_channel_get ("pointers");
+        helper->stats = xfsettings_stats_get ("pointers");
+
+        /* fetch all the settings at once */
+        helper->settings = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+                                                  (GDestroyNotify) xfce_pointers_helper_free_value);
+        props = xfsettings_prefetch_get_properties (helper->channel, NULL);
+        if (props != NULL)
+        {
+            g_hash_table_iter_init (&iter, props);
+            while (g_hash_table_iter_next (&iter, &property_name, &value))
+                xfce_pointers_helper_store_setting (helper, property_name, value);
+            g_hash_table_destroy (props);
+        }
+
+        xfsettings_stats_watch_bytes (helper->stats, (XfsdStatsBytesFunc) xfsettings_stats_table_size,
+                                      helper->settings);
+
+        helper->pending_writes = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+                                                        (GDestroyNotify) xfce_pointers_helper_free_value);
+
+#ifdef DEVICE_PROPERTIES
+        helper->atoms = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+        helper->float_atom = XInternAtom (xdisplay, "FLOAT", False);
+#endif
+
+#ifdef TYPING_DETECTION
+        /* raw key events need XI2 on the server */
+        if (!XQueryExtension (xdisplay, INAME, &helper->xi_opcode, &event_base, &error_base)
+            || XIQueryVersion (xdisplay, &major, &minor) != Success)
+        {
+            g_message ("XI2 is not available, touchpads will not be "
+                       "disabled while typing");
+            helper->xi_opcode = 0;
+        }
+
+        helper->touchpad_type = XInternAtom (xdisplay, XI_TOUCHPAD, False);
+        helper->typing_timer = g_timer_new ();
+#endif
+
+        /* open the current pointer devices */
+        xfce_pointers_helper_devices_update (helper, NULL, NULL);
 
         /* restore the pointer devices */
-        xfce_pointers_helper_restore_devices (helper, NULL);
+        xfce_pointers_helper_restore_devices (helper);
 
         /* monitor the channel */
         g_signal_connect (G_OBJECT (helper->channel), "property-changed",
              G_CALLBACK (xfce_pointers_helper_channel_property_changed), helper);
 
-        /* launch syndaemon if required */
-        xfce_pointers_helper_syndaemon_check (helper);
+        /* watch the keyboard if required */
+        xfce_pointers_helper_typing_check (helper);
 
 #ifdef DEVICE_HOTPLUGGING
+        helper->hotplug_added = g_array_new (FALSE, FALSE, sizeof (XID));
+
         if (G_LIKELY (xdisplay != NULL))
         {
             /* monitor device changes */
-            gdk_error_trap_push ();
-            DevicePresence (xdisplay, helper->device_presence_event_type, event_class);
-            XSelectExtensionEvent (xdisplay, RootWindow (xdisplay, DefaultScreen (xdisplay)), &event_class, 1);
-
-            /* add an event filter */
-            if (gdk_error_trap_pop () == 0)
+            if (xfce_pointers_helper_select_events (helper))
                 gdk_window_add_filter (NULL, xfce_pointers_helper_event_filter, helper);
             else
                 g_warning ("Failed to create device filter");
@@ -183,120 +338,152 @@ xfce_pointers_helper_init (XfcePointersHelper *helper)
 static void
 xfce_pointers_helper_finalize (GObject *object)
 {
-    xfce_pointers_helper_syndaemon_stop (XFCE_POINTERS_HELPER (object));
+    XfcePointersHelper *helper = XFCE_POINTERS_HELPER (object);
+
+#ifdef TYPING_DETECTION
+    /* do not leave the touchpads disabled */
+    if (helper->typing_timeout_id != 0)
+        g_source_remove (helper->typing_timeout_id);
+    if (helper->touchpads_off)
+        xfce_pointers_helper_typing_set_touchpads (helper, TRUE);
+    if (helper->typing_timer != NULL)
+        g_timer_destroy (helper->typing_timer);
+#endif
 
-    (*G_OBJECT_CLASS (xfce_pointers_helper_parent_class)->finalize) (object);
-}
+    if (helper->flush_timeout_id != 0)
+        g_source_remove (helper->flush_timeout_id);
 
+#ifdef DEVICE_HOTPLUGGING
+    if (helper->hotplug_timeout_id != 0)
+        g_source_remove (helper->hotplug_timeout_id);
+    if (helper->hotplug_added != NULL)
+        g_array_free (helper->hotplug_added, TRUE);
+#endif
 
+    if (helper->stats != NULL)
+        xfsettings_stats_watch_bytes (helper->stats, NULL, NULL);
 
-static void
-xfce_pointers_helper_syndaemon_stop (XfcePointersHelper *helper)
-{
-#ifdef DEVICE_PROPERTIES
-    if (helper->syndaemon_pid != 0)
-    {
-        xfsettings_dbg (XFSD_DEBUG_POINTERS, "Killed syndaemon with pid %d",
-                        helper->syndaemon_pid);
+    if (helper->settings != NULL)
+        g_hash_table_destroy (helper->settings);
+
+    if (helper->pending_writes != NULL)
+        g_hash_table_destroy (helper->pending_writes);
 
-        kill (helper->syndaemon_pid, SIGHUP);
-        g_spawn_close_pid (helper->syndaemon_pid);
-        helper->syndaemon_pid = 0;
+    if (helper->devices != NULL)
+    {
+        g_hash_table_destroy (helper->device_names);
+        g_ptr_array_unref (helper->devices);
     }
+
+    if (helper->device_list != NULL)
+        XFreeDeviceList (helper->device_list);
+
+#ifdef DEVICE_PROPERTIES
+    if (helper->atoms != NULL)
+        g_hash_table_destroy (helper->atoms);
 #endif
+
+    (*G_OBJECT_CLASS (xfce_pointers_helper_parent_class)->finalize) (object);
 }
 
 
 
 static void
-xfce_pointers_helper_syndaemon_check (XfcePointersHelper *helper)
+xfce_pointers_helper_free_value (GValue *value)
 {
-#ifdef DEVICE_PROPERTIES
-    Display     *xdisplay = GDK_DISPLAY ();
-    XDeviceInfo *device_list;
-    XDevice     *device;
-    gint         n, ndevices;
-    Atom         touchpad_type;
-    Atom         touchpad_off_prop;
-    Atom        *props;
-    gint         i, nprops;
-    gboolean     have_synaptics = FALSE;
-    gdouble      disable_duration;
-    gchar        disable_duration_string[64];
-    gchar       *args[] = { "syndaemon", "-i", disable_duration_string, "-K", "-R", NULL };
-    GError      *error = NULL;
-
-    /* only stop a running daemon */
-    if (!xfconf_channel_get_bool (helper->channel, "/DisableTouchpadWhileTyping", FALSE))
-        goto start_stop_daemon;
+    if (G_IS_VALUE (value))
+        g_value_unset (value);
+    g_free (value);
+}
 
-    gdk_error_trap_push ();
-    device_list = XListInputDevices (xdisplay, &ndevices);
-    if (gdk_error_trap_pop () != 0 || device_list == NULL)
-        goto start_stop_daemon;
 
-    touchpad_type = XInternAtom (xdisplay, XI_TOUCHPAD, True);
-    touchpad_off_prop = XInternAtom (xdisplay, "Synaptics Off", True);
 
-    for (n = 0; n < ndevices; n++)
+static void
+xfce_pointers_helper_store_setting (XfcePointersHelper *helper,
+                                    const gchar        *property_name,
+                                    const GValue       *value)
+{
+    GValue *copy;
+
+    /* an unset value means the property was removed */
+    if (value == NULL || !G_IS_VALUE (value))
     {
-        /* search for a touchpad */
-        if (device_list[n].type != touchpad_type)
-            continue;
+        g_hash_table_remove (helper->settings, property_name);
+        return;
+    }
 
-        gdk_error_trap_push ();
-        device = XOpenDevice (xdisplay, device_list[n].id);
-        if (gdk_error_trap_pop () != 0 || device == NULL)
-        {
-            g_critical ("Unable to open device %s", device_list[n].name);
-            break;
-        }
+    copy = g_new0 (GValue, 1);
+    g_value_init (copy, G_VALUE_TYPE (value));
+    g_value_copy (value, copy);
 
-        /* look for the Synaptics Off property */
-        gdk_error_trap_push ();
-        props = XListDeviceProperties (xdisplay, device, &nprops);
-        if (gdk_error_trap_pop () == 0
-            && props != NULL)
-        {
-            for (i = 0; !have_synaptics && i < nprops; i++)
-                have_synaptics = props[i] == touchpad_off_prop;
+    g_hash_table_replace (helper->settings, g_strdup (property_name), copy);
+}
 
-            XFree (props);
-        }
 
-        XCloseDevice (xdisplay, device);
 
-        if (have_synaptics)
-            break;
-    }
+static const GValue *
+xfce_pointers_helper_setting (XfcePointersHelper *helper,
+                              const gchar        *device_name,
+                              const gchar        *name,
+                              GType               type)
+{
+    gchar         prop[256];
+    const GValue *value;
 
-    XFreeDeviceList (device_list);
+    if (device_name != NULL)
+        g_snprintf (prop, sizeof (prop), "/%s/%s", device_name, name);
+    else
+        g_snprintf (prop, sizeof (prop), "/%s", name);
 
-    start_stop_daemon:
+    value = g_hash_table_lookup (helper->settings, prop);
+    if (value != NULL && G_VALUE_HOLDS (value, type))
+        return value;
 
-    /* stop the daemon in any case */
-    xfce_pointers_helper_syndaemon_stop (helper);
+    return NULL;
+}
 
-    if (have_synaptics)
-    {
-        disable_duration = xfconf_channel_get_double (helper->channel,
-                                                      "/DisableTouchpadDuration",
-                                                      2.0);
-        g_snprintf (disable_duration_string, sizeof (disable_duration_string),
-                    "%.1f", disable_duration);
-
-        if (!g_spawn_async (NULL, args, NULL, G_SPAWN_SEARCH_PATH,
-                            NULL, NULL, &helper->syndaemon_pid, &error))
-        {
-            g_critical ("Spawning syndaemon failed: %s", error->message);
-            g_error_free (error);
-        }
 
-        xfsettings_dbg (XFSD_DEBUG_POINTERS, "Started syndaemon with pid %d",
-                        helper->syndaemon_pid);
+
+static void
+xfce_pointers_helper_device_free (XfcePointerDevice *pdev)
+{
+    if (pdev->device != NULL)
+    {
+        /* the device may already be gone */
+        gdk_error_trap_push ();
+        XCloseDevice (GDK_DISPLAY (), pdev->device);
+        gdk_flush ();
+        gdk_error_trap_pop ();
     }
+
+#ifdef DEVICE_PROPERTIES
+    xfce_pointers_helper_device_flush_properties (pdev);
+    if (pdev->properties != NULL)
+        g_hash_table_destroy (pdev->properties);
 #endif
+
+    g_free (pdev->xfconf_name);
+    g_free (pdev);
+}
+
+
+
+#ifdef DEVICE_PROPERTIES
+static void
+xfce_pointers_helper_device_flush_properties (XfcePointerDevice *pdev)
+{
+    /* forget everything we learned about the properties of the device */
+    if (pdev->atoms != NULL)
+    {
+        XFree (pdev->atoms);
+        pdev->atoms = NULL;
+        pdev->n_atoms = 0;
+    }
+
+    if (pdev->properties != NULL)
+        g_hash_table_remove_all (pdev->properties);
 }
+#endif
 
 
 
@@ -619,397 +806,758 @@ xfce_pointers_helper_device_xfconf_name (const gchar *name)
 
 
 
-#ifdef DEVICE_PROPERTIES
-static void
-xfce_pointers_helper_change_property (XDeviceInfo  *device_info,
-                                      XDevice      *device,
-                                      Display      *xdisplay,
-                                      const gchar  *prop_name,
-                                      const GValue *value)
+static gboolean
+xfce_pointers_helper_devices_is_fresh (GArray *fresh_ids,
+                                       XID     id)
 {
-    Atom         *props;
-    gint          n, n_props;
-    Atom          prop;
-    gchar        *atom_name;
-    Atom          type;
-    gint          format;
-    gulong        n_items, bytes_after, i;
-    gulong        n_succeeds;
-    Atom          float_atom;
-    GPtrArray    *array = NULL;
-    const GValue *val;
-    union {
-        guchar *c;
-        gshort *s;
-        glong  *l;
-        Atom   *a;
-    } data;
+    guint i;
 
-    /* assuming the device property never contained underscores... */
-    atom_name = g_strdup (prop_name);
-    g_strdelimit (atom_name, "_", ' ');
-    prop = XInternAtom (xdisplay, atom_name, True);
-    g_free (atom_name);
+    for (i = 0; fresh_ids != NULL && i < fresh_ids->len; i++)
+        if (g_array_index (fresh_ids, XID, i) == id)
+            return TRUE;
 
-    /* because of the True in XInternAtom we quit here if the property
-     * does not exists on any of the devices */
-    if (prop == None)
-        return;
+    return FALSE;
+}
+
+
+
+static void
+xfce_pointers_helper_devices_update (XfcePointersHelper *helper,
+                                     GArray             *fresh_ids,
+                                     GPtrArray          *added)
+{
+    Display           *xdisplay = GDK_DISPLAY ();
+    XDeviceInfo       *device_list, *device_info;
+    GPtrArray         *devices;
+    XfcePointerDevice *pdev, *old;
+    gint               n, ndevices;
+    guint              i;
+    gboolean           fresh;
 
     gdk_error_trap_push ();
-    props = XListDeviceProperties (xdisplay, device, &n_props);
-    if (gdk_error_trap_pop () != 0 || props == NULL)
-        return;
+    device_list = XListInputDevices (xdisplay, &ndevices);
+    if (gdk_error_trap_pop () != 0)
+        device_list = NULL;
+    if (device_list == NULL)
+        ndevices = 0;
 
-    float_atom = XInternAtom (xdisplay, "FLOAT", False);
+    devices = g_ptr_array_new_with_free_func ((GDestroyNotify) xfce_pointers_helper_device_free);
 
-    for (n = 0; n < n_props; n++)
+#ifdef DEVICE_PROPERTIES
+    /* atoms that did not exist may have been created by the new devices */
+    if (helper->atoms != NULL)
+        g_hash_table_remove_all (helper->atoms);
+#endif
+
+    for (n = 0; n < ndevices; n++)
     {
-        /* find the matching property */
-        if (props[n] != prop)
+        /* filter the pointer devices */
+        device_info = &device_list[n];
+        if (device_info->use != IsXExtensionPointer
+            || device_info->name == NULL)
             continue;
 
-        if (XGetDeviceProperty (xdisplay, device, prop, 0, 1000, False,
-                                AnyPropertyType, &type, &format,
-                                &n_items, &bytes_after, &data.c) == Success)
+        pdev = g_new0 (XfcePointerDevice, 1);
+        pdev->info = device_info;
+
+        /* an id that was added again may belong to another device now */
+        fresh = xfce_pointers_helper_devices_is_fresh (fresh_ids, device_info->id);
+
+        /* keep the handle of devices we already know */
+        for (i = 0; !fresh && helper->devices != NULL && i < helper->devices->len; i++)
         {
-            if (n_items == 1
-                && (G_VALUE_HOLDS_INT (value)
-                    || G_VALUE_HOLDS_STRING (value)
-                    || G_VALUE_HOLDS_DOUBLE (value)))
-            {
-                /* only 1 items to set */
-                val = value;
-            }
-            else if (G_VALUE_TYPE (value) == XFCONF_TYPE_G_VALUE_ARRAY)
-            {
-                array = g_value_get_boxed (value);
-                if (array->len != n_items)
-                {
-                    g_critical ("Nr device property items (%ld) and xfconf value (%d) differ",
-                                n_items, array->len);
-                    break;
-                }
-            }
-            else
+            old = g_ptr_array_index (helper->devices, i);
+            if (old->device != NULL && old->info->id == device_info->id)
             {
-                g_critical ("Invalid device property combination");
+                pdev->device = old->device;
+                pdev->xfconf_name = old->xfconf_name;
+                old->device = NULL;
+                old->xfconf_name = NULL;
+#ifdef DEVICE_PROPERTIES
+                pdev->atoms = old->atoms;
+                pdev->n_atoms = old->n_atoms;
+                pdev->properties = old->properties;
+                old->atoms = NULL;
+                old->n_atoms = 0;
+                old->properties = NULL;
+#endif
+#ifdef TYPING_DETECTION
+                pdev->typing_prop = old->typing_prop;
+#endif
                 break;
             }
+        }
 
-            /* reset check counter */
-            n_succeeds = 0;
-
-            for (i = 0; i < n_items; i++)
+        if (pdev->device == NULL)
+        {
+            /* open the device */
+            gdk_error_trap_push ();
+            pdev->device = XOpenDevice (xdisplay, device_info->id);
+            if (gdk_error_trap_pop () != 0 || pdev->device == NULL)
             {
-                /* get value from pointer array */
-                if (array != NULL)
-                    val = g_ptr_array_index (array, i);
-                else
-                    val = value;
-
-                if (G_VALUE_HOLDS_INT (val)
-                    && type == XA_INTEGER)
-                {
-                    if (format == 8)
-                        data.c[i] = g_value_get_int (val);
-                    else if (format == 16)
-                        data.s[i] = g_value_get_int (val);
-                    else if (format == 32)
-                        data.l[i] = g_value_get_int (val);
-                    else
-                    {
-                        g_critical ("Unknown format %d for integer", format);
-                        break;
-                    }
-                }
-                else if (G_VALUE_HOLDS_STRING (val)
-                         && type == XA_ATOM
-                         && format == 32)
-                {
-                    /* set atom (reference to a string) */
-                    data.a[i] = XInternAtom (xdisplay, g_value_get_string (val), False);
-                }
-                else if (G_VALUE_HOLDS_DOUBLE (val) /* xfconf doesn't support floats */
-                         && type == float_atom
-                         && format == 32)
-                {
-                    data.l[i] = g_value_get_double (val);
-                }
-                else
-                {
-                    g_critical ("Unknown property type %s: target = %s, format = %d",
-                                G_VALUE_TYPE_NAME (val), XGetAtomName (xdisplay, type), format);
-                    break;
-                }
-
-                /* the item was successfully updated */
-                n_succeeds++;
+                g_critical ("Unable to open device %s", device_info->name);
+                g_free (pdev);
+                continue;
             }
 
-            if (n_succeeds == n_items)
-            {
-                gdk_error_trap_push ();
-                XChangeDeviceProperty (xdisplay, device, prop, type, format,
-                                       PropModeReplace, data.c, n_items);
-                if (gdk_error_trap_pop () != 0)
-                {
-                    g_critical ("Failed to set device property %s for %s",
-                                prop_name, device_info->name);
-                }
+            /* create a valid xfconf property name for the device */
+            pdev->xfconf_name = xfce_pointers_helper_device_xfconf_name (device_info->name);
 
-                xfsettings_dbg (XFSD_DEBUG_POINTERS,
-                                "[%s] Changed device property %s",
-                                device_info->name, prop_name);
-            }
+            xfsettings_dbg (XFSD_DEBUG_POINTERS, "[%s] registered device %lu as %s",
+                            device_info->name, device_info->id, pdev->xfconf_name);
+
+            /* the caches of known devices stay valid, their property
+             * changes are tracked with notify events */
+#ifdef DEVICE_PROPERTIES
+            pdev->properties = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+#endif
+#ifdef TYPING_DETECTION
+            if (helper->xi_opcode != 0)
+                pdev->typing_prop = xfce_pointers_helper_typing_property (helper, pdev);
+#endif
 
-            XFree (data.c);
+            if (added != NULL)
+                g_ptr_array_add (added, pdev);
         }
 
-        break;
+        g_ptr_array_add (devices, pdev);
     }
 
-    XFree (props);
-}
-
+    /* close the devices that went away */
+    if (helper->devices != NULL)
+    {
+        g_hash_table_destroy (helper->device_names);
+        g_ptr_array_unref (helper->devices);
+    }
 
+    if (helper->device_list != NULL)
+        XFreeDeviceList (helper->device_list);
 
-static void
-xfce_pointers_helper_change_properties (gpointer key,
-                                        gpointer value,
-                                        gpointer user_data)
-{
-    XfcePointerData *pointer_data = user_data;
-    const gchar     *prop_name = ((gchar *) key) + pointer_data->prop_name_len;
+    helper->device_list = device_list;
+    helper->ndevices = ndevices;
+    helper->devices = devices;
 
-    xfce_pointers_helper_change_property (pointer_data->device_info,
-                                          pointer_data->device,
-                                          pointer_data->xdisplay,
-                                          prop_name, value);
+    /* identical devices share a name, the first one wins like before */
+    helper->device_names = g_hash_table_new (g_str_hash, g_str_equal);
+    for (i = devices->len; i > 0; i--)
+    {
+        pdev = g_ptr_array_index (devices, i - 1);
+        g_hash_table_insert (helper->device_names, pdev->xfconf_name, pdev);
+    }
 }
-#endif
 
 
 
-static void
-xfce_pointers_helper_restore_devices (XfcePointersHelper *helper,
-                                      XID                *xid)
-{
-    Display         *xdisplay = GDK_DISPLAY ();
-    XDeviceInfo     *device_list, *device_info;
-    gint             n, ndevices;
-    XDevice         *device;
-    gchar           *device_name;
-    gchar            prop[256];
-    gboolean         right_handed;
-    gboolean         reverse_scrolling;
-    gint             threshold;
-    gdouble          acceleration;
 #ifdef DEVICE_PROPERTIES
-    GHashTable      *props;
-    XfcePointerData  pointer_data;
-#endif
-    const gchar     *mode;
+static Atom
+xfce_pointers_helper_property_atom (XfcePointersHelper *helper,
+                                    Display            *xdisplay,
+                                    const gchar        *prop_name)
+{
+    gpointer  value;
+    gchar    *atom_name;
+    Atom      atom;
 
-    gdk_error_trap_push ();
-    device_list = XListInputDevices (xdisplay, &ndevices);
-    if (gdk_error_trap_pop () != 0 || device_list == NULL)
-    {
-        g_message ("No input devices found");
-        return;
-    }
+    if (g_hash_table_lookup_extended (helper->atoms, prop_name, NULL, &value))
+        return GPOINTER_TO_UINT (value);
 
-    for (n = 0; n < ndevices; n++)
-    {
-        /* filter the pointer devices */
-        device_info = &device_list[n];
-        if (device_info->use != IsXExtensionPointer
-            || device_info->name == NULL)
-            continue;
+    /* assuming the device property never contained underscores... */
+    atom_name = g_strdup (prop_name);
+    g_strdelimit (atom_name, "_", ' ');
+    atom = XInternAtom (xdisplay, atom_name, True);
+    g_free (atom_name);
 
-        /* filter out the device if one is set */
-        if (xid != NULL && device_info->id != *xid)
-            continue;
+    g_hash_table_insert (helper->atoms, g_strdup (prop_name), GUINT_TO_POINTER (atom));
 
-        /* open the device */
-        gdk_error_trap_push ();
-        device = XOpenDevice (xdisplay, device_info->id);
-        if (gdk_error_trap_pop () != 0 || device == NULL)
-        {
-            g_critical ("Unable to open device %s", device_info->name);
-            continue;
-        }
+    return atom;
+}
 
-        /* create a valid xfconf property name for the device */
-        device_name = xfce_pointers_helper_device_xfconf_name (device_info->name);
 
-        /* read buttonmap properties */
-        g_snprintf (prop, sizeof (prop), "/%s/RightHanded", device_name);
-        right_handed = xfconf_channel_get_bool (helper->channel, prop, -1);
 
-        g_snprintf (prop, sizeof (prop), "/%s/ReverseScrolling", device_name);
-        reverse_scrolling = xfconf_channel_get_bool (helper->channel, prop, -1);
+static XfcePointerProperty *
+xfce_pointers_helper_device_property (XfcePointersHelper *helper,
+                                      XfcePointerDevice  *pdev,
+                                      Display            *xdisplay,
+                                      const gchar        *prop_name)
+{
+    XfcePointerProperty *property;
+    Atom                 atom;
+    gint                 n;
+    gulong               bytes_after;
+    guchar              *data;
 
-        if (right_handed != -1 || reverse_scrolling != -1)
-        {
-            xfce_pointers_helper_change_button_mapping (device_info, device, xdisplay,
-                                                        right_handed, reverse_scrolling);
-        }
+    property = g_hash_table_lookup (pdev->properties, prop_name);
+    if (property != NULL)
+        return property->atom != None ? property : NULL;
 
-        /* read feedback settings */
-        g_snprintf (prop, sizeof (prop), "/%s/Threshold", device_name);
-        threshold = xfconf_channel_get_int (helper->channel, prop, -1);
+    property = g_new0 (XfcePointerProperty, 1);
+    g_hash_table_insert (pdev->properties, g_strdup (prop_name), property);
 
-        g_snprintf (prop, sizeof (prop), "/%s/Acceleration", device_name);
-        acceleration = xfconf_channel_get_double (helper->channel, prop, -1.00);
+    /* because of the True in XInternAtom we quit here if the property
+     * does not exists on any of the devices */
+    atom = xfce_pointers_helper_property_atom (helper, xdisplay, prop_name);
+    if (atom == None)
+        return NULL;
 
-        if (threshold != -1 || acceleration != -1.00)
+    if (pdev->atoms == NULL)
+    {
+        gdk_error_trap_push ();
+        pdev->atoms = XListDeviceProperties (xdisplay, pdev->device, &pdev->n_atoms);
+        if (gdk_error_trap_pop () != 0 || pdev->atoms == NULL)
         {
-            xfce_pointers_helper_change_feedback (device_info, device, xdisplay,
-                                                  threshold, acceleration);
+            pdev->atoms = NULL;
+            pdev->n_atoms = 0;
         }
+    }
 
-        /* read mode settings */
-        g_snprintf (prop, sizeof (prop), "/%s/Mode", device_name);
-        mode =  xfconf_channel_get_string  (helper->channel, prop, NULL);
-
-        if (mode != NULL)
-            xfce_pointers_helper_change_mode (device_info, device, xdisplay, mode);
-
-#ifdef DEVICE_PROPERTIES
-        /* set device properties */
-        g_snprintf (prop, sizeof (prop), "/%s/Properties", device_name);
-        props = xfconf_channel_get_properties (helper->channel, prop);
+    for (n = 0; n < pdev->n_atoms; n++)
+    {
+        /* find the matching property */
+        if (pdev->atoms[n] != atom)
+            continue;
 
-        if (props != NULL)
+        /* learn the layout of the property */
+        gdk_error_trap_push ();
+        if (XGetDeviceProperty (xdisplay, pdev->device, atom, 0, 1000, False,
+                                AnyPropertyType, &property->type, &property->format,
+                                &property->n_items, &bytes_after, &data) == Success)
         {
-            pointer_data.xdisplay = xdisplay;
-            pointer_data.device = device;
-            pointer_data.device_info = device_info;
-            pointer_data.prop_name_len = strlen (prop) + 1;
-
-            g_hash_table_foreach (props, xfce_pointers_helper_change_properties, &pointer_data);
-
-            g_hash_table_destroy (props);
+            property->atom = atom;
+            XFree (data);
         }
-#endif
+        gdk_error_trap_pop ();
 
-        g_free (device_name);
-        XCloseDevice (xdisplay, device);
+        break;
     }
 
-    XFreeDeviceList (device_list);
+    xfsettings_dbg (XFSD_DEBUG_POINTERS, "[%s] cached property %s (format=%d, items=%lu)",
+                    pdev->info->name, prop_name, property->format, property->n_items);
+
+    return property->atom != None ? property : NULL;
 }
 
 
 
 static void
-xfce_pointers_helper_channel_property_changed (XfconfChannel      *channel,
-                                               const gchar        *property_name,
-                                               const GValue       *value,
-                                               XfcePointersHelper *helper)
+xfce_pointers_helper_change_property (XfcePointersHelper *helper,
+                                      XfcePointerDevice  *pdev,
+                                      Display            *xdisplay,
+                                      const gchar        *prop_name,
+                                      const GValue       *value)
 {
-    Display      *xdisplay = GDK_DISPLAY ();
-    XDeviceInfo  *device_list, *device_info;
-    XDevice      *device;
-    gint          n, ndevices;
-    gchar       **names;
-    gchar        *device_name;
-
-    if (G_UNLIKELY (property_name == NULL))
-         return;
+    XfcePointerProperty *property;
+    gulong               i;
+    gulong               n_succeeds;
+    GPtrArray           *array = NULL;
+    const GValue        *val;
+    union {
+        guchar *c;
+        gshort *s;
+        glong  *l;
+        Atom   *a;
+    } data;
 
-    /* check the daemon status */
-    if ((strcmp (property_name, "/DisableTouchpadWhileTyping") == 0) ||
-        (strcmp (property_name, "/DisableTouchpadDuration") == 0))
+    property = xfce_pointers_helper_device_property (helper, pdev, xdisplay, prop_name);
+    if (property == NULL)
+        return;
+
+    if (property->n_items == 1
+        && (G_VALUE_HOLDS_INT (value)
+            || G_VALUE_HOLDS_STRING (value)
+            || G_VALUE_HOLDS_DOUBLE (value)))
     {
-        xfce_pointers_helper_syndaemon_check (helper);
+        /* only 1 items to set */
+        val = value;
+    }
+    else if (G_VALUE_TYPE (value) == XFCONF_TYPE_G_VALUE_ARRAY)
+    {
+        array = g_value_get_boxed (value);
+        if (array->len != property->n_items)
+        {
+            g_critical ("Nr device property items (%ld) and xfconf value (%d) differ",
+                        property->n_items, array->len);
+            return;
+        }
+    }
+    else
+    {
+        g_critical ("Invalid device property combination");
         return;
     }
 
-    /* split the property name (+1 so skip the first slash in the name) */
-    names = g_strsplit (property_name + 1, "/", -1);
+    /* Xlib wants longs for 32 bits items */
+    if (property->format == 8)
+        data.c = g_new0 (guchar, property->n_items);
+    else if (property->format == 16)
+        data.s = g_new0 (gshort, property->n_items);
+    else
+        data.l = g_new0 (glong, property->n_items);
 
-    if (names != NULL && g_strv_length (names) >= 2)
+    /* reset check counter */
+    n_succeeds = 0;
+
+    for (i = 0; i < property->n_items; i++)
+    {
+        /* get value from pointer array */
+        if (array != NULL)
+            val = g_ptr_array_index (array, i);
+        else
+            val = value;
+
+        if (G_VALUE_HOLDS_INT (val)
+            && property->type == XA_INTEGER)
+        {
+            if (property->format == 8)
+                data.c[i] = g_value_get_int (val);
+            else if (property->format == 16)
+                data.s[i] = g_value_get_int (val);
+            else if (property->format == 32)
+                data.l[i] = g_value_get_int (val);
+            else
+            {
+                g_critical ("Unknown format %d for integer", property->format);
+                break;
+            }
+        }
+        else if (G_VALUE_HOLDS_STRING (val)
+                 && property->type == XA_ATOM
+                 && property->format == 32)
+        {
+            /* set atom (reference to a string) */
+            data.a[i] = XInternAtom (xdisplay, g_value_get_string (val), False);
+        }
+        else if (G_VALUE_HOLDS_DOUBLE (val) /* xfconf doesn't support floats */
+                 && property->type == helper->float_atom
+                 && property->format == 32)
+        {
+            data.l[i] = g_value_get_double (val);
+        }
+        else
+        {
+            g_critical ("Unknown property type %s: target = %s, format = %d",
+                        G_VALUE_TYPE_NAME (val), XGetAtomName (xdisplay, property->type),
+                        property->format);
+            break;
+        }
+
+        /* the item was successfully updated */
+        n_succeeds++;
+    }
+
+    if (n_succeeds == property->n_items)
     {
+        property->pending++;
+
         gdk_error_trap_push ();
-        device_list = XListInputDevices (xdisplay, &ndevices);
-        if (gdk_error_trap_pop () != 0 || device_list == NULL)
+        XChangeDeviceProperty (xdisplay, pdev->device, property->atom, property->type,
+                               property->format, PropModeReplace, data.c,
+                               property->n_items);
+        if (gdk_error_trap_pop () != 0)
         {
-            g_message ("No input devices found");
+            g_critical ("Failed to set device property %s for %s",
+                        prop_name, pdev->info->name);
+
+            /* no notify will come for this one, and the layout is suspect */
+            property->pending--;
+            xfce_pointers_helper_device_flush_properties (pdev);
+        }
+
+        xfsettings_dbg (XFSD_DEBUG_POINTERS,
+                        "[%s] Changed device property %s",
+                        pdev->info->name, prop_name);
+    }
+
+    g_free (data.c);
+}
+#endif
+
+
+
+#ifdef TYPING_DETECTION
+static const gchar *
+xfce_pointers_helper_typing_property (XfcePointersHelper *helper,
+                                      XfcePointerDevice  *pdev)
+{
+    Display *xdisplay = GDK_DISPLAY ();
+
+    if (pdev->info->type != helper->touchpad_type)
+        return NULL;
+
+    /* synaptics, or the generic property for the other drivers */
+    if (xfce_pointers_helper_device_property (helper, pdev, xdisplay, "Synaptics_Off") != NULL)
+        return "Synaptics_Off";
+    if (xfce_pointers_helper_device_property (helper, pdev, xdisplay, "Device_Enabled") != NULL)
+        return "Device_Enabled";
+
+    return NULL;
+}
+
+
+
+static void
+xfce_pointers_helper_typing_set_touchpads (XfcePointersHelper *helper,
+                                           gboolean            enabled)
+{
+    XfcePointerDevice *pdev;
+    const gchar       *prop_name;
+    GValue             value = { 0, };
+    guint              n;
+
+    g_value_init (&value, G_TYPE_INT);
+
+    for (n = 0; n < helper->devices->len; n++)
+    {
+        pdev = g_ptr_array_index (helper->devices, n);
+        prop_name = pdev->typing_prop;
+        if (prop_name == NULL)
+            continue;
+
+        if (strcmp (prop_name, "Synaptics_Off") == 0)
+            g_value_set_int (&value, enabled ? 0 : 1);
+        else
+            g_value_set_int (&value, enabled ? 1 : 0);
+
+        xfce_pointers_helper_change_property (helper, pdev, GDK_DISPLAY (),
+                                              prop_name, &value);
+    }
+
+    g_value_unset (&value);
+
+    helper->touchpads_off = !enabled;
+
+    xfsettings_dbg (XFSD_DEBUG_POINTERS, "touchpads %s while typing",
+                    enabled ? "enabled" : "disabled");
+}
+
+
+
+static gboolean
+xfce_pointers_helper_typing_timeout (gpointer user_data)
+{
+    XfcePointersHelper *helper = XFCE_POINTERS_HELPER (user_data);
+    gdouble             remaining;
+
+    helper->typing_timeout_id = 0;
+
+    /* key presses only restart the timer, see if one came meanwhile */
+    remaining = helper->typing_duration - g_timer_elapsed (helper->typing_timer, NULL);
+    if (remaining > 0.01)
+    {
+        helper->typing_timeout_id = g_timeout_add (remaining * 1000,
+                                                   xfce_pointers_helper_typing_timeout,
+                                                   helper);
+    }
+    else if (helper->touchpads_off)
+    {
+        xfce_pointers_helper_typing_set_touchpads (helper, TRUE);
+    }
+
+    return FALSE;
+}
+
+
+
+static void
+xfce_pointers_helper_typing_key (XfcePointersHelper *helper,
+                                 gint                keycode,
+                                 gboolean            pressed)
+{
+    guint n;
+
+    if (keycode < 0 || keycode > 255)
+        return;
+
+    /* modifiers, and shortcuts using them, are not typing */
+    if (helper->modifier_keys[keycode / 8] & (1 << (keycode % 8)))
+    {
+        if (pressed)
+            helper->modifiers_down[keycode / 8] |= (1 << (keycode % 8));
+        else
+            helper->modifiers_down[keycode / 8] &= ~(1 << (keycode % 8));
+        return;
+    }
+
+    if (!pressed)
+        return;
+
+    for (n = 0; n < G_N_ELEMENTS (helper->modifiers_down); n++)
+        if (helper->modifiers_down[n] != 0)
             return;
+
+    g_timer_start (helper->typing_timer);
+
+    if (!helper->touchpads_off)
+        xfce_pointers_helper_typing_set_touchpads (helper, FALSE);
+
+    if (helper->typing_timeout_id == 0)
+    {
+        helper->typing_timeout_id = g_timeout_add (helper->typing_duration * 1000,
+                                                   xfce_pointers_helper_typing_timeout,
+                                                   helper);
+    }
+}
+
+
+
+static void
+xfce_pointers_helper_typing_select (XfcePointersHelper *helper,
+                                    gboolean            watch)
+{
+    Display         *xdisplay = GDK_DISPLAY ();
+    XIEventMask      mask;
+    guchar           bits[XIMaskLen (XI_RawKeyRelease)] = { 0, };
+    XModifierKeymap *modmap;
+    gint             n, keycode;
+
+    if (watch)
+    {
+        XISetMask (bits, XI_RawKeyPress);
+        XISetMask (bits, XI_RawKeyRelease);
+
+        /* remember which keys are modifiers */
+        memset (helper->modifier_keys, 0, sizeof (helper->modifier_keys));
+        memset (helper->modifiers_down, 0, sizeof (helper->modifiers_down));
+        modmap = XGetModifierMapping (xdisplay);
+        if (modmap != NULL)
+        {
+            for (n = 0; n < 8 * modmap->max_keypermod; n++)
+            {
+                keycode = modmap->modifiermap[n];
+                if (keycode > 0 && keycode < 256)
+                    helper->modifier_keys[keycode / 8] |= (1 << (keycode % 8));
+            }
+            XFreeModifiermap (modmap);
+        }
+    }
+
+    mask.deviceid = XIAllMasterDevices;
+    mask.mask_len = sizeof (bits);
+    mask.mask = bits;
+
+    gdk_error_trap_push ();
+    XISelectEvents (xdisplay, RootWindow (xdisplay, DefaultScreen (xdisplay)), &mask, 1);
+    if (gdk_error_trap_pop () != 0)
+    {
+        g_warning ("Failed to select raw key events");
+        watch = FALSE;
+    }
+
+    helper->typing_watch = watch;
+
+    xfsettings_dbg (XFSD_DEBUG_POINTERS, "%s watching the keyboard",
+                    watch ? "started" : "stopped");
+}
+#endif
+
+
+
+static void
+xfce_pointers_helper_typing_check (XfcePointersHelper *helper)
+{
+#ifdef TYPING_DETECTION
+    XfcePointerDevice *pdev;
+    const GValue      *value;
+    gboolean           have_touchpad = FALSE;
+    gboolean           watch;
+    guint              n;
+
+    if (helper->xi_opcode == 0)
+        return;
+
+    value = xfce_pointers_helper_setting (helper, NULL, "DisableTouchpadDuration", G_TYPE_DOUBLE);
+    helper->typing_duration = value != NULL ? g_value_get_double (value) : 2.0;
+
+    value = xfce_pointers_helper_setting (helper, NULL, "DisableTouchpadWhileTyping", G_TYPE_BOOLEAN);
+    if (value != NULL && g_value_get_boolean (value))
+    {
+        /* search for a touchpad we can disable, known at registration */
+        for (n = 0; !have_touchpad && n < helper->devices->len; n++)
+        {
+            pdev = g_ptr_array_index (helper->devices, n);
+            have_touchpad = pdev->typing_prop != NULL;
         }
+    }
+
+    watch = have_touchpad;
+    if (watch != helper->typing_watch)
+        xfce_pointers_helper_typing_select (helper, watch);
 
-        for (n = 0; n < ndevices; n++)
+    if (helper->typing_watch)
+    {
+        /* apply a new duration to the running timeout right away */
+        if (helper->typing_timeout_id != 0)
         {
-            /* filter the pointer devices */
-            device_info = &device_list[n];
-            if (device_info->use != IsXExtensionPointer
-                || device_info->name == NULL)
-                continue;
+            g_source_remove (helper->typing_timeout_id);
+            xfce_pointers_helper_typing_timeout (helper);
+        }
+    }
+    else
+    {
+        if (helper->typing_timeout_id != 0)
+        {
+            g_source_remove (helper->typing_timeout_id);
+            helper->typing_timeout_id = 0;
+        }
 
-            /* search the device name */
-            device_name = xfce_pointers_helper_device_xfconf_name (device_info->name);
-            if (strcmp (names[0], device_name) == 0)
-            {
-                /* open the device */
-                gdk_error_trap_push ();
-                device = XOpenDevice (xdisplay, device_info->id);
-                if (gdk_error_trap_pop () != 0 || device == NULL)
-                {
-                    g_critical ("Unable to open device %s", device_info->name);
-                    continue;
-                }
+        if (helper->touchpads_off)
+            xfce_pointers_helper_typing_set_touchpads (helper, TRUE);
+    }
+#endif
+}
 
-                /* check the property that requires updating */
-                if (strcmp (names[1], "RightHanded") == 0)
-                {
-                    xfce_pointers_helper_change_button_mapping (device_info, device, xdisplay,
-                                                                g_value_get_boolean (value), -1);
-                }
-                else if (strcmp (names[1], "ReverseScrolling") == 0)
-                {
-                    xfce_pointers_helper_change_button_mapping (device_info, device, xdisplay,
-                                                                -1, g_value_get_boolean (value));
-                }
-                else if (strcmp (names[1], "Threshold") == 0)
-                {
-                    xfce_pointers_helper_change_feedback (device_info, device, xdisplay,
-                                                          g_value_get_int (value), -2.00);
-                }
-                else if (strcmp (names[1], "Acceleration") == 0)
-                {
-                    xfce_pointers_helper_change_feedback (device_info, device, xdisplay,
-                                                          -2, g_value_get_double (value));
-                }
+
+
+static void
+xfce_pointers_helper_restore_device (XfcePointersHelper *helper,
+                                     XfcePointerDevice  *pdev)
+{
+    Display           *xdisplay = GDK_DISPLAY ();
+    XDeviceInfo       *device_info = pdev->info;
+    XDevice           *device = pdev->device;
+    const gchar       *device_name = pdev->xfconf_name;
+    const GValue      *value;
+    gint               right_handed;
+    gint               reverse_scrolling;
+    gint               threshold;
+    gdouble            acceleration;
 #ifdef DEVICE_PROPERTIES
-                else if (strcmp (names[1], "Properties") == 0)
-                {
-                    xfce_pointers_helper_change_property (device_info, device, xdisplay,
-                                                          names[2], value);
-                }
+    gchar              prefix[256];
+    gsize              prefix_len;
+    GHashTableIter     iter;
+    gpointer           property_name, property_value;
 #endif
-                else if (strcmp (names[1], "Mode") == 0)
-                {
-                    xfce_pointers_helper_change_mode (device_info, device, xdisplay,
-                                                      g_value_get_string (value));
-                }
-                else
-                {
-                    g_warning ("Unknown property %s set for device %s",
-                               property_name, device_info->name);
-                }
 
-                XCloseDevice (xdisplay, device);
+    /* read buttonmap properties */
+    value = xfce_pointers_helper_setting (helper, device_name, "RightHanded", G_TYPE_BOOLEAN);
+    right_handed = value != NULL ? g_value_get_boolean (value) : -1;
 
-                /* stop searching */
-                n = ndevices;
-            }
+    value = xfce_pointers_helper_setting (helper, device_name, "ReverseScrolling", G_TYPE_BOOLEAN);
+    reverse_scrolling = value != NULL ? g_value_get_boolean (value) : -1;
+
+    if (right_handed != -1 || reverse_scrolling != -1)
+    {
+        xfce_pointers_helper_change_button_mapping (device_info, device, xdisplay,
+                                                    right_handed, reverse_scrolling);
+    }
 
-            g_free (device_name);
+    /* read feedback settings */
+    value = xfce_pointers_helper_setting (helper, device_name, "Threshold", G_TYPE_INT);
+    threshold = value != NULL ? g_value_get_int (value) : -1;
+
+    value = xfce_pointers_helper_setting (helper, device_name, "Acceleration", G_TYPE_DOUBLE);
+    acceleration = value != NULL ? g_value_get_double (value) : -1.00;
+
+    if (threshold != -1 || acceleration != -1.00)
+    {
+        xfce_pointers_helper_change_feedback (device_info, device, xdisplay,
+                                              threshold, acceleration);
+    }
+
+    /* read mode settings */
+    value = xfce_pointers_helper_setting (helper, device_name, "Mode", G_TYPE_STRING);
+    if (value != NULL && g_value_get_string (value) != NULL)
+        xfce_pointers_helper_change_mode (device_info, device, xdisplay,
+                                          g_value_get_string (value));
+
+#ifdef DEVICE_PROPERTIES
+    /* set device properties */
+    g_snprintf (prefix, sizeof (prefix), "/%s/Properties/", device_name);
+    prefix_len = strlen (prefix);
+
+    g_hash_table_iter_init (&iter, helper->settings);
+    while (g_hash_table_iter_next (&iter, &property_name, &property_value))
+    {
+        if (strncmp (property_name, prefix, prefix_len) == 0)
+        {
+            xfce_pointers_helper_change_property (helper, pdev, xdisplay,
+                                                  (gchar *) property_name + prefix_len,
+                                                  property_value);
         }
+    }
+#endif
+}
+
+
+
+static void
+xfce_pointers_helper_restore_devices (XfcePointersHelper *helper)
+{
+    guint n;
+
+    if (helper->devices == NULL || helper->devices->len == 0)
+    {
+        g_message ("No input devices found");
+        return;
+    }
 
-        XFreeDeviceList (device_list);
+    for (n = 0; n < helper->devices->len; n++)
+        xfce_pointers_helper_restore_device (helper, g_ptr_array_index (helper->devices, n));
+}
+
+
+
+static void
+xfce_pointers_helper_apply_device_property (XfcePointersHelper *helper,
+                                            const gchar        *property_name,
+                                            const GValue       *value)
+{
+    Display            *xdisplay = GDK_DISPLAY ();
+    XDeviceInfo        *device_info;
+    XDevice            *device;
+    XfcePointerDevice  *pdev;
+    gchar             **names;
+
+    /* split the property name (+1 so skip the first slash in the name) */
+    names = g_strsplit (property_name + 1, "/", -1);
+
+    if (names != NULL && g_strv_length (names) >= 2)
+    {
+        /* search the device name */
+        pdev = g_hash_table_lookup (helper->device_names, names[0]);
+        if (pdev != NULL)
+        {
+            device_info = pdev->info;
+            device = pdev->device;
+
+            /* check the property that requires updating */
+            if (strcmp (names[1], "RightHanded") == 0)
+            {
+                xfce_pointers_helper_change_button_mapping (device_info, device, xdisplay,
+                                                            g_value_get_boolean (value), -1);
+            }
+            else if (strcmp (names[1], "ReverseScrolling") == 0)
+            {
+                xfce_pointers_helper_change_button_mapping (device_info, device, xdisplay,
+                                                            -1, g_value_get_boolean (value));
+            }
+            else if (strcmp (names[1], "Threshold") == 0)
+            {
+                xfce_pointers_helper_change_feedback (device_info, device, xdisplay,
+                                                      g_value_get_int (value), -2.00);
+            }
+            else if (strcmp (names[1], "Acceleration") == 0)
+            {
+                xfce_pointers_helper_change_feedback (device_info, device, xdisplay,
+                                                      -2, g_value_get_double (value));
+            }
+#ifdef DEVICE_PROPERTIES
+            else if (strcmp (names[1], "Properties") == 0)
+            {
+                xfce_pointers_helper_change_property (helper, pdev, xdisplay,
+                                                      names[2], value);
+            }
+#endif
+            else if (strcmp (names[1], "Mode") == 0)
+            {
+                xfce_pointers_helper_change_mode (device_info, device, xdisplay,
+                                                  g_value_get_string (value));
+            }
+            else
+            {
+                g_warning ("Unknown property %s set for device %s",
+                           property_name, device_info->name);
+            }
+        }
     }
 
     g_strfreev (names);
@@ -1017,7 +1565,149 @@ xfce_pointers_helper_channel_property_changed (XfconfChannel      *channel,
 
 
 
+static void
+xfce_pointers_helper_queue_write (XfcePointersHelper *helper,
+                                  const gchar        *property_name,
+                                  const GValue       *value)
+{
+    GValue *copy;
+
+    copy = g_new0 (GValue, 1);
+    if (G_IS_VALUE (value))
+    {
+        g_value_init (copy, G_VALUE_TYPE (value));
+        g_value_copy (value, copy);
+    }
+
+    /* the latest value wins, the previous one is never written */
+    if (g_hash_table_lookup (helper->pending_writes, property_name) != NULL)
+        helper->n_dropped_writes++;
+
+    g_hash_table_replace (helper->pending_writes, g_strdup (property_name), copy);
+
+    if (helper->flush_timeout_id == 0)
+    {
+        helper->flush_timeout_id = g_timeout_add (WRITE_FLUSH_INTERVAL,
+                                                  xfce_pointers_helper_flush_writes,
+                                                  helper);
+    }
+}
+
+
+
+static gboolean
+xfce_pointers_helper_flush_writes (gpointer user_data)
+{
+    XfcePointersHelper *helper = XFCE_POINTERS_HELPER (user_data);
+    GHashTable         *writes;
+    GHashTableIter      iter;
+    gpointer            property_name, value;
+    XfsdStatsMark       mark;
+
+    xfsettings_stats_begin (&mark, G_STRFUNC);
+
+    helper->flush_timeout_id = 0;
+
+    /* take the queue, writing may cause new changes */
+    writes = helper->pending_writes;
+    helper->pending_writes = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+                                                    (GDestroyNotify) xfce_pointers_helper_free_value);
+
+    g_hash_table_iter_init (&iter, writes);
+    while (g_hash_table_iter_next (&iter, &property_name, &value))
+    {
+        xfce_pointers_helper_apply_device_property (helper, property_name, value);
+        helper->n_writes++;
+    }
+
+    xfsettings_trace (XFSD_TRACE_POINTERS_WRITES, g_hash_table_size (writes),
+                      helper->n_writes, helper->n_dropped_writes, 0);
+
+    g_hash_table_destroy (writes);
+
+    xfsettings_stats_end (helper->stats, XFSD_STATS_EVENT, &mark);
+
+    return FALSE;
+}
+
+
+
+static void
+xfce_pointers_helper_channel_property_changed (XfconfChannel      *channel,
+                                               const gchar        *property_name,
+                                               const GValue       *value,
+                                               XfcePointersHelper *helper)
+{
+    XfsdStatsMark mark;
+
+    if (G_UNLIKELY (property_name == NULL))
+         return;
+
+    xfsettings_stats_begin_xfconf (&mark, G_STRFUNC, property_name);
+
+    /* keep the copy of the channel up-to-date for restoring devices */
+    xfce_pointers_helper_store_setting (helper, property_name, value);
+
+    /* check the typing detector */
+    if ((strcmp (property_name, "/DisableTouchpadWhileTyping") == 0) ||
+        (strcmp (property_name, "/DisableTouchpadDuration") == 0))
+    {
+        xfce_pointers_helper_typing_check (helper);
+    }
+    else
+    {
+        /* device settings are written in batches */
+        xfce_pointers_helper_queue_write (helper, property_name, value);
+    }
+
+    xfsettings_stats_end (helper->stats, XFSD_STATS_XFCONF, &mark);
+}
+
+
+
 #ifdef DEVICE_HOTPLUGGING
+static gboolean
+xfce_pointers_helper_select_events (XfcePointersHelper *helper)
+{
+    Display           *xdisplay = GDK_DISPLAY ();
+    XEventClass       *classes;
+    gint               n_classes = 0;
+#ifdef DEVICE_PROPERTIES
+    XfcePointerDevice *pdev;
+    guint              n;
+    gint               type;
+#endif
+
+    classes = g_new0 (XEventClass, 1 + (helper->devices != NULL ? helper->devices->len : 0));
+
+    gdk_error_trap_push ();
+
+    DevicePresence (xdisplay, helper->device_presence_event_type, classes[n_classes]);
+    n_classes++;
+
+#ifdef DEVICE_PROPERTIES
+    /* property changes of the registered devices, for the layout cache */
+    for (n = 0; helper->devices != NULL && n < helper->devices->len; n++)
+    {
+        pdev = g_ptr_array_index (helper->devices, n);
+        DevicePropertyNotify (pdev->device, type, classes[n_classes]);
+        if (classes[n_classes] != 0)
+        {
+            helper->device_property_event_type = type;
+            n_classes++;
+        }
+    }
+#endif
+
+    XSelectExtensionEvent (xdisplay, RootWindow (xdisplay, DefaultScreen (xdisplay)),
+                           classes, n_classes);
+    g_free (classes);
+
+    return gdk_error_trap_pop () == 0;
+}
+
+
+
 static GdkFilterReturn
 xfce_pointers_helper_event_filter (GdkXEvent *xevent,
                                    GdkEvent  *gdk_event,
@@ -1026,17 +1716,129 @@ xfce_pointers_helper_event_filter (GdkXEvent *xevent,
     XEvent                     *event = xevent;
     XDevicePresenceNotifyEvent *dpn_event = xevent;
     XfcePointersHelper         *helper = XFCE_POINTERS_HELPER (user_data);
+#ifdef DEVICE_PROPERTIES
+    XDevicePropertyNotifyEvent *dp_event = xevent;
+    XfcePointerDevice          *pdev;
+    XfcePointerProperty        *property;
+    GHashTableIter              iter;
+    guint                       n;
+#endif
+#ifdef TYPING_DETECTION
+    XIRawEvent                 *raw_event;
+
+    /* raw key events of the typing detector, keep this cheap */
+    if (event->type == GenericEvent
+        && event->xcookie.extension == helper->xi_opcode
+        && helper->typing_watch)
+    {
+        if (XGetEventData (event->xcookie.display, &event->xcookie))
+        {
+            raw_event = event->xcookie.data;
+            if (event->xcookie.evtype == XI_RawKeyPress
+                || event->xcookie.evtype == XI_RawKeyRelease)
+            {
+                xfce_pointers_helper_typing_key (helper, raw_event->detail,
+                                                 event->xcookie.evtype == XI_RawKeyPress);
+            }
+            XFreeEventData (event->xcookie.display, &event->xcookie);
+        }
+
+        return GDK_FILTER_CONTINUE;
+    }
+#endif
+#ifdef DEVICE_PROPERTIES
 
-    if (event->type == helper->device_presence_event_type)
+    if (event->type == helper->device_property_event_type)
     {
-        /* restore device settings */
+        for (n = 0; n < helper->devices->len; n++)
+        {
+            pdev = g_ptr_array_index (helper->devices, n);
+            if (pdev->info->id != dp_event->deviceid)
+                continue;
+
+            /* the notify of one of our own writes changes nothing */
+            if (dp_event->state == PropertyNewValue)
+            {
+                g_hash_table_iter_init (&iter, pdev->properties);
+                while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &property))
+                {
+                    if (property->atom == dp_event->atom && property->pending > 0)
+                    {
+                        property->pending--;
+                        return GDK_FILTER_CONTINUE;
+                    }
+                }
+            }
+
+            xfsettings_dbg (XFSD_DEBUG_POINTERS, "[%s] properties changed, flushing cache",
+                            pdev->info->name);
+            xfce_pointers_helper_device_flush_properties (pdev);
+            break;
+        }
+
+        return GDK_FILTER_CONTINUE;
+    }
+#endif
+
+    /* devices that are enabled or disabled stay in the registry, the
+     * touchpads we disable while typing also send these */
+    if (event->type == helper->device_presence_event_type
+        && (dpn_event->devchange == DeviceAdded
+            || dpn_event->devchange == DeviceRemoved))
+    {
+        /* handle the events of a burst in one go */
+        helper->n_hotplug_events++;
         if (dpn_event->devchange == DeviceAdded)
-            xfce_pointers_helper_restore_devices (helper, &dpn_event->deviceid);
+            g_array_append_val (helper->hotplug_added, dpn_event->deviceid);
 
-        /* check if we need to launch syndaemon */
-        xfce_pointers_helper_syndaemon_check (helper);
+        if (helper->hotplug_timeout_id == 0)
+        {
+            helper->hotplug_timeout_id = g_timeout_add (HOTPLUG_BATCH_INTERVAL,
+                                                        xfce_pointers_helper_hotplug_flush,
+                                                        helper);
+        }
     }
 
     return GDK_FILTER_CONTINUE;
 }
+
+
+
+static gboolean
+xfce_pointers_helper_hotplug_flush (gpointer user_data)
+{
+    XfcePointersHelper *helper = XFCE_POINTERS_HELPER (user_data);
+    GPtrArray          *added;
+    guint               n;
+    XfsdStatsMark       mark;
+
+    xfsettings_stats_begin (&mark, G_STRFUNC);
+
+    helper->hotplug_timeout_id = 0;
+
+    /* refresh the registry */
+    added = g_ptr_array_new ();
+    xfce_pointers_helper_devices_update (helper, helper->hotplug_added, added);
+#ifdef DEVICE_PROPERTIES
+    xfce_pointers_helper_select_events (helper);
+#endif
+
+    /* restore the settings of the new devices only */
+    for (n = 0; n < added->len; n++)
+        xfce_pointers_helper_restore_device (helper, g_ptr_array_index (added, n));
+
+    /* check if we need to watch the keyboard */
+    xfce_pointers_helper_typing_check (helper);
+
+    xfsettings_trace (XFSD_TRACE_POINTERS_HOTPLUG, helper->n_hotplug_events,
+                      added->len, helper->devices->len, 0);
+
+    g_ptr_array_free (added, TRUE);
+    g_array_set_size (helper->hotplug_added, 0);
+    helper->n_hotplug_events = 0;
+
+    xfsettings_stats_end (helper->stats, XFSD_STATS_EVENT, &mark);
+
+    return FALSE;
+}
 #endif
@@ -0,0 +1,453 @@
+/*
+ *  Copyright (c) 2012 The Xfce Development Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#include <glib.h>
+#include <xfconf/xfconf.h>
+
+#include "debug.h"
+#include "prefetch.h"
+
+
+
+/* the channels the helpers read while starting */
+static const gchar *prefetch_channels[] =
+{
+    "accessibility",
+    "displays",
+    "keyboard-layout",
+    "keyboards",
+    "pointers",
+    "xfsettingsd",
+    "xfwm4",
+    "xsettings"
+};
+
+
+
+typedef struct
+{
+    XfconfChannel *channel;
+
+    /* property name -> GValue, kept current with property-changed */
+    GHashTable    *props;
+
+    /* properties looked up so far, libxfconf caches these after the
+     * first GetProperty call, so only the first lookup saves one */
+    GHashTable    *looked_up;
+}
+XfsdPrefetchChannel;
+
+
+
+/* channel name -> XfsdPrefetchChannel, NULL when not prefetching */
+static GHashTable *prefetch_table = NULL;
+
+/* lookups served from the snapshots and forwarded to xfconfd */
+static guint       prefetch_n_served = 0;
+static guint       prefetch_n_forwarded = 0;
+static gboolean    prefetch_finished = FALSE;
+
+/* D-Bus calls to xfconfd the snapshots made unnecessary */
+static guint       prefetch_n_get_avoided = 0;
+static guint       prefetch_n_get_all_avoided = 0;
+
+
+
+static void
+xfsettings_prefetch_free_value (GValue *value)
+{
+    if (G_IS_VALUE (value))
+        g_value_unset (value);
+    g_free (value);
+}
+
+
+
+static GValue *
+xfsettings_prefetch_copy_value (const GValue *value)
+{
+    GValue *copy;
+
+    copy = g_new0 (GValue, 1);
+    g_value_init (copy, G_VALUE_TYPE (value));
+    g_value_copy (value, copy);
+
+    return copy;
+}
+
+
+
+static void
+xfsettings_prefetch_channel_free (XfsdPrefetchChannel *pchannel)
+{
+    g_hash_table_destroy (pchannel->props);
+    g_hash_table_destroy (pchannel->looked_up);
+    g_object_unref (G_OBJECT (pchannel->channel));
+    g_free (pchannel);
+}
+
+
+
+static void
+xfsettings_prefetch_property_changed (XfconfChannel       *channel,
+                                      const gchar         *property,
+                                      const GValue        *value,
+                                      XfsdPrefetchChannel *pchannel)
+{
+    /* an unset value means the property was removed */
+    if (value == NULL || !G_IS_VALUE (value))
+        g_hash_table_remove (pchannel->props, property);
+    else
+        g_hash_table_replace (pchannel->props, g_strdup (property),
+                              xfsettings_prefetch_copy_value (value));
+}
+
+
+
+static XfsdPrefetchChannel *
+xfsettings_prefetch_lookup_channel (XfconfChannel *channel)
+{
+    XfsdPrefetchChannel *pchannel;
+    gchar               *channel_name;
+
+    if (prefetch_table == NULL)
+    {
+        /* count what goes to xfconfd during startup */
+        if (!prefetch_finished)
+            prefetch_n_forwarded++;
+
+        return NULL;
+    }
+
+    /* helpers can have their own channel object for the same name */
+    g_object_get (G_OBJECT (channel), "channel-name", &channel_name, NULL);
+    pchannel = g_hash_table_lookup (prefetch_table, channel_name);
+    g_free (channel_name);
+
+    if (pchannel != NULL)
+        prefetch_n_served++;
+    else
+        prefetch_n_forwarded++;
+
+    return pchannel;
+}
+
+
+
+static const GValue *
+xfsettings_prefetch_lookup (XfconfChannel *channel,
+                            const gchar   *property,
+                            gboolean      *found)
+{
+    XfsdPrefetchChannel *pchannel;
+
+    pchannel = xfsettings_prefetch_lookup_channel (channel);
+    if (pchannel == NULL)
+    {
+        *found = FALSE;
+        return NULL;
+    }
+
+    /* in the snapshot, a missing property is an unset property */
+    *found = TRUE;
+
+    if (g_hash_table_lookup (pchannel->looked_up, property) == NULL)
+    {
+        g_hash_table_insert (pchannel->looked_up, g_strdup (property), GINT_TO_POINTER (1));
+        prefetch_n_get_avoided++;
+    }
+
+    return g_hash_table_lookup (pchannel->props, property);
+}
+
+
+
+void
+xfsettings_prefetch_init (void)
+{
+    XfsdPrefetchChannel *pchannel;
+    GHashTable          *props;
+    GHashTableIter       iter;
+    gpointer             key, value;
+    guint                i;
+    GTimer              *timer;
+
+    g_return_if_fail (prefetch_table == NULL);
+
+    /* for comparing the startup time without the snapshots */
+    if (g_getenv ("XFSETTINGSD_NO_PREFETCH") != NULL)
+        return;
+
+    timer = g_timer_new ();
+
+    prefetch_table = g_hash_table_new_full (g_str_hash, g_str_equal, NULL,
+                                            (GDestroyNotify) xfsettings_prefetch_channel_free);
+
+    for (i = 0; i < G_N_ELEMENTS (prefetch_channels); i++)
+    {
+        pchannel = g_new0 (XfsdPrefetchChannel, 1);
+        pchannel->channel = g_object_ref (xfconf_channel_get (prefetch_channels[i]));
+        pchannel->props = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+                                                 (GDestroyNotify) xfsettings_prefetch_free_value);
+        pchannel->looked_up = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+        /* one D-Bus call for the entire channel */
+        props = xfconf_channel_get_properties (pchannel->channel, NULL);
+        if (props != NULL)
+        {
+            g_hash_table_iter_init (&iter, props);
+            while (g_hash_table_iter_next (&iter, &key, &value))
+            {
+                g_hash_table_iter_steal (&iter);
+                g_hash_table_insert (pchannel->props, key, value);
+            }
+            g_hash_table_destroy (props);
+        }
+
+        /* connected before the helpers, so this runs first */
+        g_signal_connect (G_OBJECT (pchannel->channel), "property-changed",
+                          G_CALLBACK (xfsettings_prefetch_property_changed), pchannel);
+
+        g_hash_table_insert (prefetch_table, (gpointer) prefetch_channels[i], pchannel);
+    }
+
+    xfsettings_dbg (XFSD_DEBUG_PREFETCH, "prefetched %d channels in %.1f ms",
+                    G_N_ELEMENTS (prefetch_channels),
+                    g_timer_elapsed (timer, NULL) * 1000.0);
+
+    g_timer_destroy (timer);
+}
+
+
+
+void
+xfsettings_prefetch_finish (gdouble startup_ms)
+{
+    GHashTableIter       iter;
+    XfsdPrefetchChannel *pchannel;
+    guint                n_channels = 0;
+
+    if (prefetch_table != NULL)
+    {
+        n_channels = g_hash_table_size (prefetch_table);
+
+        g_hash_table_iter_init (&iter, prefetch_table);
+        while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &pchannel))
+        {
+            g_signal_handlers_disconnect_by_func (G_OBJECT (pchannel->channel),
+                xfsettings_prefetch_property_changed, pchannel);
+        }
+
+        g_hash_table_destroy (prefetch_table);
+        prefetch_table = NULL;
+    }
+
+    /* the snapshots cost one GetAllProperties call per channel */
+    xfsettings_dbg (XFSD_DEBUG_PREFETCH, "started in %.1f ms: %u lookups served from %u "
+                    "prefetched channels, %u sent to xfconfd, %u GetProperty and %u "
+                    "GetAllProperties calls avoided for %u GetAllProperties calls",
+                    startup_ms, prefetch_n_served, n_channels, prefetch_n_forwarded,
+                    prefetch_n_get_avoided, prefetch_n_get_all_avoided, n_channels);
+
+    /* helpers talk to xfconf directly from now on */
+    prefetch_finished = TRUE;
+}
+
+
+
+GHashTable *
+xfsettings_prefetch_get_properties (XfconfChannel *channel,
+                                    const gchar   *property_base)
+{
+    XfsdPrefetchChannel *pchannel;
+    GHashTable          *props;
+    GHashTableIter       iter;
+    gpointer             key, value;
+    gsize                base_len = 0;
+    const gchar         *name;
+
+    g_return_val_if_fail (XFCONF_IS_CHANNEL (channel), NULL);
+
+    pchannel = xfsettings_prefetch_lookup_channel (channel);
+    if (pchannel == NULL)
+        return xfconf_channel_get_properties (channel, property_base);
+
+    /* libxfconf does not cache these */
+    prefetch_n_get_all_avoided++;
+
+    /* same matching as xfconfd, "/" and NULL return everything */
+    if (property_base != NULL && strcmp (property_base, "/") != 0)
+        base_len = strlen (property_base);
+
+    props = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+                                   (GDestroyNotify) xfsettings_prefetch_free_value);
+
+    g_hash_table_iter_init (&iter, pchannel->props);
+    while (g_hash_table_iter_next (&iter, &key, &value))
+    {
+        name = key;
+        if (base_len > 0
+            && (strncmp (name, property_base, base_len) != 0
+                || (name[base_len] != '\0' && name[base_len] != '/')))
+            continue;
+
+        g_hash_table_insert (props, g_strdup (name),
+                             xfsettings_prefetch_copy_value (value));
+    }
+
+    /* like xfconf, nothing found is not an empty table */
+    if (g_hash_table_size (props) == 0)
+    {
+        g_hash_table_destroy (props);
+        return NULL;
+    }
+
+    return props;
+}
+
+
+
+gboolean
+xfsettings_prefetch_has_property (XfconfChannel *channel,
+                                  const gchar   *property)
+{
+    const GValue *value;
+    gboolean      found;
+
+    g_return_val_if_fail (XFCONF_IS_CHANNEL (channel), FALSE);
+
+    value = xfsettings_prefetch_lookup (channel, property, &found);
+    if (!found)
+        return xfconf_channel_has_property (channel, property);
+
+    return value != NULL;
+}
+
+
+
+gboolean
+xfsettings_prefetch_get_bool (XfconfChannel *channel,
+                              const gchar   *property,
+                              gboolean       default_value)
+{
+    const GValue *value;
+    gboolean      found;
+
+    g_return_val_if_fail (XFCONF_IS_CHANNEL (channel), default_value);
+
+    value = xfsettings_prefetch_lookup (channel, property, &found);
+    if (!found)
+        return xfconf_channel_get_bool (channel, property, default_value);
+
+    if (value != NULL && G_VALUE_HOLDS_BOOLEAN (value))
+        return g_value_get_boolean (value);
+
+    return default_value;
+}
+
+
+
+gint
+xfsettings_prefetch_get_int (XfconfChannel *channel,
+                             const gchar   *property,
+                             gint           default_value)
+{
+    const GValue *value;
+    gboolean      found;
+    GValue        int_value = { 0, };
+    gint          result = default_value;
+
+    g_return_val_if_fail (XFCONF_IS_CHANNEL (channel), default_value);
+
+    value = xfsettings_prefetch_lookup (channel, property, &found);
+    if (!found)
+        return xfconf_channel_get_int (channel, property, default_value);
+
+    if (value != NULL)
+    {
+        /* stored as another integer type */
+        g_value_init (&int_value, G_TYPE_INT);
+        if (g_value_transform (value, &int_value))
+            result = g_value_get_int (&int_value);
+        g_value_unset (&int_value);
+    }
+
+    return result;
+}
+
+
+
+gchar *
+xfsettings_prefetch_get_string (XfconfChannel *channel,
+                                const gchar   *property,
+                                const gchar   *default_value)
+{
+    const GValue *value;
+    gboolean      found;
+
+    g_return_val_if_fail (XFCONF_IS_CHANNEL (channel), g_strdup (default_value));
+
+    value = xfsettings_prefetch_lookup (channel, property, &found);
+    if (!found)
+        return xfconf_channel_get_string (channel, property, default_value);
+
+    if (value != NULL && G_VALUE_HOLDS_STRING (value))
+        return g_value_dup_string (value);
+
+    return g_strdup (default_value);
+}
+
+
+
+GPtrArray *
+xfsettings_prefetch_get_arrayv (XfconfChannel *channel,
+                                const gchar   *property)
+{
+    const GValue *value;
+    gboolean      found;
+    GPtrArray    *values, *copy;
+    guint         i;
+
+    g_return_val_if_fail (XFCONF_IS_CHANNEL (channel), NULL);
+
+    value = xfsettings_prefetch_lookup (channel, property, &found);
+    if (!found)
+        return xfconf_channel_get_arrayv (channel, property);
+
+    if (value == NULL || G_VALUE_TYPE (value) != XFCONF_TYPE_G_VALUE_ARRAY)
+        return NULL;
+
+    /* deep copy, so it can be released with xfconf_array_free() */
+    values = g_value_get_boxed (value);
+    if (values == NULL)
+        return NULL;
+
+    copy = g_ptr_array_sized_new (values->len);
+    for (i = 0; i < values->len; i++)
+        g_ptr_array_add (copy, xfsettings_prefetch_copy_value (g_ptr_array_index (values, i)));
+
+    return copy;
+}
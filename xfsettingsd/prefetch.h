@@ -0,0 +1,49 @@
+/*
+ *  Copyright (c) 2012 The Xfce Development Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __PREFETCH_H__
+#define __PREFETCH_H__
+
+#include <xfconf/xfconf.h>
+
+void        xfsettings_prefetch_init           (void);
+
+void        xfsettings_prefetch_finish         (gdouble        startup_ms);
+
+GHashTable *xfsettings_prefetch_get_properties (XfconfChannel *channel,
+                                                const gchar   *property_base);
+
+gboolean    xfsettings_prefetch_has_property   (XfconfChannel *channel,
+                                                const gchar   *property);
+
+gboolean    xfsettings_prefetch_get_bool       (XfconfChannel *channel,
+                                                const gchar   *property,
+                                                gboolean       default_value);
+
+gint        xfsettings_prefetch_get_int        (XfconfChannel *channel,
+                                                const gchar   *property,
+                                                gint           default_value);
+
+gchar      *xfsettings_prefetch_get_string     (XfconfChannel *channel,
+                                                const gchar   *property,
+                                                const gchar   *default_value);
+
+GPtrArray  *xfsettings_prefetch_get_arrayv     (XfconfChannel *channel,
+                                                const gchar   *property);
+
+#endif /* !__PREFETCH_H__ */
@@ -0,0 +1,508 @@
+/*
+ *  Copyright (c) 2012 The Xfce Development Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#include <glib.h>
+#include <gdk/gdk.h>
+#include <gdk/gdkx.h>
+#include <dbus/dbus.h>
+
+#include "debug.h"
+#include "stats.h"
+#include "trace.h"
+
+#define STATS_PATH      "/org/xfce/SettingsDaemon/Stats"
+#define STATS_INTERFACE "org.xfce.SettingsDaemon.Stats"
+
+/* name, events, xfconf changes, x requests, total and max handler
+ * time in microseconds, bytes held */
+#define STATS_SIGNATURE "a(stttttt)"
+
+/* handlers blocking the main loop longer than this are logged,
+ * in milliseconds, override with XFSETTINGSD_STALL_THRESHOLD */
+#define STALL_THRESHOLD_DEFAULT 100
+
+/* upper bounds of the handler time histogram in microseconds, the
+ * last bucket counts everything above */
+#define STATS_N_BUCKETS 7
+static const guint64 stats_buckets[STATS_N_BUCKETS - 1] =
+{
+    1000, 4000, 16000, 64000, 256000, 1024000
+};
+
+
+
+struct _XfsdStats
+{
+    gchar              *name;
+    GQuark              quark;
+
+    /* quarks of the handler names, by the G_STRFUNC pointer */
+    GHashTable         *handlers;
+
+    guint64             n_events;
+    guint64             n_xfconf_changes;
+    guint64             n_x_requests;
+    guint64             handler_time;
+    guint64             handler_time_max;
+    guint               histogram[STATS_N_BUCKETS];
+    guint               n_stalls;
+
+    /* asked when the statistics are requested */
+    XfsdStatsBytesFunc  bytes_func;
+    gpointer            bytes_data;
+};
+
+
+
+static const gchar stats_introspection[] =
+    "<!DOCTYPE node PUBLIC \"-//freedesktop//DTD D-BUS Object Introspection 1.0//EN\"\n"
+    " \"http://www.freedesktop.org/standards/dbus/1.0/introspect.dtd\">\n"
+    "<node>\n"
+    "  <interface name=\"" DBUS_INTERFACE_INTROSPECTABLE "\">\n"
+    "    <method name=\"Introspect\">\n"
+    "      <arg name=\"data\" direction=\"out\" type=\"s\"/>\n"
+    "    </method>\n"
+    "  </interface>\n"
+    "  <interface name=\"" STATS_INTERFACE "\">\n"
+    "    <method name=\"GetStats\">\n"
+    "      <arg name=\"stats\" direction=\"out\" type=\"" STATS_SIGNATURE "\"/>\n"
+    "    </method>\n"
+    "  </interface>\n"
+    "</node>\n";
+
+
+
+/* all helpers in order of creation */
+static GPtrArray *stats_list = NULL;
+
+/* in microseconds, 0 if stalls are not logged */
+static gint64     stall_threshold = -1;
+
+
+
+static gint64
+xfsettings_stats_now (void)
+{
+    GTimeVal now;
+
+    g_get_current_time (&now);
+
+    return (gint64) now.tv_sec * G_USEC_PER_SEC + now.tv_usec;
+}
+
+
+
+XfsdStats *
+xfsettings_stats_get (const gchar *helper_name)
+{
+    XfsdStats *stats;
+    guint      i;
+
+    g_return_val_if_fail (helper_name != NULL, NULL);
+
+    if (stats_list == NULL)
+        stats_list = g_ptr_array_new ();
+
+    /* helpers loaded again from a module continue counting */
+    for (i = 0; i < stats_list->len; i++)
+    {
+        stats = g_ptr_array_index (stats_list, i);
+        if (strcmp (stats->name, helper_name) == 0)
+        {
+            /* the module can be at another address now */
+            g_hash_table_remove_all (stats->handlers);
+            return stats;
+        }
+    }
+
+    stats = g_new0 (XfsdStats, 1);
+    stats->name = g_strdup (helper_name);
+    stats->quark = g_quark_from_string (helper_name);
+    stats->handlers = g_hash_table_new (g_direct_hash, g_direct_equal);
+    g_ptr_array_add (stats_list, stats);
+
+    return stats;
+}
+
+
+
+static void
+xfsettings_stats_histogram (XfsdStats *stats)
+{
+    GString *line;
+    guint    i;
+
+    line = g_string_new (NULL);
+    for (i = 0; i < STATS_N_BUCKETS; i++)
+    {
+        if (i < G_N_ELEMENTS (stats_buckets))
+            g_string_append_printf (line, " <%" G_GUINT64_FORMAT "ms:%u",
+                                    stats_buckets[i] / 1000, stats->histogram[i]);
+        else
+            g_string_append_printf (line, " more:%u", stats->histogram[i]);
+    }
+
+    xfsettings_dbg_filtered (XFSD_DEBUG_STALLS, "[%s] %u stalls,%s",
+                             stats->name, stats->n_stalls, line->str);
+
+    g_string_free (line, TRUE);
+}
+
+
+
+static void
+xfsettings_stats_stall (XfsdStats           *stats,
+                        XfsdStatsKind        kind,
+                        const XfsdStatsMark *mark,
+                        gint64               elapsed)
+{
+    const gchar *value;
+    gchar       *what;
+
+    if (stall_threshold == -1)
+    {
+        value = g_getenv ("XFSETTINGSD_STALL_THRESHOLD");
+        if (value != NULL)
+            stall_threshold = MAX (atoi (value), 0) * 1000;
+        else
+            stall_threshold = STALL_THRESHOLD_DEFAULT * 1000;
+    }
+
+    if (stall_threshold == 0 || elapsed < stall_threshold)
+        return;
+
+    stats->n_stalls++;
+
+    if (mark->property != NULL)
+        what = g_strdup_printf ("xfconf change of %s", mark->property);
+    else if (mark->event_type != 0)
+        what = g_strdup_printf ("X event type %d", mark->event_type);
+    else
+        what = g_strdup (kind == XFSD_STATS_XFCONF ? "xfconf change" : "event");
+
+    /* the main loop was blocked for all the other helpers */
+    g_message ("The %s helper blocked the main loop for %.1f ms in %s (%s).",
+               stats->name, elapsed / 1000.0,
+               mark->handler != NULL ? mark->handler : "unknown handler", what);
+
+    g_free (what);
+
+    xfsettings_stats_histogram (stats);
+}
+
+
+
+void
+xfsettings_stats_begin (XfsdStatsMark *mark,
+                        const gchar   *handler)
+{
+    mark->time = xfsettings_stats_now ();
+    mark->request = NextRequest (GDK_DISPLAY ());
+    mark->handler = handler;
+    mark->event_type = 0;
+    mark->property = NULL;
+}
+
+
+
+void
+xfsettings_stats_begin_event (XfsdStatsMark *mark,
+                              const gchar   *handler,
+                              gint           event_type)
+{
+    xfsettings_stats_begin (mark, handler);
+    mark->event_type = event_type;
+}
+
+
+
+void
+xfsettings_stats_begin_xfconf (XfsdStatsMark *mark,
+                               const gchar   *handler,
+                               const gchar   *property)
+{
+    /* the property name lives as long as the handler runs */
+    xfsettings_stats_begin (mark, handler);
+    mark->property = property;
+}
+
+
+
+void
+xfsettings_stats_end (XfsdStats           *stats,
+                      XfsdStatsKind        kind,
+                      const XfsdStatsMark *mark)
+{
+    gint64 elapsed;
+    gulong n_requests;
+    GQuark handler;
+    guint  i;
+
+    g_return_if_fail (stats != NULL);
+
+    if (kind == XFSD_STATS_XFCONF)
+        stats->n_xfconf_changes++;
+    else
+        stats->n_events++;
+
+    /* requests issued on the gdk connection by the handler */
+    n_requests = NextRequest (GDK_DISPLAY ()) - mark->request;
+    stats->n_x_requests += n_requests;
+
+    /* the wall clock can jump */
+    elapsed = MAX (xfsettings_stats_now () - mark->time, 0);
+    stats->handler_time += elapsed;
+    stats->handler_time_max = MAX (stats->handler_time_max, (guint64) elapsed);
+
+    for (i = 0; i < G_N_ELEMENTS (stats_buckets); i++)
+        if ((guint64) elapsed < stats_buckets[i])
+            break;
+    stats->histogram[i]++;
+
+    /* only hash the name the first time the handler runs */
+    handler = GPOINTER_TO_UINT (g_hash_table_lookup (stats->handlers, mark->handler));
+    if (G_UNLIKELY (handler == 0))
+    {
+        handler = g_quark_from_string (mark->handler);
+        g_hash_table_insert (stats->handlers, (gpointer) mark->handler,
+                             GUINT_TO_POINTER (handler));
+    }
+
+    xfsettings_trace (kind == XFSD_STATS_XFCONF ? XFSD_TRACE_HANDLER_XFCONF : XFSD_TRACE_HANDLER_EVENT,
+                      stats->quark, handler, elapsed, n_requests);
+
+    xfsettings_stats_stall (stats, kind, mark, elapsed);
+}
+
+
+
+void
+xfsettings_stats_watch_bytes (XfsdStats          *stats,
+                              XfsdStatsBytesFunc  func,
+                              gpointer            user_data)
+{
+    g_return_if_fail (stats != NULL);
+
+    /* helpers reset this when they are destroyed */
+    stats->bytes_func = func;
+    stats->bytes_data = user_data;
+}
+
+
+
+gsize
+xfsettings_stats_table_size (GHashTable *settings)
+{
+    GHashTableIter  iter;
+    gpointer        key, value;
+    const gchar    *str;
+    gsize           size = 0;
+
+    /* a rough estimate of a property name -> GValue table */
+    g_hash_table_iter_init (&iter, settings);
+    while (g_hash_table_iter_next (&iter, &key, &value))
+    {
+        size += strlen (key) + 1 + sizeof (GValue);
+
+        if (G_VALUE_HOLDS_STRING (value))
+        {
+            str = g_value_get_string (value);
+            if (str != NULL)
+                size += strlen (str) + 1;
+        }
+    }
+
+    return size;
+}
+
+
+
+static DBusHandlerResult
+xfsettings_stats_message (DBusConnection *connection,
+                          DBusMessage    *message,
+                          void           *user_data)
+{
+    DBusMessage     *reply;
+    DBusMessageIter  iter, array_iter, struct_iter;
+    XfsdStats       *stats;
+    guint            i;
+    const gchar     *xml = stats_introspection;
+    dbus_uint64_t    bytes;
+
+    if (dbus_message_is_method_call (message, DBUS_INTERFACE_INTROSPECTABLE, "Introspect"))
+    {
+        reply = dbus_message_new_method_return (message);
+        dbus_message_append_args (reply, DBUS_TYPE_STRING, &xml, DBUS_TYPE_INVALID);
+    }
+    else if (dbus_message_is_method_call (message, STATS_INTERFACE, "GetStats"))
+    {
+        reply = dbus_message_new_method_return (message);
+
+        dbus_message_iter_init_append (reply, &iter);
+        dbus_message_iter_open_container (&iter, DBUS_TYPE_ARRAY, "(stttttt)", &array_iter);
+
+        for (i = 0; stats_list != NULL && i < stats_list->len; i++)
+        {
+            stats = g_ptr_array_index (stats_list, i);
+
+            dbus_message_iter_open_container (&array_iter, DBUS_TYPE_STRUCT, NULL, &struct_iter);
+            dbus_message_iter_append_basic (&struct_iter, DBUS_TYPE_STRING, &stats->name);
+            dbus_message_iter_append_basic (&struct_iter, DBUS_TYPE_UINT64, &stats->n_events);
+            dbus_message_iter_append_basic (&struct_iter, DBUS_TYPE_UINT64, &stats->n_xfconf_changes);
+            dbus_message_iter_append_basic (&struct_iter, DBUS_TYPE_UINT64, &stats->n_x_requests);
+            dbus_message_iter_append_basic (&struct_iter, DBUS_TYPE_UINT64, &stats->handler_time);
+            dbus_message_iter_append_basic (&struct_iter, DBUS_TYPE_UINT64, &stats->handler_time_max);
+            bytes = stats->bytes_func != NULL ? stats->bytes_func (stats->bytes_data) : 0;
+            dbus_message_iter_append_basic (&struct_iter, DBUS_TYPE_UINT64, &bytes);
+            dbus_message_iter_close_container (&array_iter, &struct_iter);
+        }
+
+        dbus_message_iter_close_container (&iter, &array_iter);
+    }
+    else
+    {
+        return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+    }
+
+    dbus_connection_send (connection, reply, NULL);
+    dbus_message_unref (reply);
+
+    return DBUS_HANDLER_RESULT_HANDLED;
+}
+
+
+
+static const DBusObjectPathVTable stats_vtable =
+{
+    NULL,
+    xfsettings_stats_message,
+};
+
+
+
+void
+xfsettings_stats_register (DBusConnection *connection)
+{
+    if (!dbus_connection_register_object_path (connection, STATS_PATH, &stats_vtable, NULL))
+        g_warning ("Failed to register the statistics object on D-Bus.");
+}
+
+
+
+void
+xfsettings_stats_unregister (DBusConnection *connection)
+{
+    dbus_connection_unregister_object_path (connection, STATS_PATH);
+}
+
+
+
+gint
+xfsettings_stats_print (const gchar *bus_name)
+{
+    DBusConnection  *connection;
+    DBusMessage     *message, *reply;
+    DBusMessageIter  iter, array_iter, struct_iter;
+    DBusError        derror;
+    const gchar     *name;
+    dbus_uint64_t    values[6];
+    guint            i;
+
+    dbus_error_init (&derror);
+
+    connection = dbus_bus_get (DBUS_BUS_SESSION, &derror);
+    if (connection == NULL)
+    {
+        g_printerr ("Failed to connect to the dbus session bus: %s\n", derror.message);
+        dbus_error_free (&derror);
+        return EXIT_FAILURE;
+    }
+
+    message = dbus_message_new_method_call (bus_name, STATS_PATH, STATS_INTERFACE, "GetStats");
+    reply = dbus_connection_send_with_reply_and_block (connection, message, -1, &derror);
+    dbus_message_unref (message);
+
+    if (reply == NULL)
+    {
+        g_printerr ("Failed to get the statistics of the running daemon: %s\n", derror.message);
+        dbus_error_free (&derror);
+        dbus_connection_unref (connection);
+        return EXIT_FAILURE;
+    }
+
+    if (!dbus_message_has_signature (reply, STATS_SIGNATURE))
+    {
+        g_printerr ("Unexpected reply from the running daemon.\n");
+        dbus_message_unref (reply);
+        dbus_connection_unref (connection);
+        return EXIT_FAILURE;
+    }
+
+    g_print ("%-20s %10s %10s %10s %12s %10s %10s\n", "helper", "events",
+             "xfconf", "x requests", "total ms", "max ms", "bytes");
+
+    dbus_message_iter_init (reply, &iter);
+    dbus_message_iter_recurse (&iter, &array_iter);
+    while (dbus_message_iter_get_arg_type (&array_iter) == DBUS_TYPE_STRUCT)
+    {
+        dbus_message_iter_recurse (&array_iter, &struct_iter);
+        dbus_message_iter_get_basic (&struct_iter, &name);
+        for (i = 0; i < G_N_ELEMENTS (values); i++)
+        {
+            dbus_message_iter_next (&struct_iter);
+            dbus_message_iter_get_basic (&struct_iter, &values[i]);
+        }
+
+        g_print ("%-20s %10" G_GUINT64_FORMAT " %10" G_GUINT64_FORMAT " %10" G_GUINT64_FORMAT
+                 " %12.1f %10.1f %10" G_GUINT64_FORMAT "\n",
+                 name, values[0], values[1], values[2], values[3] / 1000.0,
+                 values[4] / 1000.0, values[5]);
+
+        dbus_message_iter_next (&array_iter);
+    }
+
+    dbus_message_unref (reply);
+    dbus_connection_unref (connection);
+
+    return EXIT_SUCCESS;
+}
+
+
+
+void
+xfsettings_stats_histograms (void)
+{
+    guint i;
+
+    if (!xfsettings_dbg_enabled (XFSD_DEBUG_STALLS))
+        return;
+
+    for (i = 0; stats_list != NULL && i < stats_list->len; i++)
+        xfsettings_stats_histogram (g_ptr_array_index (stats_list, i));
+}
@@ -0,0 +1,79 @@
+/*
+ *  Copyright (c) 2012 The Xfce Development Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __STATS_H__
+#define __STATS_H__
+
+#include <glib-object.h>
+#include <dbus/dbus.h>
+
+typedef struct _XfsdStats     XfsdStats;
+typedef struct _XfsdStatsMark XfsdStatsMark;
+
+typedef gsize (*XfsdStatsBytesFunc) (gpointer user_data);
+
+typedef enum
+{
+    XFSD_STATS_EVENT,  /* X event or other main loop callback */
+    XFSD_STATS_XFCONF  /* xfconf property change */
+}
+XfsdStatsKind;
+
+struct _XfsdStatsMark
+{
+    gint64       time;
+    gulong       request;
+    const gchar *handler;
+
+    /* what the handler was called for, 0 and NULL if unknown */
+    gint         event_type;
+    const gchar *property;
+};
+
+XfsdStats *xfsettings_stats_get          (const gchar         *helper_name);
+
+void       xfsettings_stats_begin        (XfsdStatsMark       *mark,
+                                          const gchar         *handler);
+
+void       xfsettings_stats_begin_event  (XfsdStatsMark       *mark,
+                                          const gchar         *handler,
+                                          gint                 event_type);
+
+void       xfsettings_stats_begin_xfconf (XfsdStatsMark       *mark,
+                                          const gchar         *handler,
+                                          const gchar         *property);
+
+void       xfsettings_stats_end          (XfsdStats           *stats,
+                                          XfsdStatsKind        kind,
+                                          const XfsdStatsMark *mark);
+
+void       xfsettings_stats_watch_bytes  (XfsdStats           *stats,
+                                          XfsdStatsBytesFunc   func,
+                                          gpointer             user_data);
+
+gsize      xfsettings_stats_table_size   (GHashTable          *settings);
+
+void       xfsettings_stats_register     (DBusConnection      *connection);
+
+void       xfsettings_stats_unregister   (DBusConnection      *connection);
+
+gint       xfsettings_stats_print        (const gchar         *bus_name);
+
+void       xfsettings_stats_histograms   (void);
+
+#endif /* !__STATS_H__ */
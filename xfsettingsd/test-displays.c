@@ -0,0 +1,226 @@
+/*
+ *  Copyright (c) 2012 The Xfce Development Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Runs the displays helper on the RandR simulation, without an X server.
+ * Schemes are stored in a private channel that is removed afterwards, so
+ * the displays channel of the user is never touched. Every argument is a
+ * fixture, see displays-sim.c, by default a few generated setups are
+ * docked, undocked and switched between schemes. A fixture fails if the
+ * simulation rejects a request, if a step sends other requests than
+ * expected or if the wrong outputs are lit at the end.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#include <glib.h>
+#include <glib-object.h>
+#include <xfconf/xfconf.h>
+
+#include "debug.h"
+#include "helper-module.h"
+#include "displays.h"
+#include "displays-sim.h"
+
+/* exit status for skipped tests, see the automake manual */
+#define EXIT_SKIP       77
+
+/* give up if the trace was not replayed after this time */
+#define REPLAY_TIMEOUT  60
+
+
+
+typedef GTypeModule      TestDisplaysModule;
+typedef GTypeModuleClass TestDisplaysModuleClass;
+
+G_DEFINE_TYPE (TestDisplaysModule, test_displays_module, G_TYPE_TYPE_MODULE)
+
+
+
+typedef struct
+{
+    XfceRRBackend *backend;
+    GMainLoop     *loop;
+    GTimer        *timer;
+}
+TestDisplaysRun;
+
+
+
+static gboolean
+test_displays_module_load (GTypeModule *type_module)
+{
+    /* the helper is linked in */
+    return TRUE;
+}
+
+
+
+static void
+test_displays_module_unload (GTypeModule *type_module)
+{
+}
+
+
+
+static void
+test_displays_module_class_init (TestDisplaysModuleClass *klass)
+{
+    GTypeModuleClass *type_module_class = G_TYPE_MODULE_CLASS (klass);
+
+    type_module_class->load = test_displays_module_load;
+    type_module_class->unload = test_displays_module_unload;
+}
+
+
+
+static void
+test_displays_module_init (TestDisplaysModule *module)
+{
+}
+
+
+
+static gboolean
+test_displays_check_replayed (gpointer data)
+{
+    TestDisplaysRun *run = data;
+
+    if (!xfce_rr_backend_sim_replayed (run->backend)
+        && g_timer_elapsed (run->timer, NULL) < REPLAY_TIMEOUT)
+        return TRUE;
+
+    g_main_loop_quit (run->loop);
+
+    return FALSE;
+}
+
+
+
+static gboolean
+test_displays_run (const gchar *fixture)
+{
+    TestDisplaysRun  run;
+    XfconfChannel   *channel;
+    GObject         *helper;
+    gchar           *channel_name;
+    gboolean         passed;
+    GError          *error = NULL;
+
+    channel_name = g_strdup_printf ("xfsettingsd-test-displays-%d", (gint) getpid ());
+    channel = xfconf_channel_new (channel_name);
+
+    run.backend = xfce_rr_backend_sim_new (fixture, channel, &error);
+    if (run.backend == NULL)
+    {
+        g_printerr ("Failed to load the fixture \"%s\": %s\n", fixture, error->message);
+        g_error_free (error);
+        g_object_unref (G_OBJECT (channel));
+        g_free (channel_name);
+        return FALSE;
+    }
+
+    /* the helper frees the backend */
+    helper = xfce_displays_helper_new_for_backend (run.backend, channel);
+
+    run.loop = g_main_loop_new (NULL, FALSE);
+    run.timer = g_timer_new ();
+    g_timeout_add (100, test_displays_check_replayed, &run);
+    g_main_loop_run (run.loop);
+
+    passed = xfce_rr_backend_sim_replayed (run.backend);
+    if (!passed)
+    {
+        g_printerr ("The fixture \"%s\" was not replayed within %d seconds\n",
+                    fixture, REPLAY_TIMEOUT);
+    }
+    else if (xfce_rr_backend_sim_n_failures (run.backend) > 0)
+    {
+        /* the warnings of the simulation tell what went wrong */
+        g_printerr ("The fixture \"%s\" failed %u check(s)\n",
+                    fixture, xfce_rr_backend_sim_n_failures (run.backend));
+        passed = FALSE;
+    }
+
+    g_object_unref (helper);
+    g_main_loop_unref (run.loop);
+    g_timer_destroy (run.timer);
+
+    /* drop everything the helper stored */
+    xfconf_channel_reset_property (channel, "/", TRUE);
+    g_object_unref (G_OBJECT (channel));
+    g_free (channel_name);
+
+    return passed;
+}
+
+
+
+gint
+main (gint    argc,
+      gchar **argv)
+{
+    const gchar *fixtures[] = { "heads:1", "heads:2", "heads:4", NULL };
+    GTypeModule *module;
+    GError      *error = NULL;
+    gint         n;
+    gint         status = EXIT_SUCCESS;
+
+    g_type_init ();
+
+    xfsettings_dbg_init ();
+
+    /* the schemes go to a private channel, but that needs xfconfd */
+    if (!xfconf_init (&error))
+    {
+        g_printerr ("Skipped, failed to connect to xfconfd: %s\n", error->message);
+        g_error_free (error);
+        return EXIT_SKIP;
+    }
+
+    module = g_object_new (test_displays_module_get_type (), NULL);
+    g_type_module_set_name (module, "displays");
+    g_type_module_use (module);
+    xfsettingsd_helper_register_types (module);
+
+    if (argc > 1)
+    {
+        for (n = 1; n < argc; n++)
+            if (!test_displays_run (argv[n]))
+                status = EXIT_FAILURE;
+    }
+    else
+    {
+        for (n = 0; fixtures[n] != NULL; n++)
+            if (!test_displays_run (fixtures[n]))
+                status = EXIT_FAILURE;
+    }
+
+    xfconf_shutdown ();
+
+    return status;
+}
@@ -0,0 +1,339 @@
+/*
+ *  Copyright (c) 2012 The Xfce Development Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Applies xmodmap files to an in-memory keyboard and modifier mapping,
+ * the X requests used by keyboard-xmodmap.c are replaced below, so no
+ * X server is needed.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#include <X11/Xlib.h>
+#include <X11/keysym.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "keyboard-xmodmap.h"
+
+
+
+#define MIN_KEYCODE         8
+#define MAX_KEYCODE         255
+#define KEYSYMS_PER_KEYCODE 2
+#define MAX_KEYPERMOD       2
+
+#define KEYCODE_CAPS        66
+#define KEYCODE_CONTROL     37
+
+
+
+/* the keyboard of the fake server */
+static KeySym           server_keymap[(MAX_KEYCODE - MIN_KEYCODE + 1) * KEYSYMS_PER_KEYCODE];
+static KeyCode          server_modmap[8 * MAX_KEYPERMOD];
+
+/* number of modifier mappings refused because a key is pressed */
+static gint             server_busy;
+
+
+
+int
+XDisplayKeycodes (Display *xdisplay,
+                  int     *min_keycode,
+                  int     *max_keycode)
+{
+    *min_keycode = MIN_KEYCODE;
+    *max_keycode = MAX_KEYCODE;
+
+    return 1;
+}
+
+
+
+KeySym *
+XGetKeyboardMapping (Display *xdisplay,
+                     KeyCode  first_keycode,
+                     int      keycode_count,
+                     int     *keysyms_per_keycode)
+{
+    KeySym *keysyms;
+
+    g_assert (first_keycode >= MIN_KEYCODE);
+    g_assert (first_keycode + keycode_count - 1 <= MAX_KEYCODE);
+
+    /* freed with XFree () */
+    keysyms = malloc (sizeof (KeySym) * keycode_count * KEYSYMS_PER_KEYCODE);
+    memcpy (keysyms, server_keymap + (first_keycode - MIN_KEYCODE) * KEYSYMS_PER_KEYCODE,
+            sizeof (KeySym) * keycode_count * KEYSYMS_PER_KEYCODE);
+    *keysyms_per_keycode = KEYSYMS_PER_KEYCODE;
+
+    return keysyms;
+}
+
+
+
+int
+XChangeKeyboardMapping (Display *xdisplay,
+                        int      first_keycode,
+                        int      keysyms_per_keycode,
+                        KeySym  *keysyms,
+                        int      num_codes)
+{
+    gint code, n;
+
+    for (code = 0; code < num_codes; code++)
+    {
+        for (n = 0; n < KEYSYMS_PER_KEYCODE; n++)
+        {
+            server_keymap[(first_keycode + code - MIN_KEYCODE) * KEYSYMS_PER_KEYCODE + n] =
+                n < keysyms_per_keycode ? keysyms[code * keysyms_per_keycode + n] : NoSymbol;
+        }
+    }
+
+    return 1;
+}
+
+
+
+XModifierKeymap *
+XGetModifierMapping (Display *xdisplay)
+{
+    XModifierKeymap *modmap;
+
+    modmap = XNewModifiermap (MAX_KEYPERMOD);
+    memcpy (modmap->modifiermap, server_modmap, sizeof (server_modmap));
+
+    return modmap;
+}
+
+
+
+int
+XSetModifierMapping (Display         *xdisplay,
+                     XModifierKeymap *modmap)
+{
+    gint mod, n;
+
+    if (server_busy > 0)
+    {
+        server_busy--;
+        return MappingBusy;
+    }
+
+    memset (server_modmap, 0, sizeof (server_modmap));
+    for (mod = 0; mod < 8; mod++)
+        for (n = 0; n < MIN (modmap->max_keypermod, MAX_KEYPERMOD); n++)
+            server_modmap[mod * MAX_KEYPERMOD + n] =
+                modmap->modifiermap[mod * modmap->max_keypermod + n];
+
+    return MappingSuccess;
+}
+
+
+
+void
+gdk_error_trap_push (void)
+{
+}
+
+
+
+gint
+gdk_error_trap_pop (void)
+{
+    return 0;
+}
+
+
+
+static void
+test_xmodmap_reset (void)
+{
+    memset (server_keymap, 0, sizeof (server_keymap));
+    memset (server_modmap, 0, sizeof (server_modmap));
+    server_busy = 0;
+
+    server_keymap[(KEYCODE_CAPS - MIN_KEYCODE) * KEYSYMS_PER_KEYCODE] = XK_Caps_Lock;
+    server_keymap[(KEYCODE_CONTROL - MIN_KEYCODE) * KEYSYMS_PER_KEYCODE] = XK_Control_L;
+
+    server_modmap[LockMapIndex * MAX_KEYPERMOD] = KEYCODE_CAPS;
+    server_modmap[ControlMapIndex * MAX_KEYPERMOD] = KEYCODE_CONTROL;
+}
+
+
+
+static gboolean
+test_xmodmap_has_modifier (gint    modifier,
+                           KeyCode keycode)
+{
+    gint n;
+
+    for (n = 0; n < MAX_KEYPERMOD; n++)
+        if (server_modmap[modifier * MAX_KEYPERMOD + n] == keycode)
+            return TRUE;
+
+    return FALSE;
+}
+
+
+
+static gchar *
+test_xmodmap_write (const gchar *contents)
+{
+    gchar  *filename;
+    gint    fd;
+    GError *error = NULL;
+
+    fd = g_file_open_tmp ("test-xmodmap-XXXXXX", &filename, &error);
+    g_assert_no_error (error);
+    close (fd);
+
+    g_file_set_contents (filename, contents, -1, &error);
+    g_assert_no_error (error);
+
+    return filename;
+}
+
+
+
+static void
+test_xmodmap_apply (const gchar *contents)
+{
+    XfceXmodmap *xmodmap;
+    gchar       *filename;
+
+    filename = test_xmodmap_write (contents);
+
+    xmodmap = xfce_xmodmap_new (filename);
+    xfce_xmodmap_apply (xmodmap, NULL);
+    xfce_xmodmap_free (xmodmap);
+
+    g_unlink (filename);
+    g_free (filename);
+}
+
+
+
+/* the example of the xmodmap(1) manual page */
+static void
+test_xmodmap_swap_caps_control (void)
+{
+    test_xmodmap_reset ();
+
+    test_xmodmap_apply ("!\n"
+                        "! Swap Caps_Lock and Control_L\n"
+                        "!\n"
+                        "remove Lock = Caps_Lock\n"
+                        "remove Control = Control_L\n"
+                        "keysym Control_L = Caps_Lock\n"
+                        "keysym Caps_Lock = Control_L\n"
+                        "add Lock = Caps_Lock\n"
+                        "add Control = Control_L\n");
+
+    /* both keys are swapped, not both set to the same keysym */
+    g_assert_cmpuint (server_keymap[(KEYCODE_CAPS - MIN_KEYCODE) * KEYSYMS_PER_KEYCODE],
+                      ==, XK_Control_L);
+    g_assert_cmpuint (server_keymap[(KEYCODE_CONTROL - MIN_KEYCODE) * KEYSYMS_PER_KEYCODE],
+                      ==, XK_Caps_Lock);
+
+    /* the modifiers follow the keysyms */
+    g_assert (test_xmodmap_has_modifier (LockMapIndex, KEYCODE_CONTROL));
+    g_assert (!test_xmodmap_has_modifier (LockMapIndex, KEYCODE_CAPS));
+    g_assert (test_xmodmap_has_modifier (ControlMapIndex, KEYCODE_CAPS));
+    g_assert (!test_xmodmap_has_modifier (ControlMapIndex, KEYCODE_CONTROL));
+}
+
+
+
+static void
+test_xmodmap_keycode (void)
+{
+    test_xmodmap_reset ();
+
+    test_xmodmap_apply ("keycode 66 = Escape\n");
+
+    g_assert_cmpuint (server_keymap[(KEYCODE_CAPS - MIN_KEYCODE) * KEYSYMS_PER_KEYCODE],
+                      ==, XK_Escape);
+    g_assert_cmpuint (server_keymap[(KEYCODE_CONTROL - MIN_KEYCODE) * KEYSYMS_PER_KEYCODE],
+                      ==, XK_Control_L);
+}
+
+
+
+/* a pressed modifier must not block the main loop */
+static void
+test_xmodmap_busy (void)
+{
+    XfceXmodmap *xmodmap;
+    gchar       *filename;
+    GTimer      *timer;
+
+    test_xmodmap_reset ();
+    server_busy = 2;
+
+    filename = test_xmodmap_write ("clear Lock\n");
+    xmodmap = xfce_xmodmap_new (filename);
+    xfce_xmodmap_apply (xmodmap, NULL);
+
+    /* refused once, retried later */
+    g_assert_cmpint (server_busy, ==, 1);
+    g_assert (test_xmodmap_has_modifier (LockMapIndex, KEYCODE_CAPS));
+
+    timer = g_timer_new ();
+    while (test_xmodmap_has_modifier (LockMapIndex, KEYCODE_CAPS)
+           && g_timer_elapsed (timer, NULL) < 5.0)
+        g_main_context_iteration (NULL, TRUE);
+    g_timer_destroy (timer);
+
+    g_assert_cmpint (server_busy, ==, 0);
+    g_assert (!test_xmodmap_has_modifier (LockMapIndex, KEYCODE_CAPS));
+    g_assert (test_xmodmap_has_modifier (ControlMapIndex, KEYCODE_CONTROL));
+
+    xfce_xmodmap_free (xmodmap);
+
+    g_unlink (filename);
+    g_free (filename);
+}
+
+
+
+gint
+main (gint    argc,
+      gchar **argv)
+{
+    g_test_init (&argc, &argv, NULL);
+
+    g_test_add_func ("/xmodmap/swap-caps-control", test_xmodmap_swap_caps_control);
+    g_test_add_func ("/xmodmap/keycode", test_xmodmap_keycode);
+    g_test_add_func ("/xmodmap/busy", test_xmodmap_busy);
+
+    return g_test_run ();
+}
@@ -0,0 +1,488 @@
+/*
+ *  Copyright (c) 2012 The Xfce Development Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+#ifdef HAVE_TIME_H
+#include <time.h>
+#endif
+
+#include <glib.h>
+#include <glib-object.h>
+#include <gdk/gdk.h>
+#include <gdk/gdkx.h>
+#include <dbus/dbus.h>
+#include <libxfce4util/libxfce4util.h>
+
+#include "debug.h"
+#include "trace.h"
+
+#define TRACE_PATH      "/org/xfce/SettingsDaemon/Trace"
+#define TRACE_INTERFACE "org.xfce.SettingsDaemon.Trace"
+
+/* number of records kept, a power of two */
+#define TRACE_RING_SIZE 4096
+
+/* arguments per record */
+#define TRACE_N_ARGS    4
+
+/* written on SIGUSR1, relative to the cache directory */
+#define TRACE_FILE      "xfce4" G_DIR_SEPARATOR_S "xfsettingsd-trace.log"
+
+
+
+typedef struct _XfsdTraceFormat XfsdTraceFormat;
+typedef struct _XfsdTraceRecord XfsdTraceRecord;
+
+struct _XfsdTraceFormat
+{
+    XfsdDebugDomain  domain;
+
+    /* one character per argument: u for a number, x for a hex
+     * number, q for a quark, a for an x atom and t for a gtype */
+    const gchar     *args;
+
+    /* with a %s for each argument */
+    const gchar     *format;
+};
+
+struct _XfsdTraceRecord
+{
+    gint64      time;
+    XfsdTraceId id;
+    gulong      args[TRACE_N_ARGS];
+};
+
+
+
+/* in the order of XfsdTraceId */
+static const XfsdTraceFormat trace_formats[] =
+{
+    { XFSD_DEBUG_HANDLERS, "qquu", "%s: %s took %s us, %s X requests" },
+    { XFSD_DEBUG_HANDLERS, "qquu", "%s: %s took %s us for an xfconf change, %s X requests" },
+    { XFSD_DEBUG_XSETTINGS, "qt", "prop \"%s\" changed (type=%s)" },
+    { XFSD_DEBUG_ACCESSIBILITY, "xu", "setting controls 0x%s for %s changes" },
+    { XFSD_DEBUG_KEYBOARDS, "u", "keyboard %s added, applying the settings" },
+    { XFSD_DEBUG_KEYBOARD_LAYOUT, "uuu", "activated %s changes at once (%s activations, %s saved)" },
+    { XFSD_DEBUG_KEYBOARD_SHORTCUTS, "qu", "activated \"%s\" (stamp=%s)" },
+    { XFSD_DEBUG_POINTERS, "uuu", "flushed %s device writes (%s written, %s dropped since startup)" },
+    { XFSD_DEBUG_POINTERS, "uuu", "handled %s device events, restored %s of %s devices" },
+    { XFSD_DEBUG_WORKSPACES, "a", "root window property %s changed" },
+    { XFSD_DEBUG_DISPLAYS, "uu", "Noutput: before = %s, after = %s." },
+    { XFSD_DEBUG_CLIPBOARD, "ua", "handled event %s (atom %s)" },
+};
+
+G_STATIC_ASSERT (G_N_ELEMENTS (trace_formats) == XFSD_N_TRACES);
+
+
+
+static XfsdTraceRecord trace_ring[TRACE_RING_SIZE];
+
+/* number of records ever written, the ring wraps around */
+static guint           trace_n_records = 0;
+
+
+
+static const gchar trace_introspection[] =
+    "<!DOCTYPE node PUBLIC \"-//freedesktop//DTD D-BUS Object Introspection 1.0//EN\"\n"
+    " \"http://www.freedesktop.org/standards/dbus/1.0/introspect.dtd\">\n"
+    "<node>\n"
+    "  <interface name=\"" DBUS_INTERFACE_INTROSPECTABLE "\">\n"
+    "    <method name=\"Introspect\">\n"
+    "      <arg name=\"data\" direction=\"out\" type=\"s\"/>\n"
+    "    </method>\n"
+    "  </interface>\n"
+    "  <interface name=\"" TRACE_INTERFACE "\">\n"
+    "    <method name=\"GetTrace\">\n"
+    "      <arg name=\"log\" direction=\"out\" type=\"s\"/>\n"
+    "    </method>\n"
+    "  </interface>\n"
+    "</node>\n";
+
+
+
+static gchar *
+xfsettings_trace_arg (gchar       type,
+                      gulong      arg,
+                      GHashTable *atom_names)
+{
+    const gchar *name = NULL;
+    gchar       *atom_name;
+    gchar       *result;
+
+    switch (type)
+    {
+        case 'x':
+            return g_strdup_printf ("%lx", arg);
+
+        case 'q':
+            name = g_quark_to_string (arg);
+            break;
+
+        case 't':
+            if (arg != 0)
+                name = g_type_name (arg);
+            break;
+
+        case 'a':
+            if (arg == None)
+                break;
+
+            /* resolved for the whole dump */
+            if (atom_names != NULL)
+            {
+                name = g_hash_table_lookup (atom_names, GUINT_TO_POINTER (arg));
+                break;
+            }
+
+            /* the atom could be gone, if the client that
+             * created it disconnected */
+            gdk_error_trap_push ();
+            atom_name = XGetAtomName (GDK_DISPLAY (), arg);
+            if (gdk_error_trap_pop () == 0 && atom_name != NULL)
+            {
+                result = g_strdup (atom_name);
+                XFree (atom_name);
+                return result;
+            }
+            break;
+
+        default:
+            return g_strdup_printf ("%lu", arg);
+    }
+
+    return g_strdup (name != NULL ? name : "(none)");
+}
+
+
+
+static gchar *
+xfsettings_trace_record_message (const XfsdTraceRecord *record,
+                                 GHashTable            *atom_names)
+{
+    const gchar *type = trace_formats[record->id].args;
+    gchar       *args[TRACE_N_ARGS];
+    gchar       *message;
+    guint        i;
+
+    /* unused arguments are formatted as numbers */
+    for (i = 0; i < TRACE_N_ARGS; i++)
+    {
+        args[i] = xfsettings_trace_arg (*type != '\0' ? *type : 'u', record->args[i], atom_names);
+        if (*type != '\0')
+            type++;
+    }
+
+    /* the formats only contain %s, one for each argument */
+    message = g_strdup_printf (trace_formats[record->id].format,
+                               args[0], args[1], args[2], args[3]);
+
+    for (i = 0; i < TRACE_N_ARGS; i++)
+        g_free (args[i]);
+
+    return message;
+}
+
+
+
+void
+xfsettings_trace (XfsdTraceId id,
+                  gulong      arg1,
+                  gulong      arg2,
+                  gulong      arg3,
+                  gulong      arg4)
+{
+    XfsdTraceRecord *record;
+    GTimeVal         now;
+    gchar           *message;
+
+    /* no formatting here, this is always on */
+    record = &trace_ring[trace_n_records++ & (TRACE_RING_SIZE - 1)];
+
+    g_get_current_time (&now);
+    record->time = (gint64) now.tv_sec * G_USEC_PER_SEC + now.tv_usec;
+    record->id = id;
+    record->args[0] = arg1;
+    record->args[1] = arg2;
+    record->args[2] = arg3;
+    record->args[3] = arg4;
+
+    /* the records replace debug messages, so print them when
+     * debugging the domain */
+    if (G_UNLIKELY (xfsettings_dbg_enabled (trace_formats[id].domain)))
+    {
+        message = xfsettings_trace_record_message (record, NULL);
+        xfsettings_dbg_filtered (trace_formats[id].domain, "%s", message);
+        g_free (message);
+    }
+}
+
+
+
+static GHashTable *
+xfsettings_trace_atom_names (guint first)
+{
+    GHashTable            *atom_names;
+    GArray                *atoms;
+    const XfsdTraceRecord *record;
+    const gchar           *type;
+    gchar                **names;
+    Atom                   atom;
+    guint                  n, i;
+
+    atom_names = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL, g_free);
+    atoms = g_array_new (FALSE, FALSE, sizeof (Atom));
+
+    for (n = first; n != trace_n_records; n++)
+    {
+        record = &trace_ring[n & (TRACE_RING_SIZE - 1)];
+        type = trace_formats[record->id].args;
+        for (i = 0; i < TRACE_N_ARGS && type[i] != '\0'; i++)
+        {
+            atom = record->args[i];
+            if (type[i] != 'a' || atom == None
+                || g_hash_table_lookup_extended (atom_names, GUINT_TO_POINTER (atom), NULL, NULL))
+                continue;
+
+            g_hash_table_insert (atom_names, GUINT_TO_POINTER (atom), NULL);
+            g_array_append_val (atoms, atom);
+        }
+    }
+
+    /* one round trip for all the atoms, those that are gone stay
+     * NULL, if the client that created them disconnected */
+    if (atoms->len > 0)
+    {
+        names = g_new0 (gchar *, atoms->len);
+
+        gdk_error_trap_push ();
+        XGetAtomNames (GDK_DISPLAY (), (Atom *) atoms->data, atoms->len, names);
+        gdk_error_trap_pop ();
+
+        for (i = 0; i < atoms->len; i++)
+        {
+            if (names[i] == NULL)
+                continue;
+
+            g_hash_table_insert (atom_names, GUINT_TO_POINTER (g_array_index (atoms, Atom, i)),
+                                 g_strdup (names[i]));
+            XFree (names[i]);
+        }
+
+        g_free (names);
+    }
+
+    g_array_free (atoms, TRUE);
+
+    return atom_names;
+}
+
+
+
+gchar *
+xfsettings_trace_dump (void)
+{
+    GString               *log;
+    guint                  n, first;
+    const XfsdTraceRecord *record;
+    GHashTable            *atom_names;
+    gchar                 *message;
+    gchar                  stamp[16];
+    time_t                 secs;
+
+    log = g_string_new (NULL);
+
+    /* oldest record first */
+    first = trace_n_records > TRACE_RING_SIZE ? trace_n_records - TRACE_RING_SIZE : 0;
+    atom_names = xfsettings_trace_atom_names (first);
+
+    for (n = first; n != trace_n_records; n++)
+    {
+        record = &trace_ring[n & (TRACE_RING_SIZE - 1)];
+        message = xfsettings_trace_record_message (record, atom_names);
+
+        secs = record->time / G_USEC_PER_SEC;
+        strftime (stamp, sizeof (stamp), "%H:%M:%S", localtime (&secs));
+
+        g_string_append_printf (log, "%s.%06d %s: %s\n", stamp,
+                                (gint) (record->time % G_USEC_PER_SEC),
+                                xfsettings_dbg_domain_name (trace_formats[record->id].domain),
+                                message);
+
+        g_free (message);
+    }
+
+    g_hash_table_destroy (atom_names);
+
+    return g_string_free (log, FALSE);
+}
+
+
+
+void
+xfsettings_trace_write (void)
+{
+    gchar  *filename;
+    gchar  *log;
+    GError *error = NULL;
+
+    filename = xfce_resource_save_location (XFCE_RESOURCE_CACHE, TRACE_FILE, TRUE);
+    if (G_UNLIKELY (filename == NULL))
+    {
+        g_warning ("Failed to create the directory for the trace file.");
+        return;
+    }
+
+    log = xfsettings_trace_dump ();
+
+    if (g_file_set_contents (filename, log, -1, &error))
+    {
+        g_message ("Wrote the last %u trace records to %s.",
+                   MIN (trace_n_records, TRACE_RING_SIZE), filename);
+    }
+    else
+    {
+        g_warning ("Failed to write the trace: %s", error->message);
+        g_error_free (error);
+    }
+
+    g_free (log);
+    g_free (filename);
+}
+
+
+
+static DBusHandlerResult
+xfsettings_trace_message (DBusConnection *connection,
+                          DBusMessage    *message,
+                          void           *user_data)
+{
+    DBusMessage *reply;
+    const gchar *xml = trace_introspection;
+    gchar       *log;
+
+    if (dbus_message_is_method_call (message, DBUS_INTERFACE_INTROSPECTABLE, "Introspect"))
+    {
+        reply = dbus_message_new_method_return (message);
+        dbus_message_append_args (reply, DBUS_TYPE_STRING, &xml, DBUS_TYPE_INVALID);
+    }
+    else if (dbus_message_is_method_call (message, TRACE_INTERFACE, "GetTrace"))
+    {
+        /* strings on the bus must be valid utf-8 */
+        log = xfsettings_trace_dump ();
+        if (!g_utf8_validate (log, -1, NULL))
+        {
+            g_free (log);
+            log = g_strdup ("");
+        }
+
+        reply = dbus_message_new_method_return (message);
+        dbus_message_append_args (reply, DBUS_TYPE_STRING, &log, DBUS_TYPE_INVALID);
+        g_free (log);
+    }
+    else
+    {
+        return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+    }
+
+    dbus_connection_send (connection, reply, NULL);
+    dbus_message_unref (reply);
+
+    return DBUS_HANDLER_RESULT_HANDLED;
+}
+
+
+
+static const DBusObjectPathVTable trace_vtable =
+{
+    NULL,
+    xfsettings_trace_message,
+};
+
+
+
+void
+xfsettings_trace_register (DBusConnection *connection)
+{
+    if (!dbus_connection_register_object_path (connection, TRACE_PATH, &trace_vtable, NULL))
+        g_warning ("Failed to register the trace object on D-Bus.");
+}
+
+
+
+void
+xfsettings_trace_unregister (DBusConnection *connection)
+{
+    dbus_connection_unregister_object_path (connection, TRACE_PATH);
+}
+
+
+
+gint
+xfsettings_trace_print (const gchar *bus_name)
+{
+    DBusConnection *connection;
+    DBusMessage    *message, *reply;
+    DBusError       derror;
+    const gchar    *log;
+
+    dbus_error_init (&derror);
+
+    connection = dbus_bus_get (DBUS_BUS_SESSION, &derror);
+    if (connection == NULL)
+    {
+        g_printerr ("Failed to connect to the dbus session bus: %s\n", derror.message);
+        dbus_error_free (&derror);
+        return EXIT_FAILURE;
+    }
+
+    message = dbus_message_new_method_call (bus_name, TRACE_PATH, TRACE_INTERFACE, "GetTrace");
+    reply = dbus_connection_send_with_reply_and_block (connection, message, -1, &derror);
+    dbus_message_unref (message);
+
+    if (reply == NULL)
+    {
+        g_printerr ("Failed to get the trace of the running daemon: %s\n", derror.message);
+        dbus_error_free (&derror);
+        dbus_connection_unref (connection);
+        return EXIT_FAILURE;
+    }
+
+    if (!dbus_message_get_args (reply, NULL, DBUS_TYPE_STRING, &log, DBUS_TYPE_INVALID))
+    {
+        g_printerr ("Unexpected reply from the running daemon.\n");
+        dbus_message_unref (reply);
+        dbus_connection_unref (connection);
+        return EXIT_FAILURE;
+    }
+
+    g_print ("%s", log);
+
+    dbus_message_unref (reply);
+    dbus_connection_unref (connection);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,61 @@
+/*
+ *  Copyright (c) 2012 The Xfce Development Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+#include <glib.h>
+#include <dbus/dbus.h>
+
+/* the format of each id is in trace.c, keep the order in sync */
+typedef enum
+{
+    XFSD_TRACE_HANDLER_EVENT,
+    XFSD_TRACE_HANDLER_XFCONF,
+    XFSD_TRACE_XSETTINGS_CHANGED,
+    XFSD_TRACE_ACCESSIBILITY_FLUSH,
+    XFSD_TRACE_KEYBOARDS_DEVICE,
+    XFSD_TRACE_KEYBOARD_LAYOUT_ACTIVATE,
+    XFSD_TRACE_SHORTCUT_ACTIVATED,
+    XFSD_TRACE_POINTERS_WRITES,
+    XFSD_TRACE_POINTERS_HOTPLUG,
+    XFSD_TRACE_WORKSPACES_PROPERTY,
+    XFSD_TRACE_DISPLAYS_SCREEN_CHANGED,
+    XFSD_TRACE_CLIPBOARD_EVENT,
+
+    XFSD_N_TRACES
+}
+XfsdTraceId;
+
+void   xfsettings_trace            (XfsdTraceId     id,
+                                    gulong          arg1,
+                                    gulong          arg2,
+                                    gulong          arg3,
+                                    gulong          arg4);
+
+gchar *xfsettings_trace_dump       (void);
+
+void   xfsettings_trace_write      (void);
+
+void   xfsettings_trace_register   (DBusConnection *connection);
+
+void   xfsettings_trace_unregister (DBusConnection *connection);
+
+gint   xfsettings_trace_print      (const gchar    *bus_name);
+
+#endif /* !__TRACE_H__ */
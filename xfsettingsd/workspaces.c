@@ -31,15 +31,26 @@
 #include <X11/Xlib.h>
 #include <X11/Xatom.h>
 #include <gdk/gdkx.h>
+#ifdef HAVE_XFIXES
+#include <X11/extensions/Xfixes.h>
+#endif
 #endif
 
 #include "debug.h"
 #include "workspaces.h"
+#include "prefetch.h"
+#include "stats.h"
+#include "trace.h"
 
 #define WORKSPACES_CHANNEL    "xfwm4"
 #define WORKSPACE_NAMES_PROP  "/general/workspace_names"
 #define WORKSPACE_COUNT_PROP  "/general/workspace_count"
 
+/* how long to wait for a window manager before setting the names anyway,
+ * and the poll interval in ms when the server has no xfixes */
+#define WAIT_FOR_WM_SECONDS   (5)
+#define WAIT_FOR_WM_INTERVAL  (50)
+
 
 
 static void             xfce_workspaces_helper_finalize     (GObject              *object);
@@ -48,13 +59,20 @@ static GdkFilterReturn  xfce_workspaces_helper_filter_func  (GdkXEvent
                                                              GdkEvent             *event,
                                                              gpointer              user_data);
 static GPtrArray       *xfce_workspaces_helper_get_names    (void);
+static GPtrArray       *xfce_workspaces_helper_names_new    (const GPtrArray      *values);
 static void             xfce_workspaces_helper_set_names    (XfceWorkspacesHelper *helper,
                                                              gboolean              disable_wm_check);
 static void             xfce_workspaces_helper_save_names   (XfceWorkspacesHelper *helper);
+static gsize            xfce_workspaces_helper_names_size   (gpointer              user_data);
 static void             xfce_workspaces_helper_prop_changed (XfconfChannel        *channel,
                                                              const gchar          *property,
                                                              const GValue         *value,
                                                              XfceWorkspacesHelper *helper);
+#if defined (GDK_WINDOWING_X11) && defined (HAVE_XFIXES)
+static GdkFilterReturn  xfce_workspaces_helper_wm_filter    (GdkXEvent            *gdkxevent,
+                                                             GdkEvent             *event,
+                                                             gpointer              user_data);
+#endif
 
 
 
@@ -64,10 +82,26 @@ struct _XfceWorkspacesHelper
 
     XfconfChannel *channel;
 
-    GTimeVal       timestamp;
+    /* last known names in xfconf and on the root window, so we only
+     * write what differs and recognize our own changes coming back */
+    GPtrArray     *xfconf_names;
+    GPtrArray     *x_names;
+    guint          n_workspaces;
+
+    XfsdStats     *stats;
 
 #ifdef GDK_WINDOWING_X11
     guint          wait_for_wm_timeout_id;
+
+    /* WM_Sn selections of all screens, while waiting for the wm */
+    Atom          *wm_atoms;
+    guint          n_wm_atoms;
+    GTimer        *wm_timer;
+
+#ifdef HAVE_XFIXES
+    /* selection owner changes, 0 if not available */
+    gint           xfixes_event_base;
+#endif
 #endif
 };
 
@@ -81,18 +115,6 @@ struct _XfceWorkspacesHelperClass
 #ifdef GDK_WINDOWING_X11
 static Atom atom_net_number_of_desktops = 0;
 static Atom atom_net_desktop_names = 0;
-
-typedef struct
-{
-  XfceWorkspacesHelper *helper;
-
-  Display              *dpy;
-  Atom                 *atoms;
-  guint                 atom_count;
-  guint                 have_wm : 1;
-  guint                 counter;
-}
-WaitForWM;
 #endif
 
 
@@ -120,8 +142,17 @@ xfce_workspaces_helper_init (XfceWorkspacesHelper *helper)
 {
     GdkWindow    *root_window;
     GdkEventMask  events;
+    GPtrArray    *values;
 
     helper->channel = xfconf_channel_get(WORKSPACES_CHANNEL);
+    helper->stats = xfsettings_stats_get ("workspaces");
+
+    /* start with the names as they are now */
+    values = xfsettings_prefetch_get_arrayv (helper->channel, WORKSPACE_NAMES_PROP);
+    helper->xfconf_names = xfce_workspaces_helper_names_new (values);
+    xfconf_array_free (values);
+    helper->x_names = xfce_workspaces_helper_get_names ();
+    xfsettings_stats_watch_bytes (helper->stats, xfce_workspaces_helper_names_size, helper);
 
     /* monitor root window property changes */
     root_window = gdk_get_default_root_window ();
@@ -143,10 +174,30 @@ xfce_workspaces_helper_finalize (GObject *object)
 {
     XfceWorkspacesHelper *helper = XFCE_WORKSPACES_HELPER (object);
 
+#ifdef GDK_WINDOWING_X11
+    if (helper->wait_for_wm_timeout_id != 0)
+        g_source_remove (helper->wait_for_wm_timeout_id);
+
+#ifdef HAVE_XFIXES
+    if (helper->wm_atoms != NULL && helper->xfixes_event_base != 0)
+        gdk_window_remove_filter (NULL, xfce_workspaces_helper_wm_filter, helper);
+#endif
+
+    g_free (helper->wm_atoms);
+    if (helper->wm_timer != NULL)
+        g_timer_destroy (helper->wm_timer);
+#endif
+
     g_signal_handlers_disconnect_by_func(G_OBJECT (helper->channel),
                                          G_CALLBACK (xfce_workspaces_helper_prop_changed),
                                          helper);
 
+    xfsettings_stats_watch_bytes (helper->stats, NULL, NULL);
+
+    g_ptr_array_free (helper->xfconf_names, TRUE);
+    if (helper->x_names != NULL)
+        g_ptr_array_free (helper->x_names, TRUE);
+
     G_OBJECT_CLASS (xfce_workspaces_helper_parent_class)->finalize (object);
 }
 
@@ -160,32 +211,35 @@ xfce_workspaces_helper_filter_func (GdkXEvent  *gdkxevent,
 #ifdef GDK_WINDOWING_X11
     XfceWorkspacesHelper  *helper = XFCE_WORKSPACES_HELPER (user_data);
     XEvent                *xevent = gdkxevent;
-    GTimeVal               timestamp;
+    XfsdStatsMark          mark;
 
     if (xevent->type == PropertyNotify)
     {
+        if (xevent->xproperty.atom == atom_net_number_of_desktops
+            || xevent->xproperty.atom == atom_net_desktop_names)
+            xfsettings_trace (XFSD_TRACE_WORKSPACES_PROPERTY, xevent->xproperty.atom, 0, 0, 0);
+
         if (xevent->xproperty.atom == atom_net_number_of_desktops)
         {
+            xfsettings_stats_begin_event (&mark, G_STRFUNC, xevent->type);
+
             /* new workspace was added or removed */
             xfce_workspaces_helper_set_names (helper, TRUE);
 
             xfsettings_dbg (XFSD_DEBUG_WORKSPACES, "number of desktops changed");
+
+            xfsettings_stats_end (helper->stats, XFSD_STATS_EVENT, &mark);
         }
         else if (xevent->xproperty.atom == atom_net_desktop_names)
         {
-            /* don't respond to our own name changes (1 sec) */
-            g_get_current_time (&timestamp);
-            if (timestamp.tv_sec > helper->timestamp.tv_sec
-                || (timestamp.tv_sec == helper->timestamp.tv_sec
-                    && timestamp.tv_usec > helper->timestamp.tv_usec))
-            {
-                /* someone changed (possibly another application that does
-                 * not update xfconf) the name of a desktop, store the
-                 * new names in xfconf if different*/
-                xfce_workspaces_helper_save_names (helper);
+            xfsettings_stats_begin_event (&mark, G_STRFUNC, xevent->type);
 
-                xfsettings_dbg (XFSD_DEBUG_WORKSPACES, "someone else changed the desktop names");
-            }
+            /* someone (possibly another application that does not
+             * update xfconf, or ourselves) changed the names of the
+             * desktops, store the differences in xfconf */
+            xfce_workspaces_helper_save_names (helper);
+
+            xfsettings_stats_end (helper->stats, XFSD_STATS_EVENT, &mark);
         }
     }
 #endif
@@ -203,7 +257,6 @@ xfce_workspaces_helper_get_names (void)
     gint         i, length, num;
     GPtrArray   *names = NULL;
     gchar       *data = NULL;
-    GValue      *val;
     const gchar *p;
 
     gdk_error_trap_push ();
@@ -222,7 +275,7 @@ xfce_workspaces_helper_get_names (void)
         && data != NULL
         && length > 0)
     {
-        names = g_ptr_array_new ();
+        names = g_ptr_array_new_with_free_func (g_free);
 
         for (i = 0, num = 0; i < length - 1;)
         {
@@ -231,16 +284,13 @@ xfce_workspaces_helper_get_names (void)
             if (!g_utf8_validate (p, -1, NULL))
             {
                 g_warning ("Name of workspace %d is not UTF-8 valid.", num + 1);
-                xfconf_array_free (names);
+                g_ptr_array_free (names, TRUE);
                 g_free (data);
 
                 return NULL;
             }
 
-            val = g_new0 (GValue, 1);
-            g_value_init (val, G_TYPE_STRING);
-            g_value_set_string (val, p);
-            g_ptr_array_add (names, val);
+            g_ptr_array_add (names, g_strdup (p));
 
             i += strlen (p) + 1;
             num++;
@@ -254,6 +304,156 @@ xfce_workspaces_helper_get_names (void)
 
 
 
+static GPtrArray *
+xfce_workspaces_helper_names_new (const GPtrArray *values)
+{
+    GPtrArray   *names;
+    const gchar *name;
+    guint        i;
+
+    names = g_ptr_array_new_with_free_func (g_free);
+
+    if (values != NULL)
+    {
+        for (i = 0; i < values->len; i++)
+        {
+            name = NULL;
+            if (G_VALUE_HOLDS_STRING (g_ptr_array_index (values, i)))
+                name = g_value_get_string (g_ptr_array_index (values, i));
+            g_ptr_array_add (names, g_strdup (name != NULL ? name : ""));
+        }
+    }
+
+    return names;
+}
+
+
+
+static GPtrArray *
+xfce_workspaces_helper_names_copy (const GPtrArray *names,
+                                   guint            n_names)
+{
+    GPtrArray *copy;
+    guint      i;
+
+    copy = g_ptr_array_new_with_free_func (g_free);
+    for (i = 0; i < names->len && i < n_names; i++)
+        g_ptr_array_add (copy, g_strdup (g_ptr_array_index (names, i)));
+
+    return copy;
+}
+
+
+
+static gboolean
+xfce_workspaces_helper_names_equal (const GPtrArray *a,
+                                    const GPtrArray *b)
+{
+    guint i;
+
+    if (a == NULL || b == NULL)
+        return a == b;
+
+    if (a->len != b->len)
+        return FALSE;
+
+    for (i = 0; i < a->len; i++)
+        if (strcmp (g_ptr_array_index (a, i), g_ptr_array_index (b, i)) != 0)
+            return FALSE;
+
+    return TRUE;
+}
+
+
+
+static void
+xfce_workspaces_helper_store_xfconf (XfceWorkspacesHelper *helper,
+                                     GPtrArray            *names)
+{
+    GPtrArray *values;
+    GValue    *val;
+    guint      i;
+
+    /* takes the names */
+    if (xfce_workspaces_helper_names_equal (names, helper->xfconf_names))
+    {
+        g_ptr_array_free (names, TRUE);
+        return;
+    }
+
+    values = g_ptr_array_sized_new (names->len);
+    for (i = 0; i < names->len; i++)
+    {
+        val = g_new0 (GValue, 1);
+        g_value_init (val, G_TYPE_STRING);
+        g_value_set_string (val, g_ptr_array_index (names, i));
+        g_ptr_array_add (values, val);
+    }
+
+    /* update the cache first, so the property-changed of this
+     * change is recognized as our own */
+    g_ptr_array_free (helper->xfconf_names, TRUE);
+    helper->xfconf_names = names;
+
+    if (!xfconf_channel_set_arrayv (helper->channel, WORKSPACE_NAMES_PROP, values))
+         g_critical ("Failed to save xfconf property %s", WORKSPACE_NAMES_PROP);
+
+    xfconf_array_free (values);
+}
+
+
+
+static void
+xfce_workspaces_helper_store_x (XfceWorkspacesHelper *helper,
+                                guint                 n_workspaces)
+{
+    GString     *names_str;
+    GPtrArray   *names;
+    guint        i;
+    const gchar *name;
+
+    names = xfce_workspaces_helper_names_copy (helper->xfconf_names, n_workspaces);
+    if (xfce_workspaces_helper_names_equal (names, helper->x_names))
+    {
+        xfsettings_dbg (XFSD_DEBUG_WORKSPACES, "desktop names already up-to-date");
+        g_ptr_array_free (names, TRUE);
+        return;
+    }
+
+    /* create nul-separated string of names */
+    names_str = g_string_new (NULL);
+
+    for (i = 0; i < names->len; i++)
+    {
+        /* insert the name with nul */
+        name = g_ptr_array_index (names, i);
+        g_string_append_len (names_str, name, strlen (name) + 1);
+    }
+
+    /* the property notify of this change is compared against these */
+    if (helper->x_names != NULL)
+        g_ptr_array_free (helper->x_names, TRUE);
+    helper->x_names = names;
+
+    gdk_error_trap_push();
+
+    gdk_property_change (gdk_get_default_root_window (),
+                         gdk_atom_intern_static_string ("_NET_DESKTOP_NAMES"),
+                         gdk_atom_intern_static_string ("UTF8_STRING"),
+                         8, GDK_PROP_MODE_REPLACE,
+                         (guchar *) names_str->str,
+                         names_str->len + 1);
+
+    if (gdk_error_trap_pop () != 0)
+        g_warning ("Failed to change _NET_DESKTOP_NAMES.");
+
+    xfsettings_dbg (XFSD_DEBUG_WORKSPACES, "%d desktop names set from xfconf", i);
+
+    g_string_free (names_str, TRUE);
+}
+
+
+
 static guint
 xfce_workspaces_helper_get_count (void)
 {
@@ -296,12 +496,9 @@ xfce_workspaces_helper_get_count (void)
 static void
 xfce_workspaces_helper_set_names_real (XfceWorkspacesHelper *helper)
 {
-    GString       *names_str;
     guint          i;
     guint          n_workspaces;
     GPtrArray     *names, *existing_names;
-    GValue        *val;
-    gchar         *new_name;
     const gchar   *name;
 
     g_return_if_fail (XFCE_IS_WORKSPACES_HELPER (helper));
@@ -310,51 +507,18 @@ xfce_workspaces_helper_set_names_real (XfceWorkspacesHelper *helper)
     if (n_workspaces < 1)
         return;
 
-    /* check if there are enough names in xfconf, else we save new
-     * names first and set the names the next time property-changed is
-     * triggered on the channel */
-    names = xfconf_channel_get_arrayv (helper->channel, WORKSPACE_NAMES_PROP);
-    if (names != NULL && names->len >= n_workspaces)
+    if (helper->n_workspaces != n_workspaces)
     {
         /* store this in xfconf (for no really good reason actually) */
         xfconf_channel_set_int (helper->channel, WORKSPACE_COUNT_PROP, n_workspaces);
-
-        /* create nul-separated string of names */
-        names_str = g_string_new (NULL);
-
-        for (i = 0; i < names->len && i < n_workspaces; i++)
-        {
-            val = g_ptr_array_index (names, i);
-            name = g_value_get_string (val);
-
-            /* insert the name with nul */
-            g_string_append_len (names_str, name, strlen (name) + 1);
-        }
-
-        /* update stamp so new names is not handled for the next second */
-        g_get_current_time (&helper->timestamp);
-        g_time_val_add (&helper->timestamp, G_USEC_PER_SEC);
-
-        gdk_error_trap_push();
-
-        gdk_property_change (gdk_get_default_root_window (),
-                             gdk_atom_intern_static_string ("_NET_DESKTOP_NAMES"),
-                             gdk_atom_intern_static_string ("UTF8_STRING"),
-                             8, GDK_PROP_MODE_REPLACE,
-                             (guchar *) names_str->str,
-                             names_str->len + 1);
-
-        if (gdk_error_trap_pop () != 0)
-            g_warning ("Failed to change _NET_DESKTOP_NAMES.");
-
-        xfsettings_dbg (XFSD_DEBUG_WORKSPACES, "%d desktop names set from xfconf", i);
-
-        g_string_free (names_str, TRUE);
+        helper->n_workspaces = n_workspaces;
     }
-    else
+
+    /* check if there are enough names in xfconf, else we add names
+     * for the new workspaces first */
+    if (helper->xfconf_names->len < n_workspaces)
     {
-        if (names == NULL)
-            names = g_ptr_array_sized_new (n_workspaces);
+        names = xfce_workspaces_helper_names_copy (helper->xfconf_names, G_MAXUINT);
 
         /* get current names set in x */
         existing_names = xfce_workspaces_helper_get_names ();
@@ -364,96 +528,166 @@ xfce_workspaces_helper_set_names_real (XfceWorkspacesHelper *helper)
             if (existing_names != NULL
                 && existing_names->len > i)
             {
-                val = g_ptr_array_index (existing_names, i);
-                name = g_value_get_string (val);
-
-                if (name != NULL && *name != '\0')
+                name = g_ptr_array_index (existing_names, i);
+                if (*name != '\0')
                 {
                     /* use the existing name */
-                    val = g_new0 (GValue, 1);
-                    g_value_init (val, G_TYPE_STRING);
-                    new_name = g_strdup (name);
-                    g_value_take_string (val, new_name);
-                    g_ptr_array_add (names, val);
+                    g_ptr_array_add (names, g_strdup (name));
                     continue;
                 }
             }
 
             /* no existing name, create a new name */
-            val = g_new0 (GValue, 1);
-            g_value_init (val, G_TYPE_STRING);
-            new_name = g_strdup_printf (_("Workspace %d"), i + 1);
-            g_value_take_string (val, new_name);
-            g_ptr_array_add (names, val);
+            g_ptr_array_add (names, g_strdup_printf (_("Workspace %d"), i + 1));
         }
 
-        /* store new array in xfconf */
-        if (!xfconf_channel_set_arrayv (helper->channel, WORKSPACE_NAMES_PROP, names))
-             g_critical ("Failed to save xfconf property %s", WORKSPACE_NAMES_PROP);
+        xfsettings_dbg (XFSD_DEBUG_WORKSPACES, "extended names in xfconf from %d to %d",
+                        helper->xfconf_names->len, names->len);
 
-        xfsettings_dbg (XFSD_DEBUG_WORKSPACES, "extended names in xfconf, waiting for property-change");
+        /* store new array in xfconf */
+        xfce_workspaces_helper_store_xfconf (helper, names);
 
-        xfconf_array_free (existing_names);
+        if (existing_names != NULL)
+            g_ptr_array_free (existing_names, TRUE);
     }
 
-    xfconf_array_free (names);
+    xfce_workspaces_helper_store_x (helper, n_workspaces);
 }
 
 
 
 #ifdef GDK_WINDOWING_X11
 static gboolean
-xfce_workspaces_helper_wait_for_window_manager (gpointer data)
+xfce_workspaces_helper_have_wm (XfceWorkspacesHelper *helper)
 {
-  WaitForWM *wfwm = data;
-  guint      i;
-  gboolean   have_wm = TRUE;
+    Display *dpy = GDK_DISPLAY ();
+    guint    i;
 
-  for (i = 0; i < wfwm->atom_count; i++)
+    for (i = 0; i < helper->n_wm_atoms; i++)
     {
-      if (XGetSelectionOwner (wfwm->dpy, wfwm->atoms[i]) == None)
+        if (XGetSelectionOwner (dpy, helper->wm_atoms[i]) == None)
         {
-          DBG ("window manager not ready on screen %d, waiting...", i);
-
-          have_wm = FALSE;
-          break;
+            DBG ("window manager not ready on screen %d, waiting...", i);
+            return FALSE;
         }
     }
 
-  wfwm->have_wm = have_wm;
-
-  /* abort if a window manager is found or 5 seconds expired */
-  return wfwm->counter++ < 20 * 5 && !wfwm->have_wm;
+    return TRUE;
 }
 
 
 
 static void
-xfce_workspaces_helper_wait_for_window_manager_destroyed (gpointer data)
+xfce_workspaces_helper_wm_ready (XfceWorkspacesHelper *helper,
+                                 gboolean              have_wm)
 {
-  WaitForWM            *wfwm = data;
-  XfceWorkspacesHelper *helper = wfwm->helper;
+#ifdef HAVE_XFIXES
+    Display *dpy = GDK_DISPLAY ();
+    guint    i;
 
-  helper->wait_for_wm_timeout_id = 0;
+    if (helper->xfixes_event_base != 0)
+    {
+        /* stop watching the selections */
+        for (i = 0; i < helper->n_wm_atoms; i++)
+            XFixesSelectSelectionInput (dpy, RootWindow (dpy, i), helper->wm_atoms[i], 0);
+        gdk_window_remove_filter (NULL, xfce_workspaces_helper_wm_filter, helper);
+    }
+#endif
 
-  if (!wfwm->have_wm)
+    if (!have_wm)
     {
-      g_printerr (G_LOG_DOMAIN ": No window manager registered on screen 0.\n");
+        g_printerr (G_LOG_DOMAIN ": No window manager registered on screen 0.\n");
     }
-  else
+    else
     {
-      DBG ("found window manager after %d tries", wfwm->counter);
+        xfsettings_dbg (XFSD_DEBUG_WORKSPACES, "found window manager after %.1f ms",
+                        g_timer_elapsed (helper->wm_timer, NULL) * 1000.0);
     }
 
-  g_free (wfwm->atoms);
-  XCloseDisplay (wfwm->dpy);
-  g_slice_free (WaitForWM, wfwm);
+    g_free (helper->wm_atoms);
+    helper->wm_atoms = NULL;
+    helper->n_wm_atoms = 0;
 
-  /* set the names anyway... */
-  GDK_THREADS_ENTER ();
-  xfce_workspaces_helper_set_names_real (helper);
-  GDK_THREADS_LEAVE ();
+    g_timer_destroy (helper->wm_timer);
+    helper->wm_timer = NULL;
+
+    /* set the names anyway... */
+    xfce_workspaces_helper_set_names_real (helper);
 }
+
+
+
+static gboolean
+xfce_workspaces_helper_wait_for_window_manager (gpointer data)
+{
+    XfceWorkspacesHelper *helper = XFCE_WORKSPACES_HELPER (data);
+    gboolean              have_wm;
+    gdouble               elapsed;
+
+    /* without xfixes this polls, otherwise we only get here
+     * when a wm showed up or we give up */
+    have_wm = xfce_workspaces_helper_have_wm (helper);
+    elapsed = g_timer_elapsed (helper->wm_timer, NULL);
+    if (!have_wm && elapsed < WAIT_FOR_WM_SECONDS)
+    {
+#ifdef HAVE_XFIXES
+        if (helper->xfixes_event_base != 0)
+        {
+            /* other screens are not claimed yet, wait for their
+             * notifications during the rest of the time */
+            helper->wait_for_wm_timeout_id =
+                g_timeout_add ((WAIT_FOR_WM_SECONDS - elapsed) * 1000 + 1,
+                               xfce_workspaces_helper_wait_for_window_manager,
+                               helper);
+            return FALSE;
+        }
+#endif
+        return TRUE;
+    }
+
+    helper->wait_for_wm_timeout_id = 0;
+
+    GDK_THREADS_ENTER ();
+    xfce_workspaces_helper_wm_ready (helper, have_wm);
+    GDK_THREADS_LEAVE ();
+
+    return FALSE;
+}
+
+
+
+#ifdef HAVE_XFIXES
+static GdkFilterReturn
+xfce_workspaces_helper_wm_filter (GdkXEvent *gdkxevent,
+                                  GdkEvent  *event,
+                                  gpointer   user_data)
+{
+    XfceWorkspacesHelper       *helper = XFCE_WORKSPACES_HELPER (user_data);
+    XEvent                     *xevent = gdkxevent;
+    XFixesSelectionNotifyEvent *sn_event = gdkxevent;
+    guint                       i;
+
+    if (xevent->type != helper->xfixes_event_base + XFixesSelectionNotify
+        || sn_event->subtype != XFixesSetSelectionOwnerNotify
+        || sn_event->owner == None)
+        return GDK_FILTER_CONTINUE;
+
+    for (i = 0; i < helper->n_wm_atoms; i++)
+    {
+        if (sn_event->selection == helper->wm_atoms[i])
+        {
+            /* finish outside the filter, which removes itself */
+            if (helper->wait_for_wm_timeout_id != 0)
+                g_source_remove (helper->wait_for_wm_timeout_id);
+            helper->wait_for_wm_timeout_id =
+                g_idle_add (xfce_workspaces_helper_wait_for_window_manager, helper);
+            break;
+        }
+    }
+
+    return GDK_FILTER_CONTINUE;
+}
+#endif
 #endif
 
 
@@ -463,36 +697,74 @@ xfce_workspaces_helper_set_names (XfceWorkspacesHelper *helper,
                                   gboolean              disable_wm_check)
 {
 #ifdef GDK_WINDOWING_X11
-    WaitForWM  *wfwm;
-    guint       i;
-    gchar     **atom_names;
+    Display  *dpy;
+    guint     i;
+    gchar   **atom_names;
+#ifdef HAVE_XFIXES
+    gint      error_base;
+#endif
 
-    if (!disable_wm_check)
+    if (!disable_wm_check && helper->wait_for_wm_timeout_id == 0)
     {
-        /* setup data for wm checking */
-        wfwm = g_slice_new0 (WaitForWM);
-        wfwm->helper = helper;
-        wfwm->dpy = XOpenDisplay (NULL);
-        wfwm->have_wm = FALSE;
-        wfwm->counter = 0;
+        dpy = GDK_DISPLAY ();
+        helper->wm_timer = g_timer_new ();
 
         /* preload wm atoms for all screens */
-        wfwm->atom_count = XScreenCount (wfwm->dpy);
-        wfwm->atoms = g_new (Atom, wfwm->atom_count);
-        atom_names = g_new0 (gchar *, wfwm->atom_count + 1);
+        helper->n_wm_atoms = XScreenCount (dpy);
+        helper->wm_atoms = g_new (Atom, helper->n_wm_atoms);
+        atom_names = g_new0 (gchar *, helper->n_wm_atoms + 1);
 
-        for (i = 0; i < wfwm->atom_count; i++)
+        for (i = 0; i < helper->n_wm_atoms; i++)
             atom_names[i] = g_strdup_printf ("WM_S%d", i);
 
-        if (!XInternAtoms (wfwm->dpy, atom_names, wfwm->atom_count, False, wfwm->atoms))
-            wfwm->atom_count = 0;
+        if (!XInternAtoms (dpy, atom_names, helper->n_wm_atoms, False, helper->wm_atoms))
+            helper->n_wm_atoms = 0;
 
         g_strfreev (atom_names);
 
-        /* setup timeout to check for a window manager */
-        helper->wait_for_wm_timeout_id =
-          g_timeout_add_full (G_PRIORITY_DEFAULT_IDLE, 50, xfce_workspaces_helper_wait_for_window_manager,
-                              wfwm, xfce_workspaces_helper_wait_for_window_manager_destroyed);
+#ifdef HAVE_XFIXES
+        /* get notified when the wm claims its selection */
+        if (XFixesQueryExtension (dpy, &helper->xfixes_event_base, &error_base))
+        {
+            gdk_window_add_filter (NULL, xfce_workspaces_helper_wm_filter, helper);
+            for (i = 0; i < helper->n_wm_atoms; i++)
+            {
+                XFixesSelectSelectionInput (dpy, RootWindow (dpy, i), helper->wm_atoms[i],
+                                            XFixesSetSelectionOwnerNotifyMask);
+            }
+        }
+        else
+        {
+            helper->xfixes_event_base = 0;
+        }
+#endif
+
+        /* the wm may already be running */
+        if (xfce_workspaces_helper_have_wm (helper))
+        {
+            xfce_workspaces_helper_wm_ready (helper, TRUE);
+            return;
+        }
+
+#ifdef HAVE_XFIXES
+        if (helper->xfixes_event_base != 0)
+        {
+            /* give up after a while, not with g_timeout_add_seconds(),
+             * which can fire early and then waits another period */
+            helper->wait_for_wm_timeout_id =
+                g_timeout_add (WAIT_FOR_WM_SECONDS * 1000,
+                               xfce_workspaces_helper_wait_for_window_manager,
+                               helper);
+        }
+        else
+#endif
+        {
+            /* poll for a window manager */
+            helper->wait_for_wm_timeout_id =
+                g_timeout_add_full (G_PRIORITY_DEFAULT_IDLE, WAIT_FOR_WM_INTERVAL,
+                                    xfce_workspaces_helper_wait_for_window_manager,
+                                    helper, NULL);
+        }
     }
     else
 #endif
@@ -507,11 +779,9 @@ xfce_workspaces_helper_set_names (XfceWorkspacesHelper *helper,
 static void
 xfce_workspaces_helper_save_names (XfceWorkspacesHelper *helper)
 {
-    GPtrArray   *xfconf_names, *new_names;
-    GValue      *val_b;
-    const gchar *name_a, *name_b;
-    gboolean     save_array = FALSE;
-    guint        i;
+    GPtrArray   *new_names, *names;
+    const gchar *name;
+    guint        i, n_changed = 0;
 
     g_return_if_fail (XFCE_IS_WORKSPACES_HELPER (helper));
 
@@ -519,51 +789,70 @@ xfce_workspaces_helper_save_names (XfceWorkspacesHelper *helper)
     if (new_names == NULL)
         return;
 
-    xfconf_names = xfconf_channel_get_arrayv (helper->channel, WORKSPACE_NAMES_PROP);
-
-    if (xfconf_names == NULL
-       || xfconf_names->len < new_names->len)
+    /* don't respond to our own name changes */
+    if (xfce_workspaces_helper_names_equal (new_names, helper->x_names))
     {
-        /* store the new names in xfconf, should not append often because
-         * we probably saved (and set) a name when the workspace count
-         * was changed */
-        xfconf_channel_set_arrayv (helper->channel, WORKSPACE_NAMES_PROP, new_names);
-
-        xfsettings_dbg (XFSD_DEBUG_WORKSPACES, "storing %d names in xfconf", new_names->len);
+        g_ptr_array_free (new_names, TRUE);
+        return;
     }
-    else if (xfconf_names != NULL
-             && xfconf_names->len >= new_names->len)
+
+    if (helper->x_names != NULL)
+        g_ptr_array_free (helper->x_names, TRUE);
+    helper->x_names = new_names;
+
+    /* update the changed names in the xfconf array, names of
+     * workspaces beyond the current count are preserved */
+    names = xfce_workspaces_helper_names_copy (helper->xfconf_names, G_MAXUINT);
+    for (i = 0; i < new_names->len; i++)
     {
-        /* update the new names in the xfconf array */
-        for (i = 0; i < new_names->len; i++)
+        name = g_ptr_array_index (new_names, i);
+
+        if (i >= names->len)
+        {
+            g_ptr_array_add (names, g_strdup (name));
+        }
+        else if (strcmp (name, g_ptr_array_index (names, i)) != 0)
         {
-             name_a = g_value_get_string (g_ptr_array_index (new_names, i));
+            g_free (g_ptr_array_index (names, i));
+            g_ptr_array_index (names, i) = g_strdup (name);
+        }
+        else
+        {
+            continue;
+        }
 
-             val_b = g_ptr_array_index (xfconf_names, i);
-             name_b = g_value_get_string (val_b);
+        n_changed++;
+    }
 
-             if (g_strcmp0 (name_a, name_b) != 0)
-             {
-                 /* set the old xfconf name to the new name */
-                 g_value_unset (val_b);
-                 g_value_set_string (val_b, name_a);
+    xfsettings_dbg (XFSD_DEBUG_WORKSPACES, "someone else changed %d desktop names", n_changed);
 
-                 save_array = TRUE;
-             }
-        }
+    xfce_workspaces_helper_store_xfconf (helper, names);
+}
 
-        if (save_array)
-        {
-            xfconf_channel_set_arrayv (helper->channel, WORKSPACE_NAMES_PROP, xfconf_names);
 
-            xfsettings_dbg (XFSD_DEBUG_WORKSPACES, "merged %d xfconf and %d desktop names",
-                            xfconf_names->len, new_names->len);
+
+static gsize
+xfce_workspaces_helper_names_size (gpointer user_data)
+{
+    XfceWorkspacesHelper *helper = XFCE_WORKSPACES_HELPER (user_data);
+    GPtrArray            *names[2] = { helper->xfconf_names, helper->x_names };
+    const gchar          *name;
+    gsize                 size = 0;
+    guint                 i, n;
+
+    for (i = 0; i < G_N_ELEMENTS (names); i++)
+    {
+        if (names[i] == NULL)
+            continue;
+
+        for (n = 0; n < names[i]->len; n++)
+        {
+            name = g_ptr_array_index (names[i], n);
+            size += sizeof (gchar *) + (name != NULL ? strlen (name) + 1 : 0);
         }
     }
 
-    if (xfconf_names != NULL)
-        xfconf_array_free (xfconf_names);
-    xfconf_array_free (new_names);
+    return size;
 }
 
 
@@ -574,11 +863,34 @@ xfce_workspaces_helper_prop_changed (XfconfChannel        *channel,
                                      const GValue         *value,
                                      XfceWorkspacesHelper *helper)
 {
+    GPtrArray     *names;
+    XfsdStatsMark  mark;
+
     g_return_if_fail (XFCE_IS_WORKSPACES_HELPER (helper));
 
-    if (helper->wait_for_wm_timeout_id == 0)
+    xfsettings_stats_begin_xfconf (&mark, G_STRFUNC, property);
+
+    if (G_VALUE_HOLDS (value, XFCONF_TYPE_G_VALUE_ARRAY))
+        names = xfce_workspaces_helper_names_new (g_value_get_boxed (value));
+    else
+        names = xfce_workspaces_helper_names_new (NULL);
+
+    /* ignore the echo of our own changes */
+    if (xfce_workspaces_helper_names_equal (names, helper->xfconf_names))
+    {
+        g_ptr_array_free (names, TRUE);
+    }
+    else
     {
-        /* only set the names if the initial start is not running anymore */
-        xfce_workspaces_helper_set_names (helper, TRUE);
+        g_ptr_array_free (helper->xfconf_names, TRUE);
+        helper->xfconf_names = names;
+
+        if (helper->wait_for_wm_timeout_id == 0)
+        {
+            /* only set the names if the initial start is not running anymore */
+            xfce_workspaces_helper_set_names (helper, TRUE);
+        }
     }
+
+    xfsettings_stats_end (helper->stats, XFSD_STATS_XFCONF, &mark);
 }
@@ -51,6 +51,9 @@
 
 #include "xsettings.h"
 #include "debug.h"
+#include "prefetch.h"
+#include "stats.h"
+#include "trace.h"
 
 #define XSettingsTypeInteger 0
 #define XSettingsTypeString  1
@@ -78,6 +81,7 @@ static void     xfce_xsettings_helper_fc_free      (XfceXSettingsHelper *helper)
 static gboolean xfce_xsettings_helper_fc_init      (gpointer             data);
 static gboolean xfce_xsettings_helper_notify_idle  (gpointer             data);
 static void     xfce_xsettings_helper_setting_free (gpointer             data);
+static gsize    xfce_xsettings_helper_mem_size     (gpointer             data);
 static void     xfce_xsettings_helper_prop_changed (XfconfChannel       *channel,
                                                     const gchar         *prop_name,
                                                     const GValue        *value,
@@ -120,6 +124,8 @@ struct _XfceXSettingsHelper
     GPtrArray     *fc_monitors;
     guint          fc_notify_timeout_id;
     guint          fc_init_id;
+
+    XfsdStats     *stats;
 };
 
 struct _XfceXSetting
@@ -165,9 +171,11 @@ static void
 xfce_xsettings_helper_init (XfceXSettingsHelper *helper)
 {
     helper->channel = xfconf_channel_new ("xsettings");
+    helper->stats = xfsettings_stats_get ("xsettings");
 
     helper->settings = g_hash_table_new_full (g_str_hash, g_str_equal,
         g_free, xfce_xsettings_helper_setting_free);
+    xfsettings_stats_watch_bytes (helper->stats, xfce_xsettings_helper_mem_size, helper);
 
     xfce_xsettings_helper_load (helper);
 
@@ -200,6 +208,7 @@ xfce_xsettings_helper_finalize (GObject *object)
         xfce_xsettings_helper_screen_free (li->data);
     g_slist_free (helper->screens);
 
+    xfsettings_stats_watch_bytes (helper->stats, NULL, NULL);
     g_hash_table_destroy (helper->settings);
 
     (*G_OBJECT_CLASS (xfce_xsettings_helper_parent_class)->finalize) (object);
@@ -212,6 +221,9 @@ xfce_xsettings_helper_fc_notify (gpointer data)
 {
     XfceXSettingsHelper *helper = XFCE_XSETTINGS_HELPER (data);
     XfceXSetting        *setting;
+    XfsdStatsMark        mark;
+
+    xfsettings_stats_begin (&mark, G_STRFUNC);
 
     helper->fc_notify_timeout_id = 0;
 
@@ -246,6 +258,8 @@ xfce_xsettings_helper_fc_notify (gpointer data)
         helper->fc_init_id = g_idle_add (xfce_xsettings_helper_fc_init, helper);
     }
 
+    xfsettings_stats_end (helper->stats, XFSD_STATS_EVENT, &mark);
+
     return FALSE;
 }
 
@@ -333,11 +347,14 @@ static gboolean
 xfce_xsettings_helper_fc_init (gpointer data)
 {
     XfceXSettingsHelper *helper = XFCE_XSETTINGS_HELPER (data);
+    XfsdStatsMark        mark;
 
     g_return_val_if_fail (helper->fc_monitors == NULL, FALSE);
 
     helper->fc_init_id = 0;
 
+    xfsettings_stats_begin (&mark, G_STRFUNC);
+
     if (FcInit ())
     {
         helper->fc_monitors = g_ptr_array_new ();
@@ -350,6 +367,8 @@ xfce_xsettings_helper_fc_init (gpointer data)
                         helper->fc_monitors->len);
     }
 
+    xfsettings_stats_end (helper->stats, XFSD_STATS_EVENT, &mark);
+
     return FALSE;
 }
 
@@ -359,10 +378,15 @@ static gboolean
 xfce_xsettings_helper_notify_idle (gpointer data)
 {
     XfceXSettingsHelper *helper = XFCE_XSETTINGS_HELPER (data);
+    XfsdStatsMark        mark;
 
     /* only update if there are screen registered */
     if (helper->screens != NULL)
+    {
+        xfsettings_stats_begin (&mark, G_STRFUNC);
         xfce_xsettings_helper_notify (helper);
+        xfsettings_stats_end (helper->stats, XFSD_STATS_EVENT, &mark);
+    }
 
     helper->notify_idle_id = 0;
 
@@ -375,10 +399,15 @@ static gboolean
 xfce_xsettings_helper_notify_xft_idle (gpointer data)
 {
     XfceXSettingsHelper *helper = XFCE_XSETTINGS_HELPER (data);
+    XfsdStatsMark        mark;
 
     /* only update if there are screen registered */
     if (helper->screens != NULL)
+    {
+        xfsettings_stats_begin (&mark, G_STRFUNC);
         xfce_xsettings_helper_notify_xft (helper);
+        xfsettings_stats_end (helper->stats, XFSD_STATS_EVENT, &mark);
+    }
 
     helper->notify_xft_idle_id = 0;
 
@@ -445,12 +474,15 @@ xfce_xsettings_helper_prop_changed (XfconfChannel       *channel,
                                     const GValue        *value,
                                     XfceXSettingsHelper *helper)
 {
-    XfceXSetting *setting;
+    XfceXSetting  *setting;
+    XfsdStatsMark  mark;
 
     g_return_if_fail (helper->channel == channel);
 
-    xfsettings_dbg_filtered (XFSD_DEBUG_XSETTINGS, "prop \"%s\" changed (type=%s)",
-                             prop_name, G_VALUE_TYPE_NAME (value));
+    xfsettings_stats_begin_xfconf (&mark, G_STRFUNC, prop_name);
+
+    xfsettings_trace (XFSD_TRACE_XSETTINGS_CHANGED, g_quark_from_string (prop_name),
+                      value != NULL ? G_VALUE_TYPE (value) : G_TYPE_INVALID, 0, 0);
 
     if (G_LIKELY (value != NULL))
     {
@@ -481,6 +513,7 @@ xfce_xsettings_helper_prop_changed (XfconfChannel       *channel,
         else
         {
            /* leave, so not notification is scheduled */
+           xfsettings_stats_end (helper->stats, XFSD_STATS_XFCONF, &mark);
            return;
         }
     }
@@ -504,6 +537,8 @@ xfce_xsettings_helper_prop_changed (XfconfChannel       *channel,
     {
         helper->notify_xft_idle_id = g_idle_add (xfce_xsettings_helper_notify_xft_idle, helper);
     }
+
+    xfsettings_stats_end (helper->stats, XFSD_STATS_XFCONF, &mark);
 }
 
 
@@ -513,7 +548,7 @@ xfce_xsettings_helper_load (XfceXSettingsHelper *helper)
 {
     GHashTable *props;
 
-    props = xfconf_channel_get_properties (helper->channel, NULL);
+    props = xfsettings_prefetch_get_properties (helper->channel, NULL);
     if (G_LIKELY (props != NULL))
       {
         /* steal properties and put them in the settings table */
@@ -539,6 +574,35 @@ xfce_xsettings_helper_setting_free (gpointer data)
 
 
 
+static gsize
+xfce_xsettings_helper_mem_size (gpointer data)
+{
+    XfceXSettingsHelper *helper = XFCE_XSETTINGS_HELPER (data);
+    GHashTableIter       iter;
+    gpointer             prop_name, value;
+    XfceXSetting        *setting;
+    const gchar         *str;
+    gsize                size = 0;
+
+    g_hash_table_iter_init (&iter, helper->settings);
+    while (g_hash_table_iter_next (&iter, &prop_name, &value))
+    {
+        setting = value;
+        size += strlen (prop_name) + 1 + sizeof (XfceXSetting) + sizeof (GValue);
+
+        if (G_VALUE_HOLDS_STRING (setting->value))
+        {
+            str = g_value_get_string (setting->value);
+            if (str != NULL)
+                size += strlen (str) + 1;
+        }
+    }
+
+    return size;
+}
+
+
+
 static gint
 xfce_xsettings_helper_screen_dpi (XfceXSettingsScreen *screen)
 {
@@ -994,6 +1058,7 @@ xfce_xsettings_helper_event_filter (GdkXEvent *gdkxevent,
     GSList              *li;
     XfceXSettingsScreen *screen;
     XEvent              *xevent = gdkxevent;
+    XfsdStatsMark        mark;
 
     /* check if another settings manager took over the selection
      * of one of the windows */
@@ -1006,6 +1071,8 @@ xfce_xsettings_helper_event_filter (GdkXEvent *gdkxevent,
             if (xevent->xany.window == screen->window
                 && xevent->xselectionclear.selection == screen->selection_atom)
             {
+                xfsettings_stats_begin_event (&mark, G_STRFUNC, xevent->xany.type);
+
                 /* remove the screen */
                 helper->screens = g_slist_delete_link (helper->screens, li);
                 xfce_xsettings_helper_screen_free (screen);
@@ -1017,6 +1084,8 @@ xfce_xsettings_helper_event_filter (GdkXEvent *gdkxevent,
                 if (helper->screens == NULL)
                     gdk_window_remove_filter (NULL, xfce_xsettings_helper_event_filter, data);
 
+                xfsettings_stats_end (helper->stats, XFSD_STATS_EVENT, &mark);
+
                 return GDK_FILTER_REMOVE;
             }
         }